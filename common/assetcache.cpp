@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "texture.hpp"
+#include "assetloader.hpp"
+#include "assetcache.hpp"
+
+// The kind of loader is part of the key : the same file read two different ways is two assets
+static std::string assetKey(const char * loader, const char * path){
+	return std::string(loader) + "|" + path;
+}
+
+static bool hasExtension(const char * path, const char * extension){
+	size_t length = strlen(path), extensionLength = strlen(extension);
+	if (length < extensionLength)
+		return false;
+	const char * end = path + length - extensionLength;
+	for (size_t i = 0; i < extensionLength; i++)
+		if (tolower((unsigned char)end[i]) != tolower((unsigned char)extension[i]))
+			return false;
+	return true;
+}
+
+AssetCache::AssetCache(size_t videoMemoryBudget, size_t systemMemoryBudget)
+	: videoBudget(videoMemoryBudget), systemBudget(systemMemoryBudget){
+	memset(&stats, 0, sizeof(stats));
+}
+
+AssetCache::Entry * AssetCache::find(const std::string & key){
+	std::map<std::string, Entry *>::iterator it = entries.find(key);
+	if (it == entries.end())
+		return NULL;
+	stats.hits++;
+	acquire(it->second);
+	return it->second;
+}
+
+AssetCache::Entry * AssetCache::insert(const std::string & key){
+	Entry * entry = new Entry();
+	entry->key = key;
+	entry->references = 1;
+	entry->textureID = 0;
+	entry->texture = NULL;
+	entry->mesh = NULL;
+	entry->videoBytes = 0;
+	entry->systemBytes = 0;
+	entry->unused = false;
+	entries[key] = entry;
+	stats.misses++;
+	return entry;
+}
+
+void AssetCache::acquire(Entry * entry){
+	if (entry->unused) {
+		unusedEntries.erase(entry->lruPosition);
+		entry->unused = false;
+	}
+	entry->references++;
+}
+
+void AssetCache::release(Entry * entry){
+	if (entry->references <= 0) {
+		printf("%s was released more times than it was acquired\n", entry->key.c_str());
+		return;
+	}
+	if (--entry->references > 0)
+		return;
+	entry->lruPosition = unusedEntries.insert(unusedEntries.end(), entry);
+	entry->unused = true;
+}
+
+GLuint AssetCache::acquireTexture(const char * path){
+
+	bool streamed = !hasExtension(path, ".bmp");
+	std::string key = assetKey(streamed ? "dds" : "bmp", path);
+	Entry * entry = find(key);
+	if (entry)
+		return entry->textureID;
+
+	entry = insert(key);
+	if (streamed) {
+		entry->texture = requestTextureAsset(path);
+		entry->textureID = entry->texture->textureID;
+	} else {
+		entry->textureID = loadBMP_custom(path);
+	}
+	texturesByID[entry->textureID] = entry;
+	refreshSize(entry);
+	return entry->textureID;
+}
+
+MeshAsset * AssetCache::acquireMesh(const char * path){
+
+	std::string key = assetKey("obj", path);
+	Entry * entry = find(key);
+	if (entry)
+		return entry->mesh;
+
+	entry = insert(key);
+	entry->mesh = requestMesh(path);
+	meshes[entry->mesh] = entry;
+	return entry->mesh;
+}
+
+void AssetCache::releaseTexture(GLuint textureID){
+	std::map<GLuint, Entry *>::iterator it = texturesByID.find(textureID);
+	if (it != texturesByID.end())
+		release(it->second);
+}
+
+void AssetCache::releaseMesh(MeshAsset * mesh){
+	std::map<MeshAsset *, Entry *>::iterator it = meshes.find(mesh);
+	if (it != meshes.end())
+		release(it->second);
+}
+
+bool AssetCache::loaded(const Entry * entry) const {
+	if (entry->texture)
+		return entry->texture->ready || entry->texture->failed;
+	if (entry->mesh)
+		return entry->mesh->ready || entry->mesh->failed;
+	return true;
+}
+
+void AssetCache::refreshSize(Entry * entry){
+
+	size_t videoBytes = 0, systemBytes = 0;
+	if (entry->texture) {
+		videoBytes = entry->texture->bytes;
+	} else if (entry->mesh) {
+		// Half of it is the CPU copy
+		videoBytes = entry->mesh->bytes / 2;
+		systemBytes = entry->mesh->bytes - videoBytes;
+	} else if (entry->textureID != 0) {
+		// loadBMP_custom builds the whole mipmap chain, a third more than the image itself.
+		// 4 bytes per texel : RGBA8 with alpha, and drivers pad RGB8 to 4 bytes as well.
+		GLint width = 0, height = 0;
+		glBindTexture(GL_TEXTURE_2D, entry->textureID);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		videoBytes = (size_t)width * height * 4 * 4 / 3;
+	}
+
+	stats.videoBytesResident += videoBytes - entry->videoBytes;
+	stats.systemBytesResident += systemBytes - entry->systemBytes;
+	entry->videoBytes = videoBytes;
+	entry->systemBytes = systemBytes;
+}
+
+void AssetCache::evict(Entry * entry){
+
+	stats.videoBytesResident -= entry->videoBytes;
+	stats.systemBytesResident -= entry->systemBytes;
+	if (entry->unused)
+		unusedEntries.erase(entry->lruPosition);
+
+	if (entry->texture) {
+		releaseTextureAsset(entry->texture);
+		texturesByID.erase(entry->textureID);
+	} else if (entry->mesh) {
+		meshes.erase(entry->mesh);
+		releaseMeshAsset(entry->mesh);
+	} else {
+		glDeleteTextures(1, &entry->textureID);
+		texturesByID.erase(entry->textureID);
+	}
+
+	entries.erase(entry->key);
+	delete entry;
+}
+
+bool AssetCache::overBudget() const {
+	return stats.videoBytesResident > videoBudget || stats.systemBytesResident > systemBudget;
+}
+
+void AssetCache::setBudget(size_t videoMemoryBudget, size_t systemMemoryBudget){
+	videoBudget = videoMemoryBudget;
+	systemBudget = systemMemoryBudget;
+}
+
+void AssetCache::update(){
+
+	for (std::map<std::string, Entry *>::iterator it = entries.begin(); it != entries.end(); ++it)
+		if (it->second->texture || it->second->mesh)
+			refreshSize(it->second);
+
+	// Assets still loading can't be deleted : skip them, they will be evicted on a later frame
+	std::list<Entry *>::iterator it = unusedEntries.begin();
+	while (overBudget() && it != unusedEntries.end()) {
+		Entry * entry = *it++;
+		if (!loaded(entry))
+			continue;
+		evict(entry);
+		stats.evictions++;
+	}
+}
+
+void AssetCache::clear(){
+
+	std::vector<Entry *> all;
+	for (std::map<std::string, Entry *>::iterator it = entries.begin(); it != entries.end(); ++it)
+		all.push_back(it->second);
+
+	// Loads still in flight are deleted by cleanupAssetLoader()
+	for (size_t i = 0; i < all.size(); i++) {
+		if (loaded(all[i])) {
+			evict(all[i]);
+		} else {
+			entries.erase(all[i]->key);
+			delete all[i];
+		}
+	}
+	texturesByID.clear();
+	meshes.clear();
+	unusedEntries.clear();
+	memset(&stats, 0, sizeof(stats));
+}
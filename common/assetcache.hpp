@@ -0,0 +1,74 @@
+#ifndef ASSETCACHE_HPP
+#define ASSETCACHE_HPP
+
+#include <string>
+#include <list>
+#include <map>
+
+struct TextureAsset;
+struct MeshAsset;
+
+struct AssetCacheStats {
+	unsigned int hits;      // Acquired while already resident
+	unsigned int misses;    // Acquired and loaded
+	unsigned int evictions; // Deleted to get back under the budget
+	size_t videoBytesResident;
+	size_t systemBytesResident;
+};
+
+// Shares textures and meshes between everything that uses them.
+// An asset is loaded by the first acquire of its path and parameters, and stays resident
+// after its last release until the budget needs the room : the least recently released goes first.
+// Everything here must be called on the GL thread.
+class AssetCache {
+public:
+	AssetCache(size_t videoMemoryBudget, size_t systemMemoryBudget);
+
+	// .DDS files are loaded by the asset loader threads, .bmp files right away.
+	// Each acquire must be matched by a release.
+	GLuint acquireTexture(const char * path);
+	MeshAsset * acquireMesh(const char * path);
+	void releaseTexture(GLuint textureID);
+	void releaseMesh(MeshAsset * mesh);
+
+	void setBudget(size_t videoMemoryBudget, size_t systemMemoryBudget);
+	// Call once per frame, after updateAssetLoader() : picks up the size of the
+	// assets that finished loading and evicts unused ones while over budget.
+	void update();
+	const AssetCacheStats & getStats() const { return stats; }
+
+	// Deletes every asset, used or not. Call it before the GL context goes away.
+	void clear();
+
+private:
+	struct Entry {
+		std::string key;
+		int references;
+		GLuint textureID;
+		TextureAsset * texture;  // Streamed textures
+		MeshAsset * mesh;
+		size_t videoBytes;
+		size_t systemBytes;
+		bool unused;             // In the LRU list
+		std::list<Entry *>::iterator lruPosition;
+	};
+
+	Entry * find(const std::string & key);
+	Entry * insert(const std::string & key);
+	void acquire(Entry * entry);
+	void release(Entry * entry);
+	bool loaded(const Entry * entry) const;
+	void refreshSize(Entry * entry);
+	void evict(Entry * entry);
+	bool overBudget() const;
+
+	std::map<std::string, Entry *> entries;
+	std::map<GLuint, Entry *> texturesByID;
+	std::map<MeshAsset *, Entry *> meshes;
+	std::list<Entry *> unusedEntries;        // Least recently released first
+	size_t videoBudget;
+	size_t systemBudget;
+	AssetCacheStats stats;
+};
+
+#endif
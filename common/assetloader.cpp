@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "texture.hpp"
+#include "objloader.hpp"
+#include "threadpool.hpp"
+#include "profiler.hpp"
+#include "assetloader.hpp"
+
+// One request, filled by a worker then finished on the GL thread
+struct AssetJob {
+	enum { TEXTURE, MESH } type;
+	std::string path;
+	bool succeeded;
+
+	// Texture : the file stays mapped while its mipmaps stream in
+	TextureAsset * texture;
+	DDSStream stream;
+
+	// Mesh : loaded into a staging copy, moved into the MeshAsset on the GL thread
+	MeshAsset * mesh;
+	MeshAsset staging;
+};
+
+static std::deque< std::shared_ptr<AssetJob> > CompletedJobs; // Guarded by AssetLoaderMutex
+static std::mutex AssetLoaderMutex;
+static std::vector< std::shared_ptr<AssetJob> > UploadingJobs;    // GL thread only
+static std::vector<TextureAsset *> LoadedTextures;                // GL thread only
+static std::vector<MeshAsset *> LoadedMeshes;                     // GL thread only
+static int PendingAssets = 0;                                     // GL thread only
+
+static void completeJob(const std::shared_ptr<AssetJob> & job){
+	std::lock_guard<std::mutex> lock(AssetLoaderMutex);
+	CompletedJobs.push_back(job);
+}
+
+// Make sure the GL thread never waits on the disk when it reads the mapping
+static void prefetch(const MappedFile & file){
+	volatile unsigned char sink = 0;
+	for (size_t offset = 0; offset < file.size; offset += 4096)
+		sink ^= file.data[offset];
+	(void)sink;
+}
+
+void initAssetLoader(){
+	startThreadPool();
+}
+
+// Video memory taken by the levels uploaded so far
+static size_t streamedBytes(const DDSStream & stream){
+	size_t bytes = 0;
+	for (int level = stream.nextLevel + 1; level < (int)stream.descriptor.levels.size(); level++)
+		bytes += stream.descriptor.levels[level].size;
+	return bytes;
+}
+
+GLuint requestTexture(const char * imagepath){
+	return requestTextureAsset(imagepath)->textureID;
+}
+
+TextureAsset * requestTextureAsset(const char * imagepath){
+
+	// The placeholder : one white texel, so the first frames draw with the material color only
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	const unsigned char white[4] = { 255, 255, 255, 255 };
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0); // Complete without mipmaps until the real ones arrive
+
+	TextureAsset * texture = new TextureAsset();
+	texture->textureID = textureID;
+	texture->ready = false;
+	texture->failed = false;
+	texture->bytes = 4;
+	LoadedTextures.push_back(texture);
+
+	std::shared_ptr<AssetJob> job(new AssetJob());
+	job->type = AssetJob::TEXTURE;
+	job->path = imagepath;
+	job->texture = texture;
+	job->mesh = NULL;
+	PendingAssets++;
+
+	submitTask([job](){
+		ProfileScope scope("Read texture");
+		job->succeeded = mapFile(job->path.c_str(), job->stream.file);
+		if (!job->succeeded) {
+			printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", job->path.c_str());
+		} else if (!parseDDS(job->stream.file.data, job->stream.file.size, job->stream.descriptor)
+			|| !isDDSFormatSupported(job->stream.descriptor.format)) {
+			printf("%s can't be loaded\n", job->path.c_str());
+			unmapFile(job->stream.file);
+			job->succeeded = false;
+		} else {
+			prefetch(job->stream.file);
+		}
+		completeJob(job);
+	});
+
+	return texture;
+}
+
+MeshAsset * requestMesh(const char * path){
+
+	MeshAsset * mesh = new MeshAsset();
+	mesh->ready = false;
+	mesh->failed = false;
+	mesh->vertexbuffer = mesh->uvbuffer = mesh->normalbuffer = mesh->elementbuffer = 0;
+	mesh->indexCount = 0;
+	mesh->bytes = 0;
+	LoadedMeshes.push_back(mesh);
+
+	std::shared_ptr<AssetJob> job(new AssetJob());
+	job->type = AssetJob::MESH;
+	job->path = path;
+	job->texture = NULL;
+	job->mesh = mesh;
+	PendingAssets++;
+
+	submitTask([job](){
+		ProfileScope scope("Read mesh");
+		MeshAsset & staging = job->staging;
+		job->succeeded = loadAssImp(job->path.c_str(), staging.indices, staging.indexed_vertices, staging.indexed_uvs, staging.indexed_normals)
+			&& !staging.indices.empty();
+		completeJob(job);
+	});
+
+	return mesh;
+}
+
+static size_t uploadMesh(MeshAsset & mesh, MeshAsset & staging){
+
+	mesh.indices.swap(staging.indices);
+	mesh.indexed_vertices.swap(staging.indexed_vertices);
+	mesh.indexed_uvs.swap(staging.indexed_uvs);
+	mesh.indexed_normals.swap(staging.indexed_normals);
+
+	// Load it into a VBO
+
+	glGenBuffers(1, &mesh.vertexbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexbuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.indexed_vertices.size() * sizeof(glm::vec3), &mesh.indexed_vertices[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mesh.uvbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.uvbuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.indexed_uvs.size() * sizeof(glm::vec2), &mesh.indexed_uvs[0], GL_STATIC_DRAW);
+
+	glGenBuffers(1, &mesh.normalbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.normalbuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.indexed_normals.size() * sizeof(glm::vec3), &mesh.indexed_normals[0], GL_STATIC_DRAW);
+
+	// Generate a buffer for the indices as well
+	glGenBuffers(1, &mesh.elementbuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.elementbuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned short), &mesh.indices[0], GL_STATIC_DRAW);
+
+	mesh.indexCount = (GLsizei)mesh.indices.size();
+	mesh.ready = true;
+
+	// Once in the buffers, once in the CPU copy
+	size_t uploaded = mesh.indexed_vertices.size() * (2 * sizeof(glm::vec3) + sizeof(glm::vec2)) + mesh.indices.size() * sizeof(unsigned short);
+	mesh.bytes = 2 * uploaded;
+	return uploaded;
+}
+
+static void finishTexture(AssetJob & job){
+	job.texture->bytes = streamedBytes(job.stream);
+	if (job.stream.nextLevel < 0) {
+		job.texture->ready = true;
+		PendingAssets--;
+	}
+}
+
+void updateAssetLoader(size_t byteBudget){
+
+	// Textures already streaming get their share of the budget first
+	size_t used = 0;
+	for (size_t i = 0; i < UploadingJobs.size(); ) {
+		AssetJob & job = *UploadingJobs[i];
+		size_t remaining = used < byteBudget ? byteBudget - used : 0;
+		used += continueDDSStream(job.stream, remaining);
+		finishTexture(job);
+		if (job.stream.nextLevel < 0)
+			UploadingJobs.erase(UploadingJobs.begin() + i);
+		else
+			i++;
+	}
+
+	// Then the newly finished loads, while there is budget left.
+	// At least one per frame, so that a single large asset can't block the queue.
+	bool first = true;
+	while (first || used < byteBudget) {
+		std::shared_ptr<AssetJob> job;
+		{
+			std::lock_guard<std::mutex> lock(AssetLoaderMutex);
+			if (CompletedJobs.empty())
+				return;
+			job = CompletedJobs.front();
+			CompletedJobs.pop_front();
+		}
+		first = false;
+
+		if (!job->succeeded) {
+			if (job->mesh)
+				job->mesh->failed = true;
+			else
+				job->texture->failed = true;
+			PendingAssets--;
+			continue;
+		}
+
+		if (job->type == AssetJob::MESH) {
+			used += uploadMesh(*job->mesh, job->staging);
+			PendingAssets--;
+			continue;
+		}
+
+		size_t remaining = used < byteBudget ? byteBudget - used : 0;
+		used += beginDDSStreamMapped(job->texture->textureID, job->stream, remaining);
+		finishTexture(*job);
+		if (job->stream.nextLevel >= 0)
+			UploadingJobs.push_back(job);
+	}
+}
+
+static void deleteMesh(MeshAsset * mesh){
+	if (mesh->ready) {
+		glDeleteBuffers(1, &mesh->vertexbuffer);
+		glDeleteBuffers(1, &mesh->uvbuffer);
+		glDeleteBuffers(1, &mesh->normalbuffer);
+		glDeleteBuffers(1, &mesh->elementbuffer);
+	}
+	delete mesh;
+}
+
+void releaseTextureAsset(TextureAsset * texture){
+	std::vector<TextureAsset *>::iterator it = std::find(LoadedTextures.begin(), LoadedTextures.end(), texture);
+	if (it == LoadedTextures.end() || !(texture->ready || texture->failed))
+		return;
+	LoadedTextures.erase(it);
+	glDeleteTextures(1, &texture->textureID);
+	delete texture;
+}
+
+void releaseMeshAsset(MeshAsset * mesh){
+	std::vector<MeshAsset *>::iterator it = std::find(LoadedMeshes.begin(), LoadedMeshes.end(), mesh);
+	if (it == LoadedMeshes.end() || !(mesh->ready || mesh->failed))
+		return;
+	LoadedMeshes.erase(it);
+	deleteMesh(mesh);
+}
+
+int pendingAssetCount(){
+	return PendingAssets;
+}
+
+void cleanupAssetLoader(){
+
+	stopThreadPool();
+
+	for (size_t i = 0; i < UploadingJobs.size(); i++)
+		unmapFile(UploadingJobs[i]->stream.file);
+	UploadingJobs.clear();
+	{
+		std::lock_guard<std::mutex> lock(AssetLoaderMutex);
+		for (size_t i = 0; i < CompletedJobs.size(); i++)
+			unmapFile(CompletedJobs[i]->stream.file);
+		CompletedJobs.clear();
+	}
+
+	for (size_t i = 0; i < LoadedTextures.size(); i++) {
+		glDeleteTextures(1, &LoadedTextures[i]->textureID);
+		delete LoadedTextures[i];
+	}
+	LoadedTextures.clear();
+
+	for (size_t i = 0; i < LoadedMeshes.size(); i++)
+		deleteMesh(LoadedMeshes[i]);
+	LoadedMeshes.clear();
+	PendingAssets = 0;
+}
@@ -0,0 +1,59 @@
+#ifndef ASSETLOADER_HPP
+#define ASSETLOADER_HPP
+
+#include <vector>
+
+// A texture loaded by requestTextureAsset. textureID is usable right away.
+struct TextureAsset {
+	GLuint textureID;
+	bool ready;     // Every mipmap uploaded
+	bool failed;    // Left with the placeholder
+	size_t bytes;   // Video memory used so far
+};
+
+// A mesh loaded by requestMesh. Nothing is drawn until ready is true.
+struct MeshAsset {
+	bool ready;
+	bool failed;
+	size_t bytes;       // Video memory used by the buffers, and system memory used by the CPU copy
+	GLuint vertexbuffer;
+	GLuint uvbuffer;
+	GLuint normalbuffer;
+	GLuint elementbuffer;
+	GLsizei indexCount;
+
+	// CPU copy of what went into the buffers
+	std::vector<unsigned short> indices;
+	std::vector<glm::vec3> indexed_vertices;
+	std::vector<glm::vec2> indexed_uvs;
+	std::vector<glm::vec3> indexed_normals;
+};
+
+// Starts the worker threads. Call once, with a GL context current.
+void initAssetLoader();
+
+// Returns a texture name right away, holding a 1x1 white placeholder until the
+// .DDS file has been read and parsed by a worker and uploaded by updateAssetLoader().
+// The texture belongs to the loader, like the TextureAsset behind it.
+GLuint requestTexture(const char * imagepath);
+// Same, with the progress of the load. The TextureAsset belongs to the loader.
+TextureAsset * requestTextureAsset(const char * imagepath);
+
+// Reads the mesh with AssImp on a worker. The returned MeshAsset belongs to the loader.
+MeshAsset * requestMesh(const char * path);
+
+// Deletes an asset and its GL objects before cleanupAssetLoader(). Only once it is ready or failed.
+void releaseTextureAsset(TextureAsset * texture);
+void releaseMeshAsset(MeshAsset * mesh);
+
+// Call once per frame on the GL thread : uploads at most byteBudget bytes of finished loads.
+void updateAssetLoader(size_t byteBudget);
+
+// Number of requests not completely uploaded yet
+int pendingAssetCount();
+
+// Stops the workers and deletes the assets that were not released, the textures returned
+// by requestTexture() included : callers must not delete those themselves.
+void cleanupAssetLoader();
+
+#endif
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define BVH_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include "threadpool.hpp"
+#include "bvh.hpp"
+
+// Triangles per leaf : one packet
+#define BVH_LEAF_SIZE 4
+// Candidate split planes per axis and node
+#define BVH_BINS 16
+// Deep enough for any tree built from 16 bit indices
+#define BVH_STACK_SIZE 64
+// Rays per task of intersectBVHBatch
+#define BVH_BATCH_GRAIN 1024
+
+// ---------------------------------------------------------------------------------------------
+// Build
+
+struct BuildTriangle {
+	glm::vec3 minimum, maximum, centroid;
+	unsigned int index;
+};
+
+struct BuildBounds {
+	glm::vec3 minimum, maximum;
+
+	void clear() { minimum = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX); maximum = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX); }
+	void grow(const glm::vec3 & low, const glm::vec3 & high) { minimum = glm::min(minimum, low); maximum = glm::max(maximum, high); }
+	float area() const {
+		if (minimum.x > maximum.x)
+			return 0.0f;
+		glm::vec3 size = maximum - minimum;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+};
+
+static float component(const glm::vec3 & v, int axis){
+	return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+static void makeLeaf(BVH & bvh, unsigned int node, const std::vector<BuildTriangle> & triangles, size_t first, size_t count,
+                     const std::vector<glm::vec3> & vertices, const std::vector<unsigned short> & indices){
+
+	BVHTrianglePacket packet;
+	memset(&packet, 0, sizeof(packet)); // Unused lanes : all edges 0, never hit
+	for (size_t lane = 0; lane < count; lane++) {
+		unsigned int t = triangles[first + lane].index;
+		const glm::vec3 & a = vertices[indices[3 * t]];
+		glm::vec3 e1 = vertices[indices[3 * t + 1]] - a;
+		glm::vec3 e2 = vertices[indices[3 * t + 2]] - a;
+		for (int axis = 0; axis < 3; axis++) {
+			packet.v0[axis][lane] = component(a, axis);
+			packet.edge1[axis][lane] = component(e1, axis);
+			packet.edge2[axis][lane] = component(e2, axis);
+		}
+		packet.triangle[lane] = t;
+	}
+	for (size_t lane = count; lane < 4; lane++)
+		packet.triangle[lane] = ~0u;
+
+	bvh.nodes[node].index = (unsigned int)bvh.packets.size();
+	bvh.nodes[node].count = (unsigned int)count;
+	bvh.packets.push_back(packet);
+}
+
+static void buildNode(BVH & bvh, unsigned int node, std::vector<BuildTriangle> & triangles, size_t first, size_t count,
+                      const std::vector<glm::vec3> & vertices, const std::vector<unsigned short> & indices){
+
+	BuildBounds bounds, centroids;
+	bounds.clear();
+	centroids.clear();
+	for (size_t i = first; i < first + count; i++) {
+		bounds.grow(triangles[i].minimum, triangles[i].maximum);
+		centroids.grow(triangles[i].centroid, triangles[i].centroid);
+	}
+	for (int axis = 0; axis < 3; axis++) {
+		bvh.nodes[node].minimum[axis] = component(bounds.minimum, axis);
+		bvh.nodes[node].maximum[axis] = component(bounds.maximum, axis);
+	}
+
+	if (count <= BVH_LEAF_SIZE) {
+		makeLeaf(bvh, node, triangles, first, count, vertices, indices);
+		return;
+	}
+
+	// Bin the centroids along each axis, and keep the cheapest plane : area of each side times its triangles
+	int bestAxis = -1, bestBin = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++) {
+		float low = component(centroids.minimum, axis), high = component(centroids.maximum, axis);
+		if (high - low <= 1e-12f)
+			continue;
+		float scale = BVH_BINS / (high - low);
+
+		BuildBounds binBounds[BVH_BINS];
+		unsigned int binCount[BVH_BINS] = { 0 };
+		for (int b = 0; b < BVH_BINS; b++)
+			binBounds[b].clear();
+		for (size_t i = first; i < first + count; i++) {
+			int b = (int)((component(triangles[i].centroid, axis) - low) * scale);
+			b = b < BVH_BINS - 1 ? b : BVH_BINS - 1;
+			binBounds[b].grow(triangles[i].minimum, triangles[i].maximum);
+			binCount[b]++;
+		}
+
+		// Sweep from the right, then from the left
+		float rightArea[BVH_BINS];
+		unsigned int rightCount[BVH_BINS];
+		BuildBounds sweep;
+		sweep.clear();
+		unsigned int sum = 0;
+		for (int b = BVH_BINS - 1; b > 0; b--) {
+			sweep.grow(binBounds[b].minimum, binBounds[b].maximum);
+			sum += binCount[b];
+			rightArea[b] = sweep.area();
+			rightCount[b] = sum;
+		}
+		sweep.clear();
+		sum = 0;
+		for (int b = 0; b < BVH_BINS - 1; b++) {
+			sweep.grow(binBounds[b].minimum, binBounds[b].maximum);
+			sum += binCount[b];
+			float cost = sweep.area() * sum + rightArea[b + 1] * rightCount[b + 1];
+			if (sum > 0 && rightCount[b + 1] > 0 && cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = b;
+			}
+		}
+	}
+
+	size_t middle;
+	if (bestAxis >= 0) {
+		float low = component(centroids.minimum, bestAxis);
+		float scale = BVH_BINS / (component(centroids.maximum, bestAxis) - low);
+		size_t i = first, j = first + count;
+		while (i < j) {
+			int b = (int)((component(triangles[i].centroid, bestAxis) - low) * scale);
+			b = b < BVH_BINS - 1 ? b : BVH_BINS - 1;
+			if (b <= bestBin)
+				i++;
+			else
+				std::swap(triangles[i], triangles[--j]);
+		}
+		middle = i;
+	} else {
+		middle = first + count / 2; // All centroids at the same place : any split will do
+	}
+
+	// Left child right after this node, right child after the whole left subtree
+	unsigned int left = (unsigned int)bvh.nodes.size();
+	bvh.nodes.push_back(BVHNode());
+	buildNode(bvh, left, triangles, first, middle - first, vertices, indices);
+	unsigned int right = (unsigned int)bvh.nodes.size();
+	bvh.nodes.push_back(BVHNode());
+	buildNode(bvh, right, triangles, middle, first + count - middle, vertices, indices);
+
+	bvh.nodes[node].index = right;
+	bvh.nodes[node].count = 0;
+}
+
+void buildBVH(const std::vector<glm::vec3> & vertices, const std::vector<unsigned short> & indices, BVH & bvh){
+
+	bvh.nodes.clear();
+	bvh.packets.clear();
+
+	std::vector<BuildTriangle> triangles;
+	triangles.reserve(indices.size() / 3);
+	for (size_t t = 0; t < indices.size() / 3; t++) {
+		const glm::vec3 & a = vertices[indices[3 * t]];
+		const glm::vec3 & b = vertices[indices[3 * t + 1]];
+		const glm::vec3 & c = vertices[indices[3 * t + 2]];
+		BuildTriangle triangle;
+		triangle.minimum = glm::min(a, glm::min(b, c));
+		triangle.maximum = glm::max(a, glm::max(b, c));
+		triangle.centroid = (a + b + c) * (1.0f / 3.0f);
+		triangle.index = (unsigned int)t;
+		triangles.push_back(triangle);
+	}
+	if (triangles.empty())
+		return;
+
+	bvh.nodes.reserve(2 * triangles.size() / BVH_LEAF_SIZE + 1);
+	bvh.packets.reserve(triangles.size() / BVH_LEAF_SIZE + 1);
+	bvh.nodes.push_back(BVHNode());
+	buildNode(bvh, 0, triangles, 0, triangles.size(), vertices, indices);
+}
+
+// ---------------------------------------------------------------------------------------------
+// Queries
+
+// Entry distance into the node's box, or FLT_MAX when the ray misses it before maxDistance
+static float intersectNode(const BVHNode & node, const float origin[3], const float inverse[3], float maxDistance){
+	float enter = 0.0f, exit = maxDistance;
+	for (int axis = 0; axis < 3; axis++) {
+		float t0 = (node.minimum[axis] - origin[axis]) * inverse[axis];
+		float t1 = (node.maximum[axis] - origin[axis]) * inverse[axis];
+		if (t0 > t1) { float swap = t0; t0 = t1; t1 = swap; }
+		enter = t0 > enter ? t0 : enter;
+		exit = t1 < exit ? t1 : exit;
+	}
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+// Möller & Trumbore against the 4 triangles of a packet. Updates hit if one is closer.
+static void intersectPacket(const BVHTrianglePacket & packet, const float origin[3], const float direction[3], BVHHit & hit){
+
+#ifdef BVH_SSE
+	__m128 dx = _mm_set1_ps(direction[0]), dy = _mm_set1_ps(direction[1]), dz = _mm_set1_ps(direction[2]);
+	__m128 e1x = _mm_loadu_ps(packet.edge1[0]), e1y = _mm_loadu_ps(packet.edge1[1]), e1z = _mm_loadu_ps(packet.edge1[2]);
+	__m128 e2x = _mm_loadu_ps(packet.edge2[0]), e2y = _mm_loadu_ps(packet.edge2[1]), e2z = _mm_loadu_ps(packet.edge2[2]);
+
+	// p = d x e2, det = e1 . p
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+	__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+	__m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+	__m128 valid = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f));
+	__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), det);
+
+	// s = o - v0, u = s . p / det
+	__m128 sx = _mm_sub_ps(_mm_set1_ps(origin[0]), _mm_loadu_ps(packet.v0[0]));
+	__m128 sy = _mm_sub_ps(_mm_set1_ps(origin[1]), _mm_loadu_ps(packet.v0[1]));
+	__m128 sz = _mm_sub_ps(_mm_set1_ps(origin[2]), _mm_loadu_ps(packet.v0[2]));
+	__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), inverse);
+
+	// q = s x e1, v = d . q / det, t = e2 . q / det
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+	__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), inverse);
+	__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), inverse);
+
+	__m128 zero = _mm_setzero_ps();
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+	valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+	valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(hit.distance)));
+	int mask = _mm_movemask_ps(valid);
+	if (mask == 0)
+		return;
+
+	float ts[4], us[4], vs[4];
+	_mm_storeu_ps(ts, t);
+	_mm_storeu_ps(us, u);
+	_mm_storeu_ps(vs, v);
+	for (int lane = 0; lane < 4; lane++) {
+		if ((mask & (1 << lane)) && ts[lane] < hit.distance) {
+			hit.distance = ts[lane];
+			hit.u = us[lane];
+			hit.v = vs[lane];
+			hit.triangle = packet.triangle[lane];
+		}
+	}
+#else
+	for (int lane = 0; lane < 4; lane++) {
+		glm::vec3 d(direction[0], direction[1], direction[2]);
+		glm::vec3 e1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+		glm::vec3 e2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+		glm::vec3 p = glm::cross(d, e2);
+		float det = glm::dot(e1, p);
+		if (fabsf(det) <= 1e-12f)
+			continue;
+		float inverse = 1.0f / det;
+		glm::vec3 s(origin[0] - packet.v0[0][lane], origin[1] - packet.v0[1][lane], origin[2] - packet.v0[2][lane]);
+		float u = glm::dot(s, p) * inverse;
+		glm::vec3 q = glm::cross(s, e1);
+		float v = glm::dot(d, q) * inverse;
+		float t = glm::dot(e2, q) * inverse;
+		if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= 0.0f && t < hit.distance) {
+			hit.distance = t;
+			hit.u = u;
+			hit.v = v;
+			hit.triangle = packet.triangle[lane];
+		}
+	}
+#endif
+}
+
+bool intersectBVH(const BVH & bvh, const BVHRay & ray, BVHHit & hit){
+
+	hit.distance = ray.maxDistance;
+	hit.triangle = ~0u;
+	hit.u = hit.v = 0.0f;
+	if (bvh.nodes.empty())
+		return false;
+
+	float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+	float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+	float inverse[3];
+	for (int axis = 0; axis < 3; axis++)
+		inverse[axis] = direction[axis] != 0.0f ? 1.0f / direction[axis] : FLT_MAX;
+
+	// Nearest child first, the other one on the stack for later
+	unsigned int stack[BVH_STACK_SIZE];
+	int top = 0;
+	unsigned int node = 0;
+	if (intersectNode(bvh.nodes[0], origin, inverse, hit.distance) == FLT_MAX)
+		return false;
+	for (;;) {
+		const BVHNode & current = bvh.nodes[node];
+		if (current.count > 0) {
+			intersectPacket(bvh.packets[current.index], origin, direction, hit);
+		} else {
+			unsigned int left = node + 1, right = current.index;
+			float leftDistance = intersectNode(bvh.nodes[left], origin, inverse, hit.distance);
+			float rightDistance = intersectNode(bvh.nodes[right], origin, inverse, hit.distance);
+			if (leftDistance > rightDistance) {
+				std::swap(left, right);
+				std::swap(leftDistance, rightDistance);
+			}
+			if (leftDistance != FLT_MAX) {
+				if (rightDistance != FLT_MAX && top < BVH_STACK_SIZE)
+					stack[top++] = right;
+				node = left;
+				continue;
+			}
+		}
+		if (top == 0)
+			break;
+		node = stack[--top];
+	}
+	return hit.triangle != ~0u;
+}
+
+bool intersectSegment(const BVH & bvh, const glm::vec3 & start, const glm::vec3 & end, BVHHit & hit){
+	BVHRay ray;
+	ray.origin = start;
+	ray.direction = end - start;
+	ray.maxDistance = 1.0f;
+	return intersectBVH(bvh, ray, hit);
+}
+
+size_t intersectBVHBatch(const BVH & bvh, const BVHRay * rays, BVHHit * hits, size_t count){
+	std::vector<size_t> chunkHits((count + BVH_BATCH_GRAIN - 1) / BVH_BATCH_GRAIN, 0);
+	parallelFor(count, BVH_BATCH_GRAIN, [&](size_t begin, size_t end) {
+		size_t found = 0;
+		for (size_t i = begin; i < end; i++)
+			found += intersectBVH(bvh, rays[i], hits[i]) ? 1 : 0;
+		chunkHits[begin / BVH_BATCH_GRAIN] = found;
+	});
+	size_t total = 0;
+	for (size_t i = 0; i < chunkHits.size(); i++)
+		total += chunkHits[i];
+	return total;
+}
+
+double benchmarkBVH(const BVH & bvh, size_t rayCount){
+
+	if (bvh.nodes.empty() || rayCount == 0)
+		return 0.0;
+
+	// From random points on a sphere around the mesh, towards random points inside its box
+	const BVHNode & root = bvh.nodes[0];
+	glm::vec3 low(root.minimum[0], root.minimum[1], root.minimum[2]);
+	glm::vec3 high(root.maximum[0], root.maximum[1], root.maximum[2]);
+	glm::vec3 center = (low + high) * 0.5f;
+	float radius = glm::length(high - low);
+
+	std::vector<BVHRay> rays(rayCount);
+	std::vector<BVHHit> hits(rayCount);
+	for (size_t i = 0; i < rayCount; i++) {
+		glm::vec3 from;
+		do {
+			from = glm::vec3(rand() / (float)RAND_MAX * 2.0f - 1.0f, rand() / (float)RAND_MAX * 2.0f - 1.0f, rand() / (float)RAND_MAX * 2.0f - 1.0f);
+		} while (glm::dot(from, from) > 1.0f || glm::dot(from, from) < 0.01f);
+		glm::vec3 to(low.x + (high.x - low.x) * (rand() / (float)RAND_MAX),
+		             low.y + (high.y - low.y) * (rand() / (float)RAND_MAX),
+		             low.z + (high.z - low.z) * (rand() / (float)RAND_MAX));
+		rays[i].origin = center + glm::normalize(from) * radius;
+		rays[i].direction = glm::normalize(to - rays[i].origin);
+		rays[i].maxDistance = FLT_MAX;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t hitCount = intersectBVHBatch(bvh, &rays[0], &hits[0], rayCount);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	double raysPerSecond = seconds > 0.0 ? rayCount / seconds : 0.0;
+	printf("BVH : %u nodes, %u packets. %u rays in %.2f ms (%u hits) : %.2f Mrays/s on %u threads\n",
+		(unsigned int)bvh.nodes.size(), (unsigned int)bvh.packets.size(), (unsigned int)rayCount, seconds * 1000.0,
+		(unsigned int)hitCount, raysPerSecond / 1e6, threadPoolSize() + 1);
+	return raysPerSecond;
+}
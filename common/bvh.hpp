@@ -0,0 +1,55 @@
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <vector>
+
+// 32 bytes, two to a cache line. Nodes are stored depth first : the left child of an inner
+// node comes right after it, and `index` is its right child. A leaf has `count` > 0 and
+// `index` is its packet.
+struct BVHNode {
+	float minimum[3];
+	unsigned int index;
+	float maximum[3];
+	unsigned int count; // Triangles in the leaf, 0 for inner nodes
+};
+
+// Up to 4 triangles of a leaf, as columns so that a ray is tested against all of them at once.
+// Unused lanes are degenerate and never hit.
+struct BVHTrianglePacket {
+	float v0[3][4];
+	float edge1[3][4];
+	float edge2[3][4];
+	unsigned int triangle[4]; // Index of the triangle in the mesh (first index / 3)
+};
+
+struct BVH {
+	std::vector<BVHNode> nodes;
+	std::vector<BVHTrianglePacket> packets;
+};
+
+// Surface area heuristic, binned. Indexed triangles, as loadAssImp / indexVBO produce them.
+void buildBVH(const std::vector<glm::vec3> & vertices, const std::vector<unsigned short> & indices, BVH & bvh);
+
+struct BVHRay {
+	glm::vec3 origin;
+	glm::vec3 direction; // Not necessarily unit length : distances are in multiples of it
+	float maxDistance;
+};
+
+struct BVHHit {
+	float distance;       // Along the ray, in multiples of its direction
+	unsigned int triangle; // Index of the triangle in the mesh, ~0u when nothing was hit
+	float u, v;           // Barycentric coordinates of the hit on the triangle
+};
+
+// Closest hit, both sides of the triangles count
+bool intersectBVH(const BVH & bvh, const BVHRay & ray, BVHHit & hit);
+// From start to end : distance 0 at start, 1 at end
+bool intersectSegment(const BVH & bvh, const glm::vec3 & start, const glm::vec3 & end, BVHHit & hit);
+// Many rays, spread over the thread pool. Returns the number of hits.
+size_t intersectBVHBatch(const BVH & bvh, const BVHRay * rays, BVHHit * hits, size_t count);
+
+// Casts `rayCount` random rays at the mesh from around it, in batches, and prints rays per second
+double benchmarkBVH(const BVH & bvh, size_t rayCount);
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "collision.hpp"
+
+// Grids are capped to this many cells per axis : beyond that, cells get bigger
+#define COLLISION_MAX_RESOLUTION 128
+
+// How far from a surface a bounced particle is put back, so that it does not hit it again
+#define COLLISION_SEPARATION 0.001f
+
+static int clampCell(int cell, int resolution){
+	return cell < 0 ? 0 : (cell >= resolution ? resolution - 1 : cell);
+}
+
+void buildCollisionGrid(const std::vector<glm::vec3> & vertices, const std::vector<unsigned short> & indices,
+                        float cellSize, float margin, CollisionGrid & grid){
+
+	grid.triangles.clear();
+	grid.cellStart.clear();
+	grid.cellTriangles.clear();
+	grid.margin = margin;
+	grid.hasGround = false;
+	grid.groundHeight = 0.0f;
+
+	// Keep the triangles that have an area
+	glm::vec3 minimum(FLT_MAX, FLT_MAX, FLT_MAX), maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		const glm::vec3 & a = vertices[indices[i]];
+		const glm::vec3 & b = vertices[indices[i + 1]];
+		const glm::vec3 & c = vertices[indices[i + 2]];
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float area = glm::length(normal);
+		if (area <= 1e-12f)
+			continue;
+
+		CollisionTriangle triangle;
+		triangle.a = a;
+		triangle.edge1 = b - a;
+		triangle.edge2 = c - a;
+		triangle.normal = normal * (1.0f / area);
+		grid.triangles.push_back(triangle);
+
+		minimum = glm::min(minimum, glm::min(a, glm::min(b, c)));
+		maximum = glm::max(maximum, glm::max(a, glm::max(b, c)));
+	}
+
+	if (grid.triangles.empty()) {
+		grid.origin = glm::vec3(0.0f, 0.0f, 0.0f);
+		grid.cellSize = 1.0f;
+		grid.resolution[0] = grid.resolution[1] = grid.resolution[2] = 0;
+		grid.cellStart.push_back(0);
+		return;
+	}
+
+	glm::vec3 extent(margin, margin, margin);
+	minimum -= extent;
+	maximum += extent;
+	glm::vec3 size = maximum - minimum;
+	float largest = size.x > size.y ? (size.x > size.z ? size.x : size.z) : (size.y > size.z ? size.y : size.z);
+	if (cellSize * COLLISION_MAX_RESOLUTION < largest)
+		cellSize = largest / COLLISION_MAX_RESOLUTION;
+	grid.origin = minimum;
+	grid.cellSize = cellSize;
+	grid.resolution[0] = (int)ceilf(size.x / cellSize) > 0 ? (int)ceilf(size.x / cellSize) : 1;
+	grid.resolution[1] = (int)ceilf(size.y / cellSize) > 0 ? (int)ceilf(size.y / cellSize) : 1;
+	grid.resolution[2] = (int)ceilf(size.z / cellSize) > 0 ? (int)ceilf(size.z / cellSize) : 1;
+	size_t cellCount = (size_t)grid.resolution[0] * grid.resolution[1] * grid.resolution[2];
+
+	// Every triangle goes into the cells its box, grown by the margin, overlaps.
+	// Counted first, then filled in place : one allocation for all the lists.
+	std::vector<int> ranges(grid.triangles.size() * 6);
+	for (size_t t = 0; t < grid.triangles.size(); t++) {
+		const CollisionTriangle & triangle = grid.triangles[t];
+		glm::vec3 b = triangle.a + triangle.edge1, c = triangle.a + triangle.edge2;
+		glm::vec3 low = glm::min(triangle.a, glm::min(b, c)) - extent - grid.origin;
+		glm::vec3 high = glm::max(triangle.a, glm::max(b, c)) + extent - grid.origin;
+		int * range = &ranges[t * 6];
+		range[0] = clampCell((int)floorf(low.x / cellSize), grid.resolution[0]);
+		range[1] = clampCell((int)floorf(low.y / cellSize), grid.resolution[1]);
+		range[2] = clampCell((int)floorf(low.z / cellSize), grid.resolution[2]);
+		range[3] = clampCell((int)floorf(high.x / cellSize), grid.resolution[0]);
+		range[4] = clampCell((int)floorf(high.y / cellSize), grid.resolution[1]);
+		range[5] = clampCell((int)floorf(high.z / cellSize), grid.resolution[2]);
+	}
+
+	grid.cellStart.assign(cellCount + 1, 0);
+	for (size_t t = 0; t < grid.triangles.size(); t++) {
+		const int * range = &ranges[t * 6];
+		for (int z = range[2]; z <= range[5]; z++)
+			for (int y = range[1]; y <= range[4]; y++)
+				for (int x = range[0]; x <= range[3]; x++)
+					grid.cellStart[((size_t)z * grid.resolution[1] + y) * grid.resolution[0] + x + 1]++;
+	}
+	for (size_t i = 0; i < cellCount; i++)
+		grid.cellStart[i + 1] += grid.cellStart[i];
+
+	grid.cellTriangles.resize(grid.cellStart[cellCount]);
+	std::vector<unsigned int> fill(grid.cellStart.begin(), grid.cellStart.end() - 1);
+	for (size_t t = 0; t < grid.triangles.size(); t++) {
+		const int * range = &ranges[t * 6];
+		for (int z = range[2]; z <= range[5]; z++)
+			for (int y = range[1]; y <= range[4]; y++)
+				for (int x = range[0]; x <= range[3]; x++)
+					grid.cellTriangles[fill[((size_t)z * grid.resolution[1] + y) * grid.resolution[0] + x]++] = (unsigned int)t;
+	}
+}
+
+void setCollisionGround(CollisionGrid & grid, float height){
+	grid.hasGround = true;
+	grid.groundHeight = height;
+}
+
+// The sphere touches the front of the triangle's plane during the move, and the point of contact is inside
+static bool sweepTriangle(const CollisionTriangle & triangle, const glm::vec3 & start, const glm::vec3 & move,
+                          float radius, float & time){
+
+	float d0 = glm::dot(triangle.normal, start - triangle.a);
+	float d1 = d0 + glm::dot(triangle.normal, move);
+	if (d0 < radius || d1 >= radius)
+		return false; // Starts behind or too close, or never reaches it
+	float t = (d0 - radius) / (d0 - d1);
+	if (t >= time)
+		return false;
+
+	// Barycentric coordinates of the contact point
+	glm::vec3 p = start + move * t - triangle.normal * radius - triangle.a;
+	float d11 = glm::dot(triangle.edge1, triangle.edge1);
+	float d12 = glm::dot(triangle.edge1, triangle.edge2);
+	float d22 = glm::dot(triangle.edge2, triangle.edge2);
+	float dp1 = glm::dot(p, triangle.edge1);
+	float dp2 = glm::dot(p, triangle.edge2);
+	float denominator = d11 * d22 - d12 * d12;
+	float v = (d22 * dp1 - d12 * dp2) / denominator;
+	float w = (d11 * dp2 - d12 * dp1) / denominator;
+	if (v < 0.0f || w < 0.0f || v + w > 1.0f)
+		return false;
+
+	time = t;
+	return true;
+}
+
+bool sweepSphere(const CollisionGrid & grid, const glm::vec3 & start, const glm::vec3 & end, float radius, CollisionHit & hit){
+
+	glm::vec3 move = end - start;
+	hit.time = 1.0f;
+	bool found = false;
+
+	// The ground first : it is only a plane
+	if (grid.hasGround) {
+		float d0 = start.y - grid.groundHeight;
+		float d1 = end.y - grid.groundHeight;
+		if (d0 >= radius && d1 < radius) {
+			hit.time = (d0 - radius) / (d0 - d1);
+			hit.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+			found = true;
+		}
+	}
+
+	if (grid.triangles.empty())
+		return found;
+
+	// Part of the move inside the grid (slab test)
+	float gridSize[3] = { grid.resolution[0] * grid.cellSize, grid.resolution[1] * grid.cellSize, grid.resolution[2] * grid.cellSize };
+	float origin[3] = { start.x - grid.origin.x, start.y - grid.origin.y, start.z - grid.origin.z };
+	float direction[3] = { move.x, move.y, move.z };
+	float enter = 0.0f, exit = hit.time;
+	for (int axis = 0; axis < 3; axis++) {
+		if (fabsf(direction[axis]) < 1e-12f) {
+			if (origin[axis] < 0.0f || origin[axis] > gridSize[axis])
+				return found;
+			continue;
+		}
+		float t0 = -origin[axis] / direction[axis];
+		float t1 = (gridSize[axis] - origin[axis]) / direction[axis];
+		if (t0 > t1) { float swap = t0; t0 = t1; t1 = swap; }
+		if (t0 > enter) enter = t0;
+		if (t1 < exit) exit = t1;
+	}
+	if (enter > exit)
+		return found;
+
+	// Walk the cells the center goes through, in order (Amanatides & Woo)
+	int cell[3], step[3];
+	float next[3], delta[3];
+	for (int axis = 0; axis < 3; axis++) {
+		float position = origin[axis] + direction[axis] * enter;
+		cell[axis] = clampCell((int)floorf(position / grid.cellSize), grid.resolution[axis]);
+		if (direction[axis] > 0.0f) {
+			step[axis] = 1;
+			delta[axis] = grid.cellSize / direction[axis];
+			next[axis] = ((cell[axis] + 1) * grid.cellSize - origin[axis]) / direction[axis];
+		} else if (direction[axis] < 0.0f) {
+			step[axis] = -1;
+			delta[axis] = -grid.cellSize / direction[axis];
+			next[axis] = (cell[axis] * grid.cellSize - origin[axis]) / direction[axis];
+		} else {
+			step[axis] = 0;
+			delta[axis] = FLT_MAX;
+			next[axis] = FLT_MAX;
+		}
+	}
+
+	for (;;) {
+		size_t index = ((size_t)cell[2] * grid.resolution[1] + cell[1]) * grid.resolution[0] + cell[0];
+		for (unsigned int i = grid.cellStart[index]; i < grid.cellStart[index + 1]; i++) {
+			const CollisionTriangle & triangle = grid.triangles[grid.cellTriangles[i]];
+			if (sweepTriangle(triangle, start, move, radius, hit.time)) {
+				hit.normal = triangle.normal;
+				found = true;
+			}
+		}
+
+		// Anything in the next cells would be hit later
+		int axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+		if (next[axis] > exit || next[axis] >= hit.time)
+			break;
+		cell[axis] += step[axis];
+		if (cell[axis] < 0 || cell[axis] >= grid.resolution[axis])
+			break;
+		next[axis] += delta[axis];
+	}
+
+	return found;
+}
+
+bool collideParticle(const CollisionGrid & grid, const glm::vec3 & previous, glm::vec3 & position, glm::vec3 & speed,
+                     float radius, CollisionResponse response, float restitution){
+
+	CollisionHit hit;
+	if (!sweepSphere(grid, previous, position, radius, hit))
+		return true;
+
+	position = previous + (position - previous) * hit.time;
+	if (response == COLLISION_KILL)
+		return false;
+
+	// Reflect the part of the speed going into the surface. The rest of the step is lost.
+	position += hit.normal * COLLISION_SEPARATION;
+	float into = glm::dot(speed, hit.normal);
+	if (into < 0.0f)
+		speed -= hit.normal * ((1.0f + restitution) * into);
+	return true;
+}
+
+size_t checkCollision(){
+
+	// A quad facing up at y = 1 over x, z in [0, 2], above the ground at y = 0
+	std::vector<glm::vec3> vertices;
+	vertices.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+	vertices.push_back(glm::vec3(0.0f, 1.0f, 2.0f));
+	vertices.push_back(glm::vec3(2.0f, 1.0f, 2.0f));
+	vertices.push_back(glm::vec3(2.0f, 1.0f, 0.0f));
+	const unsigned short quad[] = { 0, 1, 2, 0, 2, 3 };
+	std::vector<unsigned short> indices(quad, quad + 6);
+	CollisionGrid grid;
+	buildCollisionGrid(vertices, indices, 0.25f, 0.1f, grid);
+	setCollisionGround(grid, 0.0f);
+
+	const float Radius = 0.05f;
+	const float Tolerance = 1e-3f;
+	size_t errors = 0;
+	CollisionHit hit;
+
+	// Falling onto the quad : touches it when the center is a radius above
+	bool found = sweepSphere(grid, glm::vec3(1.0f, 2.0f, 1.0f), glm::vec3(1.0f, 0.5f, 1.0f), Radius, hit);
+	errors += !found || fabsf(hit.time - (2.0f - 1.0f - Radius) / 1.5f) > Tolerance || fabsf(hit.normal.y - 1.0f) > Tolerance;
+	// Rising through it from below : the back face lets it through
+	errors += sweepSphere(grid, glm::vec3(1.0f, 0.5f, 1.0f), glm::vec3(1.0f, 1.5f, 1.0f), Radius, hit);
+	// Falling beside it : down to the ground
+	found = sweepSphere(grid, glm::vec3(3.0f, 2.0f, 1.0f), glm::vec3(3.0f, -1.0f, 1.0f), Radius, hit);
+	errors += !found || fabsf(hit.time - (2.0f - Radius) / 3.0f) > Tolerance || fabsf(hit.normal.y - 1.0f) > Tolerance;
+	// Beside it, above the ground : nothing
+	errors += sweepSphere(grid, glm::vec3(3.0f, 2.0f, 1.0f), glm::vec3(3.0f, 1.5f, 1.0f), Radius, hit);
+	// Contacts are on the faces only : just inside the edge hits, just outside goes by
+	errors += !sweepSphere(grid, glm::vec3(1.99f, 1.5f, 1.0f), glm::vec3(1.99f, 0.5f, 1.0f), Radius, hit);
+	errors += sweepSphere(grid, glm::vec3(2.01f, 1.5f, 1.0f), glm::vec3(2.01f, 0.5f, 1.0f), Radius, hit);
+
+	// Bounce : back above the quad, going up with half the speed
+	glm::vec3 position(1.0f, 0.9f, 1.0f), speed(0.0f, -10.0f, 0.0f);
+	bool alive = collideParticle(grid, glm::vec3(1.0f, 1.1f, 1.0f), position, speed, Radius, COLLISION_BOUNCE, 0.5f);
+	errors += !alive || position.y < 1.0f + Radius || fabsf(speed.y - 5.0f) > Tolerance;
+	// Kill : stops on the surface and dies
+	position = glm::vec3(1.0f, 0.9f, 1.0f);
+	speed = glm::vec3(0.0f, -10.0f, 0.0f);
+	alive = collideParticle(grid, glm::vec3(1.0f, 1.1f, 1.0f), position, speed, Radius, COLLISION_KILL, 0.0f);
+	errors += alive || fabsf(position.y - (1.0f + Radius)) > Tolerance;
+	// No contact : the move is kept as it is
+	position = glm::vec3(3.0f, 1.5f, 1.0f);
+	alive = collideParticle(grid, glm::vec3(3.0f, 2.0f, 1.0f), position, speed, Radius, COLLISION_KILL, 0.0f);
+	errors += !alive || position != glm::vec3(3.0f, 1.5f, 1.0f);
+
+	printf("Collision : %u errors against a quad and the ground\n", (unsigned int)errors);
+	return errors;
+}
@@ -0,0 +1,56 @@
+#ifndef COLLISION_HPP
+#define COLLISION_HPP
+
+#include <vector>
+
+// A triangle of the static scene, with what the queries need precomputed
+struct CollisionTriangle {
+	glm::vec3 a;
+	glm::vec3 edge1;  // b - a
+	glm::vec3 edge2;  // c - a
+	glm::vec3 normal; // Unit length, facing out (counter clockwise winding)
+};
+
+// The static triangles in a uniform grid of cells, built once. Each cell lists the triangles that
+// come within `margin` of it, so spheres up to that radius only need the cells their center crosses.
+// A horizontal ground plane can be added on top of the triangles.
+struct CollisionGrid {
+	glm::vec3 origin; // Corner of the first cell
+	float cellSize;
+	int resolution[3];
+	float margin;
+	std::vector<unsigned int> cellStart;     // Triangles of cell i : cellTriangles[cellStart[i] .. cellStart[i+1]]
+	std::vector<unsigned int> cellTriangles;
+	std::vector<CollisionTriangle> triangles;
+	bool hasGround;
+	float groundHeight;
+};
+
+// Indexed triangles, as loadAssImp / indexVBO produce them
+void buildCollisionGrid(const std::vector<glm::vec3> & vertices, const std::vector<unsigned short> & indices,
+                        float cellSize, float margin, CollisionGrid & grid);
+void setCollisionGround(CollisionGrid & grid, float height);
+
+struct CollisionHit {
+	float time;       // Along the move, 0 at the start, 1 at the end
+	glm::vec3 normal;
+};
+
+// First contact of a sphere of `radius` (at most the grid's margin) moving from start to end.
+// Triangles are one sided : a sphere inside the mesh leaves it freely.
+bool sweepSphere(const CollisionGrid & grid, const glm::vec3 & start, const glm::vec3 & end, float radius, CollisionHit & hit);
+
+enum CollisionResponse {
+	COLLISION_BOUNCE, // Reflected, losing some of its speed
+	COLLISION_KILL    // Stops there and dies
+};
+
+// Moves a particle from `previous` to `position` against the grid and applies the response.
+// Returns false when the particle should die.
+bool collideParticle(const CollisionGrid & grid, const glm::vec3 & previous, glm::vec3 & position, glm::vec3 & speed,
+                     float radius, CollisionResponse response, float restitution);
+
+// Sweeps spheres against a quad and the ground, where the contacts are known. Returns the errors found.
+size_t checkCollision();
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <thread>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include "emittercommands.hpp"
+
+static EmitterCommand emitterCommand(EmitterCommandType type, unsigned int emitter){
+	EmitterCommand command;
+	command.type = type;
+	command.emitter = emitter;
+	command.position = glm::vec3(0.0f, 0.0f, 0.0f);
+	command.rate = 0.0f;
+	command.count = 0;
+	command.color[0] = command.color[1] = command.color[2] = command.color[3] = 0;
+	return command;
+}
+
+EmitterCommand emitterBurst(unsigned int emitter, unsigned int count){
+	EmitterCommand command = emitterCommand(EMITTER_BURST, emitter);
+	command.count = count;
+	return command;
+}
+
+EmitterCommand emitterMove(unsigned int emitter, const glm::vec3 & position){
+	EmitterCommand command = emitterCommand(EMITTER_MOVE, emitter);
+	command.position = position;
+	return command;
+}
+
+EmitterCommand emitterSetRate(unsigned int emitter, float rate){
+	EmitterCommand command = emitterCommand(EMITTER_SET_RATE, emitter);
+	command.rate = rate;
+	return command;
+}
+
+EmitterCommand emitterSetColor(unsigned int emitter, unsigned char r, unsigned char g, unsigned char b, unsigned char a){
+	EmitterCommand command = emitterCommand(EMITTER_SET_COLOR, emitter);
+	command.color[0] = r;
+	command.color[1] = g;
+	command.color[2] = b;
+	command.color[3] = a;
+	return command;
+}
+
+EmitterCommand emitterKillAll(unsigned int emitter){
+	return emitterCommand(EMITTER_KILL_ALL, emitter);
+}
+
+void initEmitterCommandQueue(EmitterCommandQueue & queue, size_t capacity){
+	size_t size = 2;
+	while (size < capacity)
+		size <<= 1;
+	queue.commands.resize(size);
+	queue.mask = size - 1;
+	queue.head.store(0, std::memory_order_relaxed);
+	queue.tail.store(0, std::memory_order_relaxed);
+	queue.cachedHead = 0;
+	queue.cachedTail = 0;
+}
+
+bool pushEmitterCommand(EmitterCommandQueue & queue, const EmitterCommand & command){
+	// Only this thread writes tail
+	size_t tail = queue.tail.load(std::memory_order_relaxed);
+	if (tail - queue.cachedHead > queue.mask) {
+		// Looks full : see how far the consumer got
+		queue.cachedHead = queue.head.load(std::memory_order_acquire);
+		if (tail - queue.cachedHead > queue.mask)
+			return false;
+	}
+	queue.commands[tail & queue.mask] = command;
+	// Publishes the command along with the index
+	queue.tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool popEmitterCommand(EmitterCommandQueue & queue, EmitterCommand & command){
+	// Only this thread writes head
+	size_t head = queue.head.load(std::memory_order_relaxed);
+	if (head == queue.cachedTail) {
+		// Looks empty : see how far the producer got
+		queue.cachedTail = queue.tail.load(std::memory_order_acquire);
+		if (head == queue.cachedTail)
+			return false;
+	}
+	command = queue.commands[head & queue.mask];
+	// Hands the slot back to the producer once it is read
+	queue.head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+size_t stressEmitterCommandQueue(size_t count){
+
+	// A small ring, so that both sides keep finding it full or empty
+	EmitterCommandQueue queue;
+	initEmitterCommandQueue(queue, 64);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	size_t producerWaits = 0;
+	std::thread producer([&](){
+		for (size_t i = 0; i < count; i++) {
+			EmitterCommand command = emitterBurst((unsigned int)(i % 3), (unsigned int)i);
+			command.position = glm::vec3((float)(i & 0xffff), 0.0f, 0.0f);
+			while (!pushEmitterCommand(queue, command)) {
+				producerWaits++;
+				std::this_thread::yield();
+			}
+		}
+	});
+
+	size_t errors = 0, received = 0, consumerWaits = 0;
+	EmitterCommand command;
+	while (received < count) {
+		if (!popEmitterCommand(queue, command)) {
+			consumerWaits++;
+			std::this_thread::yield();
+			continue;
+		}
+		// Every field written by the producer, and in order
+		if (command.type != EMITTER_BURST || command.count != (unsigned int)received
+		    || command.emitter != (unsigned int)(received % 3) || command.position.x != (float)(received & 0xffff))
+			errors++;
+		received++;
+	}
+	producer.join();
+	if (popEmitterCommand(queue, command))
+		errors++;
+
+	double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0;
+	printf("Emitter commands : %u through the queue in %.2f ms, %u errors (full %u times, empty %u times)\n",
+		(unsigned int)count, time, (unsigned int)errors, (unsigned int)producerWaits, (unsigned int)consumerWaits);
+	return errors;
+}
@@ -0,0 +1,60 @@
+#ifndef EMITTERCOMMANDS_HPP
+#define EMITTERCOMMANDS_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+// What another thread (gameplay, input, network) may ask of an emitter while it is simulated
+enum EmitterCommandType {
+	EMITTER_BURST,     // Spawn `count` particles at once
+	EMITTER_MOVE,      // Spawn from `position` from now on
+	EMITTER_SET_RATE,  // Spawn `rate` particles per second
+	EMITTER_SET_COLOR, // Base color of the new particles
+	EMITTER_KILL_ALL   // Every live particle dies
+};
+
+struct EmitterCommand {
+	EmitterCommandType type;
+	unsigned int emitter;
+	glm::vec3 position;
+	float rate;
+	unsigned int count;
+	unsigned char color[4];
+};
+
+EmitterCommand emitterBurst(unsigned int emitter, unsigned int count);
+EmitterCommand emitterMove(unsigned int emitter, const glm::vec3 & position);
+EmitterCommand emitterSetRate(unsigned int emitter, float rate);
+EmitterCommand emitterSetColor(unsigned int emitter, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+EmitterCommand emitterKillAll(unsigned int emitter);
+
+// Commands from one thread to another, through a ring without locks : exactly one thread pushes,
+// exactly one thread pops. Each index is written by one side only and read by the other, and each
+// side keeps a copy of the other's index, so they only share a cache line when the ring looks full
+// or empty.
+#define EMITTER_COMMAND_CACHE_LINE 64
+
+struct EmitterCommandQueue {
+	std::vector<EmitterCommand> commands;
+	size_t mask; // Capacity - 1, a power of two
+
+	alignas(EMITTER_COMMAND_CACHE_LINE) std::atomic<size_t> head; // Next to pop, written by the consumer
+	size_t cachedTail;                                            // The consumer's copy of tail
+
+	alignas(EMITTER_COMMAND_CACHE_LINE) std::atomic<size_t> tail; // Next to push, written by the producer
+	size_t cachedHead;                                            // The producer's copy of head
+};
+
+// Room for at least `capacity` commands. Not thread safe : before either side starts.
+void initEmitterCommandQueue(EmitterCommandQueue & queue, size_t capacity);
+// Producer side. Returns false, and drops the command, when the ring is full.
+bool pushEmitterCommand(EmitterCommandQueue & queue, const EmitterCommand & command);
+// Consumer side. Returns false when there is nothing to pop.
+bool popEmitterCommand(EmitterCommandQueue & queue, EmitterCommand & command);
+
+// Pushes `count` commands from a thread of its own while this one pops them, and checks that
+// they all arrive once, in order. Returns the errors found.
+size_t stressEmitterCommandQueue(size_t count);
+
+#endif
@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <atomic>
+
+#include <glm/glm.hpp>
+
+#include "filewatcher.hpp"
+#include "emitterconfig.hpp"
+
+// Deeper than this, the text is surely not an emitter config
+#define CONFIG_MAX_DEPTH 32
+
+// A JSON value, as parsed
+enum ConfigValueType {
+	CONFIG_NULL,
+	CONFIG_BOOLEAN,
+	CONFIG_NUMBER,
+	CONFIG_STRING,
+	CONFIG_ARRAY,
+	CONFIG_OBJECT
+};
+
+struct ConfigValue {
+	ConfigValueType type;
+	int line;
+	bool boolean;
+	double number;
+	std::string string;
+	std::vector<ConfigValue> items; // Array, or values of an object ...
+	std::vector<std::string> keys;  // ... under these keys
+};
+
+struct ConfigParser {
+	const char * text;
+	size_t size;
+	size_t at;
+	int line;
+	std::string error;
+};
+
+static bool parseFailed(ConfigParser & parser, const char * message){
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "line %d : %s", parser.line, message);
+	parser.error = buffer;
+	return false;
+}
+
+static void skipSpace(ConfigParser & parser){
+	while (parser.at < parser.size) {
+		char c = parser.text[parser.at];
+		if (c == '\n')
+			parser.line++;
+		else if (c != ' ' && c != '\t' && c != '\r')
+			return;
+		parser.at++;
+	}
+}
+
+static bool parseLiteral(ConfigParser & parser, const char * literal){
+	size_t length = strlen(literal);
+	if (parser.size - parser.at < length || std::string(parser.text + parser.at, length) != literal)
+		return parseFailed(parser, "unexpected character");
+	parser.at += length;
+	return true;
+}
+
+static bool parseString(ConfigParser & parser, std::string & string){
+	parser.at++; // Opening quote
+	string.clear();
+	while (parser.at < parser.size) {
+		char c = parser.text[parser.at++];
+		if (c == '"')
+			return true;
+		if (c == '\n')
+			return parseFailed(parser, "unterminated string");
+		if (c != '\\') {
+			string += c;
+			continue;
+		}
+		if (parser.at >= parser.size)
+			break;
+		c = parser.text[parser.at++];
+		switch (c) {
+		case '"': case '\\': case '/': string += c; break;
+		case 'n': string += '\n'; break;
+		case 't': string += '\t'; break;
+		case 'r': string += '\r'; break;
+		case 'b': string += '\b'; break;
+		case 'f': string += '\f'; break;
+		case 'u': {
+			// Names and sprites are ASCII : anything else only has to be skipped
+			if (parser.size - parser.at < 4)
+				return parseFailed(parser, "truncated \\u escape");
+			unsigned int code = (unsigned int)strtoul(std::string(parser.text + parser.at, 4).c_str(), NULL, 16);
+			string += code < 0x80 ? (char)code : '?';
+			parser.at += 4;
+			break;
+		}
+		default:
+			return parseFailed(parser, "unknown escape in string");
+		}
+	}
+	return parseFailed(parser, "unterminated string");
+}
+
+static bool parseValue(ConfigParser & parser, ConfigValue & value, int depth){
+
+	if (depth > CONFIG_MAX_DEPTH)
+		return parseFailed(parser, "nested too deep");
+
+	skipSpace(parser);
+	if (parser.at >= parser.size)
+		return parseFailed(parser, "unexpected end of file");
+
+	value.line = parser.line;
+	char c = parser.text[parser.at];
+
+	if (c == '{' || c == '[') {
+		bool object = c == '{';
+		char close = object ? '}' : ']';
+		value.type = object ? CONFIG_OBJECT : CONFIG_ARRAY;
+		parser.at++;
+		skipSpace(parser);
+		if (parser.at < parser.size && parser.text[parser.at] == close) {
+			parser.at++;
+			return true;
+		}
+		for (;;) {
+			if (object) {
+				skipSpace(parser);
+				if (parser.at >= parser.size || parser.text[parser.at] != '"')
+					return parseFailed(parser, "expected a key");
+				std::string key;
+				if (!parseString(parser, key))
+					return false;
+				skipSpace(parser);
+				if (parser.at >= parser.size || parser.text[parser.at] != ':')
+					return parseFailed(parser, "expected ':' after the key");
+				parser.at++;
+				value.keys.push_back(key);
+			}
+			value.items.push_back(ConfigValue());
+			if (!parseValue(parser, value.items.back(), depth + 1))
+				return false;
+			skipSpace(parser);
+			if (parser.at < parser.size && parser.text[parser.at] == ',') {
+				parser.at++;
+				continue;
+			}
+			if (parser.at < parser.size && parser.text[parser.at] == close) {
+				parser.at++;
+				return true;
+			}
+			return parseFailed(parser, object ? "expected ',' or '}'" : "expected ',' or ']'");
+		}
+	}
+
+	if (c == '"') {
+		value.type = CONFIG_STRING;
+		return parseString(parser, value.string);
+	}
+	if (c == 't' || c == 'f') {
+		value.type = CONFIG_BOOLEAN;
+		value.boolean = c == 't';
+		return parseLiteral(parser, value.boolean ? "true" : "false");
+	}
+	if (c == 'n') {
+		value.type = CONFIG_NULL;
+		return parseLiteral(parser, "null");
+	}
+
+	// The text is null terminated : strtod stops at the end at worst
+	char * end;
+	value.type = CONFIG_NUMBER;
+	value.number = strtod(parser.text + parser.at, &end);
+	if (end == parser.text + parser.at)
+		return parseFailed(parser, "unexpected character");
+	parser.at = end - parser.text;
+	return true;
+}
+
+static bool keyFailed(const ConfigValue & value, const std::string & key, const char * expected, std::string & error){
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "line %d : '%s' should be %s", value.line, key.c_str(), expected);
+	error = buffer;
+	return false;
+}
+
+static bool readFloat(const ConfigValue & value, const std::string & key, float minimum, float & out, std::string & error){
+	// Also turns down NaN and infinities
+	if (value.type != CONFIG_NUMBER || !(value.number >= minimum && value.number <= 1e30))
+		return keyFailed(value, key, minimum == 0.0f ? "a number, 0 or more" : "a number", error);
+	out = (float)value.number;
+	return true;
+}
+
+static bool readFloats(const ConfigValue & value, const std::string & key, float minimum, float * out, size_t count,
+                       std::string & error){
+	if (value.type != CONFIG_ARRAY || value.items.size() != count)
+		return keyFailed(value, key, count == 2 ? "an array of 2 numbers" : "an array of 3 numbers", error);
+	for (size_t i = 0; i < count; i++) {
+		if (!readFloat(value.items[i], key, minimum, out[i], error))
+			return false;
+	}
+	return true;
+}
+
+static bool readVec3(const ConfigValue & value, const std::string & key, float minimum, glm::vec3 & out, std::string & error){
+	float v[3];
+	if (!readFloats(value, key, minimum, v, 3, error))
+		return false;
+	out = glm::vec3(v[0], v[1], v[2]);
+	return true;
+}
+
+static bool readColor(const ConfigValue & value, const std::string & key, unsigned char * out, std::string & error){
+	if (value.type != CONFIG_ARRAY || value.items.size() != 4)
+		return keyFailed(value, key, "an array of 4 numbers from 0 to 255", error);
+	for (size_t i = 0; i < 4; i++) {
+		const ConfigValue & channel = value.items[i];
+		if (channel.type != CONFIG_NUMBER || channel.number < 0.0 || channel.number > 255.0)
+			return keyFailed(channel, key, "an array of 4 numbers from 0 to 255", error);
+		out[i] = (unsigned char)(channel.number + 0.5);
+	}
+	return true;
+}
+
+// Applies the keys of one emitter object over its definition
+static bool readEmitter(const ConfigValue & object, const char * path, EmitterDefinition & definition, std::string & error){
+
+	const float Any = -1e30f;
+
+	for (size_t i = 0; i < object.items.size(); i++) {
+		const std::string & key = object.keys[i];
+		const ConfigValue & value = object.items[i];
+		bool ok = true;
+
+		if (key == "sprite") {
+			if (value.type != CONFIG_STRING)
+				return keyFailed(value, key, "a string", error);
+			definition.sprite = value.string;
+		} else if (key == "rate") {
+			ok = readFloat(value, key, 0.0f, definition.rate, error);
+		} else if (key == "life") {
+			ok = readFloat(value, key, 0.0f, definition.life, error);
+		} else if (key == "position") {
+			ok = readVec3(value, key, Any, definition.position, error);
+		} else if (key == "box") {
+			ok = readVec3(value, key, 0.0f, definition.box, error);
+		} else if (key == "cells") {
+			ok = readVec3(value, key, 0.0f, definition.cells, error);
+		} else if (key == "direction") {
+			ok = readVec3(value, key, Any, definition.direction, error);
+		} else if (key == "spread") {
+			ok = readFloat(value, key, 0.0f, definition.spread, error);
+		} else if (key == "size") {
+			float size[2];
+			ok = readFloats(value, key, 0.0f, size, 2, error);
+			if (ok) {
+				definition.sizeMin = glm::min(size[0], size[1]);
+				definition.sizeMax = glm::max(size[0], size[1]);
+			}
+		} else if (key == "color") {
+			ok = readColor(value, key, definition.color, error);
+		} else if (key == "variation") {
+			ok = readColor(value, key, definition.variation, error);
+		} else if (key == "endColor") {
+			ok = readColor(value, key, definition.endColor, error);
+			definition.colorOverLife = ok;
+		} else if (key == "endSize") {
+			ok = readFloat(value, key, 0.0f, definition.endSize, error);
+		} else if (key == "stretch") {
+			ok = readFloat(value, key, 0.0f, definition.stretch, error);
+		} else if (key == "gravity") {
+			ok = readVec3(value, key, Any, definition.gravity, error);
+		} else if (key == "drag") {
+			ok = readFloat(value, key, 0.0f, definition.drag, error);
+		} else if (key == "turbulence") {
+			ok = readFloat(value, key, Any, definition.turbulence, error);
+		} else if (key == "collision") {
+			if (value.type != CONFIG_STRING || (value.string != "bounce" && value.string != "kill" && value.string != "none"))
+				return keyFailed(value, key, "\"bounce\", \"kill\" or \"none\"", error);
+			definition.collides = value.string != "none";
+			if (definition.collides)
+				definition.collision = value.string == "bounce" ? COLLISION_BOUNCE : COLLISION_KILL;
+		} else if (key == "collisionRadius") {
+			ok = readFloat(value, key, 0.0f, definition.collisionRadius, error);
+		} else if (key == "restitution") {
+			ok = readFloat(value, key, 0.0f, definition.restitution, error);
+		} else {
+			printf("Emitter config : %s : line %d : unknown key '%s' in emitter '%s', skipped\n",
+				path, value.line, key.c_str(), definition.name.c_str());
+		}
+
+		if (!ok)
+			return false;
+	}
+	return true;
+}
+
+bool parseEmitterConfig(const std::string & text, const char * path, std::vector<EmitterDefinition> & definitions,
+                        std::string & error){
+
+	ConfigParser parser;
+	parser.text = text.c_str();
+	parser.size = text.size();
+	parser.at = 0;
+	parser.line = 1;
+
+	ConfigValue root;
+	bool parsed = parseValue(parser, root, 0);
+	skipSpace(parser);
+	if (parsed && parser.at < parser.size)
+		parsed = parseFailed(parser, "unexpected text after the emitters");
+	if (parsed && root.type != CONFIG_OBJECT)
+		parsed = parseFailed(parser, "expected an object of emitters");
+	if (!parsed) {
+		error = std::string(path) + " : " + parser.error;
+		return false;
+	}
+
+	// Everything goes to a copy first : a bad value further down leaves the definitions as they were
+	std::vector<EmitterDefinition> read = definitions;
+	for (size_t i = 0; i < root.items.size(); i++) {
+		size_t found = read.size();
+		for (size_t j = 0; j < read.size(); j++) {
+			if (read[j].name == root.keys[i])
+				found = j;
+		}
+		if (found == read.size()) {
+			printf("Emitter config : %s : line %d : no emitter named '%s', skipped\n",
+				path, root.items[i].line, root.keys[i].c_str());
+			continue;
+		}
+		if (root.items[i].type != CONFIG_OBJECT) {
+			keyFailed(root.items[i], root.keys[i], "an object", error);
+			error = std::string(path) + " : " + error;
+			return false;
+		}
+		if (!readEmitter(root.items[i], path, read[found], error)) {
+			error = std::string(path) + " : " + error;
+			return false;
+		}
+	}
+
+	definitions.swap(read);
+	return true;
+}
+
+// Returns false when the file cannot be opened
+static bool readText(const char * path, std::string & text){
+	std::ifstream stream(path, std::ios::in);
+	if (!stream.is_open())
+		return false;
+	std::stringstream sstr;
+	sstr << stream.rdbuf();
+	text = sstr.str();
+	return true;
+}
+
+bool loadEmitterConfig(const char * path, std::vector<EmitterDefinition> & definitions){
+	std::string text, error;
+	if (!readText(path, text)) {
+		printf("No emitter config in %s, using the defaults\n", path);
+		return true;
+	}
+	if (!parseEmitterConfig(text, path, definitions, error)) {
+		printf("Emitter config : %s\n", error.c_str());
+		return false;
+	}
+	return true;
+}
+
+// The definitions of the last save, waiting for the simulation. Guarded by EmitterConfigMutex.
+static std::mutex EmitterConfigMutex;
+static std::vector<EmitterDefinition> EmitterConfigDefaults;
+static std::vector<EmitterDefinition> PendingEmitterConfig;
+static std::atomic<bool> EmitterConfigPending(false);
+
+// Runs on the watcher thread : the file I/O and parsing stay off the simulation
+static void onEmitterConfigChanged(const char * path, void *){
+
+	std::vector<EmitterDefinition> definitions;
+	{
+		std::lock_guard<std::mutex> lock(EmitterConfigMutex);
+		definitions = EmitterConfigDefaults;
+	}
+
+	std::string text, error;
+	if (!readText(path, text))
+		return; // Being replaced : the rename will call again
+	if (!parseEmitterConfig(text, path, definitions, error)) {
+		printf("Emitter config : %s, keeping the previous emitters\n", error.c_str());
+		return;
+	}
+
+	printf("%s changed, reloading the emitters\n", path);
+	std::lock_guard<std::mutex> lock(EmitterConfigMutex);
+	PendingEmitterConfig.swap(definitions);
+	EmitterConfigPending = true;
+}
+
+void watchEmitterConfig(const char * path, const std::vector<EmitterDefinition> & defaults){
+	{
+		std::lock_guard<std::mutex> lock(EmitterConfigMutex);
+		EmitterConfigDefaults = defaults;
+	}
+	watchFile(path, onEmitterConfigChanged, NULL);
+}
+
+bool takeEmitterConfig(std::vector<EmitterDefinition> & definitions){
+	if (!EmitterConfigPending)
+		return false;
+	std::lock_guard<std::mutex> lock(EmitterConfigMutex);
+	definitions.swap(PendingEmitterConfig);
+	PendingEmitterConfig.clear();
+	EmitterConfigPending = false;
+	return true;
+}
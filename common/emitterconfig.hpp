@@ -0,0 +1,52 @@
+#ifndef EMITTERCONFIG_HPP
+#define EMITTERCONFIG_HPP
+
+#include <string>
+#include <vector>
+
+#include "collision.hpp"
+
+// How an emitter spawns and moves its particles. Read from the emitter config file, on top of
+// the defaults of the program.
+struct EmitterDefinition {
+	std::string name;
+	std::string sprite;         // File of a sprite of the atlas
+	float rate;                 // Particles per second, at full detail. At most the pool over their life.
+	float life;                 // Seconds
+	glm::vec3 position;         // Corner of the spawn box
+	glm::vec3 box;              // Size of the spawn box, 0 on an axis to spawn on the corner
+	glm::vec3 cells;            // Spawn positions snap to this many cells of the box per axis, 0 : anywhere
+	glm::vec3 direction;        // Initial speed ...
+	float spread;               // ... plus up to this much, in any direction
+	float sizeMin, sizeMax;
+	unsigned char color[4];     // Base color ...
+	unsigned char variation[4]; // ... plus up to this much per channel
+	bool colorOverLife;         // Fades to endColor over the life, when the config gives one
+	unsigned char endColor[4];
+	float endSize;              // Size when dying, times the spawn size : 1 keeps it
+	float stretch;              // Extra length per unit of speed, 0 for billboards
+	glm::vec3 gravity;          // Uniform acceleration, 0 for none
+	float drag;                 // Speed lost per second, in proportion to itself, 0 for none
+	float turbulence;           // Average acceleration of the curl noise, 0 for none
+	bool collides;              // "collision": "none" turns it off
+	CollisionResponse collision;
+	float collisionRadius;
+	float restitution;          // Bounce only : speed kept across the surface
+};
+
+// Reads the config text, a JSON object of emitters by name :
+//   { "smoke": { "rate": 10000, "color": [170, 170, 170, 0], ... }, "rain": { ... } }
+// Emitters and keys the text leaves out keep their value in `definitions`; unknown ones are reported
+// and skipped. On error, returns false with the line in `error`, and `definitions` is unchanged.
+bool parseEmitterConfig(const std::string & text, const char * path, std::vector<EmitterDefinition> & definitions,
+                        std::string & error);
+// Same, from a file. A missing file is not an error : the definitions stay as they are.
+bool loadEmitterConfig(const char * path, std::vector<EmitterDefinition> & definitions);
+
+// Reads the file again, on top of `defaults`, every time it is saved. The file watcher must be running.
+void watchEmitterConfig(const char * path, const std::vector<EmitterDefinition> & defaults);
+// The definitions of the last save that parsed. Returns false, without locking, when there is none
+// since the last call.
+bool takeEmitterConfig(std::vector<EmitterDefinition> & definitions);
+
+#endif
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.hpp"
+#include "emitterlod.hpp"
+
+void clearBounds(EmitterBounds & bounds){
+	bounds.minimum = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+	bounds.maximum = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+bool boundsEmpty(const EmitterBounds & bounds){
+	return bounds.minimum.x > bounds.maximum.x;
+}
+
+void growBounds(EmitterBounds & bounds, const glm::vec3 & center, float radius){
+	glm::vec3 extent(radius, radius, radius);
+	bounds.minimum = glm::min(bounds.minimum, center - extent);
+	bounds.maximum = glm::max(bounds.maximum, center + extent);
+}
+
+void mergeBounds(EmitterBounds & bounds, const EmitterBounds & other){
+	if (boundsEmpty(other))
+		return;
+	bounds.minimum = glm::min(bounds.minimum, other.minimum);
+	bounds.maximum = glm::max(bounds.maximum, other.maximum);
+}
+
+float boundsDistance(const EmitterBounds & bounds, const glm::vec3 & point){
+	glm::vec3 outside = glm::max(glm::max(bounds.minimum - point, point - bounds.maximum), glm::vec3(0.0f, 0.0f, 0.0f));
+	return glm::length(outside);
+}
+
+EmitterLOD chooseEmitterLOD(const EmitterBounds & bounds, const Frustum & frustum, const glm::vec3 & cameraPosition,
+                            const EmitterLODSettings & settings){
+
+	EmitterLOD lod;
+	lod.visible = !boundsEmpty(bounds) && boxInFrustum(frustum, bounds.minimum, bounds.maximum);
+	lod.distance = boundsEmpty(bounds) ? FLT_MAX : boundsDistance(bounds, cameraPosition);
+
+	// Linear between the two distances
+	float detail = 1.0f;
+	if (lod.distance > settings.fullDetailDistance) {
+		float range = settings.lowDetailDistance - settings.fullDetailDistance;
+		float t = range > 0.0f ? (lod.distance - settings.fullDetailDistance) / range : 1.0f;
+		if (t > 1.0f)
+			t = 1.0f;
+		detail = 1.0f + (settings.minimumSpawnScale - 1.0f) * t;
+	}
+	lod.spawnScale = detail;
+	// n particles of size s cover about n * s * s : fewer particles, bigger
+	lod.sizeScale = 1.0f / sqrtf(detail);
+	return lod;
+}
+
+void initEmitterState(EmitterState & emitter, const EmitterBounds & spawnBounds, float acceleration){
+	emitter.spawnBounds = spawnBounds;
+	clearBounds(emitter.particleBounds);
+	emitter.maxSpeed = 0.0f;
+	emitter.acceleration = acceleration;
+	emitter.pendingTime = 0.0;
+	emitter.pendingFrames = 0;
+	emitter.lod.visible = true;
+	emitter.lod.distance = 0.0f;
+	emitter.lod.spawnScale = 1.0f;
+	emitter.lod.sizeScale = 1.0f;
+}
+
+EmitterBounds currentBounds(const EmitterState & emitter, double delta){
+
+	// No particle can have gone further than this since the last simulated frame
+	float time = (float)(emitter.pendingTime + delta);
+	float travel = emitter.maxSpeed * time + 0.5f * emitter.acceleration * time * time;
+
+	EmitterBounds bounds = emitter.particleBounds;
+	if (!boundsEmpty(bounds)) {
+		glm::vec3 extent(travel, travel, travel);
+		bounds.minimum -= extent;
+		bounds.maximum += extent;
+	}
+	mergeBounds(bounds, emitter.spawnBounds);
+	return bounds;
+}
+
+double beginEmitterFrame(EmitterState & emitter, double delta, const Frustum & frustum, const glm::vec3 & cameraPosition,
+                         const EmitterLODSettings & settings, unsigned int & frames){
+
+	emitter.lod = chooseEmitterLOD(currentBounds(emitter, delta), frustum, cameraPosition, settings);
+	emitter.pendingTime += delta;
+	emitter.pendingFrames++;
+
+	// Off screen, the emitter catches up once in a while, or as soon as it is seen again
+	if (!emitter.lod.visible && emitter.pendingFrames < settings.hiddenTickInterval) {
+		frames = 0;
+		return 0.0;
+	}
+
+	double time = emitter.pendingTime;
+	frames = emitter.pendingFrames;
+	emitter.pendingTime = 0.0;
+	emitter.pendingFrames = 0;
+	clearBounds(emitter.particleBounds);
+	emitter.maxSpeed = 0.0f;
+	return time;
+}
+
+void addEmitterParticle(EmitterState & emitter, const glm::vec3 & position, float radius, const glm::vec3 & speed){
+	growBounds(emitter.particleBounds, position, radius);
+	float speed2 = glm::dot(speed, speed);
+	if (speed2 > emitter.maxSpeed * emitter.maxSpeed)
+		emitter.maxSpeed = sqrtf(speed2);
+}
+
+static bool near(float a, float b){
+	return fabsf(a - b) <= 1e-4f * (1.0f + fabsf(b));
+}
+
+// A box of `radius` around `center`
+static EmitterBounds checkBounds(const glm::vec3 & center, float radius){
+	EmitterBounds bounds;
+	clearBounds(bounds);
+	growBounds(bounds, center, radius);
+	return bounds;
+}
+
+size_t checkEmitterLOD(){
+
+	// A camera at the origin looking down -z, 90 degrees wide, with the LOD settings of the demo
+	glm::mat4 viewProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f)
+		* glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum;
+	extractFrustum(viewProjection, frustum);
+	glm::vec3 camera(0.0f, 0.0f, 0.0f);
+	const EmitterLODSettings Settings = { 20.0f, 60.0f, 0.25f, 4 };
+	size_t errors = 0;
+
+	// In view and close : visible, full detail
+	EmitterLOD lod = chooseEmitterLOD(checkBounds(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f), frustum, camera, Settings);
+	errors += !lod.visible || !near(lod.distance, 9.0f) || !near(lod.spawnScale, 1.0f) || !near(lod.sizeScale, 1.0f);
+	// Behind the camera, and empty : not visible
+	errors += chooseEmitterLOD(checkBounds(glm::vec3(0.0f, 0.0f, 10.0f), 1.0f), frustum, camera, Settings).visible;
+	EmitterBounds empty;
+	clearBounds(empty);
+	errors += chooseEmitterLOD(empty, frustum, camera, Settings).visible;
+
+	// Fewer, bigger particles from 20 to 60 units, linearly, then no fewer
+	const float Distances[] = { 5.0f, 20.0f, 30.0f, 40.0f, 60.0f, 90.0f };
+	for (size_t i = 0; i < sizeof(Distances) / sizeof(Distances[0]); i++) {
+		float t = glm::clamp((Distances[i] - 20.0f) / 40.0f, 0.0f, 1.0f);
+		float detail = 1.0f + (0.25f - 1.0f) * t;
+		lod = chooseEmitterLOD(checkBounds(glm::vec3(0.0f, 0.0f, -Distances[i]), 0.0f), frustum, camera, Settings);
+		errors += !near(lod.distance, Distances[i]) || !near(lod.spawnScale, detail) || !near(lod.sizeScale, 1.0f / sqrtf(detail));
+	}
+
+	// Behind the camera, asleep until the interval is up, then one catch up with all the time since
+	const double Delta = 1.0 / 60.0;
+	EmitterState emitter;
+	initEmitterState(emitter, checkBounds(glm::vec3(0.0f, 0.0f, 10.0f), 1.0f), 0.0f);
+	for (int round = 0; round < 2; round++) {
+		for (unsigned int frame = 1; frame <= Settings.hiddenTickInterval; frame++) {
+			unsigned int frames = 0;
+			double time = beginEmitterFrame(emitter, Delta, frustum, camera, Settings, frames);
+			bool catchUp = frame == Settings.hiddenTickInterval;
+			errors += catchUp ? (frames != frame || !near((float)time, (float)(frame * Delta))) : (frames != 0 || time != 0.0);
+		}
+	}
+	// Seen again, it catches up right away, then steps every frame
+	unsigned int frames = 0;
+	beginEmitterFrame(emitter, Delta, frustum, camera, Settings, frames);
+	emitter.spawnBounds = checkBounds(glm::vec3(0.0f, 0.0f, -10.0f), 1.0f);
+	double time = beginEmitterFrame(emitter, Delta, frustum, camera, Settings, frames);
+	errors += frames != 2 || !near((float)time, (float)(2 * Delta));
+	time = beginEmitterFrame(emitter, Delta, frustum, camera, Settings, frames);
+	errors += frames != 1 || !near((float)time, (float)Delta);
+
+	// The bounds grow by how far the fastest particle can have gone : maxSpeed t + a t^2 / 2,
+	// t counting the frames it slept through
+	initEmitterState(emitter, empty, 2.0f);
+	addEmitterParticle(emitter, glm::vec3(0.0f, 0.0f, 10.0f), 0.0f, glm::vec3(3.0f, 0.0f, 0.0f));
+	addEmitterParticle(emitter, glm::vec3(0.0f, 0.0f, 10.0f), 0.0f, glm::vec3(0.0f, -1.0f, 0.0f));
+	for (int asleep = 0; asleep < 2; asleep++) {
+		if (asleep)
+			errors += beginEmitterFrame(emitter, Delta, frustum, camera, Settings, frames) != 0.0;
+		float t = 0.5f + asleep * (float)Delta;
+		float travel = 3.0f * t + 0.5f * 2.0f * t * t;
+		EmitterBounds bounds = currentBounds(emitter, 0.5);
+		errors += !near(bounds.minimum.x, -travel) || !near(bounds.maximum.y, travel)
+			|| !near(bounds.minimum.z, 10.0f - travel) || !near(bounds.maximum.z, 10.0f + travel);
+	}
+
+	printf("Emitter LOD : %u errors with synthetic cameras\n", (unsigned int)errors);
+	return errors;
+}
@@ -0,0 +1,65 @@
+#ifndef EMITTERLOD_HPP
+#define EMITTERLOD_HPP
+
+struct Frustum;
+
+// Axis aligned box around everything an emitter may draw. Empty when minimum > maximum.
+struct EmitterBounds {
+	glm::vec3 minimum;
+	glm::vec3 maximum;
+};
+
+void clearBounds(EmitterBounds & bounds);
+bool boundsEmpty(const EmitterBounds & bounds);
+void growBounds(EmitterBounds & bounds, const glm::vec3 & center, float radius);
+void mergeBounds(EmitterBounds & bounds, const EmitterBounds & other);
+// Distance from the point to the box, 0 inside
+float boundsDistance(const EmitterBounds & bounds, const glm::vec3 & point);
+
+struct EmitterLODSettings {
+	float fullDetailDistance;        // Closer than this, the emitter spawns everything
+	float lowDetailDistance;         // From here on, it spawns minimumSpawnScale of its particles
+	float minimumSpawnScale;
+	unsigned int hiddenTickInterval; // Off screen, simulate once every this many frames
+};
+
+// What an emitter should do this frame
+struct EmitterLOD {
+	bool visible;
+	float distance;
+	float spawnScale; // Fraction of the particles to spawn ...
+	float sizeScale;  // ... and how much bigger they are, to cover about the same area
+};
+
+// Pure function of the bounds and the camera, no GL : can be evaluated for any camera
+EmitterLOD chooseEmitterLOD(const EmitterBounds & bounds, const Frustum & frustum, const glm::vec3 & cameraPosition,
+                            const EmitterLODSettings & settings);
+
+// What is kept of an emitter from one frame to the next
+struct EmitterState {
+	EmitterBounds spawnBounds;    // Where its particles are born
+	EmitterBounds particleBounds; // Its live particles, as of the last simulated frame
+	float maxSpeed;               // Of its particles, as of the last simulated frame
+	float acceleration;           // The constant acceleration of its particles
+	double pendingTime;           // Not simulated yet
+	unsigned int pendingFrames;
+	EmitterLOD lod;
+};
+
+void initEmitterState(EmitterState & emitter, const EmitterBounds & spawnBounds, float acceleration);
+
+// Bounds covering every particle as of now, even after frames without simulation
+EmitterBounds currentBounds(const EmitterState & emitter, double delta);
+
+// Chooses the LOD for this frame. Returns the time to simulate now, 0 if the emitter sleeps this frame;
+// `frames` is how many frames that time covers. When it returns more than 0, the caller simulates and
+// reports every live particle with addEmitterParticle().
+double beginEmitterFrame(EmitterState & emitter, double delta, const Frustum & frustum, const glm::vec3 & cameraPosition,
+                         const EmitterLODSettings & settings, unsigned int & frames);
+void addEmitterParticle(EmitterState & emitter, const glm::vec3 & position, float radius, const glm::vec3 & speed);
+
+// Runs the policy against a synthetic camera : in view, behind, the distance ramp, sleeping and
+// catching up, the bounds growing. Returns the errors found.
+size_t checkEmitterLOD();
+
+#endif
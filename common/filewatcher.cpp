@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "filewatcher.hpp"
+
+struct WatchedFile {
+	std::string path;       // As given to watchFile
+	std::string directory;
+	std::string name;
+	FileChangedCallback callback;
+	void * user;
+	time_t modificationTime; // Polling fallback only
+	bool dirty;
+	std::chrono::steady_clock::time_point lastEvent;
+};
+
+struct WatchedDirectory {
+	std::string path;
+	int descriptor;
+};
+
+// Editors save in several steps (truncate, write, rename...) : wait until the file is quiet
+static const std::chrono::milliseconds FileWatcherSettleTime(100);
+
+static std::thread FileWatcherThread;
+static std::atomic<bool> FileWatcherRunning(false);
+static std::mutex FileWatcherMutex;
+static std::vector<WatchedFile> WatchedFiles;
+static std::vector<WatchedDirectory> WatchedDirectories;
+static int FileWatcherDescriptor = -1;
+
+static time_t modificationTime(const char * path){
+	struct stat info;
+	if (stat(path, &info) != 0)
+		return 0;
+	return info.st_mtime;
+}
+
+static void splitPath(const std::string & path, std::string & directory, std::string & name){
+	size_t slash = path.find_last_of("/\\");
+	if (slash == std::string::npos) {
+		directory = ".";
+		name = path;
+	} else {
+		directory = path.substr(0, slash);
+		name = path.substr(slash + 1);
+	}
+}
+
+// Marks the files matching a directory event. FileWatcherMutex must be held.
+static void markDirty(const std::string & directory, const char * name){
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < WatchedFiles.size(); i++) {
+		if (WatchedFiles[i].directory == directory && WatchedFiles[i].name == name) {
+			WatchedFiles[i].dirty = true;
+			WatchedFiles[i].lastEvent = now;
+		}
+	}
+}
+
+#ifdef __linux__
+static void readEvents(){
+
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length = read(FileWatcherDescriptor, buffer, sizeof(buffer));
+	if (length <= 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(FileWatcherMutex);
+	for (char * pointer = buffer; pointer < buffer + length; ) {
+		struct inotify_event * event = (struct inotify_event *)pointer;
+		pointer += sizeof(struct inotify_event) + event->len;
+		if (event->len == 0)
+			continue;
+		for (size_t i = 0; i < WatchedDirectories.size(); i++) {
+			if (WatchedDirectories[i].descriptor == event->wd)
+				markDirty(WatchedDirectories[i].path, event->name);
+		}
+	}
+}
+#endif
+
+static void pollModificationTimes(){
+	std::lock_guard<std::mutex> lock(FileWatcherMutex);
+	for (size_t i = 0; i < WatchedFiles.size(); i++) {
+		time_t current = modificationTime(WatchedFiles[i].path.c_str());
+		if (current != 0 && current != WatchedFiles[i].modificationTime) {
+			WatchedFiles[i].modificationTime = current;
+			markDirty(WatchedFiles[i].directory, WatchedFiles[i].name.c_str());
+		}
+	}
+}
+
+static void fileWatcherLoop(){
+
+	while (FileWatcherRunning) {
+
+#ifdef __linux__
+		if (FileWatcherDescriptor >= 0) {
+			struct pollfd descriptor = { FileWatcherDescriptor, POLLIN, 0 };
+			if (poll(&descriptor, 1, 50) > 0)
+				readEvents();
+		} else
+#endif
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(250));
+			pollModificationTimes();
+		}
+
+		// Collect the settled files, then call back without holding the lock
+		std::vector<WatchedFile> settled;
+		{
+			std::lock_guard<std::mutex> lock(FileWatcherMutex);
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			for (size_t i = 0; i < WatchedFiles.size(); i++) {
+				if (WatchedFiles[i].dirty && now - WatchedFiles[i].lastEvent >= FileWatcherSettleTime) {
+					WatchedFiles[i].dirty = false;
+					settled.push_back(WatchedFiles[i]);
+				}
+			}
+		}
+		for (size_t i = 0; i < settled.size(); i++)
+			settled[i].callback(settled[i].path.c_str(), settled[i].user);
+	}
+}
+
+void startFileWatcher(){
+
+	if (FileWatcherRunning)
+		return;
+
+#ifdef __linux__
+	FileWatcherDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (FileWatcherDescriptor < 0)
+		printf("inotify is not available, polling the watched files instead\n");
+#endif
+
+	FileWatcherRunning = true;
+	FileWatcherThread = std::thread(fileWatcherLoop);
+}
+
+void watchFile(const char * path, FileChangedCallback callback, void * user){
+
+	WatchedFile file;
+	file.path = path;
+	splitPath(file.path, file.directory, file.name);
+	file.callback = callback;
+	file.user = user;
+	file.modificationTime = modificationTime(path);
+	file.dirty = false;
+
+	std::lock_guard<std::mutex> lock(FileWatcherMutex);
+	WatchedFiles.push_back(file);
+
+#ifdef __linux__
+	// inotify watches directories, so that files replaced by a rename are still seen
+	if (FileWatcherDescriptor >= 0) {
+		for (size_t i = 0; i < WatchedDirectories.size(); i++) {
+			if (WatchedDirectories[i].path == file.directory)
+				return;
+		}
+		WatchedDirectory directory;
+		directory.path = file.directory;
+		directory.descriptor = inotify_add_watch(FileWatcherDescriptor, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		if (directory.descriptor < 0)
+			printf("Impossible to watch %s\n", file.directory.c_str());
+		else
+			WatchedDirectories.push_back(directory);
+	}
+#endif
+}
+
+void stopFileWatcher(){
+
+	if (!FileWatcherRunning)
+		return;
+
+	FileWatcherRunning = false;
+	FileWatcherThread.join();
+
+#ifdef __linux__
+	if (FileWatcherDescriptor >= 0)
+		close(FileWatcherDescriptor);
+	FileWatcherDescriptor = -1;
+#endif
+
+	WatchedFiles.clear();
+	WatchedDirectories.clear();
+}
@@ -0,0 +1,12 @@
+#ifndef FILEWATCHER_HPP
+#define FILEWATCHER_HPP
+
+// Called on the watcher thread, once a burst of writes to the file has settled
+typedef void (*FileChangedCallback)(const char * path, void * user);
+
+// Uses inotify on Linux and falls back to polling the modification times elsewhere
+void startFileWatcher();
+void watchFile(const char * path, FileChangedCallback callback, void * user);
+void stopFileWatcher();
+
+#endif
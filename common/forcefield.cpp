@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "forcefield.hpp"
+
+// Attractors are at least this wide, so that their pull stays finite
+#define FORCE_MIN_RADIUS 0.001f
+
+// Unit gradients of the lattice : the edges of a cube, as in Perlin's improved noise
+static const float Gradients[12][3] = {
+	{ 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+	{ 1, 0, 1 }, { -1, 0, 1 }, { 1, 0, -1 }, { -1, 0, -1 },
+	{ 0, 1, 1 }, { 0, -1, 1 }, { 0, 1, -1 }, { 0, -1, -1 }
+};
+
+static int wrap(int i, int period){
+	i %= period;
+	return i < 0 ? i + period : i;
+}
+
+static const float * latticeGradient(int x, int y, int z, int period, unsigned int seed){
+	unsigned int h = seed;
+	h ^= (unsigned int)wrap(x, period) * 0x8da6b343u;
+	h ^= (unsigned int)wrap(y, period) * 0xd8163841u;
+	h ^= (unsigned int)wrap(z, period) * 0xcb1ab31fu;
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	return Gradients[h % 12];
+}
+
+static float fade(float t){
+	return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+// Gradient noise, repeating every `period` units on each axis
+static float gradientNoise(float x, float y, float z, int period, unsigned int seed){
+	int x0 = (int)floorf(x), y0 = (int)floorf(y), z0 = (int)floorf(z);
+	float fx = x - x0, fy = y - y0, fz = z - z0;
+
+	float corners[8];
+	for (int c = 0; c < 8; c++) {
+		int dx = c & 1, dy = (c >> 1) & 1, dz = (c >> 2) & 1;
+		const float * g = latticeGradient(x0 + dx, y0 + dy, z0 + dz, period, seed);
+		corners[c] = g[0] * (fx - dx) + g[1] * (fy - dy) + g[2] * (fz - dz);
+	}
+
+	float u = fade(fx), v = fade(fy), w = fade(fz);
+	float x00 = corners[0] + (corners[1] - corners[0]) * u;
+	float x10 = corners[2] + (corners[3] - corners[2]) * u;
+	float x01 = corners[4] + (corners[5] - corners[4]) * u;
+	float x11 = corners[6] + (corners[7] - corners[6]) * u;
+	float y0v = x00 + (x10 - x00) * v;
+	float y1v = x01 + (x11 - x01) * v;
+	return y0v + (y1v - y0v) * w;
+}
+
+void bakeCurlNoise(CurlNoiseVolume & volume, const glm::vec3 & origin, float size, int resolution, int frequency, unsigned int seed){
+
+	if (resolution < 2)
+		resolution = 2;
+	if (frequency < 1)
+		frequency = 1;
+	size_t n = (size_t)resolution;
+	size_t sampleCount = n * n * n;
+
+	volume.origin = origin;
+	volume.cellSize = size / resolution;
+	volume.resolution = resolution;
+
+	// The potential : three independent noises
+	std::vector<float> potential[3];
+	for (int c = 0; c < 3; c++) {
+		potential[c].resize(sampleCount);
+		for (size_t k = 0; k < n; k++)
+			for (size_t j = 0; j < n; j++)
+				for (size_t i = 0; i < n; i++) {
+					float scale = (float)frequency / resolution;
+					potential[c][(k * n + j) * n + i] = gradientNoise(i * scale, j * scale, k * scale, frequency, seed + c * 0x9e3779b9u);
+				}
+	}
+
+	// Its curl, with central differences around the wrapped grid
+	volume.x.resize(sampleCount);
+	volume.y.resize(sampleCount);
+	volume.z.resize(sampleCount);
+	double sumSquares = 0.0;
+	for (int k = 0; k < resolution; k++)
+		for (int j = 0; j < resolution; j++)
+			for (int i = 0; i < resolution; i++) {
+				size_t xp = (k * n + j) * n + wrap(i + 1, resolution), xm = (k * n + j) * n + wrap(i - 1, resolution);
+				size_t yp = (k * n + wrap(j + 1, resolution)) * n + i, ym = (k * n + wrap(j - 1, resolution)) * n + i;
+				size_t zp = (wrap(k + 1, resolution) * n + j) * n + i, zm = (wrap(k - 1, resolution) * n + j) * n + i;
+				const std::vector<float> & px = potential[0], & py = potential[1], & pz = potential[2];
+				size_t index = (k * n + j) * n + i;
+				volume.x[index] = (pz[yp] - pz[ym]) - (py[zp] - py[zm]);
+				volume.y[index] = (px[zp] - px[zm]) - (pz[xp] - pz[xm]);
+				volume.z[index] = (py[xp] - py[xm]) - (px[yp] - px[ym]);
+				sumSquares += volume.x[index] * volume.x[index] + volume.y[index] * volume.y[index] + volume.z[index] * volume.z[index];
+			}
+
+	// Average magnitude 1 (root mean square), so that the strength of the field is easy to pick
+	float scale = sumSquares > 0.0 ? (float)(1.0 / sqrt(sumSquares / sampleCount)) : 0.0f;
+	volume.maxMagnitude = 0.0f;
+	for (size_t i = 0; i < sampleCount; i++) {
+		volume.x[i] *= scale;
+		volume.y[i] *= scale;
+		volume.z[i] *= scale;
+		float magnitude = sqrtf(volume.x[i] * volume.x[i] + volume.y[i] * volume.y[i] + volume.z[i] * volume.z[i]);
+		if (magnitude > volume.maxMagnitude)
+			volume.maxMagnitude = magnitude;
+	}
+}
+
+glm::vec3 sampleCurlNoise(const CurlNoiseVolume & volume, const glm::vec3 & position){
+
+	int n = volume.resolution;
+	glm::vec3 cell = (position - volume.origin) * (1.0f / volume.cellSize);
+	int i0 = (int)floorf(cell.x), j0 = (int)floorf(cell.y), k0 = (int)floorf(cell.z);
+	float fx = cell.x - i0, fy = cell.y - j0, fz = cell.z - k0;
+	int i1 = wrap(i0 + 1, n), j1 = wrap(j0 + 1, n), k1 = wrap(k0 + 1, n);
+	i0 = wrap(i0, n);
+	j0 = wrap(j0, n);
+	k0 = wrap(k0, n);
+
+	size_t corners[8] = {
+		((size_t)k0 * n + j0) * n + i0, ((size_t)k0 * n + j0) * n + i1,
+		((size_t)k0 * n + j1) * n + i0, ((size_t)k0 * n + j1) * n + i1,
+		((size_t)k1 * n + j0) * n + i0, ((size_t)k1 * n + j0) * n + i1,
+		((size_t)k1 * n + j1) * n + i0, ((size_t)k1 * n + j1) * n + i1
+	};
+	float weights[8] = {
+		(1 - fx) * (1 - fy) * (1 - fz), fx * (1 - fy) * (1 - fz),
+		(1 - fx) * fy * (1 - fz),       fx * fy * (1 - fz),
+		(1 - fx) * (1 - fy) * fz,       fx * (1 - fy) * fz,
+		(1 - fx) * fy * fz,             fx * fy * fz
+	};
+
+	glm::vec3 result(0.0f, 0.0f, 0.0f);
+	for (int c = 0; c < 8; c++) {
+		result.x += volume.x[corners[c]] * weights[c];
+		result.y += volume.y[corners[c]] * weights[c];
+		result.z += volume.z[corners[c]] * weights[c];
+	}
+	return result;
+}
+
+ForceField uniformField(const glm::vec3 & acceleration){
+	ForceField field = { FORCE_UNIFORM, acceleration, 0.0f, 0.0f, NULL };
+	return field;
+}
+
+ForceField attractorField(const glm::vec3 & center, float strength, float radius){
+	ForceField field = { FORCE_ATTRACTOR, center, strength, radius > FORCE_MIN_RADIUS ? radius : FORCE_MIN_RADIUS, NULL };
+	return field;
+}
+
+ForceField curlNoiseField(const CurlNoiseVolume * noise, float strength){
+	ForceField field = { FORCE_CURL_NOISE, glm::vec3(0.0f, 0.0f, 0.0f), strength, 0.0f, noise };
+	return field;
+}
+
+void clearForceFields(ForceFieldSet & set){
+	set.count = 0;
+}
+
+bool addForceField(ForceFieldSet & set, const ForceField & field){
+	if (set.count >= FORCE_FIELD_MAX) {
+		printf("Too many force fields, at most %d per emitter\n", FORCE_FIELD_MAX);
+		return false;
+	}
+	set.fields[set.count++] = field;
+	return true;
+}
+
+glm::vec3 forceFieldAcceleration(const ForceFieldSet & set, const glm::vec3 & position){
+
+	glm::vec3 acceleration(0.0f, 0.0f, 0.0f);
+	for (unsigned int f = 0; f < set.count; f++) {
+		const ForceField & field = set.fields[f];
+		switch (field.type) {
+		case FORCE_UNIFORM:
+			acceleration += field.vector;
+			break;
+		case FORCE_ATTRACTOR: {
+			// Softened like a Plummer sphere : strength / distance^2 far away, 0 at the center
+			glm::vec3 toCenter = field.vector - position;
+			float softened = glm::dot(toCenter, toCenter) + field.radius * field.radius;
+			acceleration += toCenter * (field.strength / (softened * sqrtf(softened)));
+			break;
+		}
+		case FORCE_CURL_NOISE:
+			acceleration += sampleCurlNoise(*field.noise, position) * field.strength;
+			break;
+		}
+	}
+	return acceleration;
+}
+
+float maxForceFieldAcceleration(const ForceFieldSet & set){
+
+	float total = 0.0f;
+	for (unsigned int f = 0; f < set.count; f++) {
+		const ForceField & field = set.fields[f];
+		switch (field.type) {
+		case FORCE_UNIFORM:
+			total += glm::length(field.vector);
+			break;
+		case FORCE_ATTRACTOR:
+			// Strongest at radius / sqrt(2)
+			total += fabsf(field.strength) * 0.3849f / (field.radius * field.radius);
+			break;
+		case FORCE_CURL_NOISE:
+			total += fabsf(field.strength) * field.noise->maxMagnitude;
+			break;
+		}
+	}
+	return total;
+}
@@ -0,0 +1,54 @@
+#ifndef FORCEFIELD_HPP
+#define FORCEFIELD_HPP
+
+#include <vector>
+
+// Curl of a noise potential, baked once into a grid of samples. Divergence free, so particles
+// swirl around without bunching up or thinning out. The noise is periodic over the grid, and the
+// grid repeats over all of space.
+struct CurlNoiseVolume {
+	glm::vec3 origin;
+	float cellSize;
+	int resolution;             // Samples per axis
+	float maxMagnitude;         // Of the samples, which are scaled to an average magnitude of 1
+	std::vector<float> x, y, z; // Samples, x fastest
+};
+
+// `frequency` is how many noise features fit across the grid, per axis
+void bakeCurlNoise(CurlNoiseVolume & volume, const glm::vec3 & origin, float size, int resolution, int frequency, unsigned int seed);
+// Trilinear interpolation of the 8 samples around the position
+glm::vec3 sampleCurlNoise(const CurlNoiseVolume & volume, const glm::vec3 & position);
+
+enum ForceFieldType {
+	FORCE_UNIFORM,   // The same acceleration everywhere : gravity, wind
+	FORCE_ATTRACTOR, // Towards a point, falling with the square of the distance past `radius`
+	FORCE_CURL_NOISE // Turbulence
+};
+
+struct ForceField {
+	ForceFieldType type;
+	glm::vec3 vector; // Uniform : the acceleration. Attractor : its center.
+	float strength;   // Attractor : acceleration at distance 1. Curl noise : average acceleration. Negative repels.
+	float radius;     // Attractor : below this distance, the pull fades instead of growing without bound
+	const CurlNoiseVolume * noise;
+};
+
+ForceField uniformField(const glm::vec3 & acceleration);
+ForceField attractorField(const glm::vec3 & center, float strength, float radius);
+ForceField curlNoiseField(const CurlNoiseVolume * noise, float strength);
+
+// The fields acting on the particles of an emitter, summed
+#define FORCE_FIELD_MAX 8
+struct ForceFieldSet {
+	ForceField fields[FORCE_FIELD_MAX];
+	unsigned int count;
+};
+
+void clearForceFields(ForceFieldSet & set);
+bool addForceField(ForceFieldSet & set, const ForceField & field);
+
+glm::vec3 forceFieldAcceleration(const ForceFieldSet & set, const glm::vec3 & position);
+// Upper bound of forceFieldAcceleration's length, anywhere
+float maxForceFieldAcceleration(const ForceFieldSet & set);
+
+#endif
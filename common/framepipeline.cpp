@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+#include "profiler.hpp"
+#include "framepipeline.hpp"
+
+enum SlotState {
+	SLOT_FREE,      // With the consumer
+	SLOT_REQUESTED, // Waiting for the producer
+	SLOT_READY      // Filled, not waited for yet
+};
+
+static FrameProducer Producer;
+static bool Pipelined = false;
+static bool Stopping = false;
+static std::thread PipelineThread;
+static std::mutex PipelineMutex;
+static std::condition_variable SlotRequested;
+static std::condition_variable SlotReady;
+static SlotState Slots[FRAME_PIPELINE_SLOTS];
+static std::deque<unsigned int> Requests;
+
+static void pipelineLoop(){
+	setProfilerThreadName("Simulation");
+	for (;;) {
+		unsigned int slot;
+		{
+			std::unique_lock<std::mutex> lock(PipelineMutex);
+			SlotRequested.wait(lock, [](){ return Stopping || !Requests.empty(); });
+			if (Requests.empty())
+				return; // Stopping, and nothing left to make
+			slot = Requests.front();
+			Requests.pop_front();
+		}
+
+		Producer(slot);
+
+		std::lock_guard<std::mutex> lock(PipelineMutex);
+		Slots[slot] = SLOT_READY;
+		SlotReady.notify_all();
+	}
+}
+
+void startFramePipeline(const FrameProducer & producer, bool pipelined){
+	Producer = producer;
+	Pipelined = pipelined;
+	Stopping = false;
+	Requests.clear();
+	for (int i = 0; i < FRAME_PIPELINE_SLOTS; i++)
+		Slots[i] = SLOT_FREE;
+	if (Pipelined)
+		PipelineThread = std::thread(pipelineLoop);
+}
+
+bool framePipelined(){
+	return Pipelined;
+}
+
+void requestPipelineFrame(unsigned int slot){
+	if (slot >= FRAME_PIPELINE_SLOTS)
+		return;
+
+	std::unique_lock<std::mutex> lock(PipelineMutex);
+	if (Slots[slot] != SLOT_FREE) {
+		printf("Frame pipeline : slot %u requested again before it was waited for\n", slot);
+		return;
+	}
+
+	if (!Pipelined) {
+		lock.unlock();
+		Producer(slot);
+		Slots[slot] = SLOT_READY;
+		return;
+	}
+
+	Slots[slot] = SLOT_REQUESTED;
+	Requests.push_back(slot);
+	SlotRequested.notify_one();
+}
+
+void waitPipelineFrame(unsigned int slot){
+	if (slot >= FRAME_PIPELINE_SLOTS)
+		return;
+
+	std::unique_lock<std::mutex> lock(PipelineMutex);
+	if (Slots[slot] == SLOT_FREE)
+		return; // Never requested
+	SlotReady.wait(lock, [slot](){ return Slots[slot] == SLOT_READY; });
+	Slots[slot] = SLOT_FREE;
+}
+
+void stopFramePipeline(){
+	if (PipelineThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(PipelineMutex);
+			Stopping = true;
+			SlotRequested.notify_one();
+		}
+		PipelineThread.join();
+	}
+	Producer = FrameProducer();
+	Pipelined = false;
+}
+
+size_t checkFramePipeline(){
+
+	size_t errors = 0;
+	for (int pipelined = 0; pipelined < 2; pipelined++) {
+
+		// The stub producer : each slot's output is its input, and who made it, in what order
+		int input[FRAME_PIPELINE_SLOTS] = { 0 }, output[FRAME_PIPELINE_SLOTS] = { 0 };
+		std::thread::id maker[FRAME_PIPELINE_SLOTS];
+		std::vector<unsigned int> made;
+		startFramePipeline([&](unsigned int slot){
+			output[slot] = input[slot];
+			maker[slot] = std::this_thread::get_id();
+			made.push_back(slot); // Only the producer's thread writes it, and it is read after a wait
+		}, pipelined != 0);
+
+		// Like the frame loop : request one slot, draw the other. Pipelined, a frame is drawn one frame late.
+		const int Frames = 100;
+		for (int frame = 0; frame < Frames; frame++) {
+			unsigned int slot = frame % FRAME_PIPELINE_SLOTS;
+			input[slot] = frame;
+			requestPipelineFrame(slot);
+			unsigned int drawSlot = pipelined ? (slot + 1) % FRAME_PIPELINE_SLOTS : slot;
+			int drawnFrame = pipelined ? frame - 1 : frame;
+			waitPipelineFrame(drawSlot);
+			if (drawnFrame < 0)
+				continue;
+			errors += output[drawSlot] != drawnFrame;
+			errors += (maker[drawSlot] == std::this_thread::get_id()) != !pipelined;
+		}
+		waitPipelineFrame((Frames - 1) % FRAME_PIPELINE_SLOTS);
+
+		// Slots made in the order they were requested
+		errors += made.size() != (size_t)Frames;
+		for (size_t i = 0; i < made.size(); i++)
+			errors += made[i] != i % FRAME_PIPELINE_SLOTS;
+
+		// A slot requested again before it was waited for is made once
+		made.clear();
+		requestPipelineFrame(0);
+		requestPipelineFrame(0);
+		waitPipelineFrame(0);
+		errors += made.size() != 1;
+
+		// Stopping finishes what was requested
+		made.clear();
+		input[0] = 1000;
+		input[1] = 1001;
+		requestPipelineFrame(0);
+		requestPipelineFrame(1);
+		stopFramePipeline();
+		errors += made.size() != 2 || output[0] != 1000 || output[1] != 1001;
+	}
+
+	printf("Frame pipeline : %u errors, with and without pipelining\n", (unsigned int)errors);
+	return errors;
+}
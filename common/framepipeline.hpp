@@ -0,0 +1,30 @@
+#ifndef FRAMEPIPELINE_HPP
+#define FRAMEPIPELINE_HPP
+
+#include <functional>
+
+// Frames made in two stages. The producer fills a staging slot (simulate, sort, pack) on the
+// pipeline's own thread while the GL thread draws the other slot : frame N+1 is made while frame N
+// is drawn, one frame of latency. Without pipelining, the producer runs on the calling thread, and
+// each frame is drawn right after it is made.
+// Nothing here touches GL : any consumer can drive it, a fake renderer as well as the real one.
+#define FRAME_PIPELINE_SLOTS 2
+
+typedef std::function<void(unsigned int slot)> FrameProducer;
+
+void startFramePipeline(const FrameProducer & producer, bool pipelined);
+bool framePipelined();
+// Has `slot` filled : queued for the pipeline's thread, or right here without pipelining.
+// The caller writes the input of the slot first, and does not touch the slot until it waited for it.
+void requestPipelineFrame(unsigned int slot);
+// Returns once `slot` is filled, and hands it over to the caller until it is requested again
+void waitPipelineFrame(unsigned int slot);
+// Finishes the frames requested, then stops the thread
+void stopFramePipeline();
+
+// Drives the pipeline with a stub producer, with and without its thread : order of the slots, one
+// frame of latency, slots requested twice, frames left at stop. Not while the pipeline runs.
+// Returns the errors found.
+size_t checkFramePipeline();
+
+#endif
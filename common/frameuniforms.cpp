@@ -0,0 +1,48 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "frameuniforms.hpp"
+
+GLuint FrameUniformBufferID;
+
+void initFrameUniforms(){
+
+	glGenBuffers(1, &FrameUniformBufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, FrameUniformBufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// The binding point never changes, so it is attached once and for all
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, FrameUniformBufferID);
+}
+
+void updateFrameUniforms(const FrameUniforms & frame){
+
+	glBindBuffer(GL_UNIFORM_BUFFER, FrameUniformBufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_STREAM_DRAW); // Buffer orphaning, the previous frame may still be in flight
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void bindFrameUniforms(GLuint programID){
+
+	// The block is optional : programs like the text one only need their own uniforms
+	GLuint blockIndex = glGetUniformBlockIndex(programID, "FrameData");
+	if (blockIndex == GL_INVALID_INDEX)
+		return;
+
+	GLint blockSize = 0;
+	glGetActiveUniformBlockiv(programID, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &blockSize);
+	if (blockSize != (GLint)sizeof(FrameUniforms))
+		printf("FrameData block of program %u is %d bytes, expected %d\n", programID, blockSize, (int)sizeof(FrameUniforms));
+
+	glUniformBlockBinding(programID, blockIndex, FRAME_UNIFORMS_BINDING);
+}
+
+void cleanupFrameUniforms(){
+
+	glDeleteBuffers(1, &FrameUniformBufferID);
+}
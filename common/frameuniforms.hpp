@@ -0,0 +1,27 @@
+#ifndef FRAMEUNIFORMS_HPP
+#define FRAMEUNIFORMS_HPP
+
+// CPU mirror of the std140 "FrameData" uniform block declared in the shaders.
+// Only mat4 and vec4 members, so the C++ layout matches std140 without padding.
+struct FrameUniforms {
+	glm::mat4 V;
+	glm::mat4 P;
+	glm::mat4 VP;
+	glm::vec4 CameraRight_worldspace;
+	glm::vec4 CameraUp_worldspace;
+	glm::vec4 CameraPosition_worldspace;
+	glm::vec4 LightPosition_worldspace;
+};
+
+// Binding point shared by every program that declares FrameData
+#define FRAME_UNIFORMS_BINDING 0
+
+void initFrameUniforms();
+// Uploads the per-frame data once; every program bound with bindFrameUniforms() sees it.
+void updateFrameUniforms(const FrameUniforms & frame);
+// Connects the FrameData block of a program to the shared buffer. Call once after LoadShaders.
+// Programs that don't declare the block are left alone.
+void bindFrameUniforms(GLuint programID);
+void cleanupFrameUniforms();
+
+#endif
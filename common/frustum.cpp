@@ -0,0 +1,103 @@
+#include <math.h>
+#include <float.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <xmmintrin.h>
+#define FRUSTUM_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+void extractFrustum(const glm::mat4 & viewProjection, Frustum & frustum){
+
+	// glm is column major : row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	const glm::mat4 & m = viewProjection;
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+	glm::vec4 planes[6] = {
+		row[3] + row[0], // Left
+		row[3] - row[0], // Right
+		row[3] + row[1], // Bottom
+		row[3] - row[1], // Top
+		row[3] + row[2], // Near
+		row[3] - row[2], // Far
+	};
+
+	for (int i = 0; i < 6; i++) {
+		float length = glm::length(glm::vec3(planes[i]));
+		glm::vec4 plane = length > 0.0f ? planes[i] * (1.0f / length) : planes[i];
+		frustum.x[i] = plane.x;
+		frustum.y[i] = plane.y;
+		frustum.z[i] = plane.z;
+		frustum.w[i] = plane.w;
+	}
+	for (int i = 6; i < 8; i++) {
+		frustum.x[i] = frustum.y[i] = frustum.z[i] = 0.0f;
+		frustum.w[i] = FLT_MAX;
+	}
+}
+
+bool sphereInFrustum(const Frustum & frustum, const glm::vec3 & center, float radius){
+
+#ifdef FRUSTUM_SSE
+	// Signed distance to 4 planes at a time; outside as soon as one is below -radius
+	__m128 cx = _mm_set1_ps(center.x);
+	__m128 cy = _mm_set1_ps(center.y);
+	__m128 cz = _mm_set1_ps(center.z);
+	__m128 r = _mm_set1_ps(-radius);
+	__m128 outside = _mm_setzero_ps();
+	for (int i = 0; i < 8; i += 4) {
+		__m128 distance = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(frustum.x + i), cx), _mm_mul_ps(_mm_loadu_ps(frustum.y + i), cy)),
+			_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(frustum.z + i), cz), _mm_loadu_ps(frustum.w + i)));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, r));
+	}
+	return _mm_movemask_ps(outside) == 0;
+#else
+	for (int i = 0; i < 6; i++) {
+		float distance = frustum.x[i] * center.x + frustum.y[i] * center.y + frustum.z[i] * center.z + frustum.w[i];
+		if (distance < -radius)
+			return false;
+	}
+	return true;
+#endif
+}
+
+bool boxInFrustum(const Frustum & frustum, const glm::vec3 & minimum, const glm::vec3 & maximum){
+
+	// Only the corner furthest along each plane's normal matters : outside if even that one is behind it
+#ifdef FRUSTUM_SSE
+	__m128 zero = _mm_setzero_ps();
+	__m128 outside = _mm_setzero_ps();
+	for (int i = 0; i < 8; i += 4) {
+		__m128 nx = _mm_loadu_ps(frustum.x + i);
+		__m128 ny = _mm_loadu_ps(frustum.y + i);
+		__m128 nz = _mm_loadu_ps(frustum.z + i);
+		__m128 positiveX = _mm_cmpgt_ps(nx, zero);
+		__m128 positiveY = _mm_cmpgt_ps(ny, zero);
+		__m128 positiveZ = _mm_cmpgt_ps(nz, zero);
+		__m128 cornerX = _mm_or_ps(_mm_and_ps(positiveX, _mm_set1_ps(maximum.x)), _mm_andnot_ps(positiveX, _mm_set1_ps(minimum.x)));
+		__m128 cornerY = _mm_or_ps(_mm_and_ps(positiveY, _mm_set1_ps(maximum.y)), _mm_andnot_ps(positiveY, _mm_set1_ps(minimum.y)));
+		__m128 cornerZ = _mm_or_ps(_mm_and_ps(positiveZ, _mm_set1_ps(maximum.z)), _mm_andnot_ps(positiveZ, _mm_set1_ps(minimum.z)));
+		__m128 distance = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(nx, cornerX), _mm_mul_ps(ny, cornerY)),
+			_mm_add_ps(_mm_mul_ps(nz, cornerZ), _mm_loadu_ps(frustum.w + i)));
+		outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+	}
+	return _mm_movemask_ps(outside) == 0;
+#else
+	for (int i = 0; i < 6; i++) {
+		float distance = frustum.x[i] * (frustum.x[i] > 0.0f ? maximum.x : minimum.x)
+		               + frustum.y[i] * (frustum.y[i] > 0.0f ? maximum.y : minimum.y)
+		               + frustum.z[i] * (frustum.z[i] > 0.0f ? maximum.z : minimum.z)
+		               + frustum.w[i];
+		if (distance < 0.0f)
+			return false;
+	}
+	return true;
+#endif
+}
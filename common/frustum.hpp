@@ -0,0 +1,24 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+// The 6 planes of the camera's view volume, in world space.
+// A point p is inside plane i when x[i]*p.x + y[i]*p.y + z[i]*p.z + w[i] >= 0.
+// The planes are stored as columns so that 4 of them are tested with one SSE instruction;
+// the last two are padding that accepts everything.
+struct Frustum {
+	float x[8];
+	float y[8];
+	float z[8];
+	float w[8];
+};
+
+// From ProjectionMatrix * ViewMatrix (Gribb & Hartmann), planes normalized
+void extractFrustum(const glm::mat4 & viewProjection, Frustum & frustum);
+
+// Whether any part of the sphere may be visible. Conservative near the corners.
+bool sphereInFrustum(const Frustum & frustum, const glm::vec3 & center, float radius);
+
+// Whether any part of the axis aligned box may be visible. Conservative near the corners.
+bool boxInFrustum(const Frustum & frustum, const glm::vec3 & minimum, const glm::vec3 & maximum);
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+
+#include <GL/glew.h>
+
+#include "assetcache.hpp"
+#include "profiler.hpp"
+#include "text2D.hpp"
+
+#include "hud.hpp"
+
+// Frames kept in the graph, one bar each
+#define HUD_HISTORY 120
+#define HUD_TEXT_SIZE 12
+#define HUD_GRAPH_HEIGHT 60
+// The graph is full height at this frame time, in milliseconds
+#define HUD_GRAPH_SCALE 33.3
+
+static double FrameTimes[HUD_HISTORY]; // Milliseconds, ring buffer
+static int NextFrameTime = 0;
+
+static const unsigned char HUDTextColor[4]   = { 255, 255, 255, 255 };
+static const unsigned char HUDLabelColor[4]  = { 180, 220, 255, 255 };
+static const unsigned char HUDPanelColor[4]  = {   0,   0,   0, 160 };
+static const unsigned char HUDFastColor[4]   = {  80, 220,  80, 255 };
+static const unsigned char HUDSlowColor[4]   = { 240,  80,  60, 255 };
+static const unsigned char HUDTargetColor[4] = { 255, 255, 255, 120 };
+
+// Profiler scopes shown in the timings table
+struct HUDTimedScope {
+	const char * label;
+	const char * scope;
+};
+static const HUDTimedScope HUDTimedScopes[] = {
+	{ "smoke",  "Smoke simulate" },
+	{ "rain",   "Rain simulate" },
+	{ "sort",   "Particles sort" },
+	{ "upload", "Particles upload" },
+	{ "draw",   "Particles draw" },
+};
+#define HUD_TIMED_SCOPES (sizeof(HUDTimedScopes) / sizeof(HUDTimedScopes[0]))
+
+// "-" when the profiler has nothing for that name yet
+static void formatTime(char * text, size_t size, double milliseconds){
+	if (milliseconds < 0.0)
+		snprintf(text, size, "    -");
+	else
+		snprintf(text, size, "%5.2f", milliseconds);
+}
+
+void drawHUD(int screenWidth, int screenHeight, double frameTime,
+             const HUDEmitterStats * emitters, size_t emitterCount,
+             const AssetCacheStats & cacheStats){
+
+	double milliseconds = frameTime * 1000.0;
+	FrameTimes[NextFrameTime] = milliseconds;
+	NextFrameTime = (NextFrameTime + 1) % HUD_HISTORY;
+
+	double average = 0.0, worst = 0.0;
+	for (int i = 0; i < HUD_HISTORY; i++) {
+		average += FrameTimes[i];
+		if (FrameTimes[i] > worst)
+			worst = FrameTimes[i];
+	}
+	average /= HUD_HISTORY;
+
+	// Text goes down from the top left corner, y is up in text2D
+	int lines = 2 + 1 + (int)emitterCount + 1 + (int)HUD_TIMED_SCOPES + 2;
+	int width = 32 * HUD_TEXT_SIZE + 16; // The widest line, wider than the graph
+	int height = 8 + lines * HUD_TEXT_SIZE + HUD_GRAPH_HEIGHT + 4 * 4 + 8;
+	int left = 8;
+	// In a narrow window the panel stops at the right border, what does not fit is cut
+	if (width > screenWidth - 2 * left)
+		width = screenWidth - 2 * left > 0 ? screenWidth - 2 * left : 0;
+	int top = screenHeight - 8;
+	drawRect2D(left, top - height, width, height, HUDPanelColor);
+
+	int x = left + 8;
+	int y = top - 8 - HUD_TEXT_SIZE;
+	char text[128];
+
+	snprintf(text, sizeof(text), "%5.1f fps %5.2f ms", average > 0.0 ? 1000.0 / average : 0.0, average);
+	printText2D(text, x, y, HUD_TEXT_SIZE, HUDTextColor);
+	y -= HUD_TEXT_SIZE;
+	snprintf(text, sizeof(text), "worst %5.2f ms", worst);
+	printText2D(text, x, y, HUD_TEXT_SIZE, HUDLabelColor);
+	y -= HUD_TEXT_SIZE + 4;
+
+	// Frame time graph, oldest frame on the left. Bars over 16.6 ms are red.
+	int graphBottom = y - HUD_GRAPH_HEIGHT;
+	for (int i = 0; i < HUD_HISTORY; i++) {
+		double value = FrameTimes[(NextFrameTime + i) % HUD_HISTORY];
+		int bar = (int)(value / HUD_GRAPH_SCALE * HUD_GRAPH_HEIGHT);
+		if (bar > HUD_GRAPH_HEIGHT)
+			bar = HUD_GRAPH_HEIGHT;
+		if (bar < 1)
+			bar = 1;
+		drawRect2D(x + 2 * i, graphBottom, 2, bar, value > 1000.0 / 60.0 ? HUDSlowColor : HUDFastColor);
+	}
+	drawRect2D(x, graphBottom + (int)(1000.0 / 60.0 / HUD_GRAPH_SCALE * HUD_GRAPH_HEIGHT), 2 * HUD_HISTORY, 1, HUDTargetColor);
+	y = graphBottom - 4 - HUD_TEXT_SIZE;
+
+	// Live particles
+	snprintf(text, sizeof(text), "%-6s %6s %6s %6s %4s", "", "drawn", "culled", "max", "lod");
+	printText2D(text, x, y, HUD_TEXT_SIZE, HUDLabelColor);
+	y -= HUD_TEXT_SIZE;
+	for (size_t i = 0; i < emitterCount; i++) {
+		char detail[8];
+		if (emitters[i].asleep)
+			snprintf(detail, sizeof(detail), "off");
+		else
+			snprintf(detail, sizeof(detail), "%d%%", (int)(emitters[i].detail * 100.0f + 0.5f));
+		snprintf(text, sizeof(text), "%-6s %6d %6d %6d %4s", emitters[i].name, emitters[i].drawn, emitters[i].culled, emitters[i].capacity, detail);
+		printText2D(text, x, y, HUD_TEXT_SIZE, HUDTextColor);
+		y -= HUD_TEXT_SIZE;
+	}
+	y -= 4;
+
+	// Stage timings, smoothed by the profiler
+	snprintf(text, sizeof(text), "%-6s %5s  %5s", "ms", "cpu", "gpu");
+	printText2D(text, x, y, HUD_TEXT_SIZE, HUDLabelColor);
+	y -= HUD_TEXT_SIZE;
+	for (size_t i = 0; i < HUD_TIMED_SCOPES; i++) {
+		char cpu[16], gpu[16];
+		formatTime(cpu, sizeof(cpu), getProfileAverage(HUDTimedScopes[i].scope, PROFILE_CPU));
+		formatTime(gpu, sizeof(gpu), getProfileAverage(HUDTimedScopes[i].scope, PROFILE_GPU));
+		snprintf(text, sizeof(text), "%-6s %s  %s", HUDTimedScopes[i].label, cpu, gpu);
+		printText2D(text, x, y, HUD_TEXT_SIZE, HUDTextColor);
+		y -= HUD_TEXT_SIZE;
+	}
+	y -= 4;
+
+	// Asset memory
+	snprintf(text, sizeof(text), "video %6.1f MB", cacheStats.videoBytesResident / (1024.0 * 1024.0));
+	printText2D(text, x, y, HUD_TEXT_SIZE, HUDTextColor);
+	y -= HUD_TEXT_SIZE;
+	snprintf(text, sizeof(text), "system %5.1f MB", cacheStats.systemBytesResident / (1024.0 * 1024.0));
+	printText2D(text, x, y, HUD_TEXT_SIZE, HUDTextColor);
+}
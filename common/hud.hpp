@@ -0,0 +1,25 @@
+#ifndef HUD_HPP
+#define HUD_HPP
+
+#include <stddef.h>
+
+struct AssetCacheStats;
+
+// What one particle system reports to the HUD each frame
+struct HUDEmitterStats {
+	const char * name;
+	int drawn;    // Alive and in the frustum
+	int culled;   // Alive, simulated, but off screen
+	int capacity;
+	float detail; // Fraction of the particles it spawns at this distance
+	bool asleep;  // Off screen, simulated only once in a while
+};
+
+// Queues the overlay with text2D : frame time graph, particle counts, the timings of the
+// particle stages from the profiler and the asset memory. initText2D() must have been called.
+// Nothing is drawn until drawText2D().
+void drawHUD(int screenWidth, int screenHeight, double frameTime,
+             const HUDEmitterStats * emitters, size_t emitterCount,
+             const AssetCacheStats & cacheStats);
+
+#endif
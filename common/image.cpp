@@ -0,0 +1,656 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGE_SSE2 1
+#endif
+
+#include "mappedfile.hpp"
+#include "image.hpp"
+
+// BMP headers are little endian and the fields are not necessarily aligned
+static unsigned int readU16(const unsigned char * bytes){
+	return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8);
+}
+
+static unsigned int readU32(const unsigned char * bytes){
+	return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) | ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
+
+#define BMP_FILE_HEADER_SIZE 14
+#define BMP_INFO_HEADER_SIZE 40
+#define BMP_BI_RGB           0
+#define BMP_BI_BITFIELDS     3
+#define BMP_MAX_DIMENSION    16384
+
+// Where a channel is in a 32 bit pixel, from its BI_BITFIELDS mask
+struct ChannelMask {
+	unsigned int mask;
+	unsigned int shift;
+	unsigned int maximum;
+};
+
+static ChannelMask channelMask(unsigned int mask){
+	ChannelMask channel = { mask, 0, 0 };
+	if (mask == 0)
+		return channel;
+	while ((mask & 1) == 0) {
+		mask >>= 1;
+		channel.shift++;
+	}
+	channel.maximum = mask;
+	return channel;
+}
+
+static unsigned char readChannel(unsigned int pixel, const ChannelMask & channel, unsigned char missing){
+	if (channel.mask == 0)
+		return missing;
+	unsigned int value = (pixel & channel.mask) >> channel.shift;
+	return (unsigned char)((value * 255 + channel.maximum / 2) / channel.maximum);
+}
+
+bool decodeBMP(const unsigned char * data, size_t size, Image & image){
+
+	// A BMP files always begins with "BM"
+	if (size < BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE || data[0] != 'B' || data[1] != 'M') {
+		printf("Not a correct BMP file\n");
+		return false;
+	}
+
+	// Read the information about the image
+	unsigned int dataPos     = readU32(data + 0x0A);
+	unsigned int headerSize  = readU32(data + 0x0E);
+	int width                = (int)readU32(data + 0x12);
+	int height               = (int)readU32(data + 0x16); // Negative for top-down images
+	unsigned int bitCount    = readU16(data + 0x1C);
+	unsigned int compression = readU32(data + 0x1E);
+
+	bool topDown = height < 0;
+	if (topDown)
+		height = -height;
+	if (headerSize < BMP_INFO_HEADER_SIZE || width <= 0 || height <= 0
+		|| width > BMP_MAX_DIMENSION || height > BMP_MAX_DIMENSION) {
+		printf("Not a correct BMP file\n");
+		return false;
+	}
+	if (!(bitCount == 24 && compression == BMP_BI_RGB)
+		&& !(bitCount == 32 && (compression == BMP_BI_RGB || compression == BMP_BI_BITFIELDS))) {
+		printf("Only uncompressed 24bpp and 32bpp BMP files are supported (this one has %u bpp, compression %u)\n", bitCount, compression);
+		return false;
+	}
+
+	// 32bpp : BGRA unless masks say otherwise. They follow a 40 byte header, or are part of a larger one.
+	ChannelMask red = channelMask(0x00FF0000), green = channelMask(0x0000FF00), blue = channelMask(0x000000FF);
+	ChannelMask alpha = channelMask(0xFF000000);
+	if (compression == BMP_BI_BITFIELDS) {
+		size_t masks = BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE;
+		if (masks + 12 > size) {
+			printf("Not a correct BMP file\n");
+			return false;
+		}
+		red = channelMask(readU32(data + masks));
+		green = channelMask(readU32(data + masks + 4));
+		blue = channelMask(readU32(data + masks + 8));
+		alpha = channelMask(headerSize >= 56 && masks + 16 <= size ? readU32(data + masks + 12) : 0);
+	}
+
+	// Rows are padded to 4 bytes
+	size_t bytesPerPixel = bitCount / 8;
+	size_t rowSize = ((size_t)width * bytesPerPixel + 3) & ~(size_t)3;
+	if (dataPos == 0)
+		dataPos = BMP_FILE_HEADER_SIZE + headerSize;
+	if (dataPos > size || rowSize * height > size - dataPos) {
+		printf("BMP file is truncated\n");
+		return false;
+	}
+
+	image.width = width;
+	image.height = height;
+	image.pixels.resize((size_t)width * height * 4);
+
+	// Our rows go bottom-up, so top-down files are read backwards
+	unsigned int alphaOr = 0, alphaAnd = 255;
+	for (int y = 0; y < height; y++) {
+		const unsigned char * source = data + dataPos + rowSize * (topDown ? height - 1 - y : y);
+		unsigned char * destination = &image.pixels[(size_t)y * width * 4];
+		if (bitCount == 24) {
+			for (int x = 0; x < width; x++, source += 3, destination += 4) {
+				destination[0] = source[2];
+				destination[1] = source[1];
+				destination[2] = source[0];
+				destination[3] = 255;
+			}
+		} else {
+			for (int x = 0; x < width; x++, source += 4, destination += 4) {
+				unsigned int pixel = readU32(source);
+				destination[0] = readChannel(pixel, red, 0);
+				destination[1] = readChannel(pixel, green, 0);
+				destination[2] = readChannel(pixel, blue, 0);
+				destination[3] = readChannel(pixel, alpha, 255);
+				alphaOr |= destination[3];
+				alphaAnd &= destination[3];
+			}
+		}
+	}
+
+	// Many tools write 32bpp files with the 4th byte left at zero : that is not an alpha channel
+	if (bitCount == 32 && alphaOr == 0) {
+		for (size_t i = 3; i < image.pixels.size(); i += 4)
+			image.pixels[i] = 255;
+		alphaAnd = 255;
+	}
+	image.hasAlpha = alphaAnd != 255;
+
+	return true;
+}
+
+bool loadBMP(const char * imagepath, Image & image){
+
+	printf("Reading image %s\n", imagepath);
+
+	MappedFile file;
+	if (!mapFile(imagepath, file)) {
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return false;
+	}
+	bool decoded = decodeBMP(file.data, file.size, image);
+	unmapFile(file);
+	return decoded;
+}
+
+// Any size : odd columns and rows are averaged with their clamped neighbour
+static void downsampleRowScalar(const unsigned char * row0, const unsigned char * row1, unsigned int sourceWidth,
+                                unsigned char * destination, unsigned int firstPixel, unsigned int width){
+	for (unsigned int x = firstPixel; x < width; x++) {
+		unsigned int x0 = 2 * x, x1 = 2 * x + 1 < sourceWidth ? 2 * x + 1 : sourceWidth - 1;
+		for (unsigned int c = 0; c < 4; c++) {
+			unsigned int sum = row0[x0 * 4 + c] + row0[x1 * 4 + c] + row1[x0 * 4 + c] + row1[x1 * 4 + c];
+			destination[x * 4 + c] = (unsigned char)((sum + 2) >> 2);
+		}
+	}
+}
+
+#ifdef IMAGE_SSE2
+// Two destination pixels per iteration : 4 pixels of each source row, summed in 16 bits
+static unsigned int downsampleRowSSE2(const unsigned char * row0, const unsigned char * row1,
+                                      unsigned char * destination, unsigned int width){
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rounding = _mm_set1_epi16(2);
+	unsigned int x = 0;
+	for (; x + 2 <= width; x += 2) {
+		__m128i top = _mm_loadu_si128((const __m128i *)(row0 + x * 8));
+		__m128i bottom = _mm_loadu_si128((const __m128i *)(row1 + x * 8));
+		// Pixels 0 and 1, then 2 and 3, summed vertically
+		__m128i left = _mm_add_epi16(_mm_unpacklo_epi8(top, zero), _mm_unpacklo_epi8(bottom, zero));
+		__m128i right = _mm_add_epi16(_mm_unpackhi_epi8(top, zero), _mm_unpackhi_epi8(bottom, zero));
+		// ... then horizontally
+		left = _mm_add_epi16(left, _mm_srli_si128(left, 8));
+		right = _mm_add_epi16(right, _mm_srli_si128(right, 8));
+		__m128i sum = _mm_unpacklo_epi64(left, right);
+		__m128i average = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+		_mm_storel_epi64((__m128i *)(destination + x * 4), _mm_packus_epi16(average, zero));
+	}
+	return x;
+}
+#endif
+
+void downsampleImage(const Image & source, Image & destination){
+
+	destination.width = source.width > 1 ? source.width / 2 : 1;
+	destination.height = source.height > 1 ? source.height / 2 : 1;
+	destination.hasAlpha = source.hasAlpha;
+	destination.pixels.resize((size_t)destination.width * destination.height * 4);
+
+	size_t sourceRow = (size_t)source.width * 4;
+	for (unsigned int y = 0; y < destination.height; y++) {
+		unsigned int y1 = 2 * y + 1 < source.height ? 2 * y + 1 : source.height - 1;
+		const unsigned char * row0 = &source.pixels[2 * y * sourceRow];
+		const unsigned char * row1 = &source.pixels[y1 * sourceRow];
+		unsigned char * row = &destination.pixels[(size_t)y * destination.width * 4];
+
+		unsigned int done = 0;
+#ifdef IMAGE_SSE2
+		// Only where both source columns exist
+		if (source.width % 2 == 0)
+			done = downsampleRowSSE2(row0, row1, row, destination.width);
+#endif
+		downsampleRowScalar(row0, row1, source.width, row, done, destination.width);
+	}
+}
+
+void buildMipChain(const Image & base, std::vector<Image> & levels){
+	levels.clear();
+	levels.push_back(base);
+	while (levels.back().width > 1 || levels.back().height > 1) {
+		levels.push_back(Image());
+		downsampleImage(levels[levels.size() - 2], levels.back());
+	}
+}
+
+// 5:6:5, the endpoint format of BC1 and of the color half of BC3
+static unsigned int packRGB565(const unsigned char * color){
+	return ((color[0] * 31 + 127) / 255) << 11 | ((color[1] * 63 + 127) / 255) << 5 | ((color[2] * 31 + 127) / 255);
+}
+
+static void unpackRGB565(unsigned int packed, int * color){
+	color[0] = (((packed >> 11) & 31) * 255 + 15) / 31;
+	color[1] = (((packed >> 5) & 63) * 255 + 31) / 63;
+	color[2] = ((packed & 31) * 255 + 15) / 31;
+}
+
+static void writeU16(unsigned char * bytes, unsigned int value){
+	bytes[0] = (unsigned char)(value & 0xFF);
+	bytes[1] = (unsigned char)(value >> 8);
+}
+
+// The 16 pixels of a block, clamped to the image at the right and top edges
+static void fetchBlock(const Image & image, unsigned int blockX, unsigned int blockY, unsigned char pixels[16][4]){
+	for (unsigned int y = 0; y < 4; y++) {
+		unsigned int py = blockY * 4 + y < image.height ? blockY * 4 + y : image.height - 1;
+		for (unsigned int x = 0; x < 4; x++) {
+			unsigned int px = blockX * 4 + x < image.width ? blockX * 4 + x : image.width - 1;
+			memcpy(pixels[y * 4 + x], &image.pixels[((size_t)py * image.width + px) * 4], 4);
+		}
+	}
+}
+
+// Endpoints from the bounding box of the colors, slightly inset, and the closest of the 4 palette entries per pixel.
+// Always in 4 color mode (color0 > color1), which is also the only mode BC3 has.
+static void compressColorBlock(const unsigned char pixels[16][4], unsigned char * block){
+
+	int minimum[3] = { 255, 255, 255 }, maximum[3] = { 0, 0, 0 };
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < 3; c++) {
+			if (pixels[i][c] < minimum[c]) minimum[c] = pixels[i][c];
+			if (pixels[i][c] > maximum[c]) maximum[c] = pixels[i][c];
+		}
+	}
+	unsigned char high[3], low[3];
+	for (int c = 0; c < 3; c++) {
+		int inset = (maximum[c] - minimum[c]) / 16;
+		high[c] = (unsigned char)(maximum[c] - inset);
+		low[c] = (unsigned char)(minimum[c] + inset);
+	}
+
+	unsigned int color0 = packRGB565(high), color1 = packRGB565(low);
+	if (color0 < color1) {
+		unsigned int swap = color0; color0 = color1; color1 = swap;
+	}
+	writeU16(block, color0);
+	writeU16(block + 2, color1);
+
+	unsigned int indices = 0;
+	if (color0 != color1) {
+		int palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestDistance = 0x7FFFFFFF;
+			for (int p = 0; p < 4; p++) {
+				int dr = pixels[i][0] - palette[p][0], dg = pixels[i][1] - palette[p][1], db = pixels[i][2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= (unsigned int)best << (2 * i);
+		}
+	}
+	block[4] = (unsigned char)(indices & 0xFF);
+	block[5] = (unsigned char)((indices >> 8) & 0xFF);
+	block[6] = (unsigned char)((indices >> 16) & 0xFF);
+	block[7] = (unsigned char)(indices >> 24);
+}
+
+// BC3 alpha : two 8 bit endpoints (alpha0 > alpha1 : 8 interpolated values) and 3 bit indices
+static void compressAlphaBlock(const unsigned char pixels[16][4], unsigned char * block){
+
+	int alpha0 = 0, alpha1 = 255;
+	for (int i = 0; i < 16; i++) {
+		if (pixels[i][3] > alpha0) alpha0 = pixels[i][3];
+		if (pixels[i][3] < alpha1) alpha1 = pixels[i][3];
+	}
+	block[0] = (unsigned char)alpha0;
+	block[1] = (unsigned char)alpha1;
+
+	unsigned long long indices = 0;
+	if (alpha0 != alpha1) {
+		int palette[8];
+		palette[0] = alpha0;
+		palette[1] = alpha1;
+		for (int p = 1; p < 7; p++)
+			palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+		for (int i = 0; i < 16; i++) {
+			int best = 0, bestDistance = 256;
+			for (int p = 0; p < 8; p++) {
+				int distance = pixels[i][3] > palette[p] ? pixels[i][3] - palette[p] : palette[p] - pixels[i][3];
+				if (distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= (unsigned long long)best << (3 * i);
+		}
+	}
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = (unsigned char)((indices >> (8 * i)) & 0xFF);
+}
+
+void compressImage(const Image & image, BlockFormat format, std::vector<unsigned char> & blocks){
+
+	unsigned int blocksWide = (image.width + 3) / 4, blocksHigh = (image.height + 3) / 4;
+	size_t blockSize = format == BLOCK_BC1 ? 8 : 16;
+	blocks.resize((size_t)blocksWide * blocksHigh * blockSize);
+
+	unsigned char pixels[16][4];
+	unsigned char * block = &blocks[0];
+	for (unsigned int y = 0; y < blocksHigh; y++) {
+		for (unsigned int x = 0; x < blocksWide; x++, block += blockSize) {
+			fetchBlock(image, x, y, pixels);
+			if (format == BLOCK_BC3) {
+				compressAlphaBlock(pixels, block);
+				compressColorBlock(pixels, block + 8);
+			} else {
+				compressColorBlock(pixels, block);
+			}
+		}
+	}
+}
+
+static void writeU32(unsigned char * bytes, unsigned int value){
+	bytes[0] = (unsigned char)(value & 0xFF);
+	bytes[1] = (unsigned char)((value >> 8) & 0xFF);
+	bytes[2] = (unsigned char)((value >> 16) & 0xFF);
+	bytes[3] = (unsigned char)(value >> 24);
+}
+
+#define DDSD_CAPS        0x1
+#define DDSD_HEIGHT      0x2
+#define DDSD_WIDTH       0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE  0x80000
+#define DDPF_FOURCC      0x4
+#define DDSCAPS_COMPLEX  0x8
+#define DDSCAPS_TEXTURE  0x1000
+#define DDSCAPS_MIPMAP   0x400000
+
+bool saveDDS(const char * imagepath, const std::vector<Image> & levels, BlockFormat format){
+
+	if (levels.empty())
+		return false;
+
+	std::vector< std::vector<unsigned char> > compressed(levels.size());
+	for (size_t i = 0; i < levels.size(); i++)
+		compressImage(levels[i], format, compressed[i]);
+
+	// "DDS " and the 124 byte header, see parseDDS() for the fields we read back
+	unsigned char header[128];
+	memset(header, 0, sizeof(header));
+	memcpy(header, "DDS ", 4);
+	writeU32(header + 4, 124);
+	writeU32(header + 8, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+	writeU32(header + 12, levels[0].height);
+	writeU32(header + 16, levels[0].width);
+	writeU32(header + 20, (unsigned int)compressed[0].size());
+	writeU32(header + 28, (unsigned int)levels.size());
+	writeU32(header + 76, 32);                                // Pixel format size
+	writeU32(header + 80, DDPF_FOURCC);
+	memcpy(header + 84, format == BLOCK_BC1 ? "DXT1" : "DXT5", 4);
+	writeU32(header + 108, DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+
+	FILE * file = fopen(imagepath, "wb");
+	if (file == NULL) {
+		printf("%s could not be written\n", imagepath);
+		return false;
+	}
+	bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+	for (size_t i = 0; written && i < compressed.size(); i++)
+		written = fwrite(&compressed[i][0], 1, compressed[i].size(), file) == compressed[i].size();
+	if (fclose(file) != 0)
+		written = false;
+	if (!written)
+		printf("%s could not be written\n", imagepath);
+	return written;
+}
+
+bool convertBMPToDDS(const char * bmppath, const char * ddspath, BlockFormat format){
+	Image image;
+	if (!loadBMP(bmppath, image))
+		return false;
+	std::vector<Image> levels;
+	buildMipChain(image, levels);
+	return saveDDS(ddspath, levels, format);
+}
+
+// The pixel (x, y) of the check images, y counted from the bottom
+static void checkPixel(unsigned int x, unsigned int y, unsigned char * rgba){
+	rgba[0] = (unsigned char)(10 + 40 * x);
+	rgba[1] = (unsigned char)(20 + 50 * y);
+	rgba[2] = (unsigned char)(200 - 30 * x - 7 * y);
+	rgba[3] = (unsigned char)(255 - 60 * x - 20 * y);
+}
+
+// A BMP file in memory with the check pixels. Negative heights are written top-down.
+// With masks, the 32 bit pixels are BI_BITFIELDS with a 56 byte header : red, green, blue, alpha masks.
+static std::vector<unsigned char> makeCheckBMP(int width, int height, unsigned int bitCount, const unsigned int * masks){
+	unsigned int rows = height < 0 ? -height : height;
+	unsigned int headerSize = masks ? 56 : BMP_INFO_HEADER_SIZE;
+	size_t dataPos = BMP_FILE_HEADER_SIZE + headerSize;
+	size_t rowSize = ((size_t)width * (bitCount / 8) + 3) & ~(size_t)3;
+	std::vector<unsigned char> file(dataPos + rowSize * rows, 0);
+	file[0] = 'B';
+	file[1] = 'M';
+	writeU32(&file[0x0A], (unsigned int)dataPos);
+	writeU32(&file[0x0E], headerSize);
+	writeU32(&file[0x12], (unsigned int)width);
+	writeU32(&file[0x16], (unsigned int)height);
+	writeU16(&file[0x1A], 1);
+	writeU16(&file[0x1C], bitCount);
+	writeU32(&file[0x1E], masks ? BMP_BI_BITFIELDS : BMP_BI_RGB);
+	for (int i = 0; masks && i < 4; i++)
+		writeU32(&file[BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + 4 * i], masks[i]);
+
+	for (unsigned int y = 0; y < rows; y++) {
+		unsigned char * row = &file[dataPos + rowSize * (height < 0 ? rows - 1 - y : y)];
+		for (int x = 0; x < width; x++) {
+			unsigned char rgba[4];
+			checkPixel(x, y, rgba);
+			if (bitCount == 24) {
+				row[x * 3 + 0] = rgba[2];
+				row[x * 3 + 1] = rgba[1];
+				row[x * 3 + 2] = rgba[0];
+			} else {
+				// BGRA in memory, unless the masks put the channels elsewhere
+				const unsigned int Shifts[4] = { 16, 8, 0, 24 };
+				unsigned int pixel = 0;
+				for (int c = 0; c < 4; c++)
+					pixel |= (unsigned int)rgba[c] << (masks ? channelMask(masks[c]).shift : Shifts[c]);
+				writeU32(row + x * 4, pixel);
+			}
+		}
+	}
+	return file;
+}
+
+static size_t checkDecodedBMP(const std::vector<unsigned char> & file, unsigned int width, unsigned int height, bool alpha){
+	Image image;
+	if (!decodeBMP(&file[0], file.size(), image))
+		return 1;
+	size_t errors = image.width != width || image.height != height || image.hasAlpha != alpha;
+	for (unsigned int y = 0; y < height && errors == 0; y++) {
+		for (unsigned int x = 0; x < width; x++) {
+			unsigned char rgba[4];
+			checkPixel(x, y, rgba);
+			if (!alpha)
+				rgba[3] = 255;
+			errors += memcmp(&image.pixels[((size_t)y * width + x) * 4], rgba, 4) != 0;
+		}
+	}
+	return errors;
+}
+
+// The reference the vector path must match : every pixel is the rounded average of its 2x2 source pixels
+static size_t checkDownsample(unsigned int width, unsigned int height){
+	Image source;
+	source.width = width;
+	source.height = height;
+	source.hasAlpha = true;
+	source.pixels.resize((size_t)width * height * 4);
+	for (size_t i = 0; i < source.pixels.size(); i++)
+		source.pixels[i] = (unsigned char)(i * 37 + (i >> 5) * 11);
+
+	Image destination;
+	downsampleImage(source, destination);
+	size_t errors = destination.width != (width > 1 ? width / 2 : 1) || destination.height != (height > 1 ? height / 2 : 1);
+	for (unsigned int y = 0; y < destination.height && errors == 0; y++) {
+		unsigned int y0 = 2 * y, y1 = 2 * y + 1 < height ? 2 * y + 1 : height - 1;
+		for (unsigned int x = 0; x < destination.width; x++) {
+			unsigned int x0 = 2 * x, x1 = 2 * x + 1 < width ? 2 * x + 1 : width - 1;
+			for (unsigned int c = 0; c < 4; c++) {
+				unsigned int sum = source.pixels[((size_t)y0 * width + x0) * 4 + c] + source.pixels[((size_t)y0 * width + x1) * 4 + c]
+				                 + source.pixels[((size_t)y1 * width + x0) * 4 + c] + source.pixels[((size_t)y1 * width + x1) * 4 + c];
+				errors += destination.pixels[((size_t)y * destination.width + x) * 4 + c] != (sum + 2) / 4;
+			}
+		}
+	}
+	return errors;
+}
+
+// Decodes a BC1 color block the way the GPU does, 3 color mode included
+static void decodeColorBlock(const unsigned char * block, unsigned char pixels[16][4]){
+	unsigned int color0 = readU16(block), color1 = readU16(block + 2);
+	int palette[4][3];
+	unpackRGB565(color0, palette[0]);
+	unpackRGB565(color1, palette[1]);
+	for (int c = 0; c < 3; c++) {
+		if (color0 > color1) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		} else {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	unsigned int indices = readU32(block + 4);
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			pixels[i][c] = (unsigned char)palette[(indices >> (2 * i)) & 3][c];
+}
+
+static void decodeAlphaBlock(const unsigned char * block, unsigned char pixels[16][4]){
+	int palette[8];
+	palette[0] = block[0];
+	palette[1] = block[1];
+	if (block[0] > block[1]) {
+		for (int p = 1; p < 7; p++)
+			palette[p + 1] = ((7 - p) * block[0] + p * block[1]) / 7;
+	} else {
+		for (int p = 1; p < 5; p++)
+			palette[p + 1] = ((5 - p) * block[0] + p * block[1]) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	unsigned long long indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= (unsigned long long)block[2 + i] << (8 * i);
+	for (int i = 0; i < 16; i++)
+		pixels[i][3] = (unsigned char)palette[(indices >> (3 * i)) & 7];
+}
+
+// Compresses one 4x4 image, decodes it back and returns the largest error of a channel
+static int blockRoundTrip(const unsigned char pixels[16][4], BlockFormat format){
+	Image image;
+	image.width = 4;
+	image.height = 4;
+	image.hasAlpha = format == BLOCK_BC3;
+	image.pixels.assign(&pixels[0][0], &pixels[0][0] + 64);
+	std::vector<unsigned char> blocks;
+	compressImage(image, format, blocks);
+	if (blocks.size() != (format == BLOCK_BC1 ? 8u : 16u))
+		return 256;
+
+	unsigned char decoded[16][4];
+	if (format == BLOCK_BC3) {
+		decodeAlphaBlock(&blocks[0], decoded);
+		decodeColorBlock(&blocks[8], decoded);
+	} else {
+		decodeColorBlock(&blocks[0], decoded);
+	}
+	int worst = 0;
+	for (int i = 0; i < 16; i++) {
+		for (int c = 0; c < (format == BLOCK_BC3 ? 4 : 3); c++) {
+			int error = decoded[i][c] > pixels[i][c] ? decoded[i][c] - pixels[i][c] : pixels[i][c] - decoded[i][c];
+			if (error > worst)
+				worst = error;
+		}
+	}
+	return worst;
+}
+
+size_t checkImage(){
+
+	size_t errors = 0;
+
+	// BMP : 24 and 32 bpp, both row orders, 4th byte unused or alpha, masks in another order,
+	// an odd width so that the 24 bpp rows are padded. Truncated files are refused.
+	errors += checkDecodedBMP(makeCheckBMP(3, 2, 24, NULL), 3, 2, false);
+	errors += checkDecodedBMP(makeCheckBMP(3, -2, 24, NULL), 3, 2, false);
+	errors += checkDecodedBMP(makeCheckBMP(3, 2, 32, NULL), 3, 2, true);
+	errors += checkDecodedBMP(makeCheckBMP(3, -2, 32, NULL), 3, 2, true);
+	const unsigned int RGBAMasks[4] = { 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 };
+	errors += checkDecodedBMP(makeCheckBMP(3, 2, 32, RGBAMasks), 3, 2, true);
+	errors += checkDecodedBMP(makeCheckBMP(3, -2, 32, RGBAMasks), 3, 2, true);
+	std::vector<unsigned char> file = makeCheckBMP(3, 2, 32, NULL);
+	for (size_t i = BMP_FILE_HEADER_SIZE + BMP_INFO_HEADER_SIZE + 3; i < file.size(); i += 4)
+		file[i] = 0; // Tools that leave the 4th byte at zero : opaque
+	errors += checkDecodedBMP(file, 3, 2, false);
+	Image image;
+	file = makeCheckBMP(3, 2, 24, NULL);
+	errors += decodeBMP(&file[0], file.size() - 1, image);
+
+	// Box filter : even widths go through SSE2 with a scalar tail, odd ones and 1 pixel wide are scalar
+	const unsigned int Sizes[][2] = { { 16, 8 }, { 10, 6 }, { 4, 4 }, { 7, 5 }, { 2, 1 }, { 1, 3 } };
+	for (size_t i = 0; i < sizeof(Sizes) / sizeof(Sizes[0]); i++)
+		errors += checkDownsample(Sizes[i][0], Sizes[i][1]);
+
+	// Block compression. Colors 5:6:5 can hold come back exactly, others within its rounding.
+	// A ramp is within half a palette step : range / 6 with 4 colors, range / 14 with 8 alpha values.
+	const unsigned char Solid[][4] = { { 255, 0, 0, 255 }, { 0, 255, 0, 255 }, { 0, 0, 255, 255 }, { 255, 255, 255, 255 }, { 0, 0, 0, 255 } };
+	unsigned char pixels[16][4];
+	for (size_t i = 0; i < sizeof(Solid) / sizeof(Solid[0]); i++) {
+		for (int p = 0; p < 16; p++)
+			memcpy(pixels[p], Solid[i], 4);
+		errors += blockRoundTrip(pixels, BLOCK_BC1) != 0;
+		errors += blockRoundTrip(pixels, BLOCK_BC3) != 0;
+	}
+	for (int p = 0; p < 16; p++) {
+		pixels[p][0] = 100;
+		pixels[p][1] = 150;
+		pixels[p][2] = 200;
+		pixels[p][3] = p % 2 ? 255 : 0; // Two alpha values are the endpoints : exact
+	}
+	errors += blockRoundTrip(pixels, BLOCK_BC1) > 4;
+	errors += blockRoundTrip(pixels, BLOCK_BC3) > 4;
+	for (int p = 0; p < 16; p++) {
+		pixels[p][0] = pixels[p][1] = pixels[p][2] = (unsigned char)(p * 17);
+		pixels[p][3] = 255;
+	}
+	errors += blockRoundTrip(pixels, BLOCK_BC1) > 255 / 6 + 4;
+	errors += blockRoundTrip(pixels, BLOCK_BC3) > 255 / 6 + 4;
+	for (int p = 0; p < 16; p++) {
+		pixels[p][0] = pixels[p][1] = pixels[p][2] = 0;
+		pixels[p][3] = (unsigned char)(255 - p * 17);
+	}
+	errors += blockRoundTrip(pixels, BLOCK_BC3) > 255 / 14 + 1;
+
+	printf("Image : %u errors in BMP decoding, the box filter and block compression\n", (unsigned int)errors);
+	return errors;
+}
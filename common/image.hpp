@@ -0,0 +1,41 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+#include <stddef.h>
+#include <vector>
+
+// An uncompressed RGBA image in system memory, 4 bytes per pixel.
+// Rows are kept in the order they are given to OpenGL : the bottom row first, like in a BMP file.
+struct Image {
+	unsigned int width, height;
+	bool hasAlpha; // False when every pixel is opaque
+	std::vector<unsigned char> pixels;
+};
+
+// 24bpp and 32bpp (BI_RGB or BI_BITFIELDS), bottom-up or top-down. No GL call.
+bool decodeBMP(const unsigned char * data, size_t size, Image & image);
+bool loadBMP(const char * imagepath, Image & image);
+
+// Halves each dimension (down to 1) with a 2x2 box filter
+void downsampleImage(const Image & source, Image & destination);
+// levels[0] is a copy of base, the last level is 1x1
+void buildMipChain(const Image & base, std::vector<Image> & levels);
+
+// Block compression, 4x4 pixels per block. BC1 ignores the alpha channel.
+enum BlockFormat {
+	BLOCK_BC1, // DXT1 : 8 bytes per block
+	BLOCK_BC3  // DXT5 : 16 bytes per block, with alpha
+};
+void compressImage(const Image & image, BlockFormat format, std::vector<unsigned char> & blocks);
+
+// Compresses every level and writes a DXT1/DXT5 .DDS file that loadDDS() reads back
+// with the same orientation as loadBMP_custom() gives the original.
+bool saveDDS(const char * imagepath, const std::vector<Image> & levels, BlockFormat format);
+// loadBMP + buildMipChain + saveDDS, to precompress textures once : main --precompress
+bool convertBMPToDDS(const char * bmppath, const char * ddspath, BlockFormat format);
+
+// Decodes BMPs made in memory (24/32 bpp, both row orders, BI_BITFIELDS), compares the box filter
+// with a plain reference and round trips known colors through BC1/BC3. Returns the errors found.
+size_t checkImage();
+
+#endif
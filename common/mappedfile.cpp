@@ -0,0 +1,92 @@
+#include <stdio.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mappedfile.hpp"
+
+#ifdef _WIN32
+
+bool mapFile(const char * path, MappedFile & file){
+
+	file.data = NULL;
+	file.size = 0;
+	file.mappingHandle = NULL;
+	file.fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file.fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file.fileHandle, &size) || size.QuadPart == 0) {
+		CloseHandle(file.fileHandle);
+		return false;
+	}
+	file.size = (size_t)size.QuadPart;
+
+	file.mappingHandle = CreateFileMappingA(file.fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (file.mappingHandle != NULL)
+		file.data = (const unsigned char *)MapViewOfFile(file.mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (file.data == NULL) {
+		if (file.mappingHandle != NULL)
+			CloseHandle(file.mappingHandle);
+		CloseHandle(file.fileHandle);
+		return false;
+	}
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if (file.data == NULL)
+		return;
+	UnmapViewOfFile(file.data);
+	CloseHandle(file.mappingHandle);
+	CloseHandle(file.fileHandle);
+	file.data = NULL;
+	file.size = 0;
+}
+
+#else
+
+bool mapFile(const char * path, MappedFile & file){
+
+	file.data = NULL;
+	file.size = 0;
+	file.descriptor = open(path, O_RDONLY);
+	if (file.descriptor < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(file.descriptor, &info) != 0 || info.st_size == 0) {
+		close(file.descriptor);
+		return false;
+	}
+	file.size = (size_t)info.st_size;
+
+	void * data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, file.descriptor, 0);
+	if (data == MAP_FAILED) {
+		close(file.descriptor);
+		return false;
+	}
+	// The whole file is read front to back, once
+	madvise(data, file.size, MADV_SEQUENTIAL);
+	file.data = (const unsigned char *)data;
+	return true;
+}
+
+void unmapFile(MappedFile & file){
+	if (file.data == NULL)
+		return;
+	munmap((void *)file.data, file.size);
+	close(file.descriptor);
+	file.data = NULL;
+	file.size = 0;
+}
+
+#endif
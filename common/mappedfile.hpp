@@ -0,0 +1,21 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+
+// A read-only view of a whole file. The pages are only read when touched.
+struct MappedFile {
+	const unsigned char * data;
+	size_t size;
+#ifdef _WIN32
+	void * fileHandle;
+	void * mappingHandle;
+#else
+	int descriptor;
+#endif
+};
+
+bool mapFile(const char * path, MappedFile & file);
+void unmapFile(MappedFile & file);
+
+#endif
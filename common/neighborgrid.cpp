@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+#include "threadpool.hpp"
+#include "neighborgrid.hpp"
+
+// Particles per task when building and querying
+#define NEIGHBOR_GRAIN 2048
+
+// Cell coordinates are packed 21 bits each into the cell key : about a million cells per axis
+#define NEIGHBOR_CELL_BITS 21
+#define NEIGHBOR_CELL_OFFSET (1 << (NEIGHBOR_CELL_BITS - 1))
+
+static const float Pi = 3.14159265f;
+
+static unsigned long long cellKey(int x, int y, int z){
+	const unsigned long long mask = (1ull << NEIGHBOR_CELL_BITS) - 1;
+	return ((unsigned long long)(x + NEIGHBOR_CELL_OFFSET) & mask) << (2 * NEIGHBOR_CELL_BITS)
+	     | ((unsigned long long)(y + NEIGHBOR_CELL_OFFSET) & mask) << NEIGHBOR_CELL_BITS
+	     | ((unsigned long long)(z + NEIGHBOR_CELL_OFFSET) & mask);
+}
+
+// Spatial hash of Teschner et al., "Optimized Spatial Hashing for Collision Detection of Deformable Objects"
+static unsigned int cellBucket(int x, int y, int z, unsigned int tableMask){
+	return ((unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u ^ (unsigned int)z * 83492791u) & tableMask;
+}
+
+void initNeighborGrid(NeighborGrid & grid, size_t capacity, float cellSize){
+	unsigned int tableSize = 1024;
+	while (tableSize < capacity && tableSize < (1u << 31))
+		tableSize <<= 1;
+
+	grid.cellSize = cellSize;
+	grid.capacity = capacity;
+	grid.count = 0;
+	grid.tableMask = tableSize - 1;
+	grid.bucketStart.assign((size_t)tableSize + 1, 0);
+	grid.bucketOf.resize(capacity);
+	grid.sorted.resize(capacity);
+	grid.cell.resize(capacity);
+	grid.x.resize(capacity);
+	grid.y.resize(capacity);
+	grid.z.resize(capacity);
+	grid.density.resize(capacity);
+}
+
+size_t buildNeighborGrid(NeighborGrid & grid, const float * x, const float * y, const float * z, size_t count){
+
+	if (count > grid.capacity)
+		count = grid.capacity;
+	grid.count = count;
+	float inverse = 1.0f / grid.cellSize;
+
+	parallelFor(count, NEIGHBOR_GRAIN, [&](size_t begin, size_t end){
+		for (size_t i = begin; i < end; i++)
+			grid.bucketOf[i] = cellBucket((int)floorf(x[i] * inverse), (int)floorf(y[i] * inverse), (int)floorf(z[i] * inverse), grid.tableMask);
+	});
+
+	// Counting sort. After the prefix sum bucketStart[b] is the end of bucket b ; filling from the
+	// last particle down moves it back to the start, and keeps the particles of a bucket in order.
+	unsigned int * start = &grid.bucketStart[0];
+	size_t tableSize = (size_t)grid.tableMask + 1;
+	for (size_t b = 0; b <= tableSize; b++)
+		start[b] = 0;
+	for (size_t i = 0; i < count; i++)
+		start[grid.bucketOf[i]]++;
+	for (size_t b = 1; b <= tableSize; b++)
+		start[b] += start[b - 1];
+	for (size_t i = count; i-- > 0;)
+		grid.sorted[--start[grid.bucketOf[i]]] = (unsigned int)i;
+
+	// Positions next to each other in memory when the particles are neighbors
+	parallelFor(count, NEIGHBOR_GRAIN, [&](size_t begin, size_t end){
+		for (size_t i = begin; i < end; i++) {
+			unsigned int from = grid.sorted[i];
+			grid.x[i] = x[from];
+			grid.y[i] = y[from];
+			grid.z[i] = z[from];
+			grid.cell[i] = cellKey((int)floorf(x[from] * inverse), (int)floorf(y[from] * inverse), (int)floorf(z[from] * inverse));
+		}
+	});
+
+	return count;
+}
+
+// Calls visit(j, dx, dy, dz, squared distance) for every other particle closer than the cell size to
+// sorted particle i. d is from j to i.
+template<typename Visit>
+static void forEachNeighbor(const NeighborGrid & grid, size_t i, Visit visit){
+	float inverse = 1.0f / grid.cellSize;
+	float radius2 = grid.cellSize * grid.cellSize;
+	float px = grid.x[i], py = grid.y[i], pz = grid.z[i];
+	int cx = (int)floorf(px * inverse), cy = (int)floorf(py * inverse), cz = (int)floorf(pz * inverse);
+
+	for (int z = cz - 1; z <= cz + 1; z++)
+		for (int y = cy - 1; y <= cy + 1; y++)
+			for (int x = cx - 1; x <= cx + 1; x++) {
+				// Other cells may share the bucket : their particles are skipped by the key
+				unsigned long long key = cellKey(x, y, z);
+				unsigned int bucket = cellBucket(x, y, z, grid.tableMask);
+				for (unsigned int j = grid.bucketStart[bucket]; j < grid.bucketStart[bucket + 1]; j++) {
+					if (grid.cell[j] != key || j == i)
+						continue;
+					float dx = px - grid.x[j], dy = py - grid.y[j], dz = pz - grid.z[j];
+					float distance2 = dx * dx + dy * dy + dz * dz;
+					if (distance2 < radius2)
+						visit(j, dx, dy, dz, distance2);
+				}
+			}
+}
+
+void computeRepulsion(const NeighborGrid & grid, float strength, float * ax, float * ay, float * az){
+
+	float inverse = 1.0f / grid.cellSize;
+	parallelFor(grid.count, NEIGHBOR_GRAIN, [&](size_t begin, size_t end){
+		for (size_t i = begin; i < end; i++) {
+			float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+			forEachNeighbor(grid, i, [&](size_t, float dx, float dy, float dz, float distance2){
+				if (distance2 <= 0.0f)
+					return; // Same place : no direction to push in
+				float distance = sqrtf(distance2);
+				float push = strength * (1.0f - distance * inverse) / distance;
+				fx += dx * push;
+				fy += dy * push;
+				fz += dz * push;
+			});
+			unsigned int to = grid.sorted[i];
+			ax[to] = fx;
+			ay[to] = fy;
+			az[to] = fz;
+		}
+	});
+}
+
+void computeSPH(NeighborGrid & grid, const SPHSettings & settings, float * ax, float * ay, float * az){
+
+	// Kernels of Muller et al., "Particle-Based Fluid Simulation for Interactive Applications" :
+	// poly6 for the density, the gradient of spiky for the pressure
+	float h = grid.cellSize;
+	float h2 = h * h;
+	float poly6 = 315.0f / (64.0f * Pi * powf(h, 9.0f));
+	float spiky = 45.0f / (Pi * powf(h, 6.0f));
+
+	parallelFor(grid.count, NEIGHBOR_GRAIN, [&](size_t begin, size_t end){
+		for (size_t i = begin; i < end; i++) {
+			float sum = h2 * h2 * h2; // The particle itself
+			forEachNeighbor(grid, i, [&](size_t, float, float, float, float distance2){
+				float w = h2 - distance2;
+				sum += w * w * w;
+			});
+			grid.density[i] = settings.mass * poly6 * sum;
+		}
+	});
+
+	parallelFor(grid.count, NEIGHBOR_GRAIN, [&](size_t begin, size_t end){
+		for (size_t i = begin; i < end; i++) {
+			float density = grid.density[i];
+			float pressure = settings.stiffness * (density - settings.restDensity);
+			float fx = 0.0f, fy = 0.0f, fz = 0.0f;
+			forEachNeighbor(grid, i, [&](size_t j, float dx, float dy, float dz, float distance2){
+				if (distance2 <= 0.0f)
+					return;
+				float distance = sqrtf(distance2);
+				float other = grid.density[j];
+				float shared = (pressure + settings.stiffness * (other - settings.restDensity)) / (2.0f * other);
+				float w = h - distance;
+				float push = shared * spiky * w * w / distance;
+				fx += dx * push;
+				fy += dy * push;
+				fz += dz * push;
+			});
+			float scale = settings.mass / density;
+			unsigned int to = grid.sorted[i];
+			ax[to] = fx * scale;
+			ay[to] = fy * scale;
+			az[to] = fz * scale;
+		}
+	});
+}
+
+double benchmarkNeighborGrid(size_t count){
+
+	if (count == 0)
+		return 0.0;
+
+	// Random particles in a cube, 4 per cell on average : about 17 neighbors each
+	float side = cbrtf(count / 4.0f);
+	std::vector<float> x(count), y(count), z(count), ax(count), ay(count), az(count);
+	for (size_t i = 0; i < count; i++) {
+		x[i] = side * (rand() / (float)RAND_MAX);
+		y[i] = side * (rand() / (float)RAND_MAX);
+		z[i] = side * (rand() / (float)RAND_MAX);
+	}
+
+	NeighborGrid grid;
+	initNeighborGrid(grid, count, 1.0f);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	buildNeighborGrid(grid, &x[0], &y[0], &z[0], count);
+	std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+	computeRepulsion(grid, 1.0f, &ax[0], &ay[0], &az[0]);
+	std::chrono::steady_clock::time_point repulsed = std::chrono::steady_clock::now();
+	SPHSettings settings = { 1.0f, 4.0f, 1.0f };
+	computeSPH(grid, settings, &ax[0], &ay[0], &az[0]);
+	std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now();
+
+	double buildTime = std::chrono::duration<double>(built - start).count() * 1000.0;
+	double repulsionTime = std::chrono::duration<double>(repulsed - built).count() * 1000.0;
+	double sphTime = std::chrono::duration<double>(done - repulsed).count() * 1000.0;
+	printf("Neighbor grid : %u particles. Build %.2f ms, repulsion %.2f ms, SPH %.2f ms on %u threads\n",
+		(unsigned int)count, buildTime, repulsionTime, sphTime, threadPoolSize() + 1);
+	return buildTime + repulsionTime;
+}
@@ -0,0 +1,43 @@
+#ifndef NEIGHBORGRID_HPP
+#define NEIGHBORGRID_HPP
+
+#include <stddef.h>
+#include <vector>
+
+// Particles binned by cell into a hash table, with a counting sort : building and querying are
+// O(n), and the memory is allocated once for `capacity` particles. Cells are as wide as the
+// interaction radius, so the neighbors of a particle are in its cell and the 26 around it.
+struct NeighborGrid {
+	float cellSize;
+	size_t capacity;
+	size_t count;
+	unsigned int tableMask;                // Table size - 1, a power of 2
+	std::vector<unsigned int> bucketStart; // Particles of bucket b : sorted[bucketStart[b] .. bucketStart[b+1]]
+	std::vector<unsigned int> bucketOf;    // Per input particle
+	std::vector<unsigned int> sorted;      // Input indices, grouped by bucket
+	std::vector<unsigned long long> cell;  // Cell of each sorted particle, to skip the others sharing its bucket
+	std::vector<float> x, y, z;            // Positions, in sorted order
+	std::vector<float> density;            // SPH scratch, in sorted order
+};
+
+void initNeighborGrid(NeighborGrid & grid, size_t capacity, float cellSize);
+// Bins the positions, given as columns. Particles beyond the capacity are left out; returns how many went in.
+size_t buildNeighborGrid(NeighborGrid & grid, const float * x, const float * y, const float * z, size_t count);
+
+// Pushes particles apart when closer than the cell size, harder the closer they are.
+// Accelerations are written for the particles in the grid, in input order.
+void computeRepulsion(const NeighborGrid & grid, float strength, float * ax, float * ay, float * az);
+
+struct SPHSettings {
+	float mass;        // Of every particle
+	float restDensity; // Particles push each other apart above it, pull together below
+	float stiffness;   // Pressure per unit of density above the rest density
+};
+
+// Smoothed particle hydrodynamics, with the cell size as smoothing length : density, then pressure forces
+void computeSPH(NeighborGrid & grid, const SPHSettings & settings, float * ax, float * ay, float * az);
+
+// Times building the grid and computing the repulsion for `count` random particles, and prints it
+double benchmarkNeighborGrid(size_t count);
+
+#endif
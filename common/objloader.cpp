@@ -183,8 +183,8 @@ bool loadAssImp(
 
 	const aiScene* scene = importer.ReadFile(path, 0/*aiProcess_JoinIdenticalVertices | aiProcess_SortByPType*/);
 	if (!scene) {
-		fprintf(stderr, importer.GetErrorString());
-		getchar();
+		// No getchar() here : this runs on the asset loader threads
+		fprintf(stderr, "%s\n", importer.GetErrorString());
 		return false;
 	}
 	const aiMesh* mesh = scene->mMeshes[0]; // In this simple example code we always use the 1rst mesh (in OBJ files there is often only one anyway)
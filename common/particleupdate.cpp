@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+#include <glm/glm.hpp>
+
+#include "collision.hpp"
+#include "forcefield.hpp"
+#include "random.hpp"
+#include "threadpool.hpp"
+#include "particleupdate.hpp"
+
+// Whether a module runs : compiled in, and asked for
+#define PARTICLE_HAS(feature) ((Features & (feature)) != 0 && (features & (feature)) != 0)
+
+// The body of every kernel. `Features` are the modules compiled in, `features` the ones that run.
+// The specialized kernels pass the same constant for both, so every test folds away and the unused
+// modules are not even compiled in; the generic kernel compiles them all and tests them per particle.
+template<unsigned int Features>
+static inline void updateRange(Particle * particles, size_t begin, size_t end, unsigned int features, const ParticleUpdate & update){
+
+	float dt = update.dt;
+	float dragFactor = PARTICLE_HAS(PARTICLE_DRAG) ? expf(-update.drag * dt) : 1.0f;
+	float inverseLifetime = update.lifetime > 0.0f ? 1.0f / update.lifetime : 0.0f;
+
+	for (size_t i = begin; i < end; i++) {
+
+		Particle & p = particles[i];
+		if (p.life <= 0.0f)
+			continue;
+
+		// Decrease life
+		p.life -= dt;
+		if (p.life <= 0.0f) {
+			// Dead particles are not drawn
+			p.cameradistance = -1.0f;
+			continue;
+		}
+
+		// The acceleration is taken where the step starts and kept over it : exact for gravity,
+		// so a long catch up step lands about where small steps would.
+		p.previous = p.pos;
+		if (PARTICLE_HAS(PARTICLE_GRAVITY | PARTICLE_FORCE_FIELD)) {
+			glm::vec3 acceleration(0.0f, 0.0f, 0.0f);
+			if (PARTICLE_HAS(PARTICLE_GRAVITY))
+				acceleration += update.gravity;
+			if (PARTICLE_HAS(PARTICLE_FORCE_FIELD))
+				acceleration += forceFieldAcceleration(*update.forces, p.pos);
+			p.pos += p.speed * dt + acceleration * (0.5f * dt * dt);
+			p.speed += acceleration * dt;
+		} else {
+			p.pos += p.speed * dt;
+		}
+		if (PARTICLE_HAS(PARTICLE_DRAG))
+			p.speed *= dragFactor;
+
+		// From the spawn look to the end look, with the age : 0 when spawned, 1 when dying
+		if (PARTICLE_HAS(PARTICLE_COLOR_OVER_LIFE | PARTICLE_SIZE_OVER_LIFE)) {
+			float age = glm::clamp(1.0f - p.life * inverseLifetime, 0.0f, 1.0f);
+			if (PARTICLE_HAS(PARTICLE_COLOR_OVER_LIFE)) {
+				p.r = (unsigned char)(p.startColor[0] + (update.endColor[0] - p.startColor[0]) * age + 0.5f);
+				p.g = (unsigned char)(p.startColor[1] + (update.endColor[1] - p.startColor[1]) * age + 0.5f);
+				p.b = (unsigned char)(p.startColor[2] + (update.endColor[2] - p.startColor[2]) * age + 0.5f);
+				p.a = (unsigned char)(p.startColor[3] + (update.endColor[3] - p.startColor[3]) * age + 0.5f);
+			}
+			if (PARTICLE_HAS(PARTICLE_SIZE_OVER_LIFE))
+				p.size = p.startSize * (1.0f + (update.endSizeScale - 1.0f) * age);
+		}
+
+		if (PARTICLE_HAS(PARTICLE_COLLISION) &&
+		    !collideParticle(*update.grid, p.previous, p.pos, p.speed, update.collisionRadius, update.collision, update.restitution)) {
+			p.life = -1.0f;
+			p.cameradistance = -1.0f;
+		}
+	}
+}
+
+template<unsigned int Features>
+static void specializedKernel(Particle * particles, size_t begin, size_t end, const ParticleUpdate & update){
+	updateRange<Features>(particles, begin, end, Features, update);
+}
+
+// One kernel per set of features, instantiated from the last set down to 0
+template<unsigned int Features>
+struct ParticleKernelFiller {
+	static void fill(ParticleKernel * kernels){
+		kernels[Features] = specializedKernel<Features>;
+		ParticleKernelFiller<Features - 1>::fill(kernels);
+	}
+};
+
+template<>
+struct ParticleKernelFiller<0> {
+	static void fill(ParticleKernel * kernels){
+		kernels[0] = specializedKernel<0>;
+	}
+};
+
+struct ParticleKernelTable {
+	ParticleKernel kernels[PARTICLE_FEATURE_SETS];
+	ParticleKernelTable(){ ParticleKernelFiller<PARTICLE_FEATURE_SETS - 1>::fill(kernels); }
+};
+
+static const ParticleKernelTable ParticleKernels;
+
+ParticleKernel particleKernel(unsigned int features){
+	return ParticleKernels.kernels[features & (PARTICLE_FEATURE_SETS - 1)];
+}
+
+void updateParticlesGeneric(Particle * particles, size_t begin, size_t end, unsigned int features, const ParticleUpdate & update){
+	updateRange<PARTICLE_FEATURE_SETS - 1>(particles, begin, end, features, update);
+}
+
+void updateParticles(Particle * particles, size_t count, size_t grain, unsigned int features, const ParticleUpdate & update){
+	ParticleKernel kernel = particleKernel(features);
+	parallelFor(count, grain, [&](size_t begin, size_t end) {
+		kernel(particles, begin, end, update);
+	});
+}
+
+double benchmarkParticleUpdate(size_t count){
+
+	if (count == 0)
+		return 0.0;
+
+	// Emitters like the ones of the demo, and one with every module
+	struct BenchmarkEmitter {
+		const char * name;
+		unsigned int features;
+	};
+	const BenchmarkEmitter emitters[] = {
+		{ "rain", PARTICLE_COLLISION },
+		{ "smoke", PARTICLE_GRAVITY | PARTICLE_FORCE_FIELD | PARTICLE_COLLISION },
+		{ "sparks", PARTICLE_GRAVITY | PARTICLE_DRAG | PARTICLE_COLOR_OVER_LIFE | PARTICLE_SIZE_OVER_LIFE | PARTICLE_COLLISION },
+		{ "everything", PARTICLE_FEATURE_SETS - 1 },
+	};
+	const int Steps = 10;
+
+	// The ground, and some turbulence
+	CollisionGrid grid;
+	buildCollisionGrid(std::vector<glm::vec3>(), std::vector<unsigned short>(), 0.5f, 0.1f, grid);
+	setCollisionGround(grid, 0.0f);
+	CurlNoiseVolume noise;
+	bakeCurlNoise(noise, glm::vec3(0.0f, 0.0f, 0.0f), 16.0f, 16, 4, 1);
+	ForceFieldSet forces;
+	clearForceFields(forces);
+	addForceField(forces, curlNoiseField(&noise, 3.0f));
+
+	ParticleUpdate update;
+	update.dt = 1.0f / 60.0f;
+	update.lifetime = 1.0f;
+	update.gravity = glm::vec3(0.0f, -9.8f, 0.0f);
+	update.drag = 0.5f;
+	update.forces = &forces;
+	update.endColor[0] = update.endColor[1] = update.endColor[2] = 255;
+	update.endColor[3] = 0;
+	update.endSizeScale = 2.0f;
+	update.grid = &grid;
+	update.collisionRadius = 0.05f;
+	update.collision = COLLISION_BOUNCE;
+	update.restitution = 0.3f;
+
+	// Alive for the whole run, moving about above the ground
+	std::vector<Particle> initial(count);
+	Random random;
+	seedRandom(random, 1);
+	for (size_t i = 0; i < count; i++) {
+		Particle & p = initial[i];
+		p.pos = glm::vec3(randomRange(random, -8.0f, 8.0f), randomRange(random, 0.2f, 8.0f), randomRange(random, -8.0f, 8.0f));
+		p.previous = p.pos;
+		p.speed = randomDirection(random) * randomRange(random, 0.0f, 4.0f);
+		p.life = randomRange(random, 0.5f, 1.0f);
+		p.cameradistance = 0.0f;
+		p.angle = p.weight = 0.0f;
+		p.startSize = p.size = randomRange(random, 0.1f, 0.6f);
+		p.startColor[0] = p.r = 170;
+		p.startColor[1] = p.g = 170;
+		p.startColor[2] = p.b = 170;
+		p.startColor[3] = p.a = 80;
+	}
+
+	// On this thread only : the kernels, not the pool
+	std::vector<Particle> generic(count), specialized(count);
+	double genericTotal = 0.0, specializedTotal = 0.0;
+	for (size_t e = 0; e < sizeof(emitters) / sizeof(emitters[0]); e++) {
+		unsigned int features = emitters[e].features;
+		ParticleKernel kernel = particleKernel(features);
+		generic = initial;
+		specialized = initial;
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int step = 0; step < Steps; step++)
+			updateParticlesGeneric(&generic[0], 0, count, features, update);
+		std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+		for (int step = 0; step < Steps; step++)
+			kernel(&specialized[0], 0, count, update);
+		std::chrono::steady_clock::time_point done = std::chrono::steady_clock::now();
+
+		// Same modules, same arithmetic : the particles should come out the same
+		size_t different = 0;
+		for (size_t i = 0; i < count; i++)
+			different += memcmp(&generic[i], &specialized[i], sizeof(Particle)) != 0;
+
+		double genericTime = std::chrono::duration<double>(middle - start).count() * 1000.0;
+		double specializedTime = std::chrono::duration<double>(done - middle).count() * 1000.0;
+		genericTotal += genericTime;
+		specializedTotal += specializedTime;
+		printf("Particle update : %s, %u particles x %d steps. Generic %.2f ms, specialized %.2f ms (x%.2f)%s\n",
+			emitters[e].name, (unsigned int)count, Steps, genericTime, specializedTime,
+			specializedTime > 0.0 ? genericTime / specializedTime : 0.0, different > 0 ? ", RESULTS DIFFER" : "");
+	}
+	return specializedTotal > 0.0 ? genericTotal / specializedTotal : 0.0;
+}
@@ -0,0 +1,69 @@
+#ifndef PARTICLEUPDATE_HPP
+#define PARTICLEUPDATE_HPP
+
+#include <stddef.h>
+
+#include "collision.hpp"
+
+struct ForceFieldSet;
+
+// CPU representation of a particle
+struct Particle {
+	glm::vec3 pos, speed;
+	glm::vec3 previous; // Position before the last step : frames are drawn in between
+	unsigned char r, g, b, a; // Color
+	float size, angle, weight;
+	float life; // Remaining life of the particle. if <0 : dead and unused.
+	float cameradistance; // *Squared* distance to the camera. if dead : -1.0f
+	unsigned char startColor[4]; // As spawned, for the color over life
+	float startSize;             // As spawned, for the size over life
+
+	bool operator<(const Particle& that) const {
+		// Sort in reverse order : far particles drawn first.
+		return this->cameradistance > that.cameradistance;
+	}
+};
+
+// What a step does to the particles of an emitter, module by module. Each set of features gets
+// its own kernel, compiled with only those modules : a feature an emitter does not use costs nothing.
+enum ParticleFeature {
+	PARTICLE_GRAVITY = 1 << 0,        // Uniform acceleration
+	PARTICLE_DRAG = 1 << 1,           // Speed lost in proportion to itself
+	PARTICLE_FORCE_FIELD = 1 << 2,    // Acceleration from a ForceFieldSet : attractors, turbulence
+	PARTICLE_COLOR_OVER_LIFE = 1 << 3, // From the spawn color to endColor
+	PARTICLE_SIZE_OVER_LIFE = 1 << 4, // From the spawn size to endSizeScale times it
+	PARTICLE_COLLISION = 1 << 5       // Against a CollisionGrid
+};
+#define PARTICLE_FEATURE_SETS (1 << 6)
+
+// The parameters of the modules. Those of the features left out are not read.
+struct ParticleUpdate {
+	float dt;
+	float lifetime; // Life of a new particle, to tell how far along each one is
+	glm::vec3 gravity;
+	float drag;     // Per second : the speed is multiplied by exp(-drag * dt) every step
+	const ForceFieldSet * forces;
+	unsigned char endColor[4];
+	float endSizeScale;
+	const CollisionGrid * grid;
+	float collisionRadius;
+	CollisionResponse collision;
+	float restitution;
+};
+
+// Ages, moves and collides particles[begin .. end], the dead ones skipped
+typedef void (*ParticleKernel)(Particle * particles, size_t begin, size_t end, const ParticleUpdate & update);
+
+// The kernel compiled for these ParticleFeature bits, from a table of all of them
+ParticleKernel particleKernel(unsigned int features);
+// The same modules behind runtime tests, one kernel for every emitter. Same results, for comparison.
+void updateParticlesGeneric(Particle * particles, size_t begin, size_t end, unsigned int features, const ParticleUpdate & update);
+
+// Updates particles[0 .. count] on the thread pool, in chunks of `grain`, with the kernel of `features`
+void updateParticles(Particle * particles, size_t count, size_t grain, unsigned int features, const ParticleUpdate & update);
+
+// Times the specialized kernels against the generic one on `count` particles, for a few emitters.
+// Returns the speedup of the specialized kernels over all of them.
+double benchmarkParticleUpdate(size_t count);
+
+#endif
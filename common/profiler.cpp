@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <GL/glew.h>
+
+#include "profiler.hpp"
+
+// Frames between issuing GPU queries and reading them back
+#define PROFILER_GPU_LATENCY 2
+
+static std::mutex ProfilerMutex;
+static std::vector<ProfileEvent> Events; // Ring buffer, guarded by ProfilerMutex
+static size_t NextEvent = 0;
+static size_t EventCount = 0;
+static std::map<unsigned int, std::string> ThreadNames;
+static std::chrono::steady_clock::time_point ProfilerEpoch;
+
+// Running averages per scope name, for on-screen display
+struct NameLess {
+	bool operator()(const char * a, const char * b) const { return strcmp(a, b) < 0; }
+};
+struct ProfileAverage {
+	double cpu; // Milliseconds, negative until first timed
+	double gpu;
+};
+static std::map<const char *, ProfileAverage, NameLess> Averages; // Guarded by ProfilerMutex
+
+// Weight of the newest sample : about the last 20 frames count
+#define PROFILER_AVERAGE_WEIGHT 0.05
+
+static std::atomic<unsigned int> NextThreadID(1);
+static thread_local unsigned int ProfilerThreadID = 0;
+
+// One set of timestamp queries per frame in flight
+struct GPUFrame {
+	std::vector<GLuint> queries;       // Pairs : begin, end
+	std::vector<const char *> names;   // One per pair
+	size_t used;                       // Pairs used this frame
+};
+static bool GPUProfiling = false;
+static GPUFrame GPUFrames[PROFILER_GPU_LATENCY];
+static unsigned int CurrentGPUFrame = 0;
+static GLint64 GPUEpoch = 0;    // GL_TIMESTAMP when initProfilerGPU() ran ...
+static double GPUEpochCPU = 0;  // ... and the CPU time at that moment
+static unsigned int DroppedGPUEvents = 0;
+
+static double frameStart = -1.0;
+
+static double now(){
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - ProfilerEpoch).count();
+}
+
+static unsigned int currentThread(){
+	if (ProfilerThreadID == 0)
+		ProfilerThreadID = NextThreadID++;
+	return ProfilerThreadID;
+}
+
+static void recordEvent(const char * name, unsigned int thread, double start, double duration){
+	if (Events.empty())
+		return;
+	std::lock_guard<std::mutex> lock(ProfilerMutex);
+	ProfileEvent & event = Events[NextEvent];
+	event.name = name;
+	event.thread = thread;
+	event.start = start;
+	event.duration = duration;
+	NextEvent = (NextEvent + 1) % Events.size();
+	if (EventCount < Events.size())
+		EventCount++;
+
+	std::map<const char *, ProfileAverage, NameLess>::iterator it = Averages.find(name);
+	if (it == Averages.end()) {
+		ProfileAverage average = { -1.0, -1.0 };
+		it = Averages.insert(std::make_pair(name, average)).first;
+	}
+	double & value = thread == 0 ? it->second.gpu : it->second.cpu;
+	double milliseconds = duration / 1000.0;
+	value = value < 0.0 ? milliseconds : value + (milliseconds - value) * PROFILER_AVERAGE_WEIGHT;
+}
+
+void initProfiler(size_t capacity){
+	std::lock_guard<std::mutex> lock(ProfilerMutex);
+	Events.assign(capacity, ProfileEvent());
+	NextEvent = 0;
+	EventCount = 0;
+	ProfilerEpoch = std::chrono::steady_clock::now();
+	frameStart = -1.0;
+}
+
+bool initProfilerGPU(){
+
+	// Timestamps are core since 3.3, but some drivers report 0 bits of precision
+	GLint bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+	if (bits == 0) {
+		printf("No GPU timer queries, the profiler only times the CPU\n");
+		return false;
+	}
+
+	// Put both clocks on the same timeline
+	glGetInteger64v(GL_TIMESTAMP, &GPUEpoch);
+	GPUEpochCPU = now();
+	GPUProfiling = true;
+
+	std::lock_guard<std::mutex> lock(ProfilerMutex);
+	ThreadNames[0] = "GPU";
+	return true;
+}
+
+void cleanupProfiler(){
+	for (int i = 0; i < PROFILER_GPU_LATENCY; i++) {
+		if (!GPUFrames[i].queries.empty())
+			glDeleteQueries((GLsizei)GPUFrames[i].queries.size(), &GPUFrames[i].queries[0]);
+		GPUFrames[i].queries.clear();
+		GPUFrames[i].names.clear();
+		GPUFrames[i].used = 0;
+	}
+	GPUProfiling = false;
+
+	std::lock_guard<std::mutex> lock(ProfilerMutex);
+	Events.clear();
+	NextEvent = EventCount = 0;
+	Averages.clear();
+}
+
+// Results of a frame issued PROFILER_GPU_LATENCY frames ago. Those still not available are
+// dropped rather than waited for : a stall here would be worse than a hole in the trace.
+static void readGPUFrame(GPUFrame & frame){
+	for (size_t i = 0; i < frame.used; i++) {
+		GLuint available = 0;
+		glGetQueryObjectuiv(frame.queries[2 * i + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			DroppedGPUEvents++;
+			continue;
+		}
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(frame.queries[2 * i], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(frame.queries[2 * i + 1], GL_QUERY_RESULT, &end);
+		double start = GPUEpochCPU + (double)((GLint64)begin - GPUEpoch) / 1000.0;
+		recordEvent(frame.names[i], 0, start, (double)(end - begin) / 1000.0);
+	}
+	frame.used = 0;
+}
+
+void beginProfilerFrame(){
+
+	double time = now();
+	if (frameStart >= 0.0)
+		recordEvent("Frame", currentThread(), frameStart, time - frameStart);
+	frameStart = time;
+
+	if (GPUProfiling) {
+		CurrentGPUFrame = (CurrentGPUFrame + 1) % PROFILER_GPU_LATENCY;
+		readGPUFrame(GPUFrames[CurrentGPUFrame]);
+	}
+}
+
+void setProfilerThreadName(const char * name){
+	unsigned int thread = currentThread();
+	std::lock_guard<std::mutex> lock(ProfilerMutex);
+	ThreadNames[thread] = name;
+}
+
+ProfileScope::ProfileScope(const char * name, ProfileTimeline timeline)
+	: name(name), start(now()), gpuQuery(-1), open(true){
+
+	if (timeline != PROFILE_GPU || !GPUProfiling)
+		return;
+
+	GPUFrame & frame = GPUFrames[CurrentGPUFrame];
+	if (frame.used * 2 == frame.queries.size()) {
+		frame.queries.resize(frame.queries.size() + 2);
+		glGenQueries(2, &frame.queries[frame.queries.size() - 2]);
+		frame.names.push_back(NULL);
+	}
+	gpuQuery = (int)(frame.used * 2);
+	frame.names[frame.used] = name;
+	frame.used++;
+	glQueryCounter(frame.queries[gpuQuery], GL_TIMESTAMP);
+}
+
+void ProfileScope::end(){
+	if (!open)
+		return;
+	open = false;
+	recordEvent(name, currentThread(), start, now() - start);
+	if (gpuQuery >= 0)
+		glQueryCounter(GPUFrames[CurrentGPUFrame].queries[gpuQuery + 1], GL_TIMESTAMP);
+}
+
+size_t getProfileEvents(ProfileEvent * events, size_t maxEvents){
+	std::lock_guard<std::mutex> lock(ProfilerMutex);
+	size_t count = EventCount < maxEvents ? EventCount : maxEvents;
+	size_t first = (NextEvent + Events.size() - EventCount) % (Events.empty() ? 1 : Events.size());
+	for (size_t i = 0; i < count; i++)
+		events[i] = Events[(first + EventCount - count + i) % Events.size()];
+	return count;
+}
+
+double getProfileAverage(const char * name, ProfileTimeline timeline){
+	std::lock_guard<std::mutex> lock(ProfilerMutex);
+	std::map<const char *, ProfileAverage, NameLess>::iterator it = Averages.find(name);
+	if (it == Averages.end())
+		return -1.0;
+	return timeline == PROFILE_GPU ? it->second.gpu : it->second.cpu;
+}
+
+static void writeJSONString(FILE * file, const char * text){
+	fputc('"', file);
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\')
+			fputc('\\', file);
+		if ((unsigned char)*text >= 0x20)
+			fputc(*text, file);
+	}
+	fputc('"', file);
+}
+
+bool writeChromeTrace(const char * path){
+
+	std::vector<ProfileEvent> events(Events.size());
+	events.resize(getProfileEvents(events.empty() ? NULL : &events[0], events.size()));
+	std::map<unsigned int, std::string> names;
+	{
+		std::lock_guard<std::mutex> lock(ProfilerMutex);
+		names = ThreadNames;
+	}
+
+	FILE * file = fopen(path, "w");
+	if (file == NULL) {
+		printf("%s could not be written\n", path);
+		return false;
+	}
+
+	// Complete ("X") events, plus the thread names as metadata
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (std::map<unsigned int, std::string>::iterator it = names.begin(); it != names.end(); ++it) {
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", it->first);
+		writeJSONString(file, it->second.c_str());
+		fprintf(file, "}}");
+		first = false;
+	}
+	for (size_t i = 0; i < events.size(); i++) {
+		fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+		writeJSONString(file, events[i].name);
+		fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", events[i].thread, events[i].start, events[i].duration);
+		first = false;
+	}
+	fprintf(file, "\n]}\n");
+
+	bool written = fclose(file) == 0;
+	if (written)
+		printf("Wrote %u events to %s (%u GPU timings were not ready in time)\n", (unsigned int)events.size(), path, DroppedGPUEvents);
+	return written;
+}
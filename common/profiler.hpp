@@ -0,0 +1,53 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stddef.h>
+
+// A timed interval, in microseconds since initProfiler()
+struct ProfileEvent {
+	const char * name;   // Not copied : use string literals
+	unsigned int thread; // 0 is the GPU, then one per CPU thread in the order they first record something
+	double start;
+	double duration;
+};
+
+// Keeps the last `capacity` events in a ring buffer. The CPU side needs no GL context.
+void initProfiler(size_t capacity = 64 * 1024);
+// GL timer queries, with a context current. Returns false if the driver has no timestamps.
+bool initProfilerGPU();
+void cleanupProfiler();
+
+// Call at the start of every frame on the GL thread : closes the previous frame
+// and reads back the GPU timings of the frame before it, so the CPU never waits for them.
+void beginProfilerFrame();
+
+void setProfilerThreadName(const char * name);
+
+enum ProfileTimeline {
+	PROFILE_CPU = 0,
+	PROFILE_GPU = 1 // Also timed on the GPU, from the GL thread only
+};
+
+// Times its own lifetime, or until end() is called.
+// Scopes can nest; GPU scopes must be opened and closed on the GL thread.
+class ProfileScope {
+public:
+	ProfileScope(const char * name, ProfileTimeline timeline = PROFILE_CPU);
+	~ProfileScope() { end(); }
+	void end();
+private:
+	const char * name;
+	double start;
+	int gpuQuery; // Index of the first of 2 timestamp queries, -1 for CPU only
+	bool open;
+};
+
+// Copies the recorded events, oldest first
+size_t getProfileEvents(ProfileEvent * events, size_t maxEvents);
+// Smoothed duration of the scopes called `name` over the last few frames, in milliseconds.
+// -1 if nothing by that name was timed on that timeline yet.
+double getProfileAverage(const char * name, ProfileTimeline timeline = PROFILE_CPU);
+// Everything in the ring buffer, in the Trace Event format of chrome://tracing and Perfetto
+bool writeChromeTrace(const char * path);
+
+#endif
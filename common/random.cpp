@@ -0,0 +1,183 @@
+#include <math.h>
+#include <atomic>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RANDOM_SSE 1
+#endif
+
+#include <glm/glm.hpp>
+
+#include "random.hpp"
+
+static const float TwoPi = 6.28318531f;
+
+// Seeds of the thread generators, and a count bumped whenever it changes
+static std::atomic<unsigned long long> ThreadSeed(0);
+static std::atomic<unsigned int> SeedGeneration(1);
+static std::atomic<unsigned long long> NextThreadStream(0);
+
+static thread_local Random ThreadRandom;
+static thread_local unsigned int ThreadGeneration = 0;
+
+// Spreads any seed over all the bits : xoshiro must not start from zeros
+static unsigned long long splitMix64(unsigned long long & x){
+	unsigned long long z = (x += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+void seedRandom(Random & random, unsigned long long seed, unsigned long long stream){
+	unsigned long long x = seed ^ splitMix64(stream);
+	for (int lane = 0; lane < 4; lane++) {
+		for (int word = 0; word < 4; word += 2) {
+			unsigned long long bits = splitMix64(x);
+			random.state[word][lane] = (unsigned int)bits;
+			random.state[word + 1][lane] = (unsigned int)(bits >> 32);
+		}
+	}
+	random.used = 4;
+}
+
+void setRandomSeed(unsigned long long seed){
+	ThreadSeed = seed;
+	NextThreadStream = 0;
+	SeedGeneration++;
+}
+
+Random & threadRandom(){
+	unsigned int generation = SeedGeneration;
+	if (ThreadGeneration != generation) {
+		seedRandom(ThreadRandom, ThreadSeed, NextThreadStream++);
+		ThreadGeneration = generation;
+	}
+	return ThreadRandom;
+}
+
+// One step of the four generators : four 32 bit numbers
+static void step(Random & random, unsigned int * output){
+#ifdef RANDOM_SSE
+	__m128i s0 = _mm_loadu_si128((const __m128i *)random.state[0]);
+	__m128i s1 = _mm_loadu_si128((const __m128i *)random.state[1]);
+	__m128i s2 = _mm_loadu_si128((const __m128i *)random.state[2]);
+	__m128i s3 = _mm_loadu_si128((const __m128i *)random.state[3]);
+
+	// rotl(s0 + s3, 7) + s0
+	__m128i sum = _mm_add_epi32(s0, s3);
+	__m128i result = _mm_add_epi32(_mm_or_si128(_mm_slli_epi32(sum, 7), _mm_srli_epi32(sum, 25)), s0);
+	_mm_storeu_si128((__m128i *)output, result);
+
+	__m128i t = _mm_slli_epi32(s1, 9);
+	s2 = _mm_xor_si128(s2, s0);
+	s3 = _mm_xor_si128(s3, s1);
+	s1 = _mm_xor_si128(s1, s2);
+	s0 = _mm_xor_si128(s0, s3);
+	s2 = _mm_xor_si128(s2, t);
+	s3 = _mm_or_si128(_mm_slli_epi32(s3, 11), _mm_srli_epi32(s3, 21));
+
+	_mm_storeu_si128((__m128i *)random.state[0], s0);
+	_mm_storeu_si128((__m128i *)random.state[1], s1);
+	_mm_storeu_si128((__m128i *)random.state[2], s2);
+	_mm_storeu_si128((__m128i *)random.state[3], s3);
+#else
+	for (int lane = 0; lane < 4; lane++) {
+		unsigned int s0 = random.state[0][lane], s1 = random.state[1][lane];
+		unsigned int s2 = random.state[2][lane], s3 = random.state[3][lane];
+		unsigned int sum = s0 + s3;
+		output[lane] = ((sum << 7) | (sum >> 25)) + s0;
+
+		unsigned int t = s1 << 9;
+		s2 ^= s0;
+		s3 ^= s1;
+		s1 ^= s2;
+		s0 ^= s3;
+		s2 ^= t;
+		s3 = (s3 << 11) | (s3 >> 21);
+		random.state[0][lane] = s0;
+		random.state[1][lane] = s1;
+		random.state[2][lane] = s2;
+		random.state[3][lane] = s3;
+	}
+#endif
+}
+
+unsigned int randomUInt(Random & random){
+	if (random.used >= 4) {
+		step(random, random.output);
+		random.used = 0;
+	}
+	return random.output[random.used++];
+}
+
+// The top 24 bits, exactly representable as a float
+float randomFloat(Random & random){
+	return (randomUInt(random) >> 8) * (1.0f / 16777216.0f);
+}
+
+float randomRange(Random & random, float minimum, float maximum){
+	return minimum + (maximum - minimum) * randomFloat(random);
+}
+
+// Multiply and keep the top half (Lemire) : no division, and a bias of at most count / 2^32
+unsigned int randomBelow(Random & random, unsigned int count){
+	return (unsigned int)(((unsigned long long)randomUInt(random) * count) >> 32);
+}
+
+static glm::vec3 sphericalDirection(float u, float v){
+	float z = 2.0f * u - 1.0f;
+	float r = sqrtf(fmaxf(0.0f, 1.0f - z * z));
+	float phi = TwoPi * v;
+	return glm::vec3(r * cosf(phi), r * sinf(phi), z);
+}
+
+// Uniform in z and in the angle around z is uniform on the sphere (Archimedes)
+glm::vec3 randomDirection(Random & random){
+	float u = randomFloat(random);
+	float v = randomFloat(random);
+	return sphericalDirection(u, v);
+}
+
+glm::vec3 randomInBall(Random & random){
+	glm::vec3 direction = randomDirection(random);
+	return direction * cbrtf(randomFloat(random));
+}
+
+void randomFloats(Random & random, float * values, size_t count, float minimum, float maximum){
+	float range = maximum - minimum;
+	size_t i = 0;
+
+	// What is left of the last step first, so that batches give the same numbers as single calls
+	for (; i < count && random.used < 4; i++)
+		values[i] = minimum + range * randomFloat(random);
+
+	unsigned int bits[4];
+#ifdef RANDOM_SSE
+	__m128 scale = _mm_set1_ps(range * (1.0f / 16777216.0f));
+	__m128 offset = _mm_set1_ps(minimum);
+	for (; i + 4 <= count; i += 4) {
+		step(random, bits);
+		__m128i top = _mm_srli_epi32(_mm_loadu_si128((const __m128i *)bits), 8);
+		_mm_storeu_ps(values + i, _mm_add_ps(offset, _mm_mul_ps(_mm_cvtepi32_ps(top), scale)));
+	}
+#else
+	for (; i + 4 <= count; i += 4) {
+		step(random, bits);
+		for (int lane = 0; lane < 4; lane++)
+			values[i + lane] = minimum + range * ((bits[lane] >> 8) * (1.0f / 16777216.0f));
+	}
+#endif
+	for (; i < count; i++)
+		values[i] = minimum + range * randomFloat(random);
+}
+
+void randomDirections(Random & random, glm::vec3 * directions, size_t count){
+	// Two uniforms per direction, made four at a time
+	float uniforms[64];
+	for (size_t i = 0; i < count; i += 32) {
+		size_t batch = count - i < 32 ? count - i : 32;
+		randomFloats(random, uniforms, batch * 2, 0.0f, 1.0f);
+		for (size_t j = 0; j < batch; j++)
+			directions[i + j] = sphericalDirection(uniforms[2 * j], uniforms[2 * j + 1]);
+	}
+}
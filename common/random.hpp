@@ -0,0 +1,39 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <stddef.h>
+
+// Four xoshiro128++ generators side by side, stepped together (with SSE2 when there is).
+// A Random belongs to one thread : use threadRandom(), or one per task for results that do
+// not depend on the scheduling.
+struct Random {
+	unsigned int state[4][4]; // State word, then generator
+	unsigned int output[4];   // Numbers of the last step not handed out yet
+	unsigned int used;
+};
+
+// Generators with the same seed and different streams give unrelated sequences
+void seedRandom(Random & random, unsigned long long seed, unsigned long long stream = 0);
+
+// The calling thread's generator. Threads get streams in the order they first call it,
+// all from the seed given here (0 by default); changing it reseeds every thread's generator.
+void setRandomSeed(unsigned long long seed);
+Random & threadRandom();
+
+unsigned int randomUInt(Random & random);
+// In [0, 1)
+float randomFloat(Random & random);
+// In [minimum, maximum)
+float randomRange(Random & random, float minimum, float maximum);
+// In [0, count)
+unsigned int randomBelow(Random & random, unsigned int count);
+// Uniform on the unit sphere
+glm::vec3 randomDirection(Random & random);
+// Uniform inside the unit sphere
+glm::vec3 randomInBall(Random & random);
+
+// Batches : four numbers per step
+void randomFloats(Random & random, float * values, size_t count, float minimum, float maximum);
+void randomDirections(Random & random, glm::vec3 * directions, size_t count);
+
+#endif
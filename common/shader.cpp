@@ -13,99 +13,150 @@ using namespace std;
 #include <GL/glew.h>
 
 #include "shader.hpp"
+#include "shadercache.hpp"
+#include "shaderpreprocessor.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
-
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+bool ReadShaderFile(const char * file_path, std::string & ShaderCode){
 
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << VertexShaderStream.rdbuf();
-		VertexShaderCode = sstr.str();
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
-		return 0;
+	std::ifstream ShaderStream(file_path, std::ios::in);
+	if(!ShaderStream.is_open()){
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", file_path);
+		return false;
 	}
+	std::stringstream sstr;
+	sstr << ShaderStream.rdbuf();
+	ShaderCode = sstr.str();
+	ShaderStream.close();
+	return true;
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::stringstream sstr;
-		sstr << FragmentShaderStream.rdbuf();
-		FragmentShaderCode = sstr.str();
-		FragmentShaderStream.close();
-	}
+void StartProgramBuild(ProgramBuild & build,
+                       const char * vertex_file_path, const std::string & VertexShaderCode,
+                       const char * fragment_file_path, const std::string & FragmentShaderCode){
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
+	build.vertex_file_path = vertex_file_path;
+	build.fragment_file_path = fragment_file_path;
 
+	// Create and compile the shaders
+	build.VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	build.FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
-	// Compile Vertex Shader
 	printf("Compiling shader : %s\n", vertex_file_path);
 	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
+	glShaderSource(build.VertexShaderID, 1, &VertexSourcePointer , NULL);
+	glCompileShader(build.VertexShaderID);
 
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
-	}
+	printf("Compiling shader : %s\n", fragment_file_path);
+	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
+	glShaderSource(build.FragmentShaderID, 1, &FragmentSourcePointer , NULL);
+	glCompileShader(build.FragmentShaderID);
+
+	// Link the program. Nothing here waits for the compiler : with
+	// KHR_parallel_shader_compile the driver does the work on its own threads.
+	build.ProgramID = glCreateProgram();
+	glAttachShader(build.ProgramID, build.VertexShaderID);
+	glAttachShader(build.ProgramID, build.FragmentShaderID);
+	markProgramRetrievable(build.ProgramID);
+	glLinkProgram(build.ProgramID);
+}
 
+bool IsProgramBuildReady(const ProgramBuild & build){
 
+	if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+		return true; // No way to ask, FinishProgramBuild will block if it has to
 
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
+	GLint Completed = GL_FALSE;
+	glGetProgramiv(build.ProgramID, GL_COMPLETION_STATUS_KHR, &Completed);
+	return Completed == GL_TRUE;
+}
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+static void PrintShaderLog(GLuint ShaderID){
+	int InfoLogLength;
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+		std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
 	}
+}
 
+GLuint FinishProgramBuild(ProgramBuild & build){
 
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+	// Check the shaders
+	PrintShaderLog(build.VertexShaderID);
+	PrintShaderLog(build.FragmentShaderID);
 
 	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	printf("Linking program\n");
+	glGetProgramiv(build.ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(build.ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if ( InfoLogLength > 0 ){
 		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		glGetProgramInfoLog(build.ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
 
 	
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
+	glDetachShader(build.ProgramID, build.VertexShaderID);
+	glDetachShader(build.ProgramID, build.FragmentShaderID);
 	
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+	glDeleteShader(build.VertexShaderID);
+	glDeleteShader(build.FragmentShaderID);
+
+	if (Result != GL_TRUE) {
+		glDeleteProgram(build.ProgramID);
+		build.ProgramID = 0;
+	}
+	return build.ProgramID;
+}
+
+GLuint LoadShadersFromSource(const char * vertex_file_path, const std::string & VertexShaderCode,
+                             const char * fragment_file_path, const std::string & FragmentShaderCode,
+                             const std::string & defines){
+
+	// A program built from exactly these sources on this driver may already be on disk
+	unsigned long long CacheKey = shaderCacheKey(VertexShaderCode, FragmentShaderCode, defines);
+	GLuint CachedProgramID = loadCachedProgram(CacheKey);
+	if (CachedProgramID != 0){
+		printf("Loaded program %s + %s from the shader cache\n", vertex_file_path, fragment_file_path);
+		return CachedProgramID;
+	}
+
+	ProgramBuild build;
+	StartProgramBuild(build, vertex_file_path, VertexShaderCode, fragment_file_path, FragmentShaderCode);
+	GLuint ProgramID = FinishProgramBuild(build);
+
+	// Only a successfully linked program is worth keeping for the next launch
+	if (ProgramID != 0)
+		storeCachedProgram(CacheKey, ProgramID);
 
 	return ProgramID;
 }
 
+GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path){
+	return LoadShaders(vertex_file_path, fragment_file_path, std::vector<std::string>());
+}
+
+GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path, const std::vector<std::string> & defines){
+
+	std::vector<std::string> dependencies;
 
+	// Read the Vertex Shader code from the file, with its includes
+	std::string VertexShaderCode;
+	if (!PreprocessShader(vertex_file_path, defines, VertexShaderCode, dependencies)){
+		getchar();
+		return 0;
+	}
+
+	// Read the Fragment Shader code from the file, with its includes
+	std::string FragmentShaderCode;
+	if (!PreprocessShader(fragment_file_path, defines, FragmentShaderCode, dependencies)){
+		getchar();
+		return 0;
+	}
+
+	return LoadShadersFromSource(vertex_file_path, VertexShaderCode, fragment_file_path, FragmentShaderCode, JoinDefines(defines));
+}
@@ -1,6 +1,38 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+#include <string>
+#include <vector>
+
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path);
 
+// Compiles one permutation of a pair of shaders : the sources go through PreprocessShader
+// (#include, injected defines), and every permutation gets its own shader cache entry.
+GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path, const std::vector<std::string> & defines);
+
+// Same as LoadShaders, for sources that are already in memory. The paths are only used in messages.
+// Goes through the program binary cache when initShaderCache() was called.
+GLuint LoadShadersFromSource(const char * vertex_file_path, const std::string & VertexShaderCode,
+                             const char * fragment_file_path, const std::string & FragmentShaderCode,
+                             const std::string & defines);
+
+bool ReadShaderFile(const char * file_path, std::string & ShaderCode);
+
+// A compile + link that can be spread over several frames :
+// StartProgramBuild, then IsProgramBuildReady every frame, then FinishProgramBuild.
+struct ProgramBuild {
+	GLuint VertexShaderID;
+	GLuint FragmentShaderID;
+	GLuint ProgramID;
+	std::string vertex_file_path;
+	std::string fragment_file_path;
+};
+
+void StartProgramBuild(ProgramBuild & build,
+                       const char * vertex_file_path, const std::string & VertexShaderCode,
+                       const char * fragment_file_path, const std::string & FragmentShaderCode);
+bool IsProgramBuildReady(const ProgramBuild & build);
+// Prints the logs. Returns the program, or 0 (and deletes it) if it did not link.
+GLuint FinishProgramBuild(ProgramBuild & build);
+
 #endif
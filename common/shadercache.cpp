@@ -0,0 +1,387 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#include <GL/glew.h>
+
+#include "shadercache.hpp"
+
+// On-disk layout : this header, then the binary as returned by glGetProgramBinary
+struct ShaderCacheHeader {
+	char magic[4];               // "GLPB"
+	unsigned int version;        // SHADER_CACHE_VERSION
+	unsigned long long key;      // Guards against a renamed or mixed-up file
+	unsigned int format;         // binaryFormat from glGetProgramBinary
+	unsigned int length;         // Number of bytes following the header
+};
+
+#define SHADER_CACHE_VERSION 1
+
+// ---------------------------------------------------------------------------
+// Real GL implementation
+
+static bool glSupportsBinaries(){
+	if (!GLEW_ARB_get_program_binary)
+		return false;
+	// Some core profile drivers expose the extension but no format at all
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+static void glMarkRetrievable(GLuint programID){
+	glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+static bool glGetBinary(GLuint programID, std::vector<unsigned char> & binary, GLenum & format){
+	GLint length = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+	binary.resize(length);
+	GLsizei written = 0;
+	glGetProgramBinary(programID, length, &written, &format, &binary[0]);
+	binary.resize(written);
+	return written > 0;
+}
+
+static GLuint glProgramFromBinary(const unsigned char * binary, GLsizei length, GLenum format){
+	GLuint programID = glCreateProgram();
+	glProgramBinary(programID, format, binary, length);
+
+	GLint Result = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE) {
+		glDeleteProgram(programID);
+		return 0;
+	}
+	return programID;
+}
+
+static std::string glDriverIdentity(){
+	std::string identity;
+	const char * strings[3] = {
+		(const char *)glGetString(GL_VENDOR),
+		(const char *)glGetString(GL_RENDERER),
+		(const char *)glGetString(GL_VERSION)
+	};
+	for (int i = 0; i < 3; i++) {
+		if (strings[i])
+			identity += strings[i];
+		identity += '\n';
+	}
+	return identity;
+}
+
+static const ShaderCacheGL RealShaderCacheGL = {
+	glSupportsBinaries,
+	glMarkRetrievable,
+	glGetBinary,
+	glProgramFromBinary,
+	glDriverIdentity
+};
+
+// ---------------------------------------------------------------------------
+
+static bool ShaderCacheEnabled = false;
+static std::string ShaderCacheDirectory;
+static std::string ShaderCacheDriver;
+static ShaderCacheGL ShaderCacheFunctions;
+static ShaderCacheStats ShaderCacheCounters;
+
+static void makeDirectory(const char * path){
+#ifdef _WIN32
+	_mkdir(path);
+#else
+	mkdir(path, 0755);
+#endif
+}
+
+static void removeDirectory(const char * path){
+#ifdef _WIN32
+	_rmdir(path);
+#else
+	rmdir(path);
+#endif
+}
+
+static std::string cacheFilePath(unsigned long long key){
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", key);
+	return ShaderCacheDirectory + "/" + name;
+}
+
+void initShaderCache(const char * directory, const ShaderCacheGL * gl){
+
+	ShaderCacheFunctions = gl ? *gl : RealShaderCacheGL;
+	memset(&ShaderCacheCounters, 0, sizeof(ShaderCacheCounters));
+
+	if (!ShaderCacheFunctions.supportsBinaries()) {
+		printf("Program binaries are not supported by this driver, shaders will be compiled every time\n");
+		ShaderCacheEnabled = false;
+		return;
+	}
+
+	ShaderCacheDirectory = directory;
+	ShaderCacheDriver = ShaderCacheFunctions.driverIdentity();
+	makeDirectory(directory);
+	ShaderCacheEnabled = true;
+}
+
+bool shaderCacheEnabled(){
+	return ShaderCacheEnabled;
+}
+
+static void hashBytes(unsigned long long & hash, const void * data, size_t size){
+	const unsigned char * bytes = (const unsigned char *)data;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL; // FNV prime
+	}
+}
+
+unsigned long long shaderCacheKey(const std::string & vertexSource, const std::string & fragmentSource, const std::string & defines){
+
+	unsigned long long hash = 14695981039346656037ULL; // FNV offset basis
+
+	// Lengths are hashed too, so moving text from one stage to the other changes the key
+	const std::string * parts[4] = { &vertexSource, &fragmentSource, &defines, &ShaderCacheDriver };
+	for (int i = 0; i < 4; i++) {
+		unsigned long long length = parts[i]->size();
+		hashBytes(hash, &length, sizeof(length));
+		hashBytes(hash, parts[i]->data(), parts[i]->size());
+	}
+	return hash;
+}
+
+GLuint loadCachedProgram(unsigned long long key){
+
+	if (!ShaderCacheEnabled)
+		return 0;
+
+	std::string path = cacheFilePath(key);
+	FILE * file = fopen(path.c_str(), "rb");
+	if (!file) {
+		ShaderCacheCounters.misses++;
+		return 0;
+	}
+
+	ShaderCacheHeader header;
+	std::vector<unsigned char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, "GLPB", 4) == 0
+		&& header.version == SHADER_CACHE_VERSION
+		&& header.key == key
+		&& header.length > 0;
+	if (valid) {
+		binary.resize(header.length);
+		valid = fread(&binary[0], 1, header.length, file) == header.length;
+	}
+	fclose(file);
+
+	GLuint programID = valid ? ShaderCacheFunctions.programFromBinary(&binary[0], (GLsizei)binary.size(), header.format) : 0;
+	if (programID == 0) {
+		printf("Discarding stale shader cache entry %s\n", path.c_str());
+		remove(path.c_str());
+		ShaderCacheCounters.rejected++;
+		ShaderCacheCounters.misses++;
+		return 0;
+	}
+
+	ShaderCacheCounters.hits++;
+	return programID;
+}
+
+void markProgramRetrievable(GLuint programID){
+	if (ShaderCacheEnabled)
+		ShaderCacheFunctions.markRetrievable(programID);
+}
+
+void storeCachedProgram(unsigned long long key, GLuint programID){
+
+	if (!ShaderCacheEnabled)
+		return;
+
+	std::vector<unsigned char> binary;
+	GLenum format = 0;
+	if (!ShaderCacheFunctions.getProgramBinary(programID, binary, format))
+		return;
+
+	ShaderCacheHeader header;
+	memcpy(header.magic, "GLPB", 4);
+	header.version = SHADER_CACHE_VERSION;
+	header.key = key;
+	header.format = format;
+	header.length = (unsigned int)binary.size();
+
+	// Write to a temporary file first, so a crash never leaves a truncated entry behind
+	std::string path = cacheFilePath(key);
+	std::string temporaryPath = path + ".tmp";
+	FILE * file = fopen(temporaryPath.c_str(), "wb");
+	if (!file) {
+		printf("Impossible to write %s\n", temporaryPath.c_str());
+		return;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&binary[0], 1, binary.size(), file) == binary.size();
+	fclose(file);
+
+	remove(path.c_str()); // rename() does not replace an existing file on Windows
+	if (!written || rename(temporaryPath.c_str(), path.c_str()) != 0) {
+		remove(temporaryPath.c_str());
+		return;
+	}
+	ShaderCacheCounters.stored++;
+}
+
+void invalidateCachedProgram(unsigned long long key){
+	if (ShaderCacheEnabled)
+		remove(cacheFilePath(key).c_str());
+}
+
+void clearShaderCache(){
+
+	if (!ShaderCacheEnabled)
+		return;
+
+#ifdef _WIN32
+	struct _finddata_t entry;
+	std::string pattern = ShaderCacheDirectory + "/*.bin";
+	intptr_t handle = _findfirst(pattern.c_str(), &entry);
+	if (handle == -1)
+		return;
+	do {
+		remove((ShaderCacheDirectory + "/" + entry.name).c_str());
+	} while (_findnext(handle, &entry) == 0);
+	_findclose(handle);
+#else
+	DIR * directory = opendir(ShaderCacheDirectory.c_str());
+	if (!directory)
+		return;
+	struct dirent * entry;
+	while ((entry = readdir(directory)) != NULL) {
+		size_t length = strlen(entry->d_name);
+		if (length > 4 && strcmp(entry->d_name + length - 4, ".bin") == 0)
+			remove((ShaderCacheDirectory + "/" + entry->d_name).c_str());
+	}
+	closedir(directory);
+#endif
+}
+
+ShaderCacheStats getShaderCacheStats(){
+	return ShaderCacheCounters;
+}
+
+// ---------------------------------------------------------------------------
+// Self-check, against a fake GL : a "binary" is its program ID repeated, and the driver can be
+// told to refuse the next one
+
+#define FAKE_BINARY_FORMAT 42
+#define FAKE_BINARY_LENGTH 16
+
+static bool FakeRejectNext = false;
+static std::string FakeDriver = "Fake driver 1";
+
+static bool fakeSupportsBinaries(){ return true; }
+static void fakeMarkRetrievable(GLuint){}
+static bool fakeGetProgramBinary(GLuint programID, std::vector<unsigned char> & binary, GLenum & format){
+	binary.assign(FAKE_BINARY_LENGTH, (unsigned char)programID);
+	format = FAKE_BINARY_FORMAT;
+	return true;
+}
+static GLuint fakeProgramFromBinary(const unsigned char * binary, GLsizei length, GLenum format){
+	bool rejected = FakeRejectNext;
+	FakeRejectNext = false;
+	if (rejected || length != FAKE_BINARY_LENGTH || format != FAKE_BINARY_FORMAT)
+		return 0;
+	return binary[0];
+}
+static std::string fakeDriverIdentity(){ return FakeDriver; }
+
+static const ShaderCacheGL FakeShaderCacheGL = {
+	fakeSupportsBinaries,
+	fakeMarkRetrievable,
+	fakeGetProgramBinary,
+	fakeProgramFromBinary,
+	fakeDriverIdentity
+};
+
+size_t checkShaderCache(const char * directory){
+
+	// The cache in use is put back at the end
+	bool enabled = ShaderCacheEnabled;
+	std::string cacheDirectory = ShaderCacheDirectory;
+	std::string driver = ShaderCacheDriver;
+	ShaderCacheGL functions = ShaderCacheFunctions;
+	ShaderCacheStats counters = ShaderCacheCounters;
+
+	size_t errors = 0;
+	FakeDriver = "Fake driver 1";
+	initShaderCache(directory, &FakeShaderCacheGL);
+	clearShaderCache();
+
+	// Keys : every part counts, and where the text is
+	unsigned long long key = shaderCacheKey("vertex", "fragment", "#define A\n");
+	errors += key != shaderCacheKey("vertex", "fragment", "#define A\n");
+	errors += key == shaderCacheKey("vertex", "fragment", "");
+	errors += key == shaderCacheKey("vertexf", "ragment", "#define A\n");
+
+	// Miss, store, then hit
+	errors += loadCachedProgram(key) != 0;
+	storeCachedProgram(key, 7);
+	errors += loadCachedProgram(key) != 7;
+
+	// Refused by the driver : deleted, so the next load misses without asking it
+	FakeRejectNext = true;
+	errors += loadCachedProgram(key) != 0;
+	errors += loadCachedProgram(key) != 0;
+
+	// Cut short on disk : discarded
+	storeCachedProgram(key, 8);
+	FILE * file = fopen(cacheFilePath(key).c_str(), "r+b");
+	if (file != NULL) {
+		ShaderCacheHeader header;
+		errors += fread(&header, sizeof(header), 1, file) != 1;
+		header.length += 1; // Claims a byte more than the file has
+		fseek(file, 0, SEEK_SET);
+		fwrite(&header, sizeof(header), 1, file);
+		fclose(file);
+	} else {
+		errors++;
+	}
+	errors += loadCachedProgram(key) != 0;
+
+	// Another driver, another key
+	storeCachedProgram(key, 9);
+	FakeDriver = "Fake driver 2";
+	initShaderCache(directory, &FakeShaderCacheGL);
+	errors += shaderCacheKey("vertex", "fragment", "#define A\n") == key;
+	errors += loadCachedProgram(key) != 9; // The old entry is still readable by its key
+
+	// Cleared
+	clearShaderCache();
+	errors += loadCachedProgram(key) != 0;
+
+	ShaderCacheStats stats = getShaderCacheStats();
+	errors += stats.hits != 1 || stats.misses != 1 || stats.rejected != 0 || stats.stored != 0;
+	printf("Shader cache : %u errors against a fake driver\n", (unsigned int)errors);
+
+	removeDirectory(directory);
+	ShaderCacheEnabled = enabled;
+	ShaderCacheDirectory = cacheDirectory;
+	ShaderCacheDriver = driver;
+	ShaderCacheFunctions = functions;
+	ShaderCacheCounters = counters;
+	return errors;
+}
@@ -0,0 +1,48 @@
+#ifndef SHADERCACHE_HPP
+#define SHADERCACHE_HPP
+
+#include <string>
+#include <vector>
+
+// The handful of GL entry points the cache needs. initShaderCache() uses the real
+// driver unless it is given another table, which lets the cache run against a fake GL.
+struct ShaderCacheGL {
+	// False if the driver exposes no program binary format at all
+	bool (*supportsBinaries)();
+	// Must be called before glLinkProgram for the binary to be retrievable afterwards
+	void (*markRetrievable)(GLuint programID);
+	bool (*getProgramBinary)(GLuint programID, std::vector<unsigned char> & binary, GLenum & format);
+	// Returns 0 if the driver rejects the binary (new driver version, different GPU...)
+	GLuint (*programFromBinary)(const unsigned char * binary, GLsizei length, GLenum format);
+	// Vendor, renderer and version. Part of the key, so a driver update invalidates everything.
+	std::string (*driverIdentity)();
+};
+
+struct ShaderCacheStats {
+	unsigned int hits;
+	unsigned int misses;
+	unsigned int rejected; // Found on disk but refused by the driver or corrupted
+	unsigned int stored;
+};
+
+// Enables the cache. Without this call LoadShaders compiles every time, as before.
+void initShaderCache(const char * directory, const ShaderCacheGL * gl = NULL);
+bool shaderCacheEnabled();
+
+// 64 bits FNV-1a over the sources, the defines and the driver identity
+unsigned long long shaderCacheKey(const std::string & vertexSource, const std::string & fragmentSource, const std::string & defines);
+
+// Returns 0 on a miss. A rejected or corrupted entry is deleted.
+GLuint loadCachedProgram(unsigned long long key);
+void storeCachedProgram(unsigned long long key, GLuint programID);
+void markProgramRetrievable(GLuint programID);
+void invalidateCachedProgram(unsigned long long key);
+void clearShaderCache();
+
+ShaderCacheStats getShaderCacheStats();
+
+// Runs the cache against a fake GL in `directory` : misses, hits, entries refused by the driver or
+// cut short, a driver change. The cache in use is left as it was. Returns the errors found.
+size_t checkShaderCache(const char * directory);
+
+#endif
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include <GL/glew.h>
+
+#include "shader.hpp"
+#include "shaderpreprocessor.hpp"
+
+static std::string directoryOf(const std::string & path){
+	size_t slash = path.find_last_of("/\\");
+	if (slash == std::string::npos)
+		return "";
+	return path.substr(0, slash + 1);
+}
+
+static bool startsWithDirective(const std::string & line, const char * directive, size_t & end){
+	size_t i = line.find_first_not_of(" \t");
+	if (i == std::string::npos || line[i] != '#')
+		return false;
+	i = line.find_first_not_of(" \t", i + 1);
+	if (i == std::string::npos)
+		return false;
+	size_t length = std::string(directive).size();
+	if (line.compare(i, length, directive) != 0)
+		return false;
+	end = i + length;
+	return true;
+}
+
+static bool expandFile(const std::string & file_path, std::string & ShaderCode,
+                       std::vector<std::string> & dependencies, int depth){
+
+	if (depth > 16) {
+		printf("%s : #include nested too deeply\n", file_path.c_str());
+		return false;
+	}
+
+	std::string source;
+	if (!ReadShaderFile(file_path.c_str(), source))
+		return false;
+
+	int sourceNumber = (int)dependencies.size();
+	dependencies.push_back(file_path);
+
+	std::istringstream stream(source);
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(stream, line)) {
+		lineNumber++;
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+
+		size_t end;
+		if (startsWithDirective(line, "pragma", end) && line.find("once", end) != std::string::npos)
+			continue; // Every file is included once anyway
+
+		if (!startsWithDirective(line, "include", end)) {
+			ShaderCode += line;
+			ShaderCode += '\n';
+			continue;
+		}
+
+		size_t open = line.find('"', end);
+		size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		if (close == std::string::npos) {
+			printf("%s(%d) : malformed #include\n", file_path.c_str(), lineNumber);
+			return false;
+		}
+		std::string included = directoryOf(file_path) + line.substr(open + 1, close - open - 1);
+
+		bool alreadyIncluded = false;
+		for (size_t i = 0; i < dependencies.size(); i++)
+			alreadyIncluded = alreadyIncluded || dependencies[i] == included;
+		if (alreadyIncluded) {
+			ShaderCode += '\n'; // Keep the line count
+			continue;
+		}
+
+		std::ostringstream lineDirective;
+		lineDirective << "#line 1 " << dependencies.size() << '\n';
+		ShaderCode += lineDirective.str();
+		if (!expandFile(included, ShaderCode, dependencies, depth + 1))
+			return false;
+
+		// Back to where we were in the including file
+		std::ostringstream returnDirective;
+		returnDirective << "#line " << lineNumber + 1 << ' ' << sourceNumber << '\n';
+		ShaderCode += returnDirective.str();
+	}
+	return true;
+}
+
+bool PreprocessShader(const char * file_path, const std::vector<std::string> & defines,
+                      std::string & ShaderCode, std::vector<std::string> & dependencies){
+
+	// Source string numbers restart at 0 for every stage
+	std::string expanded;
+	std::vector<std::string> files;
+	ShaderCode.clear();
+	bool expandedAll = expandFile(file_path, expanded, files, 0);
+	dependencies.insert(dependencies.end(), files.begin(), files.end());
+	if (!expandedAll)
+		return false;
+
+	std::string injected;
+	for (size_t i = 0; i < defines.size(); i++)
+		injected += "#define " + defines[i] + "\n";
+
+	// #version has to stay the first directive, the defines go right after it
+	size_t version = expanded.find("#version");
+	if (version == std::string::npos) {
+		ShaderCode = injected + "#line 1 0\n" + expanded;
+		return true;
+	}
+	size_t endOfLine = expanded.find('\n', version);
+	if (endOfLine == std::string::npos)
+		endOfLine = expanded.size() - 1;
+
+	int versionLine = 1;
+	for (size_t i = 0; i < endOfLine; i++)
+		versionLine += expanded[i] == '\n';
+
+	std::ostringstream lineDirective;
+	lineDirective << "#line " << versionLine + 1 << " 0\n";
+	ShaderCode = expanded.substr(0, endOfLine + 1) + injected + lineDirective.str() + expanded.substr(endOfLine + 1);
+	return true;
+}
+
+std::vector<std::string> PermutationDefines(unsigned int key, const char * const * names, int count){
+	std::vector<std::string> defines;
+	for (int i = 0; i < count; i++) {
+		if (key & (1u << i))
+			defines.push_back(names[i]);
+	}
+	return defines;
+}
+
+std::string JoinDefines(const std::vector<std::string> & defines){
+	std::string joined;
+	for (size_t i = 0; i < defines.size(); i++) {
+		if (i > 0)
+			joined += ';';
+		joined += defines[i];
+	}
+	return joined;
+}
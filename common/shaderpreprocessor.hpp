@@ -0,0 +1,20 @@
+#ifndef SHADERPREPROCESSOR_HPP
+#define SHADERPREPROCESSOR_HPP
+
+#include <string>
+#include <vector>
+
+// Reads a shader and expands its #include "file" directives (paths relative to the including
+// file, every file included at most once). The defines ("NAME" or "NAME VALUE") are injected
+// right after the #version line. Every file read is appended to dependencies, in order : the
+// n-th file of the stage is source string n in the compiler messages, thanks to #line.
+bool PreprocessShader(const char * file_path, const std::vector<std::string> & defines,
+                      std::string & ShaderCode, std::vector<std::string> & dependencies);
+
+// Turns a permutation key into defines : bit i set => names[i] is defined
+std::vector<std::string> PermutationDefines(unsigned int key, const char * const * names, int count);
+
+// "A;B 2;C", used as part of the shader cache key
+std::string JoinDefines(const std::vector<std::string> & defines);
+
+#endif
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "shadercache.hpp"
+#include "shaderpreprocessor.hpp"
+#include "uniforms.hpp"
+#include "frameuniforms.hpp"
+#include "filewatcher.hpp"
+#include "shaderregistry.hpp"
+
+struct RegisteredShader {
+	std::string vertex_file_path;
+	std::string fragment_file_path;
+	std::vector<std::string> defines;
+	ShaderReloadCallback callback;
+	void * user;
+
+	GLuint programID;
+	ShaderReflection reflection;
+
+	// Both stages and everything they include. Guarded by ShaderRegistryMutex.
+	std::vector<std::string> dependencies;
+	std::vector<std::string> watchedFiles;
+
+	// Sources read by the watcher thread, waiting for the GL thread. Guarded by ShaderRegistryMutex.
+	bool sourcesPending;
+	std::string pendingVertexCode;
+	std::string pendingFragmentCode;
+
+	// Build in flight on the GL thread
+	bool building;
+	ProgramBuild build;
+	unsigned long long buildKey;
+};
+
+static std::vector<RegisteredShader> RegisteredShaders;
+static std::mutex ShaderRegistryMutex;
+static bool ShaderHotReloadEnabled = false;
+
+static void onShaderFileChanged(const char * path, void * user);
+
+// Everything that has to happen whenever a handle gets a new program
+static void installProgram(ShaderHandle handle, GLuint programID){
+
+	RegisteredShader & shader = RegisteredShaders[handle];
+	if (shader.programID != 0)
+		glDeleteProgram(shader.programID);
+	shader.programID = programID;
+	if (programID == 0)
+		return; // Broken from the start : wait for a fixed version of the file
+
+	reflectProgram(programID, shader.reflection);
+	bindFrameUniforms(programID);
+
+	glUseProgram(programID);
+	if (shader.callback)
+		shader.callback(handle, shader.reflection, shader.user);
+}
+
+// Watches the dependencies that are not watched yet. ShaderRegistryMutex must be held.
+static void watchDependencies(ShaderHandle handle){
+
+	if (!ShaderHotReloadEnabled)
+		return;
+
+	RegisteredShader & shader = RegisteredShaders[handle];
+	for (size_t i = 0; i < shader.dependencies.size(); i++) {
+		bool watched = false;
+		for (size_t j = 0; j < shader.watchedFiles.size(); j++)
+			watched = watched || shader.watchedFiles[j] == shader.dependencies[i];
+		if (watched)
+			continue;
+		shader.watchedFiles.push_back(shader.dependencies[i]);
+		watchFile(shader.dependencies[i].c_str(), onShaderFileChanged, (void *)(size_t)handle);
+	}
+}
+
+// Preprocesses both stages. Safe on any thread : it only touches its arguments.
+static bool readSources(const std::string & vertex_file_path, const std::string & fragment_file_path,
+                        const std::vector<std::string> & defines,
+                        std::string & VertexShaderCode, std::string & FragmentShaderCode,
+                        std::vector<std::string> & dependencies){
+	return PreprocessShader(vertex_file_path.c_str(), defines, VertexShaderCode, dependencies)
+		&& PreprocessShader(fragment_file_path.c_str(), defines, FragmentShaderCode, dependencies);
+}
+
+ShaderHandle registerShader(const char * vertex_file_path, const char * fragment_file_path,
+                            ShaderReloadCallback callback, void * user){
+	return registerShaderVariant(vertex_file_path, fragment_file_path, std::vector<std::string>(), callback, user);
+}
+
+ShaderHandle registerShaderVariant(const char * vertex_file_path, const char * fragment_file_path,
+                                   const std::vector<std::string> & defines,
+                                   ShaderReloadCallback callback, void * user){
+
+	RegisteredShader shader;
+	shader.vertex_file_path = vertex_file_path;
+	shader.fragment_file_path = fragment_file_path;
+	shader.defines = defines;
+	shader.callback = callback;
+	shader.user = user;
+	shader.programID = 0;
+	shader.sourcesPending = false;
+	shader.building = false;
+	shader.buildKey = 0;
+
+	std::string VertexShaderCode, FragmentShaderCode;
+	bool readAll = readSources(shader.vertex_file_path, shader.fragment_file_path, defines,
+		VertexShaderCode, FragmentShaderCode, shader.dependencies);
+
+	ShaderHandle handle;
+	{
+		std::lock_guard<std::mutex> lock(ShaderRegistryMutex);
+		handle = (ShaderHandle)RegisteredShaders.size();
+		RegisteredShaders.push_back(shader);
+		watchDependencies(handle);
+	}
+
+	GLuint programID = 0;
+	if (readAll)
+		programID = LoadShadersFromSource(vertex_file_path, VertexShaderCode, fragment_file_path, FragmentShaderCode, JoinDefines(defines));
+	installProgram(handle, programID);
+	return handle;
+}
+
+GLuint getShaderProgram(ShaderHandle handle){
+	return RegisteredShaders[handle].programID;
+}
+
+const ShaderReflection & getShaderReflection(ShaderHandle handle){
+	return RegisteredShaders[handle].reflection;
+}
+
+// Runs on the watcher thread : the file I/O and preprocessing stay off the GL thread
+static void onShaderFileChanged(const char * path, void * user){
+
+	ShaderHandle handle = (ShaderHandle)(size_t)user;
+
+	std::string vertex_file_path, fragment_file_path;
+	std::vector<std::string> defines;
+	{
+		std::lock_guard<std::mutex> lock(ShaderRegistryMutex);
+		vertex_file_path = RegisteredShaders[handle].vertex_file_path;
+		fragment_file_path = RegisteredShaders[handle].fragment_file_path;
+		defines = RegisteredShaders[handle].defines;
+	}
+
+	std::string VertexShaderCode, FragmentShaderCode;
+	std::vector<std::string> dependencies;
+	if (!readSources(vertex_file_path, fragment_file_path, defines, VertexShaderCode, FragmentShaderCode, dependencies))
+		return;
+
+	printf("%s changed, reloading %s + %s\n", path, vertex_file_path.c_str(), fragment_file_path.c_str());
+	std::lock_guard<std::mutex> lock(ShaderRegistryMutex);
+	RegisteredShader & shader = RegisteredShaders[handle];
+	shader.pendingVertexCode = VertexShaderCode;
+	shader.pendingFragmentCode = FragmentShaderCode;
+	shader.sourcesPending = true;
+
+	// The edit may have added an #include
+	shader.dependencies = dependencies;
+	watchDependencies(handle);
+}
+
+void startShaderHotReload(){
+
+	// Let the driver compile on its own threads, so a reload never stalls a frame
+	if (GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	else if (GLEW_ARB_parallel_shader_compile)
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+	startFileWatcher();
+
+	std::lock_guard<std::mutex> lock(ShaderRegistryMutex);
+	ShaderHotReloadEnabled = true;
+	for (size_t i = 0; i < RegisteredShaders.size(); i++)
+		watchDependencies((ShaderHandle)i);
+}
+
+void updateShaderRegistry(){
+
+	for (size_t i = 0; i < RegisteredShaders.size(); i++) {
+		RegisteredShader & shader = RegisteredShaders[i];
+
+		// Finish the build started in an earlier frame, once the driver is done with it
+		if (shader.building && IsProgramBuildReady(shader.build)) {
+			shader.building = false;
+			GLuint programID = FinishProgramBuild(shader.build);
+			if (programID == 0) {
+				printf("Reload of %s + %s failed, keeping the previous program\n",
+					shader.vertex_file_path.c_str(), shader.fragment_file_path.c_str());
+				continue;
+			}
+			storeCachedProgram(shader.buildKey, programID);
+			installProgram((ShaderHandle)i, programID);
+		}
+
+		// Start a build for fresh sources. A newer save replaces a build still in flight.
+		std::string VertexShaderCode, FragmentShaderCode;
+		{
+			std::lock_guard<std::mutex> lock(ShaderRegistryMutex);
+			if (!shader.sourcesPending)
+				continue;
+			shader.sourcesPending = false;
+			VertexShaderCode.swap(shader.pendingVertexCode);
+			FragmentShaderCode.swap(shader.pendingFragmentCode);
+		}
+
+		if (shader.building) {
+			FinishProgramBuild(shader.build);
+			glDeleteProgram(shader.build.ProgramID);
+			shader.building = false;
+		}
+
+		// Going back to an earlier version of the file is instant
+		shader.buildKey = shaderCacheKey(VertexShaderCode, FragmentShaderCode, JoinDefines(shader.defines));
+		GLuint cachedProgramID = loadCachedProgram(shader.buildKey);
+		if (cachedProgramID != 0) {
+			installProgram((ShaderHandle)i, cachedProgramID);
+			continue;
+		}
+
+		StartProgramBuild(shader.build, shader.vertex_file_path.c_str(), VertexShaderCode,
+			shader.fragment_file_path.c_str(), FragmentShaderCode);
+		shader.building = true;
+	}
+}
+
+void cleanupShaderRegistry(){
+
+	stopFileWatcher();
+	ShaderHotReloadEnabled = false;
+
+	for (size_t i = 0; i < RegisteredShaders.size(); i++) {
+		if (RegisteredShaders[i].building) {
+			FinishProgramBuild(RegisteredShaders[i].build);
+			glDeleteProgram(RegisteredShaders[i].build.ProgramID);
+		}
+		glDeleteProgram(RegisteredShaders[i].programID);
+	}
+	RegisteredShaders.clear();
+}
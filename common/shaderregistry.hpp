@@ -0,0 +1,34 @@
+#ifndef SHADERREGISTRY_HPP
+#define SHADERREGISTRY_HPP
+
+#include <string>
+#include <vector>
+
+typedef int ShaderHandle;
+
+// Called with the program bound, after the first load and after every successful reload.
+// This is where uniform handles are resolved and samplers are assigned to texture units.
+typedef void (*ShaderReloadCallback)(ShaderHandle handle, const ShaderReflection & reflection, void * user);
+
+// Loads the program right away (through the shader cache) and remembers where it came from.
+// The callback may be NULL.
+ShaderHandle registerShader(const char * vertex_file_path, const char * fragment_file_path,
+                            ShaderReloadCallback callback, void * user);
+// Same, for one permutation of the sources (see PreprocessShader). Each variant is a separate
+// program with its own cache entry, and is rebuilt when any file it includes changes.
+ShaderHandle registerShaderVariant(const char * vertex_file_path, const char * fragment_file_path,
+                                   const std::vector<std::string> & defines,
+                                   ShaderReloadCallback callback, void * user);
+
+// The current program. It changes when a reload succeeds, so don't keep it across frames.
+GLuint getShaderProgram(ShaderHandle handle);
+const ShaderReflection & getShaderReflection(ShaderHandle handle);
+
+// Watches the sources of every registered program and rebuilds the ones that change
+void startShaderHotReload();
+// Call once per frame on the GL thread. Starts the pending builds and swaps in the finished
+// ones. A program that fails to compile or link is dropped and the previous one is kept.
+void updateShaderRegistry();
+void cleanupShaderRegistry();
+
+#endif
@@ -0,0 +1,37 @@
+#include "simclock.hpp"
+
+void initSimulationClock(SimulationClock & clock, double stepsPerSecond, unsigned int maxSteps, double now){
+	clock.step = 1.0 / stepsPerSecond;
+	clock.maxSteps = maxSteps > 0 ? maxSteps : 1;
+	clock.lastTime = now;
+	clock.accumulator = 0.0;
+	clock.simulatedTime = 0.0;
+	clock.droppedTime = 0.0;
+}
+
+unsigned int advanceSimulationClock(SimulationClock & clock, double now){
+
+	double elapsed = now - clock.lastTime;
+	clock.lastTime = now;
+	if (elapsed > 0.0)
+		clock.accumulator += elapsed;
+
+	unsigned int steps = (unsigned int)(clock.accumulator / clock.step);
+	if (steps > clock.maxSteps) {
+		// Too far behind : keep less than a step, so that the next frames do not try to catch up either
+		double kept = clock.accumulator - steps * clock.step;
+		clock.droppedTime += (steps - clock.maxSteps) * clock.step;
+		steps = clock.maxSteps;
+		clock.accumulator = kept;
+	} else {
+		clock.accumulator -= steps * clock.step;
+	}
+
+	clock.simulatedTime += steps * clock.step;
+	return steps;
+}
+
+float simulationAlpha(const SimulationClock & clock){
+	float alpha = (float)(clock.accumulator / clock.step);
+	return alpha < 0.0f ? 0.0f : (alpha > 1.0f ? 1.0f : alpha);
+}
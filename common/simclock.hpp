@@ -0,0 +1,23 @@
+#ifndef SIMCLOCK_HPP
+#define SIMCLOCK_HPP
+
+// Runs the simulation in steps of a fixed length, whatever the frame rate : real time builds up
+// in an accumulator, and every whole step in it is simulated. Frames are drawn between the last
+// two steps. When the simulation cannot keep up, at most maxSteps are run per frame and the rest
+// of the time is dropped : it slows down rather than taking longer and longer frames to catch up.
+struct SimulationClock {
+	double step;           // Seconds simulated per step
+	unsigned int maxSteps; // Per frame
+	double lastTime;
+	double accumulator;    // Real time not simulated yet, less than a step after a frame
+	double simulatedTime;
+	double droppedTime;    // Thrown away by the maxSteps guard
+};
+
+void initSimulationClock(SimulationClock & clock, double stepsPerSecond, unsigned int maxSteps, double now);
+// Returns the number of steps to run this frame
+unsigned int advanceSimulationClock(SimulationClock & clock, double now);
+// Where the frame falls between the state before the last step (0) and after it (1)
+float simulationAlpha(const SimulationClock & clock);
+
+#endif
@@ -0,0 +1,563 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "profiler.hpp"
+#include "snapshot.hpp"
+
+// File layout (little endian, like every platform the demo runs on) :
+//   "PSNP", version
+//   then one record per frame : size of the rest of the record, frame, time, emitter count,
+//   and for each emitter its name, sprite, stretch, particle count and its 12 columns.
+//   Each column starts with its encoding, so a file can mix them.
+static const char SnapshotMagic[4] = { 'P', 'S', 'N', 'P' };
+static const unsigned int SnapshotVersion = 1;
+
+enum ColumnEncoding {
+	COLUMN_RAW = 0,
+	COLUMN_QUANTIZED = 1, // min, max, then 16 bits per value
+	COLUMN_DELTA = 2      // min, max for floats, byte count, then zigzag varints of the differences
+};
+
+// Snapshots waiting for the writer thread before new ones are dropped
+#define SNAPSHOT_MAX_PENDING 8
+
+void ParticleColumns::resize(size_t count){
+	posX.resize(count); posY.resize(count); posZ.resize(count);
+	speedX.resize(count); speedY.resize(count); speedZ.resize(count);
+	size.resize(count); life.resize(count);
+	r.resize(count); g.resize(count); b.resize(count); a.resize(count);
+}
+
+// The columns in file order
+static std::vector<float> ParticleColumns::* const FloatColumns[] = {
+	&ParticleColumns::posX, &ParticleColumns::posY, &ParticleColumns::posZ,
+	&ParticleColumns::speedX, &ParticleColumns::speedY, &ParticleColumns::speedZ,
+	&ParticleColumns::size, &ParticleColumns::life,
+};
+static std::vector<unsigned char> ParticleColumns::* const ByteColumns[] = {
+	&ParticleColumns::r, &ParticleColumns::g, &ParticleColumns::b, &ParticleColumns::a,
+};
+#define FLOAT_COLUMNS (sizeof(FloatColumns) / sizeof(FloatColumns[0]))
+#define BYTE_COLUMNS (sizeof(ByteColumns) / sizeof(ByteColumns[0]))
+
+// ---------------------------------------------------------------------------------------------
+// Encoding
+
+static void put(std::vector<unsigned char> & out, const void * data, size_t size){
+	const unsigned char * bytes = (const unsigned char *)data;
+	out.insert(out.end(), bytes, bytes + size);
+}
+
+template<typename T>
+static void putValue(std::vector<unsigned char> & out, T value){
+	put(out, &value, sizeof(T));
+}
+
+static void putVarint(std::vector<unsigned char> & out, unsigned int value){
+	while (value >= 0x80) {
+		out.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((unsigned char)value);
+}
+
+// Small differences, positive or negative, give small unsigned numbers
+static unsigned int zigzag(int value){
+	return ((unsigned int)value << 1) ^ (unsigned int)(value >> 31);
+}
+
+static void putDeltas(std::vector<unsigned char> & out, const std::vector<int> & values){
+	std::vector<unsigned char> deltas;
+	int previous = 0;
+	for (size_t i = 0; i < values.size(); i++) {
+		putVarint(deltas, zigzag(values[i] - previous));
+		previous = values[i];
+	}
+	putValue<unsigned int>(out, (unsigned int)deltas.size());
+	put(out, deltas.empty() ? NULL : &deltas[0], deltas.size());
+}
+
+static void putFloatColumn(std::vector<unsigned char> & out, const std::vector<float> & column, unsigned int compression){
+
+	if (compression == SNAPSHOT_RAW || column.empty()) {
+		putValue<unsigned char>(out, COLUMN_RAW);
+		put(out, column.empty() ? NULL : &column[0], column.size() * sizeof(float));
+		return;
+	}
+
+	float minimum = column[0], maximum = column[0];
+	for (size_t i = 1; i < column.size(); i++) {
+		if (column[i] < minimum) minimum = column[i];
+		if (column[i] > maximum) maximum = column[i];
+	}
+	float scale = maximum > minimum ? 65535.0f / (maximum - minimum) : 0.0f;
+	std::vector<int> quantized(column.size());
+	for (size_t i = 0; i < column.size(); i++)
+		quantized[i] = (int)floorf((column[i] - minimum) * scale + 0.5f);
+
+	putValue<unsigned char>(out, (compression & SNAPSHOT_DELTA) ? COLUMN_DELTA : COLUMN_QUANTIZED);
+	putValue<float>(out, minimum);
+	putValue<float>(out, maximum);
+	if (compression & SNAPSHOT_DELTA) {
+		putDeltas(out, quantized);
+		return;
+	}
+	for (size_t i = 0; i < quantized.size(); i++)
+		putValue<unsigned short>(out, (unsigned short)quantized[i]);
+}
+
+static void putByteColumn(std::vector<unsigned char> & out, const std::vector<unsigned char> & column, unsigned int compression){
+
+	// Already as small as quantization would make them
+	if (!(compression & SNAPSHOT_DELTA) || column.empty()) {
+		putValue<unsigned char>(out, COLUMN_RAW);
+		put(out, column.empty() ? NULL : &column[0], column.size());
+		return;
+	}
+
+	putValue<unsigned char>(out, COLUMN_DELTA);
+	putDeltas(out, std::vector<int>(column.begin(), column.end()));
+}
+
+void encodeSnapshot(const ParticleSnapshot & snapshot, unsigned int compression, std::vector<unsigned char> & out){
+
+	size_t start = out.size();
+	putValue<unsigned int>(out, 0); // Record size, filled in at the end
+	putValue<unsigned int>(out, snapshot.frame);
+	putValue<double>(out, snapshot.time);
+	putValue<unsigned int>(out, (unsigned int)snapshot.emitters.size());
+
+	for (size_t e = 0; e < snapshot.emitters.size(); e++) {
+		const EmitterSnapshot & emitter = snapshot.emitters[e];
+		unsigned char nameLength = (unsigned char)(emitter.name.size() < 255 ? emitter.name.size() : 255);
+		putValue<unsigned char>(out, nameLength);
+		put(out, emitter.name.c_str(), nameLength);
+		putValue<unsigned int>(out, emitter.sprite);
+		putValue<float>(out, emitter.stretch);
+		putValue<unsigned int>(out, (unsigned int)emitter.particles.count());
+
+		for (size_t c = 0; c < FLOAT_COLUMNS; c++)
+			putFloatColumn(out, emitter.particles.*FloatColumns[c], compression);
+		for (size_t c = 0; c < BYTE_COLUMNS; c++)
+			putByteColumn(out, emitter.particles.*ByteColumns[c], compression);
+	}
+
+	unsigned int recordSize = (unsigned int)(out.size() - start - sizeof(unsigned int));
+	memcpy(&out[start], &recordSize, sizeof(recordSize));
+}
+
+// ---------------------------------------------------------------------------------------------
+// Decoding
+
+struct SnapshotCursor {
+	const unsigned char * data;
+	size_t size;
+	size_t position;
+	bool failed;
+};
+
+static const unsigned char * get(SnapshotCursor & cursor, size_t size){
+	if (cursor.failed || size > cursor.size - cursor.position) {
+		cursor.failed = true;
+		return NULL;
+	}
+	const unsigned char * data = cursor.data + cursor.position;
+	cursor.position += size;
+	return data;
+}
+
+template<typename T>
+static T getValue(SnapshotCursor & cursor){
+	T value = T();
+	const unsigned char * data = get(cursor, sizeof(T));
+	if (data != NULL)
+		memcpy(&value, data, sizeof(T));
+	return value;
+}
+
+static bool getDeltas(SnapshotCursor & cursor, size_t count, std::vector<int> & values){
+	unsigned int size = getValue<unsigned int>(cursor);
+	const unsigned char * data = get(cursor, size);
+	if (data == NULL)
+		return false;
+
+	values.resize(count);
+	size_t position = 0;
+	int previous = 0;
+	for (size_t i = 0; i < count; i++) {
+		unsigned int value = 0;
+		for (int shift = 0; ; shift += 7) {
+			if (position == size || shift > 28)
+				return false;
+			unsigned char byte = data[position++];
+			value |= (unsigned int)(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+		previous += (int)(value >> 1) ^ -(int)(value & 1);
+		values[i] = previous;
+	}
+	return position == size;
+}
+
+static bool getFloatColumn(SnapshotCursor & cursor, std::vector<float> & column){
+
+	unsigned char encoding = getValue<unsigned char>(cursor);
+	if (encoding == COLUMN_RAW) {
+		const unsigned char * data = get(cursor, column.size() * sizeof(float));
+		if (data != NULL && !column.empty())
+			memcpy(&column[0], data, column.size() * sizeof(float));
+		return data != NULL;
+	}
+	if (encoding != COLUMN_QUANTIZED && encoding != COLUMN_DELTA)
+		return false;
+
+	float minimum = getValue<float>(cursor);
+	float maximum = getValue<float>(cursor);
+	float step = (maximum - minimum) / 65535.0f;
+	if (encoding == COLUMN_DELTA) {
+		std::vector<int> quantized;
+		if (!getDeltas(cursor, column.size(), quantized))
+			return false;
+		for (size_t i = 0; i < column.size(); i++)
+			column[i] = minimum + quantized[i] * step;
+		return true;
+	}
+	for (size_t i = 0; i < column.size(); i++)
+		column[i] = minimum + getValue<unsigned short>(cursor) * step;
+	return !cursor.failed;
+}
+
+static bool getByteColumn(SnapshotCursor & cursor, std::vector<unsigned char> & column){
+
+	unsigned char encoding = getValue<unsigned char>(cursor);
+	if (encoding == COLUMN_RAW) {
+		const unsigned char * data = get(cursor, column.size());
+		if (data != NULL && !column.empty())
+			memcpy(&column[0], data, column.size());
+		return data != NULL;
+	}
+	if (encoding != COLUMN_DELTA)
+		return false;
+
+	std::vector<int> values;
+	if (!getDeltas(cursor, column.size(), values))
+		return false;
+	for (size_t i = 0; i < column.size(); i++)
+		column[i] = (unsigned char)values[i];
+	return true;
+}
+
+size_t decodeSnapshot(const unsigned char * data, size_t size, ParticleSnapshot & snapshot){
+
+	SnapshotCursor cursor = { data, size, 0, false };
+	unsigned int recordSize = getValue<unsigned int>(cursor);
+	if (cursor.failed || recordSize > size - cursor.position)
+		return 0;
+	cursor.size = cursor.position + recordSize; // Never read into the next record
+
+	snapshot.frame = getValue<unsigned int>(cursor);
+	snapshot.time = getValue<double>(cursor);
+	unsigned int emitterCount = getValue<unsigned int>(cursor);
+	if (cursor.failed)
+		return 0;
+
+	// Every emitter takes at least a byte per column : rejects absurd counts before allocating
+	if (emitterCount > (cursor.size - cursor.position) / (FLOAT_COLUMNS + BYTE_COLUMNS))
+		return 0;
+
+	snapshot.emitters.resize(emitterCount);
+	for (unsigned int e = 0; e < emitterCount; e++) {
+		EmitterSnapshot & emitter = snapshot.emitters[e];
+		unsigned char nameLength = getValue<unsigned char>(cursor);
+		const unsigned char * name = get(cursor, nameLength);
+		if (name == NULL)
+			return 0;
+		emitter.name.assign((const char *)name, nameLength);
+		emitter.sprite = getValue<unsigned int>(cursor);
+		emitter.stretch = getValue<float>(cursor);
+		unsigned int count = getValue<unsigned int>(cursor);
+		// Every particle takes at least a byte per column : rejects absurd counts before allocating
+		if (cursor.failed || count > (cursor.size - cursor.position) / (FLOAT_COLUMNS + BYTE_COLUMNS))
+			return 0;
+
+		emitter.particles.resize(count);
+		for (size_t c = 0; c < FLOAT_COLUMNS; c++)
+			if (!getFloatColumn(cursor, emitter.particles.*FloatColumns[c]))
+				return 0;
+		for (size_t c = 0; c < BYTE_COLUMNS; c++)
+			if (!getByteColumn(cursor, emitter.particles.*ByteColumns[c]))
+				return 0;
+	}
+
+	if (cursor.failed || cursor.position != cursor.size)
+		return 0;
+	return cursor.size;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Writer thread
+
+static std::thread SnapshotThread;
+static std::mutex SnapshotMutex;
+static std::condition_variable SnapshotCondition;
+static std::deque<ParticleSnapshot> PendingSnapshots; // Guarded by SnapshotMutex
+static bool SnapshotStopping = false;
+static FILE * SnapshotFile = NULL;
+static unsigned int SnapshotInterval = 1;
+static unsigned int SnapshotCompressionFlags = SNAPSHOT_RAW;
+static unsigned int WrittenSnapshots = 0;
+static unsigned int DroppedSnapshots = 0;
+
+static void snapshotWriterLoop(){
+	setProfilerThreadName("Snapshot writer");
+	std::vector<unsigned char> record;
+	for (;;) {
+		ParticleSnapshot snapshot;
+		{
+			std::unique_lock<std::mutex> lock(SnapshotMutex);
+			SnapshotCondition.wait(lock, [](){ return SnapshotStopping || !PendingSnapshots.empty(); });
+			if (PendingSnapshots.empty())
+				return; // Stopping, and everything is written
+			snapshot.emitters.swap(PendingSnapshots.front().emitters);
+			snapshot.frame = PendingSnapshots.front().frame;
+			snapshot.time = PendingSnapshots.front().time;
+			PendingSnapshots.pop_front();
+		}
+
+		ProfileScope scope("Write snapshot");
+		record.clear();
+		encodeSnapshot(snapshot, SnapshotCompressionFlags, record);
+		if (fwrite(&record[0], 1, record.size(), SnapshotFile) == record.size())
+			WrittenSnapshots++;
+	}
+}
+
+bool startSnapshotWriter(const char * path, unsigned int interval, unsigned int compression){
+
+	if (SnapshotFile != NULL)
+		return false;
+
+	SnapshotFile = fopen(path, "wb");
+	if (SnapshotFile == NULL) {
+		printf("%s could not be opened for writing\n", path);
+		return false;
+	}
+	fwrite(SnapshotMagic, 1, sizeof(SnapshotMagic), SnapshotFile);
+	fwrite(&SnapshotVersion, sizeof(SnapshotVersion), 1, SnapshotFile);
+
+	SnapshotInterval = interval > 0 ? interval : 1;
+	SnapshotCompressionFlags = compression;
+	SnapshotStopping = false;
+	WrittenSnapshots = DroppedSnapshots = 0;
+	SnapshotThread = std::thread(snapshotWriterLoop);
+	return true;
+}
+
+bool snapshotWanted(unsigned int frame){
+	return SnapshotFile != NULL && frame % SnapshotInterval == 0;
+}
+
+void submitSnapshot(ParticleSnapshot & snapshot){
+
+	{
+		std::lock_guard<std::mutex> lock(SnapshotMutex);
+		if (SnapshotFile == NULL || PendingSnapshots.size() >= SNAPSHOT_MAX_PENDING) {
+			DroppedSnapshots++;
+			snapshot.emitters.clear();
+			return;
+		}
+		PendingSnapshots.push_back(ParticleSnapshot());
+		ParticleSnapshot & pending = PendingSnapshots.back();
+		pending.frame = snapshot.frame;
+		pending.time = snapshot.time;
+		pending.emitters.swap(snapshot.emitters);
+	}
+	SnapshotCondition.notify_one();
+}
+
+void stopSnapshotWriter(){
+
+	if (SnapshotFile == NULL)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(SnapshotMutex);
+		SnapshotStopping = true;
+	}
+	SnapshotCondition.notify_all();
+	SnapshotThread.join();
+
+	fclose(SnapshotFile);
+	SnapshotFile = NULL;
+	printf("Wrote %u particle snapshots (%u dropped)\n", WrittenSnapshots, DroppedSnapshots);
+}
+
+// ---------------------------------------------------------------------------------------------
+// Reader
+
+bool openSnapshotReader(const char * path, SnapshotReader & reader){
+
+	reader.frames.clear();
+	reader.next = 0;
+	if (!mapFile(path, reader.file)) {
+		printf("%s could not be opened\n", path);
+		return false;
+	}
+
+	size_t header = sizeof(SnapshotMagic) + sizeof(unsigned int);
+	unsigned int version = 0;
+	if (reader.file.size >= header)
+		memcpy(&version, reader.file.data + sizeof(SnapshotMagic), sizeof(version));
+	if (reader.file.size < header || memcmp(reader.file.data, SnapshotMagic, sizeof(SnapshotMagic)) != 0 || version != SnapshotVersion) {
+		printf("%s is not a particle snapshot file\n", path);
+		unmapFile(reader.file);
+		return false;
+	}
+
+	// Index the frame records. A record cut short (the program was killed while writing) ends the file.
+	size_t offset = header;
+	while (reader.file.size - offset >= sizeof(unsigned int)) {
+		unsigned int recordSize;
+		memcpy(&recordSize, reader.file.data + offset, sizeof(recordSize));
+		if (recordSize > reader.file.size - offset - sizeof(unsigned int))
+			break;
+		reader.frames.push_back(offset);
+		offset += sizeof(unsigned int) + recordSize;
+	}
+
+	if (reader.frames.empty()) {
+		printf("%s has no complete snapshot\n", path);
+		unmapFile(reader.file);
+		return false;
+	}
+	return true;
+}
+
+bool readSnapshot(SnapshotReader & reader, ParticleSnapshot & snapshot){
+	if (reader.frames.empty())
+		return false;
+	size_t offset = reader.frames[reader.next];
+	reader.next = (reader.next + 1) % reader.frames.size();
+	return decodeSnapshot(reader.file.data + offset, reader.file.size - offset, snapshot) != 0;
+}
+
+void closeSnapshotReader(SnapshotReader & reader){
+	unmapFile(reader.file);
+	reader.frames.clear();
+	reader.next = 0;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Self-check
+
+static EmitterSnapshot checkEmitter(const char * name, size_t count, bool constant){
+	EmitterSnapshot emitter;
+	emitter.name = name;
+	emitter.sprite = (unsigned int)count % 7;
+	emitter.stretch = 0.05f;
+	emitter.particles.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		// Wide and narrow ranges, negative values, and repeats for the deltas
+		float x = constant ? 1.5f : (float)i;
+		for (size_t c = 0; c < FLOAT_COLUMNS; c++)
+			(emitter.particles.*FloatColumns[c])[i] = constant ? x : sinf(x * (0.1f + c)) * (c + 1) * 10.0f - (float)c;
+		for (size_t c = 0; c < BYTE_COLUMNS; c++)
+			(emitter.particles.*ByteColumns[c])[i] = constant ? 200 : (unsigned char)((i * (c + 3)) / 5);
+	}
+	return emitter;
+}
+
+// The decoded particles against the encoded ones : exact when raw, within a step of the range otherwise
+static size_t compareSnapshots(const ParticleSnapshot & expected, const ParticleSnapshot & decoded, unsigned int compression){
+
+	if (decoded.frame != expected.frame || decoded.time != expected.time || decoded.emitters.size() != expected.emitters.size())
+		return 1;
+
+	size_t errors = 0;
+	for (size_t e = 0; e < expected.emitters.size(); e++) {
+		const EmitterSnapshot & a = expected.emitters[e];
+		const EmitterSnapshot & b = decoded.emitters[e];
+		if (a.name != b.name || a.sprite != b.sprite || a.stretch != b.stretch || a.particles.count() != b.particles.count()) {
+			errors++;
+			continue;
+		}
+		for (size_t c = 0; c < FLOAT_COLUMNS; c++) {
+			const std::vector<float> & column = a.particles.*FloatColumns[c];
+			const std::vector<float> & result = b.particles.*FloatColumns[c];
+			float minimum = 0.0f, maximum = 0.0f;
+			for (size_t i = 0; i < column.size(); i++) {
+				minimum = i == 0 || column[i] < minimum ? column[i] : minimum;
+				maximum = i == 0 || column[i] > maximum ? column[i] : maximum;
+			}
+			float step = compression == SNAPSHOT_RAW ? 0.0f : (maximum - minimum) / 65535.0f;
+			for (size_t i = 0; i < column.size(); i++)
+				errors += fabsf(result[i] - column[i]) > step;
+		}
+		for (size_t c = 0; c < BYTE_COLUMNS; c++)
+			errors += (a.particles.*ByteColumns[c]) != (b.particles.*ByteColumns[c]);
+	}
+	return errors;
+}
+
+size_t checkSnapshotEncoding(){
+
+	ParticleSnapshot snapshot;
+	snapshot.frame = 42;
+	snapshot.time = 1.75;
+	snapshot.emitters.push_back(checkEmitter("smoke", 1000, false));
+	snapshot.emitters.push_back(checkEmitter("empty", 0, false));
+	snapshot.emitters.push_back(checkEmitter("still", 10, true));
+
+	const unsigned int Compressions[] = { SNAPSHOT_RAW, SNAPSHOT_QUANTIZE, SNAPSHOT_DELTA, SNAPSHOT_QUANTIZE | SNAPSHOT_DELTA };
+	size_t errors = 0;
+	for (size_t k = 0; k < sizeof(Compressions) / sizeof(Compressions[0]); k++) {
+		unsigned int compression = Compressions[k];
+
+		// Two records back to back : the first must stop where the second starts
+		std::vector<unsigned char> data;
+		encodeSnapshot(snapshot, compression, data);
+		size_t recordSize = data.size();
+		snapshot.frame++;
+		encodeSnapshot(snapshot, compression, data);
+		snapshot.frame--;
+
+		ParticleSnapshot decoded;
+		size_t used = decodeSnapshot(&data[0], data.size(), decoded);
+		size_t roundTrip = used != recordSize ? 1 : compareSnapshots(snapshot, decoded, compression);
+		used = decodeSnapshot(&data[recordSize], data.size() - recordSize, decoded);
+		roundTrip += used != data.size() - recordSize || decoded.frame != snapshot.frame + 1;
+
+		// Cut anywhere, the record must be refused
+		size_t truncated = 0;
+		for (size_t size = 0; size < recordSize; size += size < 64 ? 1 : recordSize / 97 + 1)
+			truncated += decodeSnapshot(&data[0], size, decoded) != 0;
+		truncated += decodeSnapshot(&data[0], recordSize - 1, decoded) != 0;
+
+		// Corrupt : a huge emitter count, an unknown column encoding, a broken variable length integer
+		size_t corrupt = 0;
+		const size_t EmitterCountOffset = 4 + 4 + 8;
+		const size_t ColumnOffset = EmitterCountOffset + 4 + 1 + 5 + 4 + 4 + 4; // First column of "smoke"
+		std::vector<unsigned char> bad(data.begin(), data.begin() + recordSize);
+		memset(&bad[EmitterCountOffset], 0xff, 4);
+		corrupt += decodeSnapshot(&bad[0], bad.size(), decoded) != 0;
+		bad.assign(data.begin(), data.begin() + recordSize);
+		bad[ColumnOffset] = 0x7f;
+		corrupt += decodeSnapshot(&bad[0], bad.size(), decoded) != 0;
+		if (compression & SNAPSHOT_DELTA) {
+			bad.assign(data.begin(), data.begin() + recordSize);
+			bad[ColumnOffset + 1 + 4 + 4 + 4] ^= 0x80; // Joins two integers, or splits one
+			corrupt += decodeSnapshot(&bad[0], bad.size(), decoded) != 0;
+		}
+
+		printf("Snapshot encoding %u : %u bytes, round trip %u errors, truncated %u accepted, corrupt %u accepted\n",
+			compression, (unsigned int)recordSize, (unsigned int)roundTrip, (unsigned int)truncated, (unsigned int)corrupt);
+		errors += roundTrip + truncated + corrupt;
+	}
+	return errors;
+}
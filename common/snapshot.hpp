@@ -0,0 +1,74 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "mappedfile.hpp"
+
+// The live particles of one emitter, one column per attribute (structure of arrays)
+struct ParticleColumns {
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> speedX, speedY, speedZ;
+	std::vector<float> size, life;
+	std::vector<unsigned char> r, g, b, a;
+
+	size_t count() const { return life.size(); }
+	void resize(size_t count);
+	void clear() { resize(0); }
+};
+
+struct EmitterSnapshot {
+	std::string name;
+	unsigned int sprite; // Index in the sprite atlas
+	float stretch;       // Extra length per unit of speed, 0 for billboards
+	ParticleColumns particles;
+};
+
+// Everything needed to draw the particles of one frame again
+struct ParticleSnapshot {
+	unsigned int frame;
+	double time;
+	std::vector<EmitterSnapshot> emitters;
+};
+
+// Compression of the columns, can be combined
+enum SnapshotCompression {
+	SNAPSHOT_RAW = 0,
+	SNAPSHOT_QUANTIZE = 1 << 0, // Floats as 16 bits over the range of their column
+	SNAPSHOT_DELTA = 1 << 1     // Each value as the difference with the previous one, in variable length integers.
+	                            // Floats are quantized first.
+};
+
+// One frame record of a snapshot file, appended to `out`
+void encodeSnapshot(const ParticleSnapshot & snapshot, unsigned int compression, std::vector<unsigned char> & out);
+// Decodes one frame record. Returns the bytes it used, 0 if the record is truncated or corrupt.
+size_t decodeSnapshot(const unsigned char * data, size_t size, ParticleSnapshot & snapshot);
+// Round trips a few emitters, an empty one included, through every compression, and feeds truncated
+// and corrupt records to the decoder. Returns the errors found.
+size_t checkSnapshotEncoding();
+
+// Appends a snapshot every `interval` frames to `path`. Encoding and writing happen on a
+// thread of their own; if it falls behind, snapshots are dropped rather than waited for.
+bool startSnapshotWriter(const char * path, unsigned int interval, unsigned int compression);
+// Whether this frame should be captured
+bool snapshotWanted(unsigned int frame);
+// Hands the snapshot over to the writer thread; `snapshot` is left empty
+void submitSnapshot(ParticleSnapshot & snapshot);
+// Writes what is still queued and closes the file
+void stopSnapshotWriter();
+
+// Plays back a snapshot file, frame after frame
+struct SnapshotReader {
+	MappedFile file;
+	std::vector<size_t> frames; // Offset of every frame record
+	size_t next;
+};
+
+bool openSnapshotReader(const char * path, SnapshotReader & reader);
+// The next frame, starting over after the last one
+bool readSnapshot(SnapshotReader & reader, ParticleSnapshot & snapshot);
+void closeSnapshotReader(SnapshotReader & reader);
+
+#endif
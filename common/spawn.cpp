@@ -0,0 +1,55 @@
+#include <stddef.h>
+#include <functional>
+
+#include <glm/glm.hpp>
+
+#include "random.hpp"
+#include "threadpool.hpp"
+#include "spawn.hpp"
+
+void initSpawnRing(SpawnRing & ring, size_t capacity){
+	ring.capacity = capacity;
+	ring.next = 0;
+}
+
+size_t reserveSpawnSlots(SpawnRing & ring, size_t & count){
+	if (count > ring.capacity)
+		count = ring.capacity;
+	size_t first = ring.next;
+	ring.next += count;
+	if (ring.next >= ring.capacity)
+		ring.next -= ring.capacity;
+	return first;
+}
+
+size_t spawnParticles(SpawnRing & ring, size_t count, unsigned long long seed,
+                      const std::function<void(size_t, size_t, Random &)> & fill){
+
+	if (ring.capacity == 0 || count == 0)
+		return 0;
+	size_t first = reserveSpawnSlots(ring, count);
+
+	parallelFor(count, SPAWN_BATCH, [&](size_t begin, size_t end) {
+		for (size_t batch = begin; batch < end; batch += SPAWN_BATCH) {
+			size_t batchEnd = batch + SPAWN_BATCH < end ? batch + SPAWN_BATCH : end;
+
+			Random random;
+			seedRandom(random, seed, batch / SPAWN_BATCH);
+
+			// A batch crossing the end of the array is filled in two runs
+			size_t slot = first + batch;
+			if (slot >= ring.capacity)
+				slot -= ring.capacity;
+			size_t batchCount = batchEnd - batch;
+			size_t beforeEnd = ring.capacity - slot;
+			if (batchCount <= beforeEnd) {
+				fill(slot, batchCount, random);
+			} else {
+				fill(slot, beforeEnd, random);
+				fill(0, batchCount - beforeEnd, random);
+			}
+		}
+	});
+
+	return count;
+}
@@ -0,0 +1,32 @@
+#ifndef SPAWN_HPP
+#define SPAWN_HPP
+
+#include <stddef.h>
+#include <functional>
+
+struct Random;
+
+// Slots of an emitter's particle array, handed out in a circle. The particles of an emitter all
+// live the same time, so the next slots hold the oldest particles. They are dead already as long as
+// the emitter spawns at most capacity / life particles per second; past that, or in a large burst,
+// live particles are overwritten.
+struct SpawnRing {
+	size_t capacity;
+	size_t next;
+};
+
+// Most slots given to one call of the fill function
+#define SPAWN_BATCH 1024
+
+void initSpawnRing(SpawnRing & ring, size_t capacity);
+// Reserves `count` slots in one step (at most the capacity) and returns the first. They go on
+// from there, back to slot 0 past the end.
+size_t reserveSpawnSlots(SpawnRing & ring, size_t & count);
+
+// Reserves `count` slots and has them filled on the thread pool, by fill(first, count, random),
+// for contiguous runs of at most SPAWN_BATCH slots. Each run gets its own generator, from the seed
+// and its place in the burst : the result does not depend on the threads. Returns how many spawned.
+size_t spawnParticles(SpawnRing & ring, size_t count, unsigned long long seed,
+                      const std::function<void(size_t, size_t, Random &)> & fill);
+
+#endif
@@ -0,0 +1,454 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "texture.hpp"
+#include "spriteatlas.hpp"
+
+static unsigned int alignUp(unsigned int value, unsigned int alignment){
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Tries one atlas size. Rows ("shelves") are as tall as their first, tallest, rectangle.
+// Each rectangle takes its size plus the padding on every side.
+static bool packShelves(const std::vector<AtlasRect> & sizes, const std::vector<size_t> & order,
+                        unsigned int alignment, unsigned int padding, unsigned int atlasSize, std::vector<AtlasRect> & placed){
+	unsigned int x = 0, y = 0, shelfHeight = 0;
+	for (size_t i = 0; i < order.size(); i++) {
+		const AtlasRect & size = sizes[order[i]];
+		unsigned int width = size.width + 2 * padding;
+		unsigned int height = size.height + 2 * padding;
+		if (x + width > atlasSize) {
+			x = 0;
+			y += alignUp(shelfHeight, alignment);
+			shelfHeight = 0;
+		}
+		if (x + width > atlasSize || y + height > atlasSize)
+			return false;
+
+		AtlasRect & rect = placed[order[i]];
+		rect.x = x + padding;
+		rect.y = y + padding;
+		rect.width = size.width;
+		rect.height = size.height;
+		x += alignUp(width, alignment);
+		shelfHeight = std::max(shelfHeight, height);
+	}
+	return true;
+}
+
+struct TallerFirst {
+	const std::vector<AtlasRect> & sizes;
+	TallerFirst(const std::vector<AtlasRect> & s) : sizes(s) {}
+	bool operator()(size_t a, size_t b) const { return sizes[a].height > sizes[b].height; }
+};
+
+bool packAtlas(const std::vector<AtlasRect> & sizes, unsigned int alignment, unsigned int padding, unsigned int maxSize,
+               std::vector<AtlasRect> & placed, unsigned int & atlasSize){
+
+	if (alignment == 0 || (alignment & (alignment - 1)) != 0 || padding % alignment != 0)
+		return false;
+
+	std::vector<size_t> order(sizes.size());
+	unsigned long long area = 0;
+	unsigned int largest = alignment;
+	for (size_t i = 0; i < sizes.size(); i++) {
+		order[i] = i;
+		unsigned int width = sizes[i].width + 2 * padding;
+		unsigned int height = sizes[i].height + 2 * padding;
+		area += (unsigned long long)alignUp(width, alignment) * alignUp(height, alignment);
+		largest = std::max(largest, std::max(width, height));
+	}
+	std::stable_sort(order.begin(), order.end(), TallerFirst(sizes));
+
+	// Start from the smallest size that could possibly fit, and double until it does
+	atlasSize = 1;
+	while (atlasSize < largest || (unsigned long long)atlasSize * atlasSize < area)
+		atlasSize *= 2;
+
+	placed.resize(sizes.size());
+	for (; atlasSize <= maxSize; atlasSize *= 2) {
+		if (packShelves(sizes, order, alignment, padding, atlasSize, placed))
+			return true;
+	}
+	return false;
+}
+
+glm::vec4 atlasUVRect(const AtlasRect & rect, unsigned int atlasSize){
+	float scale = 1.0f / atlasSize;
+	return glm::vec4(rect.x * scale, rect.y * scale, rect.width * scale, rect.height * scale);
+}
+
+// Number of mipmaps that can be copied as whole 4x4 blocks
+static unsigned int blockAlignedLevels(const DDSDescriptor & descriptor){
+	unsigned int levels = 0;
+	while (levels < descriptor.levels.size()
+		&& descriptor.width % (4u << levels) == 0 && descriptor.height % (4u << levels) == 0)
+		levels++;
+	return levels;
+}
+
+// One fully opaque white 4x4 block, for the sprites that could not be loaded
+static bool whiteBlock(unsigned int format, unsigned char block[16]){
+	static const unsigned char whiteColor[8] = { 0xFF, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0 };
+	switch (format) {
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		memcpy(block, whiteColor, 8);
+		return true;
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		memset(block, 0xFF, 8); // 4 bits of alpha per texel
+		memcpy(block + 8, whiteColor, 8);
+		return true;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		memset(block, 0, 8);
+		block[0] = block[1] = 0xFF; // Both alpha endpoints at 255
+		memcpy(block + 8, whiteColor, 8);
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Flips the 2 bit color indices of a DXT1 block, or of the color half of a DXT3/DXT5 one.
+// Rows are the last 4 bytes, texel x of a row at bits 2x.
+static void mirrorColorBlock(unsigned char * block, bool flipX, bool flipY){
+	unsigned char * rows = block + 4;
+	if (flipX) {
+		for (int y = 0; y < 4; y++) {
+			unsigned char row = rows[y];
+			rows[y] = (unsigned char)(((row & 0x03) << 6) | ((row & 0x0C) << 2) | ((row & 0x30) >> 2) | ((row & 0xC0) >> 6));
+		}
+	}
+	if (flipY) {
+		std::swap(rows[0], rows[3]);
+		std::swap(rows[1], rows[2]);
+	}
+}
+
+// DXT3 alpha : 4 bits per texel, 2 bytes per row, texel x at bits 4x
+static void mirrorExplicitAlphaBlock(unsigned char * block, bool flipX, bool flipY){
+	if (flipX) {
+		for (int y = 0; y < 4; y++) {
+			unsigned char left = block[2 * y], right = block[2 * y + 1];
+			block[2 * y] = (unsigned char)((right >> 4) | (right << 4));
+			block[2 * y + 1] = (unsigned char)((left >> 4) | (left << 4));
+		}
+	}
+	if (flipY) {
+		std::swap(block[0], block[6]); std::swap(block[1], block[7]);
+		std::swap(block[2], block[4]); std::swap(block[3], block[5]);
+	}
+}
+
+// DXT5 alpha, and the channels of BC4/BC5 : two endpoints, then 3 bits per texel, texel (x, y) at bits 3 (4y + x)
+static void mirrorInterpolatedAlphaBlock(unsigned char * block, bool flipX, bool flipY){
+	unsigned long long bits = 0, mirrored = 0;
+	for (int i = 0; i < 6; i++)
+		bits |= (unsigned long long)block[2 + i] << (8 * i);
+	for (int y = 0; y < 4; y++) {
+		for (int x = 0; x < 4; x++) {
+			unsigned long long index = (bits >> (3 * (4 * y + x))) & 7;
+			int to = 4 * (flipY ? 3 - y : y) + (flipX ? 3 - x : x);
+			mirrored |= index << (3 * to);
+		}
+	}
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = (unsigned char)(mirrored >> (8 * i));
+}
+
+// Mirrors a block in place. BC7 blocks can't be flipped by moving bits around : they stay as they are.
+static void mirrorBlock(unsigned int format, unsigned char * block, bool flipX, bool flipY){
+	if (!flipX && !flipY)
+		return;
+	switch (format) {
+	case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+		mirrorColorBlock(block, flipX, flipY);
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+		mirrorExplicitAlphaBlock(block, flipX, flipY);
+		mirrorColorBlock(block + 8, flipX, flipY);
+		break;
+	case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+	case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+		mirrorInterpolatedAlphaBlock(block, flipX, flipY);
+		mirrorColorBlock(block + 8, flipX, flipY);
+		break;
+	case GL_COMPRESSED_RED_RGTC1:
+	case GL_COMPRESSED_SIGNED_RED_RGTC1:
+		mirrorInterpolatedAlphaBlock(block, flipX, flipY);
+		break;
+	case GL_COMPRESSED_RG_RGTC2:
+	case GL_COMPRESSED_SIGNED_RG_RGTC2:
+		mirrorInterpolatedAlphaBlock(block, flipX, flipY);
+		mirrorInterpolatedAlphaBlock(block + 8, flipX, flipY);
+		break;
+	default:
+		break;
+	}
+}
+
+// The block of the sprite that a block of its border repeats : the border mirrors the sprite,
+// so the texels next to its edge are the texels of the edge
+static unsigned int mirroredBlock(int block, unsigned int count, bool & flipped){
+	flipped = block < 0 || block >= (int)count;
+	if (block < 0)
+		block = -1 - block;
+	else if (block >= (int)count)
+		block = 2 * (int)count - 1 - block;
+	return (unsigned int)std::min(std::max(block, 0), (int)count - 1);
+}
+
+bool buildSpriteAtlas(const std::vector<SpriteSource> & sprites, unsigned int maxSize, SpriteAtlas & atlas){
+
+	// The atlas has the format of the sprites, and as many mipmaps as the shortest chain allows
+	unsigned int levels = 0;
+	bool first = true;
+	for (size_t i = 0; i < sprites.size(); i++) {
+		if (sprites[i].data == NULL)
+			continue;
+		const DDSDescriptor & descriptor = sprites[i].descriptor;
+		if (first) {
+			atlas.format = descriptor.format;
+			atlas.blockSize = descriptor.blockSize;
+			levels = blockAlignedLevels(descriptor);
+			first = false;
+		} else if (descriptor.format != atlas.format) {
+			printf("Sprite %u does not have the same format as the others (0x%x instead of 0x%x)\n",
+				(unsigned int)i, descriptor.format, atlas.format);
+			return false;
+		}
+		levels = std::min(levels, blockAlignedLevels(descriptor));
+	}
+	if (first || levels == 0) {
+		printf("No sprite can be put in an atlas\n");
+		return false;
+	}
+
+	unsigned char white[16];
+	bool hasWhite = whiteBlock(atlas.format, white);
+
+	// Every sprite starts on a block at every level, with a border of a block at the smallest level
+	// so that filtering never reaches into its neighbours
+	unsigned int alignment = 4u << (levels - 1);
+	atlas.padding = alignment;
+	std::vector<AtlasRect> sizes(sprites.size());
+	for (size_t i = 0; i < sprites.size(); i++) {
+		sizes[i].x = sizes[i].y = 0;
+		if (sprites[i].data) {
+			sizes[i].width = sprites[i].descriptor.width;
+			sizes[i].height = sprites[i].descriptor.height;
+		} else if (hasWhite) {
+			sizes[i].width = sizes[i].height = alignment;
+		} else {
+			printf("Sprite %u is missing and no placeholder exists for format 0x%x\n", (unsigned int)i, atlas.format);
+			return false;
+		}
+	}
+	if (!packAtlas(sizes, alignment, atlas.padding, maxSize, atlas.rects, atlas.size)) {
+		printf("The sprites don't fit in a %ux%u atlas\n", maxSize, maxSize);
+		return false;
+	}
+
+	// Copy the blocks, and their mirror images around them, at every level. The unused space stays zero.
+	atlas.levels.resize(levels);
+	for (unsigned int level = 0; level < levels; level++) {
+		unsigned int atlasBlocks = (atlas.size >> level) / 4;
+		int border = (int)((atlas.padding >> level) / 4);
+		std::vector<unsigned char> & destination = atlas.levels[level];
+		destination.assign((size_t)atlasBlocks * atlasBlocks * atlas.blockSize, 0);
+
+		for (size_t i = 0; i < sprites.size(); i++) {
+			const AtlasRect & rect = atlas.rects[i];
+			unsigned int columns = (rect.width >> level) / 4;
+			unsigned int rows = (rect.height >> level) / 4;
+			for (int row = -border; row < (int)rows + border; row++) {
+				bool flipY;
+				unsigned int fromRow = mirroredBlock(row, rows, flipY);
+				for (int column = -border; column < (int)columns + border; column++) {
+					bool flipX;
+					unsigned int fromColumn = mirroredBlock(column, columns, flipX);
+					size_t toBlock = ((size_t)((int)(rect.y >> level) / 4 + row) * atlasBlocks + (int)(rect.x >> level) / 4 + column);
+					unsigned char * to = &destination[toBlock * atlas.blockSize];
+					if (sprites[i].data)
+						memcpy(to, sprites[i].data + sprites[i].descriptor.levels[level].offset
+							+ ((size_t)fromRow * columns + fromColumn) * atlas.blockSize, atlas.blockSize);
+					else
+						memcpy(to, white, atlas.blockSize);
+					mirrorBlock(atlas.format, to, flipX, flipY);
+				}
+			}
+		}
+	}
+
+	atlas.uvRects.resize(sprites.size());
+	for (size_t i = 0; i < sprites.size(); i++)
+		atlas.uvRects[i] = atlasUVRect(atlas.rects[i], atlas.size);
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Self-check
+
+// What a DXT5 texel reads : the endpoints of its block and its two indices
+static unsigned long long atlasTexel(const SpriteAtlas & atlas, unsigned int level, unsigned int x, unsigned int y){
+	unsigned int atlasBlocks = (atlas.size >> level) / 4;
+	const unsigned char * block = &atlas.levels[level][((size_t)(y / 4) * atlasBlocks + x / 4) * atlas.blockSize];
+	unsigned long long alphaBits = 0;
+	for (int i = 0; i < 6; i++)
+		alphaBits |= (unsigned long long)block[2 + i] << (8 * i);
+	unsigned long long alphaIndex = (alphaBits >> (3 * (4 * (y % 4) + x % 4))) & 7;
+	unsigned long long colorIndex = (block[12 + y % 4] >> (2 * (x % 4))) & 3;
+	unsigned long long endpoints = block[0] | (block[1] << 8) | ((unsigned long long)block[8] << 16) | ((unsigned long long)block[9] << 24)
+		| ((unsigned long long)block[10] << 32) | ((unsigned long long)block[11] << 40);
+	return endpoints | (alphaIndex << 48) | (colorIndex << 51);
+}
+
+// Where the border texel at `offset` from the start of a sprite `length` texels long is mirrored from
+static unsigned int mirroredTexel(int offset, unsigned int length){
+	if (offset < 0)
+		offset = -1 - offset;
+	else if (offset >= (int)length)
+		offset = 2 * (int)length - 1 - offset;
+	return (unsigned int)std::min(std::max(offset, 0), (int)length - 1);
+}
+
+size_t checkSpriteAtlas(){
+
+	size_t errors = 0;
+
+	// Packing : aligned, inside the atlas, and no two padded rectangles overlapping
+	const unsigned int Dimensions[6][2] = { { 64, 32 }, { 16, 16 }, { 128, 8 }, { 8, 64 }, { 32, 32 }, { 8, 8 } };
+	std::vector<AtlasRect> sizes(6), placed;
+	for (int i = 0; i < 6; i++) {
+		sizes[i].x = sizes[i].y = 0;
+		sizes[i].width = Dimensions[i][0];
+		sizes[i].height = Dimensions[i][1];
+	}
+	const unsigned int Alignment = 8, Padding = 8;
+	unsigned int atlasSize = 0;
+	if (!packAtlas(sizes, Alignment, Padding, 1024, placed, atlasSize)) {
+		errors++;
+	} else {
+		for (size_t i = 0; i < placed.size(); i++) {
+			const AtlasRect & a = placed[i];
+			errors += a.width != sizes[i].width || a.height != sizes[i].height;
+			errors += a.x < Padding || a.y < Padding || (a.x - Padding) % Alignment != 0 || (a.y - Padding) % Alignment != 0;
+			errors += a.x + a.width + Padding > atlasSize || a.y + a.height + Padding > atlasSize;
+			for (size_t j = 0; j < i; j++) {
+				const AtlasRect & b = placed[j];
+				errors += a.x < b.x + b.width + 2 * Padding && b.x < a.x + a.width + 2 * Padding
+					&& a.y < b.y + b.height + 2 * Padding && b.y < a.y + a.height + 2 * Padding;
+			}
+		}
+	}
+	errors += packAtlas(sizes, Alignment, Padding / 2, 1024, placed, atlasSize); // Padding not a multiple of the alignment
+	errors += packAtlas(sizes, Alignment, Padding, 64, placed, atlasSize);       // Too small
+
+	// Building : DXT5 sprites of made up blocks, and a missing one
+	const unsigned int SpriteSizes[2] = { 16, 8 };
+	std::vector< std::vector<unsigned char> > files(2);
+	std::vector<SpriteSource> sprites(3);
+	unsigned int seed = 12345;
+	for (int i = 0; i < 2; i++) {
+		DDSDescriptor & descriptor = sprites[i].descriptor;
+		descriptor.width = descriptor.height = SpriteSizes[i];
+		descriptor.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		descriptor.blockSize = 16;
+		size_t offset = 0;
+		for (unsigned int size = SpriteSizes[i]; size >= 4 && descriptor.levels.size() < 2; size /= 2) {
+			DDSMipLevel level;
+			level.width = level.height = size;
+			level.offset = offset;
+			level.size = (size / 4) * (size / 4) * descriptor.blockSize;
+			descriptor.levels.push_back(level);
+			offset += level.size;
+		}
+		files[i].resize(offset);
+		for (size_t b = 0; b < offset; b++) {
+			seed = seed * 1664525u + 1013904223u;
+			files[i][b] = (unsigned char)(seed >> 24);
+		}
+		sprites[i].data = &files[i][0];
+	}
+	sprites[2].data = NULL;
+
+	SpriteAtlas atlas;
+	if (!buildSpriteAtlas(sprites, 1024, atlas) || atlas.padding == 0) {
+		errors++;
+	} else {
+		// Inside, the texels of the sprite; around it, their mirror image
+		for (size_t i = 0; i < 2; i++) {
+			const AtlasRect & rect = atlas.rects[i];
+			for (unsigned int level = 0; level < atlas.levels.size(); level++) {
+				unsigned int width = rect.width >> level, height = rect.height >> level;
+				int border = (int)(atlas.padding >> level);
+				unsigned int left = rect.x >> level, top = rect.y >> level;
+				const DDSMipLevel & mip = sprites[i].descriptor.levels[level];
+				errors += memcmp(&atlas.levels[level][((size_t)(top / 4) * ((atlas.size >> level) / 4) + left / 4) * atlas.blockSize],
+					sprites[i].data + mip.offset, atlas.blockSize) != 0;
+				for (int y = -border; y < (int)height + border; y++) {
+					for (int x = -border; x < (int)width + border; x++) {
+						unsigned long long texel = atlasTexel(atlas, level, left + x, top + y);
+						unsigned long long expected = atlasTexel(atlas, level, left + mirroredTexel(x, width), top + mirroredTexel(y, height));
+						errors += texel != expected;
+					}
+				}
+			}
+		}
+	}
+
+	printf("Sprite atlas : %u errors in the packing and the borders\n", (unsigned int)errors);
+	return errors;
+}
+
+GLuint loadSpriteAtlas(const std::vector<const char *> & paths, SpriteAtlas & atlas){
+
+	std::vector<MappedFile> files(paths.size());
+	std::vector<SpriteSource> sprites(paths.size());
+	for (size_t i = 0; i < paths.size(); i++) {
+		sprites[i].data = NULL;
+		if (!mapFile(paths[i], files[i])) {
+			printf("%s could not be opened, a white square is used instead\n", paths[i]);
+			continue;
+		}
+		if (!parseDDS(files[i].data, files[i].size, sprites[i].descriptor)) {
+			printf("%s can't be loaded, a white square is used instead\n", paths[i]);
+			continue;
+		}
+		sprites[i].data = files[i].data;
+	}
+
+	bool built = buildSpriteAtlas(sprites, 4096, atlas);
+	for (size_t i = 0; i < files.size(); i++)
+		unmapFile(files[i]);
+	if (!built || !isDDSFormatSupported(atlas.format))
+		return 0;
+
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (unsigned int level = 0; level < atlas.levels.size(); level++) {
+		unsigned int size = atlas.size >> level;
+		glCompressedTexImage2D(GL_TEXTURE_2D, level, atlas.format, size, size, 0,
+			(GLsizei)atlas.levels[level].size(), &atlas.levels[level][0]);
+	}
+
+	// The chain stops where sprites would start sharing blocks
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)atlas.levels.size() - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+	return textureID;
+}
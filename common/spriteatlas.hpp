@@ -0,0 +1,57 @@
+#ifndef SPRITEATLAS_HPP
+#define SPRITEATLAS_HPP
+
+#include <vector>
+
+#include "texture.hpp"
+
+// Where a sprite ended up in the atlas, in texels
+struct AtlasRect {
+	unsigned int x, y;
+	unsigned int width, height;
+};
+
+// Packs the rectangles in rows, tallest first, into the smallest square power-of-two atlas
+// not larger than maxSize. Every rectangle keeps `padding` texels free on each side, and starts on
+// a multiple of alignment (a power of two, that padding is a multiple of).
+// Only does arithmetic : no file, no GL call.
+bool packAtlas(const std::vector<AtlasRect> & sizes, unsigned int alignment, unsigned int padding, unsigned int maxSize,
+               std::vector<AtlasRect> & placed, unsigned int & atlasSize);
+
+// Offset (xy) and scale (zw) that take the [0,1] UVs of a sprite to its rectangle in the atlas
+glm::vec4 atlasUVRect(const AtlasRect & rect, unsigned int atlasSize);
+inline glm::vec2 remapAtlasUV(const glm::vec4 & uvRect, const glm::vec2 & uv){
+	return glm::vec2(uvRect.x, uvRect.y) + uv * glm::vec2(uvRect.z, uvRect.w);
+}
+
+// Block compressed sprites copied block by block into one atlas, mipmaps included.
+// All the sprites must have the same format. Each one is surrounded by its mirror image, `padding`
+// texels wide, so that linear filtering and the mipmaps don't bleed its neighbours in.
+struct SpriteAtlas {
+	unsigned int size;       // Width and height of level 0
+	unsigned int format;     // GL compressed internal format
+	unsigned int blockSize;  // Bytes per 4x4 block
+	unsigned int padding;    // Texels of border around every sprite, at level 0
+	std::vector< std::vector<unsigned char> > levels;
+	std::vector<AtlasRect> rects;
+	std::vector<glm::vec4> uvRects; // One per sprite, see atlasUVRect
+};
+
+// A sprite to put in the atlas : a parsed DDS and the bytes it was parsed from
+struct SpriteSource {
+	DDSDescriptor descriptor;
+	const unsigned char * data;
+};
+
+// Sprites with data == NULL (missing files) are replaced by a white square.
+// Still CPU only : the result can be checked, or saved, without a context.
+bool buildSpriteAtlas(const std::vector<SpriteSource> & sprites, unsigned int maxSize, SpriteAtlas & atlas);
+
+// Packs made up rectangles and DXT5 sprites, and checks the placement and the mirrored borders
+// texel by texel. Returns the errors found.
+size_t checkSpriteAtlas();
+
+// Reads the .DDS files, builds the atlas and uploads it. Returns 0 on failure.
+GLuint loadSpriteAtlas(const std::vector<const char *> & paths, SpriteAtlas & atlas);
+
+#endif
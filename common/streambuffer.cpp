@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <GL/glew.h>
+
+#include "streambuffer.hpp"
+
+bool initStreamBuffer(StreamBuffer & stream, GLenum target, size_t size){
+
+	stream.target = target;
+	stream.size = size;
+	stream.offset = 0;
+	stream.mapped = NULL;
+	stream.region = 0;
+	for (int i = 0; i < STREAM_BUFFER_REGIONS; i++)
+		stream.fences[i] = 0;
+
+	glGenBuffers(1, &stream.buffer);
+	glBindBuffer(target, stream.buffer);
+
+	if (GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(target, size, NULL, flags);
+		stream.mapped = (unsigned char *)glMapBufferRange(target, 0, size, flags);
+		if (stream.mapped != NULL)
+			return true;
+		// Start again with a buffer that can be respecified
+		glDeleteBuffers(1, &stream.buffer);
+		glGenBuffers(1, &stream.buffer);
+		glBindBuffer(target, stream.buffer);
+	}
+
+	glBufferData(target, size, NULL, GL_STREAM_DRAW);
+	return true;
+}
+
+// Moves on to the next third of the buffer : the GPU must be done with what it read there last time
+static void enterNextRegion(StreamBuffer & stream){
+	stream.fences[stream.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	stream.region = (stream.region + 1) % STREAM_BUFFER_REGIONS;
+
+	GLsync fence = stream.fences[stream.region];
+	if (fence == 0)
+		return;
+	GLenum result = glClientWaitSync(fence, 0, 0);
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+	glDeleteSync(fence);
+	stream.fences[stream.region] = 0;
+}
+
+void * mapStreamBuffer(StreamBuffer & stream, size_t bytes, size_t & offset){
+
+	size_t regionSize = stream.size / STREAM_BUFFER_REGIONS;
+	if (bytes == 0 || bytes > regionSize)
+		return NULL;
+
+	if (stream.mapped != NULL) {
+		// A write never straddles two thirds : it starts the next one instead. The fence placed when
+		// leaving a third then comes after every draw that reads from it.
+		unsigned int region = (unsigned int)(stream.offset / regionSize);
+		if (region >= STREAM_BUFFER_REGIONS)
+			region = STREAM_BUFFER_REGIONS - 1; // The remainder of the division
+		size_t regionEnd = region == STREAM_BUFFER_REGIONS - 1 ? stream.size : (region + 1) * regionSize;
+		offset = stream.offset;
+		if (offset + bytes > regionEnd) {
+			region = (region + 1) % STREAM_BUFFER_REGIONS;
+			offset = region * regionSize;
+		}
+		stream.offset = offset + bytes;
+
+		while (stream.region != region)
+			enterNextRegion(stream);
+		return stream.mapped + offset;
+	}
+
+	bool wraps = stream.offset + bytes > stream.size;
+	offset = wraps ? 0 : stream.offset;
+	stream.offset = offset + bytes;
+
+	glBindBuffer(stream.target, stream.buffer);
+	if (wraps)
+		glBufferData(stream.target, stream.size, NULL, GL_STREAM_DRAW); // Buffer orphaning
+	return glMapBufferRange(stream.target, offset, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void unmapStreamBuffer(StreamBuffer & stream){
+	glBindBuffer(stream.target, stream.buffer);
+	if (stream.mapped == NULL)
+		glUnmapBuffer(stream.target);
+}
+
+void cleanupStreamBuffer(StreamBuffer & stream){
+	for (int i = 0; i < STREAM_BUFFER_REGIONS; i++) {
+		if (stream.fences[i] != 0)
+			glDeleteSync(stream.fences[i]);
+		stream.fences[i] = 0;
+	}
+	if (stream.mapped != NULL) {
+		glBindBuffer(stream.target, stream.buffer);
+		glUnmapBuffer(stream.target);
+		stream.mapped = NULL;
+	}
+	glDeleteBuffers(1, &stream.buffer);
+	stream.buffer = 0;
+}
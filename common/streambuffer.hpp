@@ -0,0 +1,29 @@
+#ifndef STREAMBUFFER_HPP
+#define STREAMBUFFER_HPP
+
+#include <stddef.h>
+
+#define STREAM_BUFFER_REGIONS 3
+
+// A buffer the CPU fills every frame while the GPU still reads what was written before.
+// With ARB_buffer_storage it stays mapped for good (persistent, coherent), and each third of
+// it is fenced so the CPU only waits if it catches up with the GPU. Without it, each write
+// maps a fresh range unsynchronized and the buffer is orphaned when it wraps around.
+struct StreamBuffer {
+	GLuint buffer;
+	GLenum target;
+	size_t size;
+	size_t offset;          // Where the next write goes
+	unsigned char * mapped; // Persistent mapping, or NULL
+	unsigned int region;    // Third being written
+	GLsync fences[STREAM_BUFFER_REGIONS];
+};
+
+bool initStreamBuffer(StreamBuffer & stream, GLenum target, size_t size);
+// Space for `bytes` contiguous bytes, at `offset` in the buffer. NULL if bytes is more than a third of it.
+void * mapStreamBuffer(StreamBuffer & stream, size_t bytes, size_t & offset);
+// Call before drawing from what was just written. The buffer is left bound to its target.
+void unmapStreamBuffer(StreamBuffer & stream);
+void cleanupStreamBuffer(StreamBuffer & stream);
+
+#endif
@@ -1,5 +1,8 @@
 #include <vector>
+#include <cstdio>
 #include <cstring>
+#include <cstddef>
+#include <cmath>
 
 #include <GL/glew.h>
 
@@ -9,116 +12,349 @@ using namespace glm;
 
 #include "shader.hpp"
 #include "texture.hpp"
+#include "uniforms.hpp"
+#include "shaderregistry.hpp"
+#include "streambuffer.hpp"
 
 #include "text2D.hpp"
 
+// Room for this many vertices per frame (a third of the stream buffer)
+#define TEXT2D_MAX_VERTICES (32 * 1024)
+
+// The character whose cell is used for solid rectangles
+#define TEXT2D_SOLID_CHARACTER 127
+
 unsigned int Text2DTextureID;
-unsigned int Text2DVertexBufferID;
-unsigned int Text2DUVBufferID;
-unsigned int Text2DShaderID;
-unsigned int Text2DUniformID;
+ShaderHandle Text2DShader;
+UniformVec2 Text2DScreenSize;
+StreamBuffer Text2DVertexBuffer;
+std::vector<TextVertex> Text2DVertices; // Queued this frame, kept allocated between frames
+
+// 5x7 glyphs of the printable ASCII characters, top row first, bit 4 is the leftmost column.
+// Used when no font texture is given.
+static const unsigned char BuiltinFont[95][8] = {
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04, 0x00 }, // '!'
+	{ 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+	{ 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A, 0x00 }, // '#'
+	{ 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04, 0x00 }, // '$'
+	{ 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03, 0x00 }, // '%'
+	{ 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D, 0x00 }, // '&'
+	{ 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "'"
+	{ 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02, 0x00 }, // '('
+	{ 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08, 0x00 }, // ')'
+	{ 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00, 0x00 }, // '*'
+	{ 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00, 0x00 }, // '+'
+	{ 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08, 0x00 }, // ','
+	{ 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00, 0x00 }, // '-'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // '.'
+	{ 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00, 0x00 }, // '/'
+	{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E, 0x00 }, // '0'
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00 }, // '1'
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F, 0x00 }, // '2'
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E, 0x00 }, // '3'
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02, 0x00 }, // '4'
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E, 0x00 }, // '5'
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E, 0x00 }, // '6'
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08, 0x00 }, // '7'
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E, 0x00 }, // '8'
+	{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C, 0x00 }, // '9'
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00, 0x00 }, // ':'
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08, 0x00 }, // ';'
+	{ 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02, 0x00 }, // '<'
+	{ 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // '='
+	{ 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08, 0x00 }, // '>'
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04, 0x00 }, // '?'
+	{ 0x0E, 0x11, 0x17, 0x15, 0x17, 0x10, 0x0F, 0x00 }, // '@'
+	{ 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11, 0x00 }, // 'A'
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E, 0x00 }, // 'B'
+	{ 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E, 0x00 }, // 'C'
+	{ 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C, 0x00 }, // 'D'
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F, 0x00 }, // 'E'
+	{ 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10, 0x00 }, // 'F'
+	{ 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F, 0x00 }, // 'G'
+	{ 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11, 0x00 }, // 'H'
+	{ 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00 }, // 'I'
+	{ 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C, 0x00 }, // 'J'
+	{ 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11, 0x00 }, // 'K'
+	{ 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F, 0x00 }, // 'L'
+	{ 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11, 0x00 }, // 'M'
+	{ 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11, 0x00 }, // 'N'
+	{ 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00 }, // 'O'
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10, 0x00 }, // 'P'
+	{ 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D, 0x00 }, // 'Q'
+	{ 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11, 0x00 }, // 'R'
+	{ 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E, 0x00 }, // 'S'
+	{ 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00 }, // 'T'
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E, 0x00 }, // 'U'
+	{ 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00 }, // 'V'
+	{ 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A, 0x00 }, // 'W'
+	{ 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11, 0x00 }, // 'X'
+	{ 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04, 0x00 }, // 'Y'
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F, 0x00 }, // 'Z'
+	{ 0x07, 0x04, 0x04, 0x04, 0x04, 0x04, 0x07, 0x00 }, // '['
+	{ 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00, 0x00 }, // '\\'
+	{ 0x1C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x1C, 0x00 }, // ']'
+	{ 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '^'
+	{ 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x00 }, // '_'
+	{ 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '`'
+	{ 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F, 0x00 }, // 'a'
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E, 0x00 }, // 'b'
+	{ 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E, 0x00 }, // 'c'
+	{ 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F, 0x00 }, // 'd'
+	{ 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E, 0x00 }, // 'e'
+	{ 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08, 0x00 }, // 'f'
+	{ 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E, 0x00 }, // 'g'
+	{ 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00 }, // 'h'
+	{ 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E, 0x00 }, // 'i'
+	{ 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C, 0x00 }, // 'j'
+	{ 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12, 0x00 }, // 'k'
+	{ 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E, 0x00 }, // 'l'
+	{ 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11, 0x00 }, // 'm'
+	{ 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11, 0x00 }, // 'n'
+	{ 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E, 0x00 }, // 'o'
+	{ 0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10, 0x00 }, // 'p'
+	{ 0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01, 0x00 }, // 'q'
+	{ 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10, 0x00 }, // 'r'
+	{ 0x00, 0x00, 0x0F, 0x10, 0x0E, 0x01, 0x1E, 0x00 }, // 's'
+	{ 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06, 0x00 }, // 't'
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D, 0x00 }, // 'u'
+	{ 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04, 0x00 }, // 'v'
+	{ 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A, 0x00 }, // 'w'
+	{ 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x00 }, // 'x'
+	{ 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E, 0x00 }, // 'y'
+	{ 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F, 0x00 }, // 'z'
+	{ 0x03, 0x04, 0x04, 0x08, 0x04, 0x04, 0x03, 0x00 }, // '{'
+	{ 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00 }, // '|'
+	{ 0x18, 0x04, 0x04, 0x02, 0x04, 0x04, 0x18, 0x00 }, // '}'
+	{ 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00, 0x00 }, // '~'
+};
+
+// The same 16x16 grid as the font textures, 8x8 pixels per cell, white with the glyph in alpha.
+// Rows go top to bottom like in a DDS file, so the UVs are the same for both.
+static GLuint createBuiltinFontTexture(){
+
+	const int size = 16 * 8;
+	std::vector<unsigned char> pixels(size * size * 4, 255);
+	for (int i = 3; i < size * size * 4; i += 4)
+		pixels[i] = 0;
+
+	for (int character = 32; character <= TEXT2D_SOLID_CHARACTER; character++) {
+		int cellX = (character % 16) * 8, cellY = (character / 16) * 8;
+		for (int row = 0; row < 8; row++) {
+			for (int column = 0; column < 8; column++) {
+				bool set;
+				if (character == TEXT2D_SOLID_CHARACTER)
+					set = true;
+				else
+					set = column >= 1 && column <= 5 && (BuiltinFont[character - 32][row] & (1 << (5 - column))) != 0;
+				pixels[((cellY + row) * size + cellX + column) * 4 + 3] = set ? 255 : 0;
+			}
+		}
+	}
+
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+	// Pixel font : no filtering, no mipmaps
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	return textureID;
+}
+
+static void onTextShaderLoaded(ShaderHandle, const ShaderReflection & reflection, void *){
+	Text2DScreenSize = getUniformVec2(reflection, "ScreenSize");
+	// Set our "myTextureSampler" sampler to use Texture Unit 0
+	setUniform(getUniformSampler(reflection, "myTextureSampler"), 0);
+}
 
 void initText2D(const char * texturePath){
 
 	// Initialize texture
-	Text2DTextureID = loadDDS(texturePath);
+	Text2DTextureID = texturePath ? loadDDS(texturePath) : 0;
+	if (Text2DTextureID == 0)
+		Text2DTextureID = createBuiltinFontTexture();
 
-	// Initialize VBO
-	glGenBuffers(1, &Text2DVertexBufferID);
-	glGenBuffers(1, &Text2DUVBufferID);
+	// Initialize VBO : one stream for the whole frame
+	initStreamBuffer(Text2DVertexBuffer, GL_ARRAY_BUFFER, STREAM_BUFFER_REGIONS * TEXT2D_MAX_VERTICES * sizeof(TextVertex));
+	Text2DVertices.reserve(TEXT2D_MAX_VERTICES);
 
 	// Initialize Shader
-	Text2DShaderID = LoadShaders( "TextVertexShader.vertexshader", "TextVertexShader.fragmentshader" );
+	Text2DShader = registerShader("TextVertexShader.vertexshader", "TextVertexShader.fragmentshader", onTextShaderLoaded, NULL);
+}
 
-	// Initialize uniforms' IDs
-	Text2DUniformID = glGetUniformLocation( Text2DShaderID, "myTextureSampler" );
+static void pushVertex(std::vector<TextVertex> & vertices, float x, float y, float u, float v, const unsigned char color[4]){
+	TextVertex vertex;
+	vertex.x = x;
+	vertex.y = y;
+	vertex.u = u;
+	vertex.v = v;
+	memcpy(vertex.color, color, 4);
+	vertices.push_back(vertex);
+}
 
+static void pushQuad(std::vector<TextVertex> & vertices, float x, float y, float width, float height,
+                     float uv_x, float uv_y, float uv_size, const unsigned char color[4]){
+
+	// Two triangles : up left, down left, up right, then down right, up right, down left
+	pushVertex(vertices, x        , y + height, uv_x          , uv_y          , color);
+	pushVertex(vertices, x        , y         , uv_x          , uv_y + uv_size, color);
+	pushVertex(vertices, x + width, y + height, uv_x + uv_size, uv_y          , color);
+
+	pushVertex(vertices, x + width, y         , uv_x + uv_size, uv_y + uv_size, color);
+	pushVertex(vertices, x + width, y + height, uv_x + uv_size, uv_y          , color);
+	pushVertex(vertices, x        , y         , uv_x          , uv_y + uv_size, color);
 }
 
-void printText2D(const char * text, int x, int y, int size){
+void buildTextQuads(const char * text, int x, int y, int size, const unsigned char color[4], std::vector<TextVertex> & vertices){
 
 	unsigned int length = strlen(text);
-
-	// Fill buffers
-	std::vector<glm::vec2> vertices;
-	std::vector<glm::vec2> UVs;
 	for ( unsigned int i=0 ; i<length ; i++ ){
-		
-		glm::vec2 vertex_up_left    = glm::vec2( x+i*size     , y+size );
-		glm::vec2 vertex_up_right   = glm::vec2( x+i*size+size, y+size );
-		glm::vec2 vertex_down_right = glm::vec2( x+i*size+size, y      );
-		glm::vec2 vertex_down_left  = glm::vec2( x+i*size     , y      );
+		unsigned char character = text[i];
+		if (character == ' ')
+			continue; // Nothing to draw
+		float uv_x = (character%16)/16.0f;
+		float uv_y = (character/16)/16.0f;
+		pushQuad(vertices, (float)(x+i*size), (float)y, (float)size, (float)size, uv_x, uv_y, 1.0f/16.0f, color);
+	}
+}
+
+void buildRectQuad(int x, int y, int width, int height, const unsigned char color[4], std::vector<TextVertex> & vertices){
+	// The middle of the solid cell, so that filtering never reaches its neighbours
+	float uv_x = (TEXT2D_SOLID_CHARACTER%16 + 0.5f)/16.0f;
+	float uv_y = (TEXT2D_SOLID_CHARACTER/16 + 0.5f)/16.0f;
+	pushQuad(vertices, (float)x, (float)y, (float)width, (float)height, uv_x, uv_y, 0.0f, color);
+}
 
-		vertices.push_back(vertex_up_left   );
-		vertices.push_back(vertex_down_left );
-		vertices.push_back(vertex_up_right  );
+// Corners of the quads, in the order pushQuad() emits them : 0 left/bottom, 1 right/top.
+// The top of a glyph is the top of its cell, so v goes the other way.
+static const int QuadCorners[6][2] = { { 0, 1 }, { 0, 0 }, { 1, 1 }, { 1, 0 }, { 1, 1 }, { 0, 0 } };
+
+// Compares six vertices against the quad (x, y, width, height) showing the UVs (u, v) to (u + uvSize, v + uvSize)
+static size_t checkQuad(const TextVertex * quad, float x, float y, float width, float height,
+                        float u, float v, float uvSize, const unsigned char color[4]){
+	size_t errors = 0;
+	for (int i = 0; i < 6; i++) {
+		const TextVertex & vertex = quad[i];
+		errors += vertex.x != x + QuadCorners[i][0] * width || vertex.y != y + QuadCorners[i][1] * height;
+		errors += fabsf(vertex.u - (u + QuadCorners[i][0] * uvSize)) > 1e-6f
+			|| fabsf(vertex.v - (v + (1 - QuadCorners[i][1]) * uvSize)) > 1e-6f;
+		errors += memcmp(vertex.color, color, 4) != 0;
+	}
+	// Both triangles wind counterclockwise, like the rest of the scene
+	for (int triangle = 0; triangle < 2; triangle++) {
+		const TextVertex * t = quad + 3 * triangle;
+		float area = (t[1].x - t[0].x) * (t[2].y - t[0].y) - (t[1].y - t[0].y) * (t[2].x - t[0].x);
+		errors += width * height > 0.0f && area <= 0.0f;
+	}
+	return errors;
+}
 
-		vertices.push_back(vertex_down_right);
-		vertices.push_back(vertex_up_right);
-		vertices.push_back(vertex_down_left);
+size_t checkText2D(){
+
+	static const unsigned char Color[4] = { 10, 20, 30, 40 };
+	std::vector<TextVertex> vertices;
+	size_t errors = 0;
+
+	// A rectangle first : text is appended after it. Its UVs all sit in the middle of the solid cell.
+	buildRectQuad(5, 6, 30, 40, Color, vertices);
+	errors += vertices.size() != 6;
+	if (vertices.size() == 6)
+		errors += checkQuad(&vertices[0], 5.0f, 6.0f, 30.0f, 40.0f,
+		                    (TEXT2D_SOLID_CHARACTER % 16 + 0.5f) / 16.0f, (TEXT2D_SOLID_CHARACTER / 16 + 0.5f) / 16.0f, 0.0f, Color);
+
+	// The space makes no quad but still moves the pen
+	buildTextQuads("A b", 10, 20, 8, Color, vertices);
+	errors += vertices.size() != 18;
+	if (vertices.size() == 18) {
+		errors += checkQuad(&vertices[6], 10.0f, 20.0f, 8.0f, 8.0f, ('A' % 16) / 16.0f, ('A' / 16) / 16.0f, 1.0f / 16.0f, Color);
+		errors += checkQuad(&vertices[12], 26.0f, 20.0f, 8.0f, 8.0f, ('b' % 16) / 16.0f, ('b' / 16) / 16.0f, 1.0f / 16.0f, Color);
+	}
 
-		char character = text[i];
-		float uv_x = (character%16)/16.0f;
-		float uv_y = (character/16)/16.0f;
+	printf("Text2D : %u errors in the quads of a known string\n", (unsigned int)errors);
+	return errors;
+}
 
-		glm::vec2 uv_up_left    = glm::vec2( uv_x           , uv_y );
-		glm::vec2 uv_up_right   = glm::vec2( uv_x+1.0f/16.0f, uv_y );
-		glm::vec2 uv_down_right = glm::vec2( uv_x+1.0f/16.0f, (uv_y + 1.0f/16.0f) );
-		glm::vec2 uv_down_left  = glm::vec2( uv_x           , (uv_y + 1.0f/16.0f) );
-		UVs.push_back(uv_up_left   );
-		UVs.push_back(uv_down_left );
-		UVs.push_back(uv_up_right  );
-
-		UVs.push_back(uv_down_right);
-		UVs.push_back(uv_up_right);
-		UVs.push_back(uv_down_left);
+void printText2D(const char * text, int x, int y, int size){
+	static const unsigned char white[4] = { 255, 255, 255, 255 };
+	buildTextQuads(text, x, y, size, white, Text2DVertices);
+}
+
+void printText2D(const char * text, int x, int y, int size, const unsigned char color[4]){
+	buildTextQuads(text, x, y, size, color, Text2DVertices);
+}
+
+void drawRect2D(int x, int y, int width, int height, const unsigned char color[4]){
+	buildRectQuad(x, y, width, height, color, Text2DVertices);
+}
+
+void drawText2D(int screenWidth, int screenHeight){
+
+	if (Text2DVertices.empty())
+		return;
+	if (Text2DVertices.size() > TEXT2D_MAX_VERTICES)
+		Text2DVertices.resize(TEXT2D_MAX_VERTICES - TEXT2D_MAX_VERTICES % 6);
+
+	// Append this frame's quads to the stream
+	size_t bytes = Text2DVertices.size() * sizeof(TextVertex);
+	size_t offset = 0;
+	void * destination = mapStreamBuffer(Text2DVertexBuffer, bytes, offset);
+	if (destination == NULL) {
+		Text2DVertices.clear();
+		return;
 	}
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec2), &vertices[0], GL_STATIC_DRAW);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-	glBufferData(GL_ARRAY_BUFFER, UVs.size() * sizeof(glm::vec2), &UVs[0], GL_STATIC_DRAW);
+	memcpy(destination, &Text2DVertices[0], bytes);
+	unmapStreamBuffer(Text2DVertexBuffer);
 
 	// Bind shader
-	glUseProgram(Text2DShaderID);
+	glUseProgram(getShaderProgram(Text2DShader));
+	setUniform(Text2DScreenSize, glm::vec2((float)screenWidth, (float)screenHeight));
 
 	// Bind texture
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, Text2DTextureID);
-	// Set our "myTextureSampler" sampler to use Texture Unit 0
-	glUniform1i(Text2DUniformID, 0);
 
 	// 1rst attribute buffer : vertices
 	glEnableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DVertexBufferID);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)(offset + offsetof(TextVertex, x)) );
 
 	// 2nd attribute buffer : UVs
 	glEnableVertexAttribArray(1);
-	glBindBuffer(GL_ARRAY_BUFFER, Text2DUVBufferID);
-	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, (void*)0 );
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)(offset + offsetof(TextVertex, u)) );
+
+	// 3rd attribute buffer : colors
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex), (void*)(offset + offsetof(TextVertex, color)) );
 
+	// On top of everything
+	glDisable(GL_DEPTH_TEST);
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	// Draw call
-	glDrawArrays(GL_TRIANGLES, 0, vertices.size() );
+	glDrawArrays(GL_TRIANGLES, 0, (GLsizei)Text2DVertices.size() );
 
 	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
 
 	glDisableVertexAttribArray(0);
 	glDisableVertexAttribArray(1);
+	glDisableVertexAttribArray(2);
 
+	Text2DVertices.clear();
 }
 
 void cleanupText2D(){
 
 	// Delete buffers
-	glDeleteBuffers(1, &Text2DVertexBufferID);
-	glDeleteBuffers(1, &Text2DUVBufferID);
+	cleanupStreamBuffer(Text2DVertexBuffer);
+	Text2DVertices.clear();
 
 	// Delete texture
 	glDeleteTextures(1, &Text2DTextureID);
 
-	// Delete shader
-	glDeleteProgram(Text2DShaderID);
+	// The program belongs to the shader registry
 }
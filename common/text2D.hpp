@@ -1,8 +1,32 @@
 #ifndef TEXT2D_HPP
 #define TEXT2D_HPP
 
+#include <stddef.h>
+#include <vector>
+
+// One corner of a glyph quad, in pixels from the bottom left of the screen
+struct TextVertex {
+	float x, y;
+	float u, v;
+	unsigned char color[4];
+};
+
+// The font texture is a 16x16 grid of glyphs, in ASCII order from the top left.
+// Six vertices (two triangles) per character are appended to vertices; no GL call is made.
+void buildTextQuads(const char * text, int x, int y, int size, const unsigned char color[4], std::vector<TextVertex> & vertices);
+// A solid rectangle, drawn with the texel the font keeps white for that purpose
+void buildRectQuad(int x, int y, int width, int height, const unsigned char color[4], std::vector<TextVertex> & vertices);
+// Builds a rectangle and a known string and checks the positions, UVs and colors of every vertex.
+// Returns the errors found.
+size_t checkText2D();
+
+// With texturePath NULL, or if it can't be loaded, a built-in 8x8 font is used
 void initText2D(const char * texturePath);
+// These only queue quads : everything queued in a frame is drawn by one drawText2D() call
 void printText2D(const char * text, int x, int y, int size);
+void printText2D(const char * text, int x, int y, int size, const unsigned char color[4]);
+void drawRect2D(int x, int y, int width, int height, const unsigned char color[4]);
+void drawText2D(int screenWidth, int screenHeight);
 void cleanupText2D();
 
-#endif
\ No newline at end of file
+#endif
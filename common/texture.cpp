@@ -1,69 +1,27 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 #include <GL/glew.h>
 
 #include <GLFW/glfw3.h>
 
+#include "mappedfile.hpp"
+#include "image.hpp"
+#include "texture.hpp"
 
-GLuint loadBMP_custom(const char * imagepath){
-
-	printf("Reading image %s\n", imagepath);
-
-	// Data read from the header of the BMP file
-	unsigned char header[54];
-	unsigned int dataPos;
-	unsigned int imageSize;
-	unsigned int width, height;
-	// Actual RGB data
-	unsigned char * data;
-
-	// Open the file
-	errno_t err;
-	FILE * file;
-	if ((err = fopen_s(&file, imagepath, "rb")) != 0){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
-		getchar();
-		return 0;
-	}
 
-	// Read the header, i.e. the 54 first bytes
+GLuint loadBMP_custom(const char * imagepath){
 
-	// If less than 54 bytes are read, problem
-	if ( fread(header, 1, 54, file)!=54 ){ 
-		printf("Not a correct BMP file\n");
-		fclose(file);
-		return 0;
-	}
-	// A BMP files always begins with "BM"
-	if ( header[0]!='B' || header[1]!='M' ){
-		printf("Not a correct BMP file\n");
-		fclose(file);
+	// Decode the file into memory
+	Image image;
+	if (!loadBMP(imagepath, image))
 		return 0;
-	}
-	// Make sure this is a 24bpp file
-	if ( *(int*)&(header[0x1E])!=0  )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-	if ( *(int*)&(header[0x1C])!=24 )         {printf("Not a correct BMP file\n");    fclose(file); return 0;}
-
-	// Read the information about the image
-	dataPos    = *(int*)&(header[0x0A]);
-	imageSize  = *(int*)&(header[0x22]);
-	width      = *(int*)&(header[0x12]);
-	height     = *(int*)&(header[0x16]);
-
-	// Some BMP files are misformatted, guess missing information
-	if (imageSize==0)    imageSize=width*height*3; // 3 : one byte for each Red, Green and Blue component
-	if (dataPos==0)      dataPos=54; // The BMP header is done that way
-
-	// Create a buffer
-	data = new unsigned char [imageSize];
-
-	// Read the actual data from the file into the buffer
-	fread(data,1,imageSize,file);
 
-	// Everything is in memory now, the file can be closed.
-	fclose (file);
+	// The mipmaps are made on the CPU, with the same box filter as the DDS converter
+	std::vector<Image> levels;
+	buildMipChain(image, levels);
 
 	// Create one OpenGL texture
 	GLuint textureID;
@@ -71,24 +29,23 @@ GLuint loadBMP_custom(const char * imagepath){
 	
 	// "Bind" the newly created texture : all future texture functions will modify this texture
 	glBindTexture(GL_TEXTURE_2D, textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0,GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
-
-	// OpenGL has now copied the data. Free our own version
-	delete [] data;
+	// Give the image to OpenGL. Opaque images don't need to keep their alpha channel in video memory.
+	GLint internalFormat = image.hasAlpha ? GL_RGBA8 : GL_RGB8;
+	for (size_t level = 0; level < levels.size(); level++)
+		glTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat, levels[level].width, levels[level].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &levels[level].pixels[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
 
 	// Poor filtering, or ...
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); 
 
-	// ... nice trilinear filtering ...
+	// ... nice trilinear filtering.
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	// ... which requires mipmaps. Generate them automatically.
-	glGenerateMipmap(GL_TEXTURE_2D);
 
 	// Return the ID of the texture we just created
 	return textureID;
@@ -124,96 +81,359 @@ GLuint loadBMP_custom(const char * imagepath){
 #define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
 #define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
 #define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+#define FOURCC_ATI1 0x31495441 // Equivalent to "ATI1" in ASCII (BC4)
+#define FOURCC_BC4U 0x55344342 // Equivalent to "BC4U" in ASCII
+#define FOURCC_BC4S 0x53344342 // Equivalent to "BC4S" in ASCII
+#define FOURCC_ATI2 0x32495441 // Equivalent to "ATI2" in ASCII (BC5)
+#define FOURCC_BC5U 0x55354342 // Equivalent to "BC5U" in ASCII
+#define FOURCC_BC5S 0x53354342 // Equivalent to "BC5S" in ASCII
+#define FOURCC_DX10 0x30315844 // Equivalent to "DX10" in ASCII : a DDS_HEADER_DXT10 follows the header
+
+// The subset of DXGI_FORMAT we can upload
+#define DXGI_FORMAT_BC1_UNORM       71
+#define DXGI_FORMAT_BC1_UNORM_SRGB  72
+#define DXGI_FORMAT_BC2_UNORM       74
+#define DXGI_FORMAT_BC2_UNORM_SRGB  75
+#define DXGI_FORMAT_BC3_UNORM       77
+#define DXGI_FORMAT_BC3_UNORM_SRGB  78
+#define DXGI_FORMAT_BC4_UNORM       80
+#define DXGI_FORMAT_BC4_SNORM       81
+#define DXGI_FORMAT_BC5_UNORM       83
+#define DXGI_FORMAT_BC5_SNORM       84
+#define DXGI_FORMAT_BC7_UNORM       98
+#define DXGI_FORMAT_BC7_UNORM_SRGB  99
+
+#define DDS_MAGIC_SIZE        4
+#define DDS_HEADER_SIZE       124
+#define DDS_HEADER_DXT10_SIZE 20
+#define DDS_MAX_DIMENSION     16384
+#define DDSD_MIPMAPCOUNT      0x20000
+#define DDS_DIMENSION_TEXTURE2D 3
+
+// DDS files are little endian and the header fields are not necessarily aligned
+static unsigned int readU32(const unsigned char * bytes){
+	return (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) | ((unsigned int)bytes[2] << 16) | ((unsigned int)bytes[3] << 24);
+}
 
-GLuint loadDDS(const char * imagepath){
-
-	unsigned char header[124];
+static bool formatFromFourCC(unsigned int fourCC, unsigned int & format, unsigned int & blockSize){
+	switch(fourCC) 
+	{ 
+	case FOURCC_DXT1: format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; blockSize = 8;  return true;
+	case FOURCC_DXT3: format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; blockSize = 16; return true;
+	case FOURCC_DXT5: format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; blockSize = 16; return true;
+	case FOURCC_ATI1:
+	case FOURCC_BC4U: format = GL_COMPRESSED_RED_RGTC1;          blockSize = 8;  return true;
+	case FOURCC_BC4S: format = GL_COMPRESSED_SIGNED_RED_RGTC1;   blockSize = 8;  return true;
+	case FOURCC_ATI2:
+	case FOURCC_BC5U: format = GL_COMPRESSED_RG_RGTC2;           blockSize = 16; return true;
+	case FOURCC_BC5S: format = GL_COMPRESSED_SIGNED_RG_RGTC2;    blockSize = 16; return true;
+	default: return false;
+	}
+}
 
-	FILE *fp; 
- 
-	/* try to open the file */
-	errno_t err; 
-	if ((err = fopen_s(&fp, imagepath, "rb")) != 0){
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
-		return 0;
+static bool formatFromDXGI(unsigned int dxgiFormat, unsigned int & format, unsigned int & blockSize){
+	switch(dxgiFormat)
+	{
+	case DXGI_FORMAT_BC1_UNORM:      format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;       blockSize = 8;  return true;
+	case DXGI_FORMAT_BC1_UNORM_SRGB: format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT; blockSize = 8;  return true;
+	case DXGI_FORMAT_BC2_UNORM:      format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;       blockSize = 16; return true;
+	case DXGI_FORMAT_BC2_UNORM_SRGB: format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT; blockSize = 16; return true;
+	case DXGI_FORMAT_BC3_UNORM:      format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;       blockSize = 16; return true;
+	case DXGI_FORMAT_BC3_UNORM_SRGB: format = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT; blockSize = 16; return true;
+	case DXGI_FORMAT_BC4_UNORM:      format = GL_COMPRESSED_RED_RGTC1;                blockSize = 8;  return true;
+	case DXGI_FORMAT_BC4_SNORM:      format = GL_COMPRESSED_SIGNED_RED_RGTC1;         blockSize = 8;  return true;
+	case DXGI_FORMAT_BC5_UNORM:      format = GL_COMPRESSED_RG_RGTC2;                 blockSize = 16; return true;
+	case DXGI_FORMAT_BC5_SNORM:      format = GL_COMPRESSED_SIGNED_RG_RGTC2;          blockSize = 16; return true;
+	case DXGI_FORMAT_BC7_UNORM:      format = GL_COMPRESSED_RGBA_BPTC_UNORM;          blockSize = 16; return true;
+	case DXGI_FORMAT_BC7_UNORM_SRGB: format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;    blockSize = 16; return true;
+	default: return false;
 	}
-   
+}
+
+bool parseDDS(const unsigned char * data, size_t size, DDSDescriptor & descriptor){
+
+	descriptor.levels.clear();
+
 	/* verify the type of file */ 
-	char filecode[4]; 
-	fread(filecode, 1, 4, fp); 
-	if (strncmp(filecode, "DDS ", 4) != 0) { 
-		fclose(fp); 
-		return 0; 
+	if (size < DDS_MAGIC_SIZE + DDS_HEADER_SIZE || memcmp(data, "DDS ", 4) != 0) {
+		printf("Not a DDS file\n");
+		return false;
 	}
-	
+
 	/* get the surface desc */ 
-	fread(&header, 124, 1, fp); 
-
-	unsigned int height      = *(unsigned int*)&(header[8 ]);
-	unsigned int width	     = *(unsigned int*)&(header[12]);
-	unsigned int linearSize	 = *(unsigned int*)&(header[16]);
-	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-	unsigned int fourCC      = *(unsigned int*)&(header[80]);
-
- 
-	unsigned char * buffer;
-	unsigned int bufsize;
-	/* how big is it going to be including all mipmaps? */ 
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize; 
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char)); 
-	fread(buffer, 1, bufsize, fp); 
-	/* close the file pointer */ 
-	fclose(fp);
-
-	unsigned int components  = (fourCC == FOURCC_DXT1) ? 3 : 4; 
-	unsigned int format;
-	switch(fourCC) 
-	{ 
-	case FOURCC_DXT1: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; 
-		break; 
-	case FOURCC_DXT3: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; 
-		break; 
-	case FOURCC_DXT5: 
-		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; 
-		break; 
-	default: 
-		free(buffer); 
-		return 0; 
+	const unsigned char * header = data + DDS_MAGIC_SIZE;
+	if (readU32(header + 0) != DDS_HEADER_SIZE || readU32(header + 72) != 32) {
+		printf("Corrupted DDS header\n");
+		return false;
 	}
 
-	// Create one OpenGL texture
-	GLuint textureID;
-	glGenTextures(1, &textureID);
+	unsigned int flags       = readU32(header + 4);
+	unsigned int height      = readU32(header + 8);
+	unsigned int width       = readU32(header + 12);
+	unsigned int mipMapCount = readU32(header + 24);
+	unsigned int fourCC      = readU32(header + 80);
 
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
-	
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16; 
-	unsigned int offset = 0;
+	if (width == 0 || height == 0 || width > DDS_MAX_DIMENSION || height > DDS_MAX_DIMENSION) {
+		printf("Unsupported DDS size %ux%u\n", width, height);
+		return false;
+	}
+
+	size_t offset = DDS_MAGIC_SIZE + DDS_HEADER_SIZE;
+	bool known;
+	if (fourCC == FOURCC_DX10) {
+		if (size < offset + DDS_HEADER_DXT10_SIZE) {
+			printf("Truncated DDS header\n");
+			return false;
+		}
+		const unsigned char * header10 = data + offset;
+		unsigned int dxgiFormat = readU32(header10 + 0);
+		unsigned int dimension  = readU32(header10 + 4);
+		unsigned int arraySize  = readU32(header10 + 12);
+		if (dimension != DDS_DIMENSION_TEXTURE2D || arraySize > 1) {
+			printf("Only single 2D textures are supported in DDS files\n");
+			return false;
+		}
+		known = formatFromDXGI(dxgiFormat, descriptor.format, descriptor.blockSize);
+		offset += DDS_HEADER_DXT10_SIZE;
+	} else {
+		known = formatFromFourCC(fourCC, descriptor.format, descriptor.blockSize);
+	}
+	if (!known) {
+		printf("Unsupported DDS pixel format\n");
+		return false;
+	}
 
-	/* load the mipmaps */ 
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) 
+	// A full chain stops at 1x1, whatever the header says
+	unsigned int maxLevels = 1;
+	for (unsigned int largest = width > height ? width : height; largest > 1; largest /= 2)
+		maxLevels++;
+	if (!(flags & DDSD_MIPMAPCOUNT) || mipMapCount == 0)
+		mipMapCount = 1;
+	if (mipMapCount > maxLevels)
+		mipMapCount = maxLevels;
+
+	descriptor.width = width;
+	descriptor.height = height;
+
+	/* locate the mipmaps, checking each one against the file length */ 
+	for (unsigned int level = 0; level < mipMapCount; ++level) 
 	{ 
-		unsigned int size = ((width+3)/4)*((height+3)/4)*blockSize; 
-		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,  
-			0, size, buffer + offset); 
-	 
-		offset += size; 
+		DDSMipLevel mip;
+		mip.width = width;
+		mip.height = height;
+		mip.offset = offset;
+		mip.size = (size_t)((width+3)/4)*((height+3)/4)*descriptor.blockSize; 
+		if (mip.size > size - offset) {
+			if (level == 0) {
+				printf("Truncated DDS file\n");
+				return false;
+			}
+			printf("Truncated DDS file, keeping the first %u mipmaps\n", level);
+			break;
+		}
+		descriptor.levels.push_back(mip);
+
+		offset += mip.size; 
 		width  /= 2; 
 		height /= 2; 
 
 		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
 		if(width < 1) width = 1;
 		if(height < 1) height = 1;
-
 	} 
 
-	free(buffer); 
+	return true;
+}
+
+static void writeU32(unsigned char * bytes, unsigned int value){
+	bytes[0] = (unsigned char)value;
+	bytes[1] = (unsigned char)(value >> 8);
+	bytes[2] = (unsigned char)(value >> 16);
+	bytes[3] = (unsigned char)(value >> 24);
+}
+
+// A DDS file in memory : magic, header, the DX10 header when fourCC asks for one, then dataSize bytes of blocks
+static std::vector<unsigned char> makeCheckDDS(unsigned int width, unsigned int height, unsigned int mipMapCount,
+                                               unsigned int fourCC, unsigned int dxgiFormat, size_t dataSize){
+	size_t headerSize = DDS_MAGIC_SIZE + DDS_HEADER_SIZE + (fourCC == FOURCC_DX10 ? DDS_HEADER_DXT10_SIZE : 0);
+	std::vector<unsigned char> file(headerSize + dataSize, 0);
+	memcpy(&file[0], "DDS ", 4);
+	unsigned char * header = &file[DDS_MAGIC_SIZE];
+	writeU32(header + 0, DDS_HEADER_SIZE);
+	writeU32(header + 4, mipMapCount > 0 ? DDSD_MIPMAPCOUNT : 0);
+	writeU32(header + 8, height);
+	writeU32(header + 12, width);
+	writeU32(header + 24, mipMapCount);
+	writeU32(header + 72, 32); // Size of the pixel format
+	writeU32(header + 80, fourCC);
+	if (fourCC == FOURCC_DX10) {
+		unsigned char * header10 = header + DDS_HEADER_SIZE;
+		writeU32(header10 + 0, dxgiFormat);
+		writeU32(header10 + 4, DDS_DIMENSION_TEXTURE2D);
+		writeU32(header10 + 12, 1);
+	}
+	return file;
+}
+
+// Expected levels : each one is a whole number of blocks, right after the previous one
+static size_t checkDDSLevels(const DDSDescriptor & descriptor, size_t firstOffset, unsigned int width, unsigned int height, size_t count){
+	size_t errors = descriptor.levels.size() != count;
+	size_t offset = firstOffset;
+	for (size_t level = 0; level < descriptor.levels.size() && level < count; level++) {
+		const DDSMipLevel & mip = descriptor.levels[level];
+		size_t size = (size_t)((width + 3) / 4) * ((height + 3) / 4) * descriptor.blockSize;
+		errors += mip.width != width || mip.height != height || mip.offset != offset || mip.size != size;
+		offset += size;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return errors;
+}
+
+size_t checkDDSParser(){
+
+	const size_t Header = DDS_MAGIC_SIZE + DDS_HEADER_SIZE;
+	DDSDescriptor descriptor;
+	std::vector<unsigned char> file;
+	size_t errors = 0;
+
+	// Valid : DXT1 8x8 and its full chain, 32 + 8 + 8 + 8 bytes
+	file = makeCheckDDS(8, 8, 4, FOURCC_DXT1, 0, 56);
+	errors += !parseDDS(&file[0], file.size(), descriptor) || descriptor.width != 8 || descriptor.height != 8
+		|| descriptor.format != GL_COMPRESSED_RGBA_S3TC_DXT1_EXT || descriptor.blockSize != 8;
+	errors += checkDDSLevels(descriptor, Header, 8, 8, 4);
+	// Valid : BC7 through the DX10 header, not square, not a power of two, no mipmap count
+	file = makeCheckDDS(12, 5, 0, FOURCC_DX10, DXGI_FORMAT_BC7_UNORM, 3 * 2 * 16);
+	errors += !parseDDS(&file[0], file.size(), descriptor) || descriptor.format != GL_COMPRESSED_RGBA_BPTC_UNORM
+		|| descriptor.blockSize != 16;
+	errors += checkDDSLevels(descriptor, Header + DDS_HEADER_DXT10_SIZE, 12, 5, 1);
+
+	// Truncated : in the header, in the DX10 header, in the first level, in a later level
+	file = makeCheckDDS(8, 8, 4, FOURCC_DXT5, 0, 0);
+	errors += parseDDS(&file[0], Header - 1, descriptor);
+	file = makeCheckDDS(8, 8, 1, FOURCC_DX10, DXGI_FORMAT_BC3_UNORM, 0);
+	errors += parseDDS(&file[0], Header + DDS_HEADER_DXT10_SIZE - 1, descriptor);
+	file = makeCheckDDS(8, 8, 4, FOURCC_DXT5, 0, 63);
+	errors += parseDDS(&file[0], file.size(), descriptor) || !descriptor.levels.empty();
+	file = makeCheckDDS(8, 8, 4, FOURCC_DXT5, 0, 64 + 16 + 15);
+	errors += !parseDDS(&file[0], file.size(), descriptor);
+	errors += checkDDSLevels(descriptor, Header, 8, 8, 2);
+
+	// Lying headers : more mipmaps than a full chain, wrong sizes, no size, too large, unknown or unusable formats
+	file = makeCheckDDS(8, 8, 30, FOURCC_DXT3, 0, 64 + 16 + 16 + 16 + 256); // Bytes to spare after the 1x1 level
+	errors += !parseDDS(&file[0], file.size(), descriptor);
+	errors += checkDDSLevels(descriptor, Header, 8, 8, 4);
+	file = makeCheckDDS(8, 8, 1, FOURCC_DXT1, 0, 32);
+	writeU32(&file[DDS_MAGIC_SIZE], 100);
+	errors += parseDDS(&file[0], file.size(), descriptor);
+	file = makeCheckDDS(8, 8, 1, FOURCC_DXT1, 0, 32);
+	writeU32(&file[DDS_MAGIC_SIZE + 72], 0);
+	errors += parseDDS(&file[0], file.size(), descriptor);
+	file = makeCheckDDS(0, 8, 1, FOURCC_DXT1, 0, 32);
+	errors += parseDDS(&file[0], file.size(), descriptor);
+	file = makeCheckDDS(0x80000000u, 0x80000000u, 1, FOURCC_DXT1, 0, 32);
+	errors += parseDDS(&file[0], file.size(), descriptor);
+	file = makeCheckDDS(8, 8, 1, 0x34545844 /* "DXT4" */, 0, 64);
+	errors += parseDDS(&file[0], file.size(), descriptor);
+	file = makeCheckDDS(8, 8, 1, FOURCC_DX10, 2 /* R32G32B32A32_FLOAT */, 1024);
+	errors += parseDDS(&file[0], file.size(), descriptor);
+	file = makeCheckDDS(8, 8, 1, FOURCC_DX10, DXGI_FORMAT_BC1_UNORM, 64);
+	writeU32(&file[Header + 12], 6); // A texture array
+	errors += parseDDS(&file[0], file.size(), descriptor);
+	file = makeCheckDDS(8, 8, 1, FOURCC_DXT1, 0, 32);
+	file[0] = 'X';
+	errors += parseDDS(&file[0], file.size(), descriptor);
+
+	printf("DDS parser : %u errors with valid, truncated and lying files\n", (unsigned int)errors);
+	return errors;
+}
+
+bool isDDSFormatSupported(unsigned int format){
+	if (format == GL_COMPRESSED_RGBA_BPTC_UNORM || format == GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM)
+		return GLEW_ARB_texture_compression_bptc != GL_FALSE;
+	return true; // S3TC is everywhere on desktop, RGTC is core since 3.0
+}
+
+static void uploadDDSLevel(const DDSDescriptor & descriptor, const unsigned char * data, unsigned int level){
+	const DDSMipLevel & mip = descriptor.levels[level];
+	glCompressedTexImage2D(GL_TEXTURE_2D, level, descriptor.format, mip.width, mip.height,  
+		0, (GLsizei)mip.size, data + mip.offset); 
+}
+
+GLuint loadDDS(const char * imagepath){
 
+	DDSStream stream;
+	GLuint textureID = beginDDSStream(imagepath, stream, (size_t)-1);
+	// With no budget limit every level is uploaded, and the file closed, before this returns
 	return textureID;
+}
+
+GLuint beginDDSStream(const char * imagepath, DDSStream & stream, size_t byteBudget){
+
+	stream.textureID = 0;
+	stream.nextLevel = -1;
 
+	/* try to open the file */
+	if (!mapFile(imagepath, stream.file)) {
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); 
+		return 0;
+	}
 
-}
\ No newline at end of file
+	if (!parseDDS(stream.file.data, stream.file.size, stream.descriptor) || !isDDSFormatSupported(stream.descriptor.format)) {
+		printf("%s can't be loaded\n", imagepath);
+		unmapFile(stream.file);
+		return 0;
+	}
+
+	// Create one OpenGL texture
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	beginDDSStreamMapped(textureID, stream, byteBudget);
+
+	return textureID;
+}
+
+size_t beginDDSStreamMapped(GLuint textureID, DDSStream & stream, size_t byteBudget){
+
+	stream.textureID = textureID;
+
+	// "Bind" the texture : all future texture functions will modify this texture
+	glBindTexture(GL_TEXTURE_2D, stream.textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
+
+	// The texture is only sampled between the base level and the last one
+	int levelCount = (int)stream.descriptor.levels.size();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+
+	// Start from the smallest mipmap : the texture is usable right away, just blurry
+	stream.nextLevel = levelCount - 1;
+	size_t uploaded = stream.descriptor.levels[stream.nextLevel].size;
+	uploadDDSLevel(stream.descriptor, stream.file.data, stream.nextLevel);
+	stream.nextLevel--;
+	return uploaded + continueDDSStream(stream, uploaded < byteBudget ? byteBudget - uploaded : 0);
+}
+
+size_t continueDDSStream(DDSStream & stream, size_t byteBudget){
+
+	if (stream.file.data == NULL)
+		return 0;
+
+	glBindTexture(GL_TEXTURE_2D, stream.textureID);
+	glPixelStorei(GL_UNPACK_ALIGNMENT,1);	
+
+	// Upload finer and finer levels while they fit in the budget. The first one goes even if it
+	// does not : a level larger than the budget would never be uploaded otherwise.
+	size_t uploaded = 0;
+	while (stream.nextLevel >= 0 && byteBudget > 0
+	       && (uploaded == 0 || uploaded + stream.descriptor.levels[stream.nextLevel].size <= byteBudget)) {
+		uploaded += stream.descriptor.levels[stream.nextLevel].size;
+		uploadDDSLevel(stream.descriptor, stream.file.data, stream.nextLevel);
+		stream.nextLevel--;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, stream.nextLevel + 1);
+
+	// Once every level is in video memory, the file can be closed.
+	if (stream.nextLevel < 0)
+		unmapFile(stream.file);
+	return uploaded;
+}
@@ -1,7 +1,11 @@
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
 
-// Load a .BMP file using our custom loader
+#include <vector>
+
+#include "mappedfile.hpp"
+
+// Load a .BMP file (24 or 32bpp) using our custom loader, with mipmaps made on the CPU
 GLuint loadBMP_custom(const char * imagepath);
 
 //// Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
@@ -12,5 +16,46 @@ GLuint loadBMP_custom(const char * imagepath);
 // Load a .DDS file using GLFW's own loader
 GLuint loadDDS(const char * imagepath);
 
+// One mipmap of a DDS file
+struct DDSMipLevel {
+	unsigned int width, height;
+	size_t offset; // From the start of the file
+	size_t size;
+};
+
+// What parseDDS finds in a file : no GL call is made, so this works without a context
+struct DDSDescriptor {
+	unsigned int width, height;
+	unsigned int format;    // GL compressed internal format
+	unsigned int blockSize; // Bytes per 4x4 block
+	std::vector<DDSMipLevel> levels;
+};
+
+// Checks the header and every mipmap against the file length. Handles DXT1/3/5,
+// BC4/BC5 (ATI1/ATI2) and, through the DX10 header, BC1 to BC5 and BC7 (sRGB included).
+bool parseDDS(const unsigned char * data, size_t size, DDSDescriptor & descriptor);
+// Runs parseDDS on files made in memory : valid, truncated and with lying headers. Returns the errors found.
+size_t checkDDSParser();
+// BC7 needs ARB_texture_compression_bptc, the other formats are always there
+bool isDDSFormatSupported(unsigned int format);
+
+// A DDS texture loaded progressively : the coarse mipmaps first, the fine ones over later frames
+struct DDSStream {
+	GLuint textureID;
+	MappedFile file;
+	DDSDescriptor descriptor;
+	int nextLevel; // Finest level not uploaded yet, -1 when done
+};
+
+// Uploads the smallest mipmap, then more while they fit in byteBudget. The texture is usable right away.
+GLuint beginDDSStream(const char * imagepath, DDSStream & stream, size_t byteBudget);
+// Same as beginDDSStream for a file already mapped and parsed into stream.file and
+// stream.descriptor, for instance on a loader thread. textureID must have been generated.
+// Returns the bytes uploaded.
+size_t beginDDSStreamMapped(GLuint textureID, DDSStream & stream, size_t byteBudget);
+// Uploads the next levels, at most byteBudget bytes of them, but at least one level when byteBudget > 0.
+// Returns the bytes uploaded. The stream is complete (and the file closed) once nextLevel is -1.
+size_t continueDDSStream(DDSStream & stream, size_t byteBudget);
+
 
 #endif
\ No newline at end of file
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "profiler.hpp"
+#include "threadpool.hpp"
+
+static std::vector<std::thread> WorkerThreads;
+static std::deque< std::function<void()> > PendingTasks;
+static std::mutex ThreadPoolMutex;
+static std::condition_variable ThreadPoolCondition;
+static bool ThreadPoolStopping = false;
+
+static void workerLoop(){
+	setProfilerThreadName("Worker");
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(ThreadPoolMutex);
+			ThreadPoolCondition.wait(lock, [](){ return ThreadPoolStopping || !PendingTasks.empty(); });
+			if (ThreadPoolStopping)
+				return;
+			task.swap(PendingTasks.front());
+			PendingTasks.pop_front();
+		}
+		task();
+	}
+}
+
+void startThreadPool(unsigned int threadCount){
+
+	if (!WorkerThreads.empty())
+		return;
+
+	if (threadCount == 0) {
+		unsigned int cores = std::thread::hardware_concurrency();
+		threadCount = cores > 1 ? cores - 1 : 1;
+	}
+
+	ThreadPoolStopping = false;
+	for (unsigned int i = 0; i < threadCount; i++)
+		WorkerThreads.push_back(std::thread(workerLoop));
+}
+
+void submitTask(const std::function<void()> & task){
+
+	if (WorkerThreads.empty()) {
+		task(); // No pool : run it right here
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(ThreadPoolMutex);
+		PendingTasks.push_back(task);
+	}
+	ThreadPoolCondition.notify_one();
+}
+
+unsigned int threadPoolSize(){
+	return (unsigned int)WorkerThreads.size();
+}
+
+void stopThreadPool(){
+
+	{
+		std::lock_guard<std::mutex> lock(ThreadPoolMutex);
+		ThreadPoolStopping = true;
+		PendingTasks.clear();
+	}
+	ThreadPoolCondition.notify_all();
+
+	for (size_t i = 0; i < WorkerThreads.size(); i++)
+		WorkerThreads[i].join();
+	WorkerThreads.clear();
+}
+
+// Shared by the caller of parallelFor and the tasks it submitted. Tasks that start after every
+// chunk is taken find nothing to do, so they may outlive the call.
+struct ParallelFor {
+	const std::function<void(size_t, size_t)> * body;
+	size_t count;
+	size_t grain;
+	size_t chunks;
+	std::atomic<size_t> nextChunk;
+	std::atomic<size_t> doneChunks;
+	std::mutex mutex;
+	std::condition_variable finished;
+};
+
+static void runChunks(ParallelFor & loop){
+	for (;;) {
+		size_t chunk = loop.nextChunk++;
+		if (chunk >= loop.chunks)
+			return;
+		size_t begin = chunk * loop.grain;
+		size_t end = begin + loop.grain < loop.count ? begin + loop.grain : loop.count;
+		(*loop.body)(begin, end);
+		if (++loop.doneChunks == loop.chunks) {
+			std::lock_guard<std::mutex> lock(loop.mutex);
+			loop.finished.notify_all();
+		}
+	}
+}
+
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> & body){
+
+	if (count == 0)
+		return;
+	if (grain == 0)
+		grain = 1;
+	size_t chunks = (count + grain - 1) / grain;
+	if (chunks == 1 || WorkerThreads.empty()) {
+		body(0, count);
+		return;
+	}
+
+	std::shared_ptr<ParallelFor> loop(new ParallelFor());
+	loop->body = &body;
+	loop->count = count;
+	loop->grain = grain;
+	loop->chunks = chunks;
+	loop->nextChunk = 0;
+	loop->doneChunks = 0;
+
+	size_t helpers = chunks - 1 < WorkerThreads.size() ? chunks - 1 : WorkerThreads.size();
+	for (size_t i = 0; i < helpers; i++)
+		submitTask([loop](){ runChunks(*loop); });
+
+	runChunks(*loop);
+
+	std::unique_lock<std::mutex> lock(loop->mutex);
+	loop->finished.wait(lock, [&loop](){ return loop->doneChunks == loop->chunks; });
+}
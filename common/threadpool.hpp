@@ -0,0 +1,29 @@
+#ifndef THREADPOOL_HPP
+#define THREADPOOL_HPP
+
+#include <functional>
+#include <future>
+#include <memory>
+
+// A fixed set of worker threads, started once. Tasks run in submission order, several at a time.
+// 0 threads means one per core, minus the one the GL thread runs on.
+void startThreadPool(unsigned int threadCount = 0);
+void submitTask(const std::function<void()> & task);
+unsigned int threadPoolSize();
+// Waits for the running tasks, drops the queued ones
+void stopThreadPool();
+
+// Calls body(begin, end) over [0, count) in chunks of `grain`, on the workers and on the calling thread,
+// and returns once every chunk is done. The caller takes chunks too, so this never waits on a busy pool.
+void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> & body);
+
+// Same as submitTask, with the result (or the exception) delivered through a future
+template<typename T>
+std::future<T> submitTaskWithResult(const std::function<T()> & function){
+	std::shared_ptr< std::packaged_task<T()> > task(new std::packaged_task<T()>(function));
+	std::future<T> result = task->get_future();
+	submitTask([task](){ (*task)(); });
+	return result;
+}
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include "uniforms.hpp"
+
+// glGetActiveUniform reports arrays as "name[0]"; we want to look them up as "name"
+static std::string stripArraySuffix(const char * name){
+	std::string result(name);
+	size_t bracket = result.find('[');
+	if (bracket != std::string::npos)
+		result.erase(bracket);
+	return result;
+}
+
+void reflectProgram(GLuint programID, ShaderReflection & reflection){
+
+	reflection.programID = programID;
+	reflection.uniforms.clear();
+	reflection.attributes.clear();
+
+	GLint count = 0;
+	char name[256];
+
+	// Uniforms. Members of uniform blocks have no location and are fed through buffers instead.
+	glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+	for (GLint i = 0; i < count; i++) {
+		GLuint index = i;
+		GLint blockIndex = -1;
+		glGetActiveUniformsiv(programID, 1, &index, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+		if (blockIndex != -1)
+			continue;
+
+		ShaderVariable variable;
+		glGetActiveUniform(programID, index, sizeof(name), NULL, &variable.size, &variable.type, name);
+		variable.name = stripArraySuffix(name);
+		variable.location = glGetUniformLocation(programID, name);
+		reflection.uniforms.push_back(variable);
+	}
+
+	// Vertex attributes
+	glGetProgramiv(programID, GL_ACTIVE_ATTRIBUTES, &count);
+	for (GLint i = 0; i < count; i++) {
+		ShaderVariable variable;
+		glGetActiveAttrib(programID, i, sizeof(name), NULL, &variable.size, &variable.type, name);
+		variable.name = name;
+		variable.location = glGetAttribLocation(programID, name);
+		reflection.attributes.push_back(variable);
+	}
+}
+
+static GLint findUniform(const ShaderReflection & reflection, const char * name, GLenum expectedType){
+
+	for (size_t i = 0; i < reflection.uniforms.size(); i++) {
+		const ShaderVariable & variable = reflection.uniforms[i];
+		if (variable.name != name)
+			continue;
+		if (variable.type != expectedType) {
+			printf("Uniform %s of program %u does not have the expected type (0x%x instead of 0x%x)\n",
+				name, reflection.programID, variable.type, expectedType);
+			return -1;
+		}
+		return variable.location;
+	}
+
+	// Not an error : the compiler removes every uniform that does not contribute to the output
+	return -1;
+}
+
+UniformFloat getUniformFloat(const ShaderReflection & reflection, const char * name){
+	UniformFloat handle = { findUniform(reflection, name, GL_FLOAT) };
+	return handle;
+}
+
+UniformVec2 getUniformVec2(const ShaderReflection & reflection, const char * name){
+	UniformVec2 handle = { findUniform(reflection, name, GL_FLOAT_VEC2) };
+	return handle;
+}
+
+UniformVec3 getUniformVec3(const ShaderReflection & reflection, const char * name){
+	UniformVec3 handle = { findUniform(reflection, name, GL_FLOAT_VEC3) };
+	return handle;
+}
+
+UniformVec4 getUniformVec4(const ShaderReflection & reflection, const char * name){
+	UniformVec4 handle = { findUniform(reflection, name, GL_FLOAT_VEC4) };
+	return handle;
+}
+
+UniformMat4 getUniformMat4(const ShaderReflection & reflection, const char * name){
+	UniformMat4 handle = { findUniform(reflection, name, GL_FLOAT_MAT4) };
+	return handle;
+}
+
+UniformSampler getUniformSampler(const ShaderReflection & reflection, const char * name){
+	UniformSampler handle = { findUniform(reflection, name, GL_SAMPLER_2D) };
+	return handle;
+}
+
+GLint getAttribLocation(const ShaderReflection & reflection, const char * name){
+	for (size_t i = 0; i < reflection.attributes.size(); i++) {
+		if (reflection.attributes[i].name == name)
+			return reflection.attributes[i].location;
+	}
+	return -1;
+}
+
+void setUniform(UniformFloat handle, float value){
+	glUniform1f(handle.location, value);
+}
+
+void setUniform(UniformVec2 handle, const glm::vec2 & value){
+	glUniform2f(handle.location, value.x, value.y);
+}
+
+void setUniform(UniformVec3 handle, const glm::vec3 & value){
+	glUniform3f(handle.location, value.x, value.y, value.z);
+}
+
+void setUniform(UniformVec4 handle, const glm::vec4 * values, int count){
+	glUniform4fv(handle.location, count, &values[0][0]);
+}
+
+void setUniform(UniformMat4 handle, const glm::mat4 & value){
+	glUniformMatrix4fv(handle.location, 1, GL_FALSE, &value[0][0]);
+}
+
+void setUniform(UniformSampler handle, int textureUnit){
+	glUniform1i(handle.location, textureUnit);
+}
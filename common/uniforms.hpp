@@ -0,0 +1,49 @@
+#ifndef UNIFORMS_HPP
+#define UNIFORMS_HPP
+
+#include <string>
+#include <vector>
+
+// One active uniform or vertex attribute of a linked program
+struct ShaderVariable {
+	std::string name;
+	GLint location;
+	GLenum type;
+	GLint size;
+};
+
+// Everything the driver tells us about a linked program, queried once after LoadShaders
+struct ShaderReflection {
+	GLuint programID;
+	std::vector<ShaderVariable> uniforms;
+	std::vector<ShaderVariable> attributes;
+};
+
+void reflectProgram(GLuint programID, ShaderReflection & reflection);
+
+// Typed uniform handles. A location of -1 (uniform optimized out, or missing)
+// is silently ignored by glUniform*, just like with glGetUniformLocation.
+struct UniformFloat   { GLint location; };
+struct UniformVec2    { GLint location; };
+struct UniformVec3    { GLint location; };
+struct UniformVec4    { GLint location; };
+struct UniformMat4    { GLint location; };
+struct UniformSampler { GLint location; };
+
+UniformFloat   getUniformFloat  (const ShaderReflection & reflection, const char * name);
+UniformVec2    getUniformVec2   (const ShaderReflection & reflection, const char * name);
+UniformVec3    getUniformVec3   (const ShaderReflection & reflection, const char * name);
+UniformVec4    getUniformVec4   (const ShaderReflection & reflection, const char * name);
+UniformMat4    getUniformMat4   (const ShaderReflection & reflection, const char * name);
+UniformSampler getUniformSampler(const ShaderReflection & reflection, const char * name);
+GLint          getAttribLocation(const ShaderReflection & reflection, const char * name);
+
+void setUniform(UniformFloat handle, float value);
+void setUniform(UniformVec2 handle, const glm::vec2 & value);
+void setUniform(UniformVec3 handle, const glm::vec3 & value);
+// count > 1 for arrays of vec4
+void setUniform(UniformVec4 handle, const glm::vec4 * values, int count);
+void setUniform(UniformMat4 handle, const glm::mat4 & value);
+void setUniform(UniformSampler handle, int textureUnit);
+
+#endif
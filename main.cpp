@@ -1,7 +1,13 @@
 // Include standard headers
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include <float.h>
+#include <string.h>
 #include <vector>
+#include <string>
+#include <algorithm>
 
 // Include GLEW
 #include <GL/glew.h>
@@ -20,7 +26,34 @@ GLFWwindow* window;
 using namespace glm;
 
 #include <common/shader.hpp>
+#include <common/shadercache.hpp>
+#include <common/uniforms.hpp>
+#include <common/frameuniforms.hpp>
+#include <common/shaderpreprocessor.hpp>
+#include <common/shaderregistry.hpp>
 #include <common/texture.hpp>
+#include <common/image.hpp>
+#include <common/assetloader.hpp>
+#include <common/assetcache.hpp>
+#include <common/spriteatlas.hpp>
+#include <common/profiler.hpp>
+#include <common/text2D.hpp>
+#include <common/hud.hpp>
+#include <common/snapshot.hpp>
+#include <common/frustum.hpp>
+#include <common/emitterlod.hpp>
+#include <common/collision.hpp>
+#include <common/bvh.hpp>
+#include <common/neighborgrid.hpp>
+#include <common/forcefield.hpp>
+#include <common/random.hpp>
+#include <common/spawn.hpp>
+#include <common/simclock.hpp>
+#include <common/framepipeline.hpp>
+#include <common/emittercommands.hpp>
+#include <common/emitterconfig.hpp>
+#include <common/particleupdate.hpp>
+#include <common/threadpool.hpp>
 #include <common/controls.hpp>
 #include <common/objloader.hpp>
 #include <common/vboindexer.hpp>
@@ -28,56 +61,539 @@ using namespace glm;
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
 
-// CPU representation of a particle
-struct Particle {
-	glm::vec3 pos, speed;
-	unsigned char r, g, b, a; // Color
-	float size, angle, weight;
-	float life; // Remaining life of the particle. if <0 : dead and unused.
-	float cameradistance; // *Squared* distance to the camera. if dead : -1.0f
+const int MaxParticles = 100000;
+
+// What the GPU gets for each particle. Smoke and rain go in the same buffer, sorted together.
+struct ParticleInstance {
+	GLfloat xyzs[4];   // Position of the center, and size
+	GLfloat motion[4]; // Velocity, and extra length per unit of speed (0 : a plain billboard)
+	GLubyte color[4];
+	GLfloat sprite;    // Index in the sprite atlas
+};
 
-	bool operator<(const Particle& that) const {
+struct ParticleSortKey {
+	float cameradistance; // *Squared* distance to the camera
+	int instance;
+
+	bool operator<(const ParticleSortKey& that) const {
 		// Sort in reverse order : far particles drawn first.
 		return this->cameradistance > that.cameradistance;
 	}
 };
 
-const int MaxParticles = 100000;
-Particle ParticlesContainer[100 * MaxParticles];
+// The sprites of all the particle systems, packed in one atlas. Adding an effect only adds a sprite here.
+enum ParticleSprite {
+	SPRITE_SMOKE,
+	SPRITE_RAIN,
+	SPRITE_COUNT
+};
+static const char * const ParticleSpriteFiles[SPRITE_COUNT] = { "particle.DDS", "raindrop.DDS" };
+// As many sprites as Particle.vertexshader has SpriteRects (PARTICLE_MAX_SPRITES)
+const int MaxParticleSprites = 16;
+static_assert(SPRITE_COUNT <= MaxParticleSprites, "Particle.vertexshader can't address that many sprites");
+
+// Emitters spawn fewer, bigger particles from 20 to 60 units away, down to a quarter.
+// Off screen, they are simulated once every 4 frames.
+const EmitterLODSettings ParticleLODSettings = { 20.0f, 60.0f, 0.25f, 4 };
+// The emitters are read from this file at startup, and again every time it is saved
+const char * const DefaultEmitterConfig = "emitters.json";
+// The turbulence emitters can swirl in : a baked curl noise of 4 features across 16 units, repeating
+const float TurbulenceSize = 16.0f;
+const int TurbulenceResolution = 32;
+const int TurbulenceFrequency = 4;
+
+// Particles collide as small spheres, whatever the size of their sprite, up to this radius
+const float CollisionCellSize = 0.5f;
+const float MaxCollisionRadius = 0.1f;
+// Particles per task of the parallel update
+const size_t ParticleUpdateGrain = 4096;
+// The particles are simulated 60 times per second, whatever the frame rate. A frame runs at
+// most 4 steps : slower than 15 frames per second, the simulation slows down.
+const double SimulationRate = 60.0;
+const unsigned int MaxSimulationSteps = 4;
+
+// Smoke particles closer than this push each other apart, so the plume spreads instead of
+// piling up. Press G to switch between a plain repulsion, a pressure (SPH), and nothing.
+enum SmokeInteraction {
+	SMOKE_INTERACTION_REPULSION,
+	SMOKE_INTERACTION_SPH,
+	SMOKE_INTERACTION_NONE,
+	SMOKE_INTERACTION_COUNT
+};
+const float SmokeInteractionRadius = 0.25f;
+const float SmokeRepulsion = 4.0f;
+const SPHSettings SmokeSPH = { 1.0f, 200.0f, 50.0f };
+
+// The particles of one frame, from the GL thread asking for them to their draw
+struct ParticleFrame {
+	// What the GL thread saw when it asked
+	unsigned int number;
+	double time;
+	glm::vec3 cameraPosition;
+	Frustum frustum;
+	double simulatedTime; // Whole steps of the simulation clock
+	double simulationStep;
+	float alpha;          // Where the frame falls between the last two steps
+	bool carReady;
+	SmokeInteraction interaction;
+
+	// What the simulation made : the instances, back to front, ready to upload
+	std::vector<ParticleInstance> instances;
+	std::vector<ParticleInstance> sorted;
+	std::vector<ParticleSortKey> keys;
+	int instanceCount;
+	int smokeCount, rainCount;
+	int smokeCulled, rainCulled;
+	float smokeDetail, rainDetail;
+	bool smokeAsleep, rainAsleep;
+};
+
+// Bytes of texture mipmaps uploaded per frame while textures are streaming in
+const size_t TextureStreamBudget = 256 * 1024;
+// Memory the asset cache may keep for assets nothing uses anymore
+const size_t AssetVideoMemoryBudget = 64 * 1024 * 1024;
+const size_t AssetSystemMemoryBudget = 64 * 1024 * 1024;
+Particle ParticlesContainer[MaxParticles];
 Particle RaindropsContainer[MaxParticles];
-int LastUsedParticle = 0;
 
-// Finds a Particle in ParticlesContainer which isn't used yet.
-// (i.e. life < 0);
-int FindUnusedParticle() {
+// The emitters, in the order of their definitions, as the commands name them
+enum ParticleEmitter {
+	SMOKE_EMITTER,
+	RAIN_EMITTER
+};
 
-	for (int i = LastUsedParticle; i<MaxParticles; i++) {
-		if (ParticlesContainer[i].life < 0) {
-			LastUsedParticle = i;
-			return i;
+// Commands sent by the GL thread, and at most that many between two steps
+const size_t EmitterCommandCapacity = 256;
+// Particles of the burst sent with X
+const unsigned int SmokeBurst = 5000;
+
+static void setColor(unsigned char * color, unsigned char r, unsigned char g, unsigned char b, unsigned char a) {
+	color[0] = r;
+	color[1] = g;
+	color[2] = b;
+	color[3] = a;
+}
+
+// What the emitters do where the config file says nothing : smoke rises from the car's exhaust and
+// swirls in the turbulence, rain falls from a 10 x 24 grid of columns and stops on what it hits.
+static std::vector<EmitterDefinition> defaultEmitters() {
+	std::vector<EmitterDefinition> definitions(2);
+
+	EmitterDefinition & smoke = definitions[SMOKE_EMITTER];
+	smoke.name = "smoke";
+	smoke.sprite = "particle.DDS";
+	smoke.rate = 10000.0f; // 10 new particles each millisecond
+	smoke.life = 1.0f;     // Each particle will live 1 second
+	smoke.position = glm::vec3(2.0f, 1.5f, -7.0f);
+	smoke.box = glm::vec3(0.0f, 0.0f, 0.0f);
+	smoke.cells = glm::vec3(0.0f, 0.0f, 0.0f);
+	smoke.direction = glm::vec3(0.0f, 1.5f, -10.0f);
+	smoke.spread = 2.5f;
+	smoke.sizeMin = 0.1f;
+	smoke.sizeMax = 0.6f;
+	setColor(smoke.color, 170, 170, 170, 0);
+	setColor(smoke.variation, 10, 10, 10, 85);
+	smoke.colorOverLife = false;
+	setColor(smoke.endColor, 170, 170, 170, 0);
+	smoke.endSize = 1.0f;
+	smoke.stretch = 0.0f;
+	smoke.gravity = glm::vec3(0.0f, 2.0f, 0.0f); // Rises
+	smoke.drag = 0.0f;
+	smoke.turbulence = 3.0f;
+	smoke.collides = true;
+	smoke.collision = COLLISION_BOUNCE;
+	smoke.collisionRadius = 0.1f;
+	smoke.restitution = 0.3f;
+
+	EmitterDefinition & rain = definitions[RAIN_EMITTER];
+	rain.name = "rain";
+	rain.sprite = "raindrop.DDS";
+	rain.rate = 100000.0f; // 100 new drops each millisecond : as many as the pool holds over their life
+	rain.life = 1.0f;
+	rain.position = glm::vec3(-5.0f, 10.0f, -18.0f);
+	rain.box = glm::vec3(10.0f, 0.0f, 24.0f);
+	rain.cells = glm::vec3(10.0f, 0.0f, 24.0f);
+	rain.direction = glm::vec3(0.0f, -10.0f, 1.0f); // Straight down, all at the same speed
+	rain.spread = 0.0f;
+	rain.sizeMin = 0.1f;
+	rain.sizeMax = 0.6f;
+	setColor(rain.color, 26, 35, 126, 50);
+	setColor(rain.variation, 10, 10, 10, 0);
+	rain.colorOverLife = false;
+	setColor(rain.endColor, 26, 35, 126, 50);
+	rain.endSize = 1.0f;
+	rain.stretch = 0.05f; // Drops get longer with their speed
+	rain.gravity = glm::vec3(0.0f, 0.0f, 0.0f);
+	rain.drag = 0.0f;
+	rain.turbulence = 0.0f;
+	rain.collides = true;
+	rain.collision = COLLISION_KILL;
+	rain.collisionRadius = 0.02f;
+	rain.restitution = 0.0f;
+
+	return definitions;
+}
+
+// New particles of an emitter in particles[0 .. count], each attribute drawn for the whole run at once
+static void fillParticles(Particle * particles, size_t count, Random & random, const EmitterDefinition & definition, float sizeScale) {
+
+	glm::vec3 directions[SPAWN_BATCH];
+	float offsets[3 * SPAWN_BATCH], radii[SPAWN_BATCH], sizes[SPAWN_BATCH], colors[4 * SPAWN_BATCH];
+	randomFloats(random, offsets, 3 * count, 0.0f, 1.0f);
+	randomDirections(random, directions, count);
+	randomFloats(random, radii, count, 0.0f, 1.0f);
+	randomFloats(random, sizes, count, definition.sizeMin, definition.sizeMax);
+	randomFloats(random, colors, 4 * count, 0.0f, 1.0f);
+
+	for (size_t i = 0; i < count; i++) {
+		Particle & p = particles[i];
+		p.life = definition.life;
+
+		// Anywhere in the spawn box, or on one of its cells
+		glm::vec3 offset(offsets[3 * i], offsets[3 * i + 1], offsets[3 * i + 2]);
+		for (int axis = 0; axis < 3; axis++) {
+			if (definition.cells[axis] >= 1.0f)
+				offset[axis] = floorf(offset[axis] * definition.cells[axis]) / definition.cells[axis];
 		}
+		p.pos = definition.position + offset * definition.box;
+		p.previous = p.pos;
+
+		// Uniform inside a sphere around the main direction
+		p.speed = definition.direction + directions[i] * (cbrtf(radii[i]) * definition.spread);
+
+		// A random shade of the color
+		p.r = glm::min(definition.color[0] + (int)(colors[4 * i] * definition.variation[0]), 255);
+		p.g = glm::min(definition.color[1] + (int)(colors[4 * i + 1] * definition.variation[1]), 255);
+		p.b = glm::min(definition.color[2] + (int)(colors[4 * i + 2] * definition.variation[2]), 255);
+		p.a = glm::min(definition.color[3] + (int)(colors[4 * i + 3] * definition.variation[3]), 255);
+		p.size = sizes[i] * sizeScale;
+
+		// Where the color and size over life start from
+		p.startColor[0] = p.r;
+		p.startColor[1] = p.g;
+		p.startColor[2] = p.b;
+		p.startColor[3] = p.a;
+		p.startSize = p.size;
 	}
+}
+
+// What the simulation derives from the definition of an emitter
+struct EmitterSetup {
+	unsigned int sprite;
+	unsigned int features; // ParticleFeature bits : which update kernel runs its particles
+	ForceFieldSet forces;  // The fields other than gravity
+	float maxRate;         // Spawns per second that only reuse the slots of dead particles
+};
 
-	for (int i = 0; i<LastUsedParticle; i++) {
-		if (ParticlesContainer[i].life < 0) {
-			LastUsedParticle = i;
+// Ages, moves and collides all the particles of an emitter over dt, on every core, with the kernel
+// compiled for the features it uses
+static void stepEmitter(Particle * particles, size_t count, float dt, const EmitterDefinition & definition,
+                        const EmitterSetup & setup, const CollisionGrid & grid) {
+	ParticleUpdate update;
+	update.dt = dt;
+	update.lifetime = definition.life;
+	update.gravity = definition.gravity;
+	update.drag = definition.drag;
+	update.forces = &setup.forces;
+	for (int c = 0; c < 4; c++)
+		update.endColor[c] = definition.endColor[c];
+	update.endSizeScale = definition.endSize;
+	update.grid = &grid;
+	update.collisionRadius = definition.collisionRadius;
+	update.collision = definition.collision;
+	update.restitution = definition.restitution;
+	updateParticles(particles, count, ParticleUpdateGrain, setup.features, update);
+}
+
+// Where the particles of an emitter are born
+static EmitterBounds spawnBounds(const EmitterDefinition & definition) {
+	EmitterBounds bounds;
+	clearBounds(bounds);
+	growBounds(bounds, definition.position, 1.0f);
+	growBounds(bounds, definition.position + definition.box, 1.0f);
+	return bounds;
+}
+
+// Index of a sprite of the atlas, from its file
+static unsigned int findSprite(const std::string & file) {
+	for (unsigned int i = 0; i < SPRITE_COUNT; i++) {
+		if (file == ParticleSpriteFiles[i])
 			return i;
+	}
+	printf("No sprite %s in the atlas, using %s\n", file.c_str(), ParticleSpriteFiles[0]);
+	return 0;
+}
+
+// The rate an emitter can spawn at without taking the slots of live particles
+static float clampSpawnRate(const EmitterDefinition & definition, const EmitterSetup & setup, float rate) {
+	if (rate <= setup.maxRate)
+		return rate;
+	printf("Emitter %s : %g particles per second living %g s need more than %d slots, spawning %g per second\n",
+		definition.name.c_str(), rate, definition.life, MaxParticles, setup.maxRate);
+	return setup.maxRate;
+}
+
+// Sets up what the simulation derives from a definition, and where its particles can be for the LOD
+static void setupEmitter(EmitterDefinition & definition, const CurlNoiseVolume * turbulence,
+                         EmitterSetup & setup, EmitterState & emitter) {
+
+	// The ring of slots hands out the oldest one : it must be dead by then
+	setup.maxRate = definition.life > 0.0f ? MaxParticles / definition.life : FLT_MAX;
+	definition.rate = clampSpawnRate(definition, setup, definition.rate);
+
+	// The collision grid only finds the triangles within its margin
+	if (definition.collisionRadius > MaxCollisionRadius) {
+		printf("Emitter %s : collision radius %g, %g at most\n", definition.name.c_str(), definition.collisionRadius, MaxCollisionRadius);
+		definition.collisionRadius = MaxCollisionRadius;
+	}
+
+	setup.sprite = findSprite(definition.sprite);
+
+	clearForceFields(setup.forces);
+	if (definition.turbulence != 0.0f)
+		addForceField(setup.forces, curlNoiseField(turbulence, definition.turbulence));
+
+	// Only the modules the definition uses
+	setup.features = 0;
+	if (glm::length(definition.gravity) > 0.0f)
+		setup.features |= PARTICLE_GRAVITY;
+	if (definition.drag > 0.0f)
+		setup.features |= PARTICLE_DRAG;
+	if (setup.forces.count > 0)
+		setup.features |= PARTICLE_FORCE_FIELD;
+	if (definition.colorOverLife)
+		setup.features |= PARTICLE_COLOR_OVER_LIFE;
+	if (definition.endSize != 1.0f)
+		setup.features |= PARTICLE_SIZE_OVER_LIFE;
+	if (definition.collides)
+		setup.features |= PARTICLE_COLLISION;
+
+	emitter.spawnBounds = spawnBounds(definition);
+	emitter.acceleration = glm::length(definition.gravity) + maxForceFieldAcceleration(setup.forces);
+}
+
+// Particles to spawn over `time` at `rate` per second. The fractions left add up from one step to the next.
+static int spawnCount(double rate, double time, double & carry) {
+	double exact = rate * time + carry;
+	int count = (int)exact;
+	carry = exact - count;
+	return count;
+}
+
+// On screen, an emitter runs the fixed steps of the clock; off screen, it catches up in one step
+static unsigned int emitterSteps(const EmitterState & emitter, double time, double step) {
+	if (time <= 0.0)
+		return 0;
+	if (!emitter.lod.visible)
+		return 1;
+	unsigned int steps = (unsigned int)(time / step + 0.5);
+	return steps > 0 ? steps : 1;
+}
+
+// Uniform handles of the car program, resolved again every time the program is reloaded
+struct CarUniforms {
+	UniformMat4 MVP;
+	UniformMat4 M;
+	UniformFloat ambience_factor;
+	UniformFloat diffuse_factor;
+	UniformFloat specular_factor;
+};
+
+void onCarShaderLoaded(ShaderHandle, const ShaderReflection & reflection, void * user) {
+	CarUniforms * uniforms = (CarUniforms *)user;
+
+	// Get a handle for our "MVP" uniform
+	uniforms->MVP = getUniformMat4(reflection, "MVP");
+	uniforms->M = getUniformMat4(reflection, "M");
+
+	// Get a handle for the lighting factors
+	uniforms->ambience_factor = getUniformFloat(reflection, "ambience_factor");
+	uniforms->diffuse_factor = getUniformFloat(reflection, "diffuse_factor");
+	uniforms->specular_factor = getUniformFloat(reflection, "specular_factor");
+
+	// The sampler always reads Texture Unit 0, so it is set once here rather than every frame
+	setUniform(getUniformSampler(reflection, "myTextureSampler"), 0);
+}
+
+// The particle program only needs its sampler and where the sprites are in the atlas
+void onParticleShaderLoaded(ShaderHandle, const ShaderReflection & reflection, void * user) {
+	const SpriteAtlas * atlas = (const SpriteAtlas *)user;
+
+	// The atlas always lives in Texture Unit 1
+	setUniform(getUniformSampler(reflection, "myTextureSampler"), 1);
+	if (!atlas->uvRects.empty()) {
+		int count = (int)atlas->uvRects.size();
+		if (count > MaxParticleSprites) {
+			printf("%d sprites in the atlas, the particle shader only reads %d\n", count, MaxParticleSprites);
+			count = MaxParticleSprites;
 		}
+		setUniform(getUniformVec4(reflection, "SpriteRects"), &atlas->uvRects[0], count);
 	}
+}
+
+// Permutation bits of Particle.vertexshader, in the order of ParticleShaderDefines
+enum ParticleShaderPermutation {
+	PARTICLE_BILLBOARD = 0,
+	PARTICLE_STRETCHED = 1 << 0,
+	PARTICLE_ATLAS = 1 << 1,
+};
+static const char * const ParticleShaderDefines[] = { "PARTICLE_STRETCHED", "PARTICLE_ATLAS" };
 
-	return 0; // All particles are taken, override the first one
+ShaderHandle registerParticleShader(unsigned int permutation, const SpriteAtlas * atlas) {
+	return registerShaderVariant("Particle.vertexshader", "Particle.fragmentshader",
+		PermutationDefines(permutation, ParticleShaderDefines, (int)(sizeof(ParticleShaderDefines) / sizeof(ParticleShaderDefines[0]))), onParticleShaderLoaded, (void *)atlas);
 }
 
-void SortParticles() {
-	std::sort(&ParticlesContainer[0], &ParticlesContainer[MaxParticles]);
+// Radius of a sphere around the particle's quad, stretched along its speed like in Particle.vertexshader
+static float particleRadius(float size, const glm::vec3 & speed, float stretchFactor) {
+	float stretch = 1.0f;
+	if (stretchFactor > 0.0f)
+		stretch += glm::length(speed) * stretchFactor;
+	return 0.5f * size * (1.0f + stretch); // At least half the diagonal
 }
 
-void SortRaindrops() {
-	std::sort(&RaindropsContainer[0], &RaindropsContainer[MaxParticles]);
+// Copies the live particles of a pool into a snapshot, one column per attribute
+static void captureEmitter(const char * name, unsigned int sprite, float stretch,
+                           const Particle * particles, int count, EmitterSnapshot & emitter) {
+	emitter.name = name;
+	emitter.sprite = sprite;
+	emitter.stretch = stretch;
+
+	ParticleColumns & columns = emitter.particles;
+	columns.clear();
+	for (int i = 0; i < count; i++) {
+		const Particle & p = particles[i];
+		if (p.life <= 0.0f)
+			continue;
+		columns.posX.push_back(p.pos.x);
+		columns.posY.push_back(p.pos.y);
+		columns.posZ.push_back(p.pos.z);
+		columns.speedX.push_back(p.speed.x);
+		columns.speedY.push_back(p.speed.y);
+		columns.speedZ.push_back(p.speed.z);
+		columns.size.push_back(p.size);
+		columns.life.push_back(p.life);
+		columns.r.push_back(p.r);
+		columns.g.push_back(p.g);
+		columns.b.push_back(p.b);
+		columns.a.push_back(p.a);
+	}
 }
 
-int main(void)
+// Fills the GPU buffer with recorded particles, the way the simulation loops do. Returns the new instance count.
+// Particles outside the frustum are counted in `culled`.
+static int appendSnapshotInstances(const EmitterSnapshot & emitter, const glm::vec3 & CameraPosition, const Frustum & frustum,
+                                   ParticleInstance * instances, ParticleSortKey * keys, int InstancesCount, int maxInstances, int & culled) {
+	const ParticleColumns & columns = emitter.particles;
+	for (size_t i = 0; i < columns.count() && InstancesCount < maxInstances; i++) {
+		glm::vec3 pos(columns.posX[i], columns.posY[i], columns.posZ[i]);
+		glm::vec3 speed(columns.speedX[i], columns.speedY[i], columns.speedZ[i]);
+		if (!sphereInFrustum(frustum, pos, particleRadius(columns.size[i], speed, emitter.stretch))) {
+			culled++;
+			continue;
+		}
+
+		ParticleInstance & instance = instances[InstancesCount];
+		instance.xyzs[0] = columns.posX[i];
+		instance.xyzs[1] = columns.posY[i];
+		instance.xyzs[2] = columns.posZ[i];
+		instance.xyzs[3] = columns.size[i];
+
+		instance.motion[0] = columns.speedX[i];
+		instance.motion[1] = columns.speedY[i];
+		instance.motion[2] = columns.speedZ[i];
+		instance.motion[3] = emitter.stretch;
+
+		instance.color[0] = columns.r[i];
+		instance.color[1] = columns.g[i];
+		instance.color[2] = columns.b[i];
+		instance.color[3] = columns.a[i];
+
+		instance.sprite = (GLfloat)emitter.sprite;
+
+		keys[InstancesCount].cameradistance = glm::length2(pos - CameraPosition);
+		keys[InstancesCount].instance = InstancesCount;
+		InstancesCount++;
+	}
+	return InstancesCount;
+}
+
+// Times the BVH, the neighbor search and the particle update, away from the frame loop and without a window
+static int runBenchmarks() {
+
+	startThreadPool();
+
+	std::vector<unsigned short> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if (loadAssImp("humvee.obj", indices, vertices, uvs, normals)) {
+		BVH carBVH;
+		buildBVH(vertices, indices, carBVH);
+		benchmarkBVH(carBVH, 1024 * 1024);
+	}
+	benchmarkNeighborGrid(100000);
+	benchmarkNeighborGrid(1000000);
+	benchmarkParticleUpdate(100000);
+
+	stopThreadPool();
+	return 0;
+}
+
+// Checks the parts that can run without a window. Returns the exit code : 1 if any check failed.
+static int runSelfTests() {
+
+	int failed = 0;
+	failed += checkShaderCache("shadercache-check") != 0;
+	failed += checkSpriteAtlas() != 0;
+	failed += checkImage() != 0;
+	failed += checkDDSParser() != 0;
+	failed += checkText2D() != 0;
+	failed += checkEmitterLOD() != 0;
+	failed += checkCollision() != 0;
+	failed += checkSnapshotEncoding() != 0;
+	failed += stressEmitterCommandQueue(1000000) != 0;
+	failed += checkFramePipeline() != 0;
+
+	printf("Self-test : %d check(s) failed\n", failed);
+	return failed > 0 ? 1 : 0;
+}
+
+int main(int argc, char * argv[])
 {
+	// --record <file> [frames] : writes the particles to <file> every [frames] frames (10 by default)
+	// --replay <file>          : draws the particles recorded in <file> instead of simulating them
+	// --no-pipeline            : simulates the particles of a frame before drawing them, on the GL thread
+	// --emitters <file>        : reads the emitters from <file> instead of emitters.json
+	// --benchmark              : prints the timings of the simulation parts and exits, without a window
+	// --self-test              : runs the checks that need no window, exits with 1 if one fails
+	// --precompress <bmp> <dds> [bc1|bc3] : writes <bmp> and its mipmaps as a DXT1 (default) or DXT5 .DDS, and exits
+	const char * recordPath = NULL;
+	const char * replayPath = NULL;
+	unsigned int recordInterval = 10;
+	bool pipelined = true;
+	const char * emitterConfigPath = DefaultEmitterConfig;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			recordPath = argv[++i];
+			if (i + 1 < argc && atoi(argv[i + 1]) > 0)
+				recordInterval = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replayPath = argv[++i];
+		} else if (strcmp(argv[i], "--no-pipeline") == 0) {
+			pipelined = false;
+		} else if (strcmp(argv[i], "--emitters") == 0 && i + 1 < argc) {
+			emitterConfigPath = argv[++i];
+		} else if (strcmp(argv[i], "--benchmark") == 0) {
+			return runBenchmarks();
+		} else if (strcmp(argv[i], "--self-test") == 0) {
+			return runSelfTests();
+		} else if (strcmp(argv[i], "--precompress") == 0 && i + 2 < argc) {
+			BlockFormat format = i + 3 < argc && strcmp(argv[i + 3], "bc3") == 0 ? BLOCK_BC3 : BLOCK_BC1;
+			return convertBMPToDDS(argv[i + 1], argv[i + 2], format) ? 0 : 1;
+		}
+	}
+
 	// Initialise GLFW
 	if (!glfwInit())
 	{
@@ -111,6 +627,20 @@ int main(void)
 		return -1;
 	}
 
+	// Linked programs are kept on disk, keyed by their sources and the driver version
+	initShaderCache("shadercache");
+
+	// Every stage of the frame is timed, on the CPU and, for the draws, on the GPU.
+	// Press T to write the last few seconds to trace.json (open it in chrome://tracing or Perfetto).
+	initProfiler();
+	initProfilerGPU();
+	setProfilerThreadName("Main");
+	bool traceKeyWasPressed = false;
+
+	// Frame times, particle counts and the particle timings on screen. Press H to hide them.
+	bool showHUD = true;
+	bool hudKeyWasPressed = false;
+
 	// Ensure we can capture the escape key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 	// Hide the mouse and enable unlimited mouvement
@@ -136,83 +666,62 @@ int main(void)
 	glBindVertexArray(VertexArrayID);
 
 
-	// Create and compile our GLSL program from the shaders
-	GLuint programIDCar = LoadShaders("StandardShading.vertexshader", "StandardShading.fragmentshader");
+	// V, P, VP, the camera basis and the light are shared by all programs and uploaded once per frame
+	initFrameUniforms();
 
-	// Get a handle for our "MVP" uniform
-	GLuint MatrixID = glGetUniformLocation(programIDCar, "MVP");
-	GLuint ViewMatrixID = glGetUniformLocation(programIDCar, "V");
-	GLuint ModelMatrixID = glGetUniformLocation(programIDCar, "M");
+	// Create and compile our GLSL program from the shaders.
+	// The registry queries all the uniforms once; the main loop only uses the typed handles.
+	CarUniforms carUniforms;
+	ShaderHandle carShader = registerShader("StandardShading.vertexshader", "StandardShading.fragmentshader", onCarShaderLoaded, &carUniforms);
 
-	// Load the texture
-	GLuint TextureCar = loadDDS("uvmap.DDS");
+	// Load the texture and the mesh on the worker threads.
+	// The texture is a white placeholder until its mipmaps stream in; the car is drawn once its mesh is ready.
+	// The cache shares them with anything else that asks for the same files.
+	initAssetLoader();
+	AssetCache assets(AssetVideoMemoryBudget, AssetSystemMemoryBudget);
+	GLuint TextureCar = assets.acquireTexture("uvmap.DDS");
+	MeshAsset * car = assets.acquireMesh("humvee.obj");
 
-	// Get a handle for our "myTextureSampler" uniform
-	GLuint TextureIDCar = glGetUniformLocation(programIDCar, "myTextureSampler");
-
-	// Read our .obj file
-	std::vector<unsigned short> indices;
-	std::vector<glm::vec3> indexed_vertices;
-	std::vector<glm::vec2> indexed_uvs;
-	std::vector<glm::vec3> indexed_normals;
-	bool res = loadAssImp("humvee.obj", indices, indexed_vertices, indexed_uvs, indexed_normals);
-
-	// Load it into a VBO
-
-	GLuint vertexbuffer;
-	glGenBuffers(1, &vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_vertices.size() * sizeof(glm::vec3), &indexed_vertices[0], GL_STATIC_DRAW);
-
-	GLuint uvbuffer;
-	glGenBuffers(1, &uvbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_uvs.size() * sizeof(glm::vec2), &indexed_uvs[0], GL_STATIC_DRAW);
-
-	GLuint normalbuffer;
-	glGenBuffers(1, &normalbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-	glBufferData(GL_ARRAY_BUFFER, indexed_normals.size() * sizeof(glm::vec3), &indexed_normals[0], GL_STATIC_DRAW);
-
-	// Generate a buffer for the indices as well
-	GLuint elementbuffer;
-	glGenBuffers(1, &elementbuffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned short), &indices[0], GL_STATIC_DRAW);
-
-	// Get a handle for our "LightPosition" uniform
-	glUseProgram(programIDCar);
-	GLuint LightID = glGetUniformLocation(programIDCar, "LightPosition_worldspace");
+	// All the HUD text, batched into one draw with the built-in font
+	initText2D(NULL);
 
 	// For speed computation
 	double lastTime = glfwGetTime();
 	int nbFrames = 0;
 
 
-	//================================================ SMOKE PARTICLES =============================================
-
-	// Create and compile our GLSL program from the shaders
-	GLuint programID = LoadShaders("Particle.vertexshader", "Particle.fragmentshader");
-
-	// Vertex shader
-	GLuint CameraRight_worldspace_ID = glGetUniformLocation(programID, "CameraRight_worldspace");
-	GLuint CameraUp_worldspace_ID = glGetUniformLocation(programID, "CameraUp_worldspace");
-	GLuint ViewProjMatrixID = glGetUniformLocation(programID, "VP");
-
-	// fragment shader
-	GLuint TextureID = glGetUniformLocation(programID, "myTextureSampler");
-
-
-	static GLfloat* g_particule_position_size_data = new GLfloat[MaxParticles * 4];
-	static GLubyte* g_particule_color_data = new GLubyte[MaxParticles * 4];
+	//================================================== PARTICLES ================================================
+
+	// Pack the sprites of every particle system in one texture.
+	// Each particle carries its sprite index, so smoke and rain are drawn together.
+	SpriteAtlas particleAtlas;
+	std::vector<const char *> spriteFiles(ParticleSpriteFiles, ParticleSpriteFiles + SPRITE_COUNT);
+	GLuint TextureParticles = loadSpriteAtlas(spriteFiles, particleAtlas);
+
+	// Create and compile our GLSL program from the shaders.
+	// The camera basis and VP come from the FrameData block, the atlas lives in Texture Unit 1.
+	ShaderHandle particleShader = registerParticleShader(PARTICLE_ATLAS, &particleAtlas);
+
+	// Two frames of particles : one is simulated and packed while the other is drawn
+	ParticleFrame particleFrames[FRAME_PIPELINE_SLOTS];
+	for (int i = 0; i < FRAME_PIPELINE_SLOTS; i++) {
+		particleFrames[i].instances.resize(2 * MaxParticles);
+		particleFrames[i].sorted.resize(2 * MaxParticles);
+		particleFrames[i].keys.resize(2 * MaxParticles);
+		particleFrames[i].instanceCount = 0;
+		particleFrames[i].smokeCount = particleFrames[i].rainCount = 0;
+		particleFrames[i].smokeCulled = particleFrames[i].rainCulled = 0;
+		particleFrames[i].smokeDetail = particleFrames[i].rainDetail = 1.0f;
+		particleFrames[i].smokeAsleep = particleFrames[i].rainAsleep = false;
+	}
 
 	for (int i = 0; i<MaxParticles; i++) {
 		ParticlesContainer[i].life = -1.0f;
 		ParticlesContainer[i].cameradistance = -1.0f;
+		RaindropsContainer[i].life = -1.0f;
+		RaindropsContainer[i].cameradistance = -1.0f;
 	}
 
-	GLuint Texture = loadDDS("particle.DDS");
-
 	// The VBO containing the 4 vertices of the particles.
 	// Thanks to instancing, they will be shared by all particles.
 	static const GLfloat g_vertex_buffer_data[] = {
@@ -226,95 +735,431 @@ int main(void)
 	glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
 
-	// The VBO containing the positions and sizes of the particles
-	GLuint particles_position_buffer;
-	glGenBuffers(1, &particles_position_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
+	// The VBO containing everything else, one ParticleInstance per particle
+	GLuint particles_instance_buffer;
+	glGenBuffers(1, &particles_instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, particles_instance_buffer);
 	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, 2 * MaxParticles * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
 
-	// The VBO containing the colors of the particles
-	GLuint particles_color_buffer;
-	glGenBuffers(1, &particles_color_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW);
+	//================================================ END PARTICLES ==============================================
 
+	float lastTimeCheck = lastTime;
 
+	// Particle snapshots, to reproduce a frame offline and time the rendering without the simulation
+	SnapshotReader replay;
+	ParticleSnapshot replayed;
+	bool replaying = replayPath != NULL && openSnapshotReader(replayPath, replay);
+	if (recordPath != NULL && !replaying)
+		startSnapshotWriter(recordPath, recordInterval, SNAPSHOT_QUANTIZE | SNAPSHOT_DELTA);
+	unsigned int frameNumber = 0;
+
+	// The emitters : the defaults, and what the config file changes. Only the simulation touches these.
+	std::vector<EmitterDefinition> emitterDefinitions = defaultEmitters();
+	loadEmitterConfig(emitterConfigPath, emitterDefinitions);
+	EmitterDefinition smokeDefinition = emitterDefinitions[SMOKE_EMITTER];
+	EmitterDefinition rainDefinition = emitterDefinitions[RAIN_EMITTER];
+
+	// Where each emitter's particles can be, to skip whole emitters off screen
+	EmitterState smokeEmitter, rainEmitter;
+
+	// The ground right away, the car once its mesh has loaded
+	CollisionGrid collisionGrid;
+	buildCollisionGrid(std::vector<glm::vec3>(), std::vector<unsigned short>(), CollisionCellSize, MaxCollisionRadius, collisionGrid);
+	setCollisionGround(collisionGrid, 0.0f);
+	bool carCollides = false;
+
+	// Ray queries against the car, for picking and the like. Run with --benchmark to time them.
+	BVH carBVH;
+
+	// Live smoke particles, as columns for the neighbor search, and where they are in ParticlesContainer
+	NeighborGrid smokeGrid;
+	initNeighborGrid(smokeGrid, MaxParticles, SmokeInteractionRadius);
+	std::vector<float> smokeX(MaxParticles), smokeY(MaxParticles), smokeZ(MaxParticles);
+	std::vector<float> smokeForceX(MaxParticles), smokeForceY(MaxParticles), smokeForceZ(MaxParticles);
+	std::vector<unsigned int> smokeLive(MaxParticles);
+	SmokeInteraction smokeInteraction = SMOKE_INTERACTION_REPULSION;
+	bool interactionKeyWasPressed = false;
+
+	// What pushes the particles of each emitter around, which sprite they use, and how they are updated
+	CurlNoiseVolume turbulence;
+	bakeCurlNoise(turbulence, glm::vec3(0.0f, 0.0f, 0.0f), TurbulenceSize, TurbulenceResolution, TurbulenceFrequency, 1);
+	EmitterSetup smokeSetup, rainSetup;
+
+	initEmitterState(smokeEmitter, spawnBounds(smokeDefinition), 0.0f);
+	initEmitterState(rainEmitter, spawnBounds(rainDefinition), 0.0f);
+	setupEmitter(smokeDefinition, &turbulence, smokeSetup, smokeEmitter);
+	setupEmitter(rainDefinition, &turbulence, rainSetup, rainEmitter);
+	SpawnRing smokeSlots, rainSlots;
+	initSpawnRing(smokeSlots, MaxParticles);
+	initSpawnRing(rainSlots, MaxParticles);
+	double smokeSpawnCarry = 0.0, rainSpawnCarry = 0.0;
+
+	// Commands for the emitters, from the GL thread to the simulation. Press X for a burst of smoke,
+	// Z to clear every particle.
+	EmitterCommandQueue emitterCommands;
+	initEmitterCommandQueue(emitterCommands, EmitterCommandCapacity);
+	bool burstKeyWasPressed = false;
+	bool killKeyWasPressed = false;
+
+	// Applies the commands sent so far, before either emitter steps : nothing iterates the particles then
+	auto applyEmitterCommands = [&]() {
+		EmitterCommand command;
+		while (popEmitterCommand(emitterCommands, command)) {
+			if (command.emitter != SMOKE_EMITTER && command.emitter != RAIN_EMITTER)
+				continue;
+			bool smoke = command.emitter == SMOKE_EMITTER;
+			EmitterDefinition & definition = smoke ? smokeDefinition : rainDefinition;
+			EmitterState & emitter = smoke ? smokeEmitter : rainEmitter;
+			Particle * particles = smoke ? ParticlesContainer : RaindropsContainer;
+			float sizeScale = emitter.lod.sizeScale;
+
+			switch (command.type) {
+			case EMITTER_BURST:
+				spawnParticles(smoke ? smokeSlots : rainSlots, command.count, randomUInt(threadRandom()),
+					[&](size_t first, size_t count, Random & random) {
+						fillParticles(&particles[first], count, random, definition, sizeScale);
+					});
+				break;
+			case EMITTER_MOVE:
+				definition.position = command.position;
+				emitter.spawnBounds = spawnBounds(definition);
+				break;
+			case EMITTER_SET_RATE:
+				definition.rate = clampSpawnRate(definition, smoke ? smokeSetup : rainSetup, command.rate > 0.0f ? command.rate : 0.0f);
+				break;
+			case EMITTER_SET_COLOR:
+				for (int c = 0; c < 4; c++)
+					definition.color[c] = command.color[c];
+				break;
+			case EMITTER_KILL_ALL:
+				parallelFor(MaxParticles, ParticleUpdateGrain, [&](size_t begin, size_t end) {
+					for (size_t i = begin; i < end; i++) {
+						particles[i].life = -1.0f;
+						particles[i].cameradistance = -1.0f;
+					}
+				});
+				break;
+			}
+		}
+	};
 
-	//============================================ END SMOKE PARTICLES =============================================
+	SimulationClock simulationClock;
+	initSimulationClock(simulationClock, SimulationRate, MaxSimulationSteps, glfwGetTime());
 
+	// Makes the particles of a frame : simulates them, or reads them back from a recording, then sorts
+	// and packs them. Runs on the pipeline's thread, and touches nothing the GL thread uses.
+	FrameProducer simulateParticles = [&](unsigned int slot) {
 
-	//================================================ RAIN PARTICLES =============================================
+		ParticleFrame & frame = particleFrames[slot];
+		const glm::vec3 & CameraPosition = frame.cameraPosition;
+		const Frustum & frustum = frame.frustum;
+		float alpha = frame.alpha;
 
-	// Create and compile our GLSL program from the shaders
-	GLuint programIDRain = LoadShaders("ParticleRain.vertexshader", "ParticleRain.fragmentshader");
+		if (!carCollides && frame.carReady) {
+			ProfileScope collisionScope("Build collision grid and BVH");
+			buildCollisionGrid(car->indexed_vertices, car->indices, CollisionCellSize, MaxCollisionRadius, collisionGrid);
+			setCollisionGround(collisionGrid, 0.0f);
+			buildBVH(car->indexed_vertices, car->indices, carBVH);
+			carCollides = true;
+		}
 
-	// Vertex shader
-	GLuint CameraRight_worldspace_ID_rain = glGetUniformLocation(programIDRain, "CameraRight_worldspace");
-	GLuint CameraUp_worldspace_ID_rain = glGetUniformLocation(programIDRain, "CameraUp_worldspace");
-	GLuint ViewProjMatrixID_rain = glGetUniformLocation(programIDRain, "VP");
+		// A saved emitter config takes over between two frames, along with what it changes in the
+		// force fields and the LOD. What the commands changed before is lost with the old definitions.
+		std::vector<EmitterDefinition> reloaded;
+		if (takeEmitterConfig(reloaded)) {
+			smokeDefinition = reloaded[SMOKE_EMITTER];
+			rainDefinition = reloaded[RAIN_EMITTER];
+			setupEmitter(smokeDefinition, &turbulence, smokeSetup, smokeEmitter);
+			setupEmitter(rainDefinition, &turbulence, rainSetup, rainEmitter);
+		}
 
-	// fragment shader
-	GLuint TextureIDRain = glGetUniformLocation(programIDRain, "myTextureSampler");
+		// Once per simulated frame, before either emitter steps, and even when the LOD puts them to sleep
+		ProfileScope commandsScope("Emitter commands");
+		applyEmitterCommands();
+		commandsScope.end();
+
+		int InstancesCount = 0;
+		int SmokeCount = 0, RainCount = 0;
+		int SmokeCulled = 0, RainCulled = 0;
+
+		if (replaying) {
+			// Draw what was recorded instead of simulating : the render path alone
+			ProfileScope replayScope("Replay");
+			if (readSnapshot(replay, replayed)) {
+				for (size_t e = 0; e < replayed.emitters.size(); e++) {
+					int first = InstancesCount;
+					InstancesCount = appendSnapshotInstances(replayed.emitters[e], CameraPosition, frustum,
+						&frame.instances[0], &frame.keys[0], InstancesCount, 2 * MaxParticles,
+						e == 0 ? SmokeCulled : RainCulled);
+					if (e == 0)
+						SmokeCount = InstancesCount - first;
+					else
+						RainCount += InstancesCount - first;
+				}
+			}
+			replayScope.end();
+		} else {
+
+			//============================================ SMOKE PARTICLES ==============================================
+
+			// Off screen, the emitter sleeps and catches up every few frames; far away, it spawns less.
+			unsigned int smokeFrames = 0;
+			double smokeDelta = beginEmitterFrame(smokeEmitter, frame.simulatedTime, frustum, CameraPosition, ParticleLODSettings, smokeFrames);
+			float smokeSpawnScale = smokeEmitter.lod.spawnScale;
+			float smokeSizeScale = smokeEmitter.lod.sizeScale;
+			unsigned int smokeSteps = emitterSteps(smokeEmitter, smokeDelta, frame.simulationStep);
+			float smokeStep = smokeSteps > 0 ? (float)(smokeDelta / smokeSteps) : 0.0f;
+
+			ProfileScope smokeSimulateScope("Smoke simulate");
+			for (unsigned int step = 0; step < smokeSteps; step++) {
+
+				// Generate new particles at the emitter's rate, in one block of slots filled on every core
+				ProfileScope smokeSpawnScope("Smoke spawn");
+				int newparticles = spawnCount(smokeDefinition.rate * smokeSpawnScale, smokeStep, smokeSpawnCarry);
+				spawnParticles(smokeSlots, newparticles, randomUInt(threadRandom()), [&](size_t first, size_t count, Random & random) {
+					fillParticles(&ParticlesContainer[first], count, random, smokeDefinition, smokeSizeScale);
+				});
+				smokeSpawnScope.end();
+
+				// Push the live particles apart, from their neighbors within SmokeInteractionRadius
+				if (frame.interaction != SMOKE_INTERACTION_NONE) {
+					ProfileScope interactionScope("Smoke interaction");
+					size_t liveCount = 0;
+					for (int i = 0; i < MaxParticles; i++) {
+						const Particle& p = ParticlesContainer[i];
+						if (p.life <= 0.0f)
+							continue;
+						smokeX[liveCount] = p.pos.x;
+						smokeY[liveCount] = p.pos.y;
+						smokeZ[liveCount] = p.pos.z;
+						smokeLive[liveCount++] = i;
+					}
+
+					buildNeighborGrid(smokeGrid, &smokeX[0], &smokeY[0], &smokeZ[0], liveCount);
+					if (frame.interaction == SMOKE_INTERACTION_SPH)
+						computeSPH(smokeGrid, SmokeSPH, &smokeForceX[0], &smokeForceY[0], &smokeForceZ[0]);
+					else
+						computeRepulsion(smokeGrid, SmokeRepulsion, &smokeForceX[0], &smokeForceY[0], &smokeForceZ[0]);
+
+					parallelFor(liveCount, ParticleUpdateGrain, [&](size_t begin, size_t end) {
+						for (size_t k = begin; k < end; k++)
+							ParticlesContainer[smokeLive[k]].speed += glm::vec3(smokeForceX[k], smokeForceY[k], smokeForceZ[k]) * smokeStep;
+					});
+				}
 
-	static GLfloat* g_particule_position_size_data_rain = new GLfloat[MaxParticles * 4];
-	static GLubyte* g_particule_color_data_rain = new GLubyte[MaxParticles * 4];
+				// Move and collide all particles, on every core
+				stepEmitter(ParticlesContainer, MaxParticles, smokeStep, smokeDefinition, smokeSetup, collisionGrid);
+			}
 
-	for (int i = 0; i<MaxParticles; i++) {
-		RaindropsContainer[i].life = -1.0f;
-		RaindropsContainer[i].cameradistance = -1.0f;
-	}
+			// Then, in order, gather the visible ones for the GPU, between their last two positions.
+			// A sleeping emitter leaves its particles as they are, and draws none.
+			for (int i = 0; smokeFrames > 0 && i<MaxParticles; i++) {
 
-	GLuint Texture_rain = loadDDS("raindrop.DDS");
+				Particle& p = ParticlesContainer[i]; // shortcut
 
-	// The VBO containing the 4 vertices of the particles.
-	// Thanks to instancing, they will be shared by all particles.
-	static const GLfloat g_vertex_buffer_data_rain[] = {
-		-0.05f, 0.6f, 0.2f,
-		0.05f, 0.6f, 0.2f,
-		0.1f,  0.5f, 0.2f,
-		0.1f, -0.5f, 0.5f,
-		0.05f, -0.6f, 0.5f,
-		-0.05f, -0.6f, 0.5f,
-		-0.1f, -0.5f, 0.5f,
-		-0.1f,  0.5f, 0.2f,
-	};
-	GLuint billboard_vertex_buffer_rain;
-	glGenBuffers(1, &billboard_vertex_buffer_rain);
-	glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer_rain);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data_rain), g_vertex_buffer_data_rain, GL_STATIC_DRAW);
-
-	// The VBO containing the positions and sizes of the particles
-	GLuint particles_position_buffer_rain;
-	glGenBuffers(1, &particles_position_buffer_rain);
-	glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer_rain);
-	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+				if (p.life > 0.0f) {
 
-	// The VBO containing the colors of the particles
-	GLuint particles_color_buffer_rain;
-	glGenBuffers(1, &particles_color_buffer_rain);
-	glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer_rain);
-	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW);
+					float radius = particleRadius(p.size, p.speed, smokeDefinition.stretch);
+					addEmitterParticle(smokeEmitter, p.pos, radius, p.speed);
 
+					// Off screen : it keeps moving, but is neither sorted nor drawn
+					glm::vec3 position = p.previous + (p.pos - p.previous) * alpha;
+					if (!sphereInFrustum(frustum, position, radius)) {
+						p.cameradistance = -1.0f;
+						SmokeCulled++;
+						continue;
+					}
+					p.cameradistance = glm::length2(position - CameraPosition);
 
+					// Fill the GPU buffer
+					ParticleInstance & instance = frame.instances[InstancesCount];
+					instance.xyzs[0] = position.x;
+					instance.xyzs[1] = position.y;
+					instance.xyzs[2] = position.z;
 
-	//============================================ END RAIN PARTICLES =============================================
+					instance.xyzs[3] = p.size;
 
-	float lastTimeCheck = lastTime;
+					instance.motion[0] = p.speed.x;
+					instance.motion[1] = p.speed.y;
+					instance.motion[2] = p.speed.z;
+					instance.motion[3] = smokeDefinition.stretch;
+
+					instance.color[0] = p.r;
+					instance.color[1] = p.g;
+					instance.color[2] = p.b;
+					instance.color[3] = p.a;
+
+					instance.sprite = (GLfloat)smokeSetup.sprite;
+
+					frame.keys[InstancesCount].cameradistance = p.cameradistance;
+					frame.keys[InstancesCount].instance = InstancesCount;
+					InstancesCount++;
+				}
+			}
+
+			smokeSimulateScope.end();
+			SmokeCount = InstancesCount;
+
+			//=========================================== END SMOKE PARTICLES ==============================================
+
+			//============================================ RAIN PARTICLES ==============================================
+
+			unsigned int rainFrames = 0;
+			double rainDelta = beginEmitterFrame(rainEmitter, frame.simulatedTime, frustum, CameraPosition, ParticleLODSettings, rainFrames);
+			float rainSpawnScale = rainEmitter.lod.spawnScale;
+			float rainSizeScale = rainEmitter.lod.sizeScale;
+			unsigned int rainSteps = emitterSteps(rainEmitter, rainDelta, frame.simulationStep);
+			float rainStep = rainSteps > 0 ? (float)(rainDelta / rainSteps) : 0.0f;
+
+			ProfileScope rainSimulateScope("Rain simulate");
+			for (unsigned int step = 0; step < rainSteps; step++) {
+
+				// Generate new drops at the emitter's rate
+				ProfileScope rainSpawnScope("Rain spawn");
+				int newparticles_rain = spawnCount(rainDefinition.rate * rainSpawnScale, rainStep, rainSpawnCarry);
+				spawnParticles(rainSlots, newparticles_rain, randomUInt(threadRandom()), [&](size_t first, size_t count, Random & random) {
+					fillParticles(&RaindropsContainer[first], count, random, rainDefinition, rainSizeScale);
+				});
+				rainSpawnScope.end();
+
+				// Move and collide all drops, on every core
+				stepEmitter(RaindropsContainer, MaxParticles, rainStep, rainDefinition, rainSetup, collisionGrid);
+			}
+
+			// Then, in order, gather the visible ones for the GPU, between their last two positions
+			for (int i = 0; rainFrames > 0 && i<MaxParticles; i++) {
+
+				Particle& r = RaindropsContainer[i]; // shortcut
+
+				if (r.life > 0.0f) {
+
+					float radius = particleRadius(r.size, r.speed, rainDefinition.stretch);
+					addEmitterParticle(rainEmitter, r.pos, radius, r.speed);
+
+					// Off screen : it keeps moving, but is neither sorted nor drawn
+					glm::vec3 position = r.previous + (r.pos - r.previous) * alpha;
+					if (!sphereInFrustum(frustum, position, radius)) {
+						r.cameradistance = -1.0f;
+						RainCulled++;
+						continue;
+					}
+					r.cameradistance = glm::length2(position - CameraPosition);
+
+					// Fill the GPU buffer, after the smoke
+					ParticleInstance & instance = frame.instances[InstancesCount];
+					instance.xyzs[0] = position.x;
+					instance.xyzs[1] = position.y;
+					instance.xyzs[2] = position.z;
+
+					instance.xyzs[3] = r.size;
+
+					instance.motion[0] = r.speed.x;
+					instance.motion[1] = r.speed.y;
+					instance.motion[2] = r.speed.z;
+					instance.motion[3] = rainDefinition.stretch;
+
+					instance.color[0] = r.r;
+					instance.color[1] = r.g;
+					instance.color[2] = r.b;
+					instance.color[3] = r.a;
+
+					instance.sprite = (GLfloat)rainSetup.sprite;
+
+					frame.keys[InstancesCount].cameradistance = r.cameradistance;
+					frame.keys[InstancesCount].instance = InstancesCount;
+					InstancesCount++;
+				}
+			}
+
+			rainSimulateScope.end();
+			RainCount = InstancesCount - SmokeCount;
+
+			//=========================================== END RAIN PARTICLES ==============================================
+		}
+
+		// Every few frames, hand the particles over to the snapshot writer
+		if (!replaying && snapshotWanted(frame.number)) {
+			ProfileScope captureScope("Capture snapshot");
+			ParticleSnapshot snapshot;
+			snapshot.frame = frame.number;
+			snapshot.time = frame.time;
+			snapshot.emitters.resize(2);
+			captureEmitter(smokeDefinition.name.c_str(), smokeSetup.sprite, smokeDefinition.stretch, ParticlesContainer, MaxParticles, snapshot.emitters[0]);
+			captureEmitter(rainDefinition.name.c_str(), rainSetup.sprite, rainDefinition.stretch, RaindropsContainer, MaxParticles, snapshot.emitters[1]);
+			submitSnapshot(snapshot);
+		}
+
+		// Smoke and rain blend the same way, so they are sorted together and drawn in one call
+		ProfileScope sortScope("Particles sort");
+		std::sort(frame.keys.begin(), frame.keys.begin() + InstancesCount);
+		for (int i = 0; i < InstancesCount; i++)
+			frame.sorted[i] = frame.instances[frame.keys[i].instance];
+		sortScope.end();
+
+		frame.instanceCount = InstancesCount;
+		frame.smokeCount = SmokeCount;
+		frame.rainCount = RainCount;
+		frame.smokeCulled = SmokeCulled;
+		frame.rainCulled = RainCulled;
+		frame.smokeDetail = replaying ? 1.0f : smokeEmitter.lod.spawnScale;
+		frame.rainDetail = replaying ? 1.0f : rainEmitter.lod.spawnScale;
+		frame.smokeAsleep = !replaying && !smokeEmitter.lod.visible;
+		frame.rainAsleep = !replaying && !rainEmitter.lod.visible;
+	};
+	startFramePipeline(simulateParticles, pipelined);
+
+	// Edited shaders are rebuilt in the background and swapped in without a restart, and so are the emitters
+	startShaderHotReload();
+	watchEmitterConfig(emitterConfigPath, defaultEmitters());
 
 	do {
 
+		beginProfilerFrame();
+
+		bool traceKeyPressed = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+		if (traceKeyPressed && !traceKeyWasPressed)
+			writeChromeTrace("trace.json");
+		traceKeyWasPressed = traceKeyPressed;
+
+		bool hudKeyPressed = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+		if (hudKeyPressed && !hudKeyWasPressed)
+			showHUD = !showHUD;
+		hudKeyWasPressed = hudKeyPressed;
+
+		bool interactionKeyPressed = glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS;
+		if (interactionKeyPressed && !interactionKeyWasPressed)
+			smokeInteraction = (SmokeInteraction)((smokeInteraction + 1) % SMOKE_INTERACTION_COUNT);
+		interactionKeyWasPressed = interactionKeyPressed;
+
+		// Sent now, applied by the simulation at its next step
+		bool burstKeyPressed = glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS;
+		if (burstKeyPressed && !burstKeyWasPressed && !pushEmitterCommand(emitterCommands, emitterBurst(SMOKE_EMITTER, SmokeBurst)))
+			printf("Emitter commands : queue full, burst dropped\n");
+		burstKeyWasPressed = burstKeyPressed;
+
+		bool killKeyPressed = glfwGetKey(window, GLFW_KEY_Z) == GLFW_PRESS;
+		if (killKeyPressed && !killKeyWasPressed) {
+			if (!pushEmitterCommand(emitterCommands, emitterKillAll(SMOKE_EMITTER)) ||
+			    !pushEmitterCommand(emitterCommands, emitterKillAll(RAIN_EMITTER)))
+				printf("Emitter commands : queue full, kill dropped\n");
+		}
+		killKeyWasPressed = killKeyPressed;
+
+		// Swap in the shaders whose rebuild finished since the last frame
+		ProfileScope shadersScope("Shader reload");
+		updateShaderRegistry();
+		shadersScope.end();
+
+		// Bring in a few more mipmaps of the textures still streaming
+		ProfileScope assetsScope("Asset streaming", PROFILE_GPU);
+		updateAssetLoader(TextureStreamBudget);
+		assets.update();
+		assetsScope.end();
+
 		// Measure speed
 		double currentTime = glfwGetTime();
 		nbFrames++;
-		if (currentTime - lastTime >= 1.0) { // If last prinf() was more than 1sec ago
-											 // printf and reset
-			lastTime += 1.0;
-		}
-
 		if (currentTime - lastTimeCheck >= 1.0) { // If last prinf() was more than 1sec ago
 												  // printf and reset
 			printf("%d frame/s\n", nbFrames);
@@ -325,101 +1170,14 @@ int main(void)
 		// Clear the screen
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Use our shader
-		glUseProgram(programIDCar);
-
 		// Compute the MVP matrix from keyboard and mouse input
+		ProfileScope inputScope("Input");
 		computeMatricesFromInputs();
 		glm::mat4 ProjectionMatrix = getProjectionMatrix();
 		glm::mat4 ViewMatrix = getViewMatrix();
 		glm::mat4 ModelMatrix = glm::mat4(1.0);
 		glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
 
-		// Compute ambience, specularity, and diffusement
-		GLfloat current_ambience_factor = getAmbienceFactor();
-		GLfloat current_specular_factor = getSpecularFactor();
-		GLfloat current_diffuse_factor = getDiffuseFactor();
-
-		// Send our transformation to the currently bound shader, 
-		// in the "MVP" uniform
-		glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-		glUniformMatrix4fv(ModelMatrixID, 1, GL_FALSE, &ModelMatrix[0][0]);
-		glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &ViewMatrix[0][0]);
-
-		//Send ambience, specularity, and diffusement to shader
-		GLuint ambience_id = glGetUniformLocation(programIDCar, "ambience_factor");
-		GLuint specular_id = glGetUniformLocation(programIDCar, "specular_factor");
-		GLuint diffuse_id = glGetUniformLocation(programIDCar, "diffuse_factor");
-		glUniform1f(ambience_id, current_ambience_factor);
-		glUniform1f(diffuse_id, current_diffuse_factor);
-		glUniform1f(specular_id, current_specular_factor);
-
-		glm::vec3 lightPos = glm::vec3(0, 10, 1.2);
-		glUniform3f(LightID, lightPos.x, lightPos.y, lightPos.z);
-
-		// Bind our texture in Texture Unit 0
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, TextureCar);
-		// Set our "myTextureSampler" sampler to use Texture Unit 0
-		glUniform1i(TextureIDCar, 0);
-
-		// 1rst attribute buffer : vertices
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(
-			0,                  // attribute
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-		);
-
-		// 2nd attribute buffer : UVs
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-		glVertexAttribPointer(
-			1,                                // attribute
-			2,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// 3rd attribute buffer : normals
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, normalbuffer);
-		glVertexAttribPointer(
-			2,                                // attribute
-			3,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// Index buffer
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementbuffer);
-
-		// Draw the triangles !
-		glDrawElements(
-			GL_TRIANGLES,      // mode
-			indices.size(),    // count
-			GL_UNSIGNED_SHORT,   // type
-			(void*)0           // element array buffer offset
-		);
-
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
-
-
-		//============================================ SMOKE PARTICLES ==============================================
-
-		double delta = currentTime - lastTime;
-		lastTime = currentTime;
-
 		// We will need the camera's position in order to sort the particles
 		// w.r.t the camera's distance.
 		// There should be a getCameraPosition() function in common/controls.cpp, 
@@ -428,101 +1186,147 @@ int main(void)
 
 		glm::mat4 ViewProjectionMatrix = ProjectionMatrix * ViewMatrix;
 
+		// Particles outside of this are simulated, but not sorted nor uploaded
+		Frustum frustum;
+		extractFrustum(ViewProjectionMatrix, frustum);
 
-		// Generate 10 new particule each millisecond,
-		// but limit this to 16 ms (60 fps), or if you have 1 long frame (1sec),
-		// newparticles will be huge and the next frame even longer.
-		int newparticles = (int)(delta*10000.0);
-		if (newparticles > (int)(0.016f*10000.0))
-			newparticles = (int)(0.016f*10000.0);
-
-		for (int i = 0; i<newparticles; i++) {
-			int particleIndex = FindUnusedParticle();
-			ParticlesContainer[particleIndex].life = 1.0f; // This particle will live 5 seconds.
-			ParticlesContainer[particleIndex].pos = glm::vec3(2, 1.5f, -7.0f);
-
-			float spread = 2.5f;
-			glm::vec3 maindir = glm::vec3(0.0f, 1.5f, -10.0f);
-			// Very bad way to generate a random direction; 
-			// See for instance http://stackoverflow.com/questions/5408276/python-uniform-spherical-distribution instead,
-			// combined with some user-controlled parameters (main direction, spread, etc)
-			glm::vec3 randomdir = glm::vec3(
-				(rand() % 2000 - 1000.0f) / 1000.0f,
-				-(rand() % 2000 - 1000.0f) / 1000.0f,
-				(rand() % 2000 - 1000.0f) / 1000.0f
-			);
-
-			ParticlesContainer[particleIndex].speed = maindir + randomdir*spread;
-
-
-			// Very bad way to generate a random color
-			ParticlesContainer[particleIndex].r = rand() % 10 + 170;
-			ParticlesContainer[particleIndex].g = rand() % 10 + 170;
-			ParticlesContainer[particleIndex].b = rand() % 10 + 170;
-			ParticlesContainer[particleIndex].a = (rand() % 256) / 3;
-
-			ParticlesContainer[particleIndex].size = (rand() % 1000) / 2000.0f + 0.1f;
-
-		}
-
-
-
-		// Simulate all particles
-		int ParticlesCount = 0;
-		for (int i = 0; i<MaxParticles; i++) {
-
-			Particle& p = ParticlesContainer[i]; // shortcut
-
-			if (p.life > 0.0f) {
+		glm::vec3 lightPos = glm::vec3(0, 10, 1.2);
 
-				// Decrease life
-				p.life -= delta;
-				if (p.life > 0.0f) {
+		// Everything that is the same for all the programs goes to the GPU once
+		FrameUniforms frame;
+		frame.V = ViewMatrix;
+		frame.P = ProjectionMatrix;
+		frame.VP = ViewProjectionMatrix;
+		frame.CameraRight_worldspace = glm::vec4(ViewMatrix[0][0], ViewMatrix[1][0], ViewMatrix[2][0], 0.0f);
+		frame.CameraUp_worldspace = glm::vec4(ViewMatrix[0][1], ViewMatrix[1][1], ViewMatrix[2][1], 0.0f);
+		frame.CameraPosition_worldspace = glm::vec4(CameraPosition, 1.0f);
+		frame.LightPosition_worldspace = glm::vec4(lightPos, 1.0f);
+		updateFrameUniforms(frame);
+		inputScope.end();
 
-					// Simulate simple physics : gravity only, no collisions
-					p.speed += glm::vec3(0.0f, 1.0f, 0.0f) * (float)delta * 2.0f;
-					p.pos += p.speed * (float)delta;
-					p.cameradistance = glm::length2(p.pos - CameraPosition);
-					//ParticlesContainer[i].pos += glm::vec3(0.0f,10.0f, 0.0f) * (float)delta;
+		double delta = currentTime - lastTime;
+		lastTime = currentTime;
 
-					// Fill the GPU buffer
-					g_particule_position_size_data[4 * ParticlesCount + 0] = p.pos.x;
-					g_particule_position_size_data[4 * ParticlesCount + 1] = p.pos.y;
-					g_particule_position_size_data[4 * ParticlesCount + 2] = p.pos.z;
+		// Whole steps of simulation for the time that passed, and where this frame falls between the last two
+		unsigned int simulationSteps = advanceSimulationClock(simulationClock, currentTime);
+
+		// Ask for the particles of this frame. Pipelined, they are simulated on their own thread
+		// while the GL thread draws the car and the particles of the previous frame.
+		unsigned int slot = frameNumber % FRAME_PIPELINE_SLOTS;
+		ParticleFrame & request = particleFrames[slot];
+		request.number = frameNumber;
+		request.time = currentTime;
+		request.cameraPosition = CameraPosition;
+		request.frustum = frustum;
+		request.simulatedTime = simulationSteps * simulationClock.step;
+		request.simulationStep = simulationClock.step;
+		request.alpha = simulationAlpha(simulationClock);
+		request.carReady = car->ready;
+		request.interaction = smokeInteraction;
+		requestPipelineFrame(slot);
+
+		// The mesh is still being read by a worker during the first frames
+		ProfileScope carScope("Car draw", PROFILE_GPU);
+		if (car->ready) {
+
+			// Use our shader
+			glUseProgram(getShaderProgram(carShader));
+
+			// Compute ambience, specularity, and diffusement
+			GLfloat current_ambience_factor = getAmbienceFactor();
+			GLfloat current_specular_factor = getSpecularFactor();
+			GLfloat current_diffuse_factor = getDiffuseFactor();
+
+			// Send our transformation to the currently bound shader, 
+			// in the "MVP" uniform
+			setUniform(carUniforms.MVP, MVP);
+			setUniform(carUniforms.M, ModelMatrix);
+
+			//Send ambience, specularity, and diffusement to shader
+			setUniform(carUniforms.ambience_factor, current_ambience_factor);
+			setUniform(carUniforms.diffuse_factor, current_diffuse_factor);
+			setUniform(carUniforms.specular_factor, current_specular_factor);
+
+			// Bind our texture in Texture Unit 0
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, TextureCar);
+
+			// 1rst attribute buffer : vertices
+			glEnableVertexAttribArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, car->vertexbuffer);
+			glVertexAttribPointer(
+				0,                  // attribute
+				3,                  // size
+				GL_FLOAT,           // type
+				GL_FALSE,           // normalized?
+				0,                  // stride
+				(void*)0            // array buffer offset
+			);
 
-					g_particule_position_size_data[4 * ParticlesCount + 3] = p.size;
+			// 2nd attribute buffer : UVs
+			glEnableVertexAttribArray(1);
+			glBindBuffer(GL_ARRAY_BUFFER, car->uvbuffer);
+			glVertexAttribPointer(
+				1,                                // attribute
+				2,                                // size
+				GL_FLOAT,                         // type
+				GL_FALSE,                         // normalized?
+				0,                                // stride
+				(void*)0                          // array buffer offset
+			);
 
-					g_particule_color_data[4 * ParticlesCount + 0] = p.r;
-					g_particule_color_data[4 * ParticlesCount + 1] = p.g;
-					g_particule_color_data[4 * ParticlesCount + 2] = p.b;
-					g_particule_color_data[4 * ParticlesCount + 3] = p.a;
+			// 3rd attribute buffer : normals
+			glEnableVertexAttribArray(2);
+			glBindBuffer(GL_ARRAY_BUFFER, car->normalbuffer);
+			glVertexAttribPointer(
+				2,                                // attribute
+				3,                                // size
+				GL_FLOAT,                         // type
+				GL_FALSE,                         // normalized?
+				0,                                // stride
+				(void*)0                          // array buffer offset
+			);
 
-				}
-				else {
-					// Particles that just died will be put at the end of the buffer in SortParticles();
-					p.cameradistance = -1.0f;
-				}
+			// Index buffer
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, car->elementbuffer);
 
-				ParticlesCount++;
+			// Draw the triangles !
+			glDrawElements(
+				GL_TRIANGLES,      // mode
+				car->indexCount,   // count
+				GL_UNSIGNED_SHORT,   // type
+				(void*)0           // element array buffer offset
+			);
 
-			}
+			glDisableVertexAttribArray(0);
+			glDisableVertexAttribArray(1);
+			glDisableVertexAttribArray(2);
 		}
+		carScope.end();
+
 
-		SortParticles();
+		// The particles to draw : made during the previous frame when pipelined, just now otherwise
+		unsigned int drawSlot = framePipelined() ? (slot + 1) % FRAME_PIPELINE_SLOTS : slot;
+		ProfileScope waitScope("Particles wait");
+		waitPipelineFrame(drawSlot);
+		waitScope.end();
+		const ParticleFrame & drawn = particleFrames[drawSlot];
+		frameNumber++;
 
+		//============================================== DRAW PARTICLES ===============================================
 
-		// Update the buffers that OpenGL uses for rendering.
+		// Update the buffer that OpenGL uses for rendering.
 		// There are much more sophisticated means to stream data from the CPU to the GPU, 
 		// but this is outside the scope of this tutorial.
 		// http://www.opengl.org/wiki/Buffer_Object_Streaming
 
-		glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
-		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-		glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLfloat) * 4, g_particule_position_size_data);
+		ProfileScope uploadScope("Particles upload", PROFILE_GPU);
+		glBindBuffer(GL_ARRAY_BUFFER, particles_instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, 2 * MaxParticles * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
+		glBufferSubData(GL_ARRAY_BUFFER, 0, drawn.instanceCount * sizeof(ParticleInstance), &drawn.sorted[0]);
+		uploadScope.end();
 
-		glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-		glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLubyte) * 4, g_particule_color_data);
+		ProfileScope drawScope("Particles draw", PROFILE_GPU);
 
 		// BLEND STILL NEEDS A PIX !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
 		glEnablei(4, GL_BLEND);
@@ -533,19 +1337,11 @@ int main(void)
 		glBlendFunci(6, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 		// Use our shader
-		glUseProgram(programID);
+		glUseProgram(getShaderProgram(particleShader));
 
-		// Bind our texture in Texture Unit 0
+		// Bind the sprite atlas in Texture Unit 1
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, Texture);
-		// Set our "myTextureSampler" sampler to use Texture Unit 0
-		glUniform1i(TextureID, 1);
-
-		// Same as the billboards tutorial
-		glUniform3f(CameraRight_worldspace_ID, ViewMatrix[0][0], ViewMatrix[1][0], ViewMatrix[2][0]);
-		glUniform3f(CameraUp_worldspace_ID, ViewMatrix[0][1], ViewMatrix[1][1], ViewMatrix[2][1]);
-
-		glUniformMatrix4fv(ViewProjMatrixID, 1, GL_FALSE, &ViewProjectionMatrix[0][0]);
+		glBindTexture(GL_TEXTURE_2D, TextureParticles);
 
 		// 1rst attribute buffer : vertices
 		glEnableVertexAttribArray(4);
@@ -559,245 +1355,122 @@ int main(void)
 			(void*)0            // array buffer offset
 		);
 
+		// The other attributes are interleaved in the instance buffer
+		glBindBuffer(GL_ARRAY_BUFFER, particles_instance_buffer);
+
 		// 2nd attribute buffer : positions of particles' centers
 		glEnableVertexAttribArray(5);
-		glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
 		glVertexAttribPointer(
 			5,                                // attribute. No particular reason for 1, but must match the layout in the shader.
 			4,                                // size : x + y + z + size => 4
 			GL_FLOAT,                         // type
 			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
+			sizeof(ParticleInstance),         // stride
+			(void*)offsetof(ParticleInstance, xyzs) // array buffer offset
 		);
 
 		// 3rd attribute buffer : particles' colors
 		glEnableVertexAttribArray(6);
-		glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
 		glVertexAttribPointer(
 			6,                                // attribute. No particular reason for 1, but must match the layout in the shader.
 			4,                                // size : r + g + b + a => 4
 			GL_UNSIGNED_BYTE,                 // type
 			GL_TRUE,                          // normalized?    *** YES, this means that the unsigned char[4] will be accessible with a vec4 (floats) in the shader ***
-			0,                                // stride
-			(void*)0                          // array buffer offset
+			sizeof(ParticleInstance),         // stride
+			(void*)offsetof(ParticleInstance, color) // array buffer offset
 		);
 
-		// These functions are specific to glDrawArrays*Instanced*.
-		// The first parameter is the attribute buffer we're talking about.
-		// The second parameter is the "rate at which generic vertex attributes advance when rendering multiple instances"
-		// http://www.opengl.org/sdk/docs/man/xhtml/glVertexAttribDivisor.xml
-		glVertexAttribDivisor(4, 0); // particles vertices : always reuse the same 4 vertices -> 0
-		glVertexAttribDivisor(5, 1); // positions : one per quad (its center)                 -> 1
-		glVertexAttribDivisor(6, 1); // color : one per quad                                  -> 1
-
-									 // Draw the particules !
-									 // This draws many times a small triangle_strip (which looks like a quad).
-									 // This is equivalent to :
-									 // for(i in ParticlesCount) : glDrawArrays(GL_TRIANGLE_STRIP, 0, 4), 
-									 // but faster.
-		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ParticlesCount);
-
-		glDisableVertexAttribArray(4);
-		glDisableVertexAttribArray(5);
-		glDisableVertexAttribArray(6);
-
-		//=========================================== END SMOKE PARTICLES ==============================================
-
-		//============================================ RAIN PARTICLES ==============================================
-
-		// Generate 10 new particule each millisecond,
-		// but limit this to 16 ms (60 fps), or if you have 1 long frame (1sec),
-		// newparticles will be huge and the next frame even longer.
-		int newparticles_rain = (int)(delta*1000000.0);
-		if (newparticles_rain  > (int)(0.016f*1000000.0))
-			newparticles_rain = (int)(0.016f*1000000.0);
-
-		for (int i = 0; i<newparticles_rain; i++) {
-			int particleIndex_rain = FindUnusedParticle();
-			RaindropsContainer[particleIndex_rain].life = 1.0f;
-			int x = rand() % 10;
-			int z = rand() % 24;
-			RaindropsContainer[particleIndex_rain].pos = glm::vec3(x - 5, 10.0f, z - 18);
-
-			glm::vec3 maindir = glm::vec3(0.0f, -10.0f, 1.0f);
-			// Very bad way to generate a random direction; 
-			// See for instance http://stackoverflow.com/questions/5408276/python-uniform-spherical-distribution instead,
-			// combined with some user-controlled parameters (main direction, spread, etc)
-			/*glm::vec3 randomdir = glm::vec3(
-			(rand() % 2000 - 1000.0f) / 1000.0f,
-			-(rand() % 2000 - 1000.0f) / 1000.0f,
-			(rand() % 2000 - 1000.0f) / 1000.0f
-			);*/
-
-			RaindropsContainer[particleIndex_rain].speed = maindir;
-
-
-			// Very bad way to generate a random color
-			RaindropsContainer[particleIndex_rain].r = rand() % 10 + 26;
-			RaindropsContainer[particleIndex_rain].g = rand() % 10 + 35;
-			RaindropsContainer[particleIndex_rain].b = rand() % 10 + 126;
-			RaindropsContainer[particleIndex_rain].a = 50;
-			RaindropsContainer[particleIndex_rain].size = (rand() % 1000) / 2000.0f + 0.1f;
-
-		}
-
-
-
-		// Simulate all particles
-		int RaindropsCount = 0;
-		for (int i = 0; i<MaxParticles; i++) {
-
-			Particle& r = RaindropsContainer[i]; // shortcut
-
-			if (r.life > 0.0f) {
-
-				// Decrease life
-				r.life -= delta;
-				if (r.life > 0.0f) {
-
-					// Simulate simple physics : gravity only, no collisions
-					r.speed += glm::vec3(0.0f, 0.0f, 0.0f) * (float)delta * 2.0f;
-					r.pos += r.speed * (float)delta;
-					r.cameradistance = glm::length2(r.pos - CameraPosition);
-					//ParticlesContainer[i].pos += glm::vec3(0.0f,10.0f, 0.0f) * (float)delta;
-
-					// Fill the GPU buffer
-					g_particule_position_size_data_rain[4 * RaindropsCount + 0] = r.pos.x;
-					g_particule_position_size_data_rain[4 * RaindropsCount + 1] = r.pos.y;
-					g_particule_position_size_data_rain[4 * RaindropsCount + 2] = r.pos.z;
-
-					g_particule_position_size_data_rain[4 * RaindropsCount + 3] = r.size;
-
-					g_particule_color_data_rain[4 * RaindropsCount + 0] = r.r;
-					g_particule_color_data_rain[4 * RaindropsCount + 1] = r.g;
-					g_particule_color_data_rain[4 * RaindropsCount + 2] = r.b;
-					g_particule_color_data_rain[4 * RaindropsCount + 3] = r.a;
-
-				}
-				else {
-					// Particles that just died will be put at the end of the buffer in SortParticles();
-					r.cameradistance = -1.0f;
-				}
-
-				RaindropsCount++;
-
-			}
-		}
-
-		SortRaindrops();
-
-
-		// Update the buffers that OpenGL uses for rendering.
-		// There are much more sophisticated means to stream data from the CPU to the GPU, 
-		// but this is outside the scope of this tutorial.
-		// http://www.opengl.org/wiki/Buffer_Object_Streaming
-
-		glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer_rain);
-		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-		glBufferSubData(GL_ARRAY_BUFFER, 0, RaindropsCount * sizeof(GLfloat) * 4, g_particule_position_size_data_rain);
-
-		glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer_rain);
-		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-		glBufferSubData(GL_ARRAY_BUFFER, 0, RaindropsCount * sizeof(GLubyte) * 4, g_particule_color_data_rain);
-
-
-		// BLEND STILL NEEDS A PIX !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-		glEnablei(7, GL_BLEND);
-		glBlendFunci(7, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glEnablei(8, GL_BLEND);
-		glBlendFunci(8, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glEnablei(9, GL_BLEND);
-		glBlendFunci(9, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-		// Use our shader
-		glUseProgram(programIDRain);
-
-		// Bind our texture in Texture Unit 0
-		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, Texture_rain);
-		// Set our "myTextureSampler" sampler to use Texture Unit 0
-		glUniform1i(TextureIDRain, 2);
-
-		// Same as the billboards tutorial
-		glUniform3f(CameraRight_worldspace_ID_rain, ViewMatrix[0][0], ViewMatrix[1][0], ViewMatrix[2][0]);
-		glUniform3f(CameraUp_worldspace_ID_rain, ViewMatrix[0][1], ViewMatrix[1][1], ViewMatrix[2][1]);
-
-		glUniformMatrix4fv(ViewProjMatrixID, 1, GL_FALSE, &ViewProjectionMatrix[0][0]);
-
-		// 1rst attribute buffer : vertices
+		// 4th attribute buffer : particles' velocities and stretch factors
 		glEnableVertexAttribArray(7);
-		glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer_rain);
 		glVertexAttribPointer(
-			7,                  // attribute. No particular reason for 0, but must match the layout in the shader.
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
+			7,                                // attribute
+			4,                                // size : x + y + z + stretch => 4
+			GL_FLOAT,                         // type
+			GL_FALSE,                         // normalized?
+			sizeof(ParticleInstance),         // stride
+			(void*)offsetof(ParticleInstance, motion) // array buffer offset
 		);
 
-		// 2nd attribute buffer : positions of particles' centers
+		// 5th attribute buffer : particles' sprites
 		glEnableVertexAttribArray(8);
-		glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer_rain);
 		glVertexAttribPointer(
-			8,                                // attribute. No particular reason for 1, but must match the layout in the shader.
-			4,                                // size : x + y + z + size => 4
+			8,                                // attribute
+			1,                                // size
 			GL_FLOAT,                         // type
 			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// 3rd attribute buffer : particles' colors
-		glEnableVertexAttribArray(9);
-		glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer_rain);
-		glVertexAttribPointer(
-			9,                                // attribute. No particular reason for 1, but must match the layout in the shader.
-			4,                                // size : r + g + b + a => 4
-			GL_UNSIGNED_BYTE,                 // type
-			GL_TRUE,                          // normalized?    *** YES, this means that the unsigned char[4] will be accessible with a vec4 (floats) in the shader ***
-			0,                                // stride
-			(void*)0                          // array buffer offset
+			sizeof(ParticleInstance),         // stride
+			(void*)offsetof(ParticleInstance, sprite) // array buffer offset
 		);
 
 		// These functions are specific to glDrawArrays*Instanced*.
 		// The first parameter is the attribute buffer we're talking about.
 		// The second parameter is the "rate at which generic vertex attributes advance when rendering multiple instances"
 		// http://www.opengl.org/sdk/docs/man/xhtml/glVertexAttribDivisor.xml
-		glVertexAttribDivisor(7, 0); // particles vertices : always reuse the same 4 vertices -> 0
-		glVertexAttribDivisor(8, 1); // positions : one per quad (its center)                 -> 1
-		glVertexAttribDivisor(9, 1); // color : one per quad                                  -> 1
+		glVertexAttribDivisor(4, 0); // particles vertices : always reuse the same 4 vertices -> 0
+		glVertexAttribDivisor(5, 1); // positions : one per quad (its center)                 -> 1
+		glVertexAttribDivisor(6, 1); // color : one per quad                                  -> 1
+		glVertexAttribDivisor(7, 1); // velocity : one per quad                               -> 1
+		glVertexAttribDivisor(8, 1); // sprite : one per quad                                 -> 1
 
 									 // Draw the particules !
 									 // This draws many times a small triangle_strip (which looks like a quad).
 									 // This is equivalent to :
-									 // for(i in ParticlesCount) : glDrawArrays(GL_TRIANGLE_STRIP, 0, 4), 
+									 // for(i in InstancesCount) : glDrawArrays(GL_TRIANGLE_STRIP, 0, 4), 
 									 // but faster.
-		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, RaindropsCount);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, drawn.instanceCount);
 
+		glDisableVertexAttribArray(4);
+		glDisableVertexAttribArray(5);
+		glDisableVertexAttribArray(6);
 		glDisableVertexAttribArray(7);
 		glDisableVertexAttribArray(8);
-		glDisableVertexAttribArray(9);
+		drawScope.end();
+
+		//============================================ END DRAW PARTICLES =============================================
+
+		if (showHUD) {
+			ProfileScope hudScope("HUD", PROFILE_GPU);
+			int screenWidth, screenHeight;
+			glfwGetWindowSize(window, &screenWidth, &screenHeight);
+			HUDEmitterStats emitters[] = {
+				{ "smoke", drawn.smokeCount, drawn.smokeCulled, MaxParticles, drawn.smokeDetail, drawn.smokeAsleep },
+				{ "rain", drawn.rainCount, drawn.rainCulled, MaxParticles, drawn.rainDetail, drawn.rainAsleep },
+			};
+			drawHUD(screenWidth, screenHeight, delta, emitters, 2, assets.getStats());
+			drawText2D(screenWidth, screenHeight);
+		}
 
 		// Swap buffers
+		ProfileScope swapScope("Swap");
 		glfwSwapBuffers(window);
 		glfwPollEvents();
-
-		//=========================================== END RAIN PARTICLES ==============================================
+		swapScope.end();
 
 	} // Check if the ESC key was pressed or the window was closed
 	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
 		glfwWindowShouldClose(window) == 0);
 
+	stopFramePipeline();
+	stopSnapshotWriter();
+	if (replaying)
+		closeSnapshotReader(replay);
+
 	// Cleanup VBO and shader
-	glDeleteBuffers(1, &vertexbuffer);
-	glDeleteBuffers(1, &uvbuffer);
-	glDeleteBuffers(1, &normalbuffer);
-	glDeleteBuffers(1, &elementbuffer);
-	glDeleteProgram(programIDCar);
-	glDeleteTextures(1, &TextureCar);
+	assets.releaseMesh(car);
+	assets.releaseTexture(TextureCar);
+	assets.clear();
+	cleanupAssetLoader();
+	cleanupText2D();
+	cleanupShaderRegistry();
+
+	// Cleanup the particles
+	glDeleteBuffers(1, &billboard_vertex_buffer);
+	glDeleteBuffers(1, &particles_instance_buffer);
+	glDeleteTextures(1, &TextureParticles);
+
 	glDeleteVertexArrays(1, &VertexArrayID);
+	cleanupFrameUniforms();
+	cleanupProfiler();
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -0,0 +1,10 @@
+// Per-frame data shared by every program, filled once per frame (see common/frameuniforms.hpp)
+layout(std140) uniform FrameData {
+	mat4 V;
+	mat4 P;
+	mat4 VP;
+	vec4 CameraRight_worldspace;
+	vec4 CameraUp_worldspace;
+	vec4 CameraPosition_worldspace;
+	vec4 LightPosition_worldspace;
+};